@@ -0,0 +1,223 @@
+#include "BenchUtil.h"
+#include "BufferPool.h"
+#include "MySocket.h"
+#include "PktDef.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+using namespace std;
+
+// GCC sees the free() below inlined into std::vector and takes it for a
+// mismatched delete; these operators are the allocator, so it is not.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Counts every global operator new call made by the benchmark process.
+static atomic<long long> AllocCount(0);
+
+void* operator new(size_t size)
+{
+    AllocCount.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static const int ALLOC_BENCH_ITERATIONS = 1000000;
+
+// Reports heap allocations and average time per command for one body size.
+// Bodies that do not fit inline use a caller-provided arena when useArena is set.
+static void RunEncodeDecode(int bodySize, bool useArena)
+{
+    vector<char> body(bodySize, 0x11);
+    char wire[4096];
+    static char arena[4096];
+    char* arenaPtr = useArena ? arena : nullptr;
+    const char* storage = (bodySize <= PktDef::INLINE_BODY_SIZE) ? "inline" : (useArena ? "arena" : "heap");
+
+    long long allocsBefore = AllocCount;
+    long long start = NowNs();
+    for (int i = 0; i < ALLOC_BENCH_ITERATIONS; ++i) {
+        PktDef tx;
+        tx.SetBodyArena(arenaPtr, sizeof(arena));
+        tx.SetPktCount(i);
+        tx.SetCmd(PktDef::DRIVE);
+        tx.SetBodyData(body.data(), bodySize);
+        tx.CalcCRC();
+        int len = tx.GenPacket(wire, sizeof(wire));
+        DoNotOptimize(wire + len);
+    }
+    long long encodeNs = NowNs() - start;
+    long long encodeAllocs = AllocCount - allocsBefore;
+
+    allocsBefore = AllocCount;
+    start = NowNs();
+    int wireLen = PktDef::HEADERSIZE + bodySize + 1;
+    for (int i = 0; i < ALLOC_BENCH_ITERATIONS; ++i) {
+        PktDef rx;
+        rx.SetBodyArena(arenaPtr, sizeof(arena));
+        rx.Parse(wire, wireLen);
+        DoNotOptimize(rx.GetBodyData());
+    }
+    long long decodeNs = NowNs() - start;
+    long long decodeAllocs = AllocCount - allocsBefore;
+
+    BenchResult("pktdef/encode").Param("body", bodySize).Param("storage", storage)
+        .Metric("allocs_per_cmd", static_cast<double>(encodeAllocs) / ALLOC_BENCH_ITERATIONS)
+        .Metric("avg_ns", static_cast<double>(encodeNs / ALLOC_BENCH_ITERATIONS)).Report();
+    BenchResult("pktdef/decode").Param("body", bodySize).Param("storage", storage)
+        .Metric("allocs_per_cmd", static_cast<double>(decodeAllocs) / ALLOC_BENCH_ITERATIONS)
+        .Metric("avg_ns", static_cast<double>(decodeNs / ALLOC_BENCH_ITERATIONS)).Report();
+}
+
+BENCHMARK(PktDefAllocations)
+{
+    RunEncodeDecode(static_cast<int>(sizeof(PktDef::DriveBody)), false);
+    RunEncodeDecode(PktDef::INLINE_BODY_SIZE, false);
+    RunEncodeDecode(512, false);
+    RunEncodeDecode(512, true);
+}
+
+static const int POOL_BENCH_PACKETS = 200000;
+static const int POOL_BENCH_SOCKETS = 2000;
+static const int POOL_BENCH_BODY = 512;
+
+static const char* PoolLabel(bool pooled)
+{
+    return pooled ? "slab" : "new";
+}
+
+static void ReportPoolResult(const char* name, bool pooled, long long allocs, int ops, LatencySamples& samples)
+{
+    BenchResult result(name);
+    result.Param("allocator", PoolLabel(pooled));
+    result.Metric("mallocs_per_op", static_cast<double>(allocs) / ops);
+    samples.AddTo(result, false);
+    result.Report();
+}
+
+// Build, serialize and destroy heap packets on one thread. With the pool off
+// every object, body and serialization buffer is its own new[].
+static void RunPacketChurn(bool pooled)
+{
+    BufferPool::SetEnabled(pooled);
+    vector<char> body(POOL_BENCH_BODY, 0x42);
+    LatencySamples samples;
+    samples.Reserve(POOL_BENCH_PACKETS);
+    long long allocsBefore = AllocCount.load();
+    for (int i = 0; i < POOL_BENCH_PACKETS; ++i) {
+        long long start = NowNs();
+        PktDef* pkt = PoolNew<PktDef>();
+        pkt->SetCmd(PktDef::RESPONSE);
+        pkt->SetPktCount(i);
+        pkt->SetBodyData(body.data(), POOL_BENCH_BODY);
+        pkt->CalcCRC();
+        DoNotOptimize(pkt->GenPacket());
+        PoolDelete(pkt);
+        samples.Add(NowNs() - start);
+    }
+    ReportPoolResult("pool/packet_churn", pooled, AllocCount.load() - allocsBefore, POOL_BENCH_PACKETS, samples);
+    BufferPool::SetEnabled(true);
+}
+
+// A producer builds packets and a consumer thread destroys them, as with
+// CommandDispatcher nodes. Latency is the producer's cost to build one.
+static void RunCrossThreadChurn(bool pooled)
+{
+    BufferPool::SetEnabled(pooled);
+    const int ringSize = 1024;
+    vector<atomic<PktDef*>> ring(ringSize);
+    for (atomic<PktDef*>& slot : ring)
+        slot.store(nullptr);
+    vector<char> body(POOL_BENCH_BODY, 0x42);
+
+    thread consumer([&ring]() {
+        for (int i = 0; i < POOL_BENCH_PACKETS; ++i) {
+            atomic<PktDef*>& slot = ring[i % ring.size()];
+            PktDef* pkt;
+            while (!(pkt = slot.load(memory_order_acquire)))
+                this_thread::yield();
+            slot.store(nullptr, memory_order_relaxed);
+            PoolDelete(pkt);
+        }
+    });
+
+    LatencySamples samples;
+    samples.Reserve(POOL_BENCH_PACKETS);
+    long long allocsBefore = AllocCount.load();
+    for (int i = 0; i < POOL_BENCH_PACKETS; ++i) {
+        long long start = NowNs();
+        PktDef* pkt = PoolNew<PktDef>();
+        pkt->SetPktCount(i);
+        pkt->SetBodyData(body.data(), POOL_BENCH_BODY);
+        samples.Add(NowNs() - start);
+        atomic<PktDef*>& slot = ring[i % ringSize];
+        while (slot.load(memory_order_relaxed))
+            this_thread::yield();
+        slot.store(pkt, memory_order_release);
+    }
+    consumer.join();
+    ReportPoolResult("pool/cross_thread", pooled, AllocCount.load() - allocsBefore, POOL_BENCH_PACKETS, samples);
+    BufferPool::SetEnabled(true);
+}
+
+// Create and close UDP client sockets; the receive buffer is MaxSize * RECV_POOL_SIZE.
+static void RunSocketChurn(bool pooled)
+{
+    BufferPool::SetEnabled(pooled);
+    LatencySamples samples;
+    samples.Reserve(POOL_BENCH_SOCKETS);
+    long long allocsBefore = AllocCount.load();
+    for (int i = 0; i < POOL_BENCH_SOCKETS; ++i) {
+        long long start = NowNs();
+        {
+            MySocket sock(CLIENT, "127.0.0.1", 27172, UDP, 4096);
+            DoNotOptimize(&sock);
+        }
+        samples.Add(NowNs() - start);
+    }
+    ReportPoolResult("pool/socket_churn", pooled, AllocCount.load() - allocsBefore, POOL_BENCH_SOCKETS, samples);
+    BufferPool::SetEnabled(true);
+}
+
+BENCHMARK(SlabPoolAllocations)
+{
+    for (int pass = 0; pass < 2; ++pass) {
+        bool pooled = pass == 1;
+        RunPacketChurn(pooled);
+        RunCrossThreadChurn(pooled);
+        RunSocketChurn(pooled);
+    }
+    BufferPool::Stats stats = BufferPool::GetStats();
+    BenchResult("pool/stats").Metric("slabs", static_cast<double>(stats.Slabs))
+        .Metric("slab_kb", static_cast<double>(stats.SlabBytes / 1024))
+        .Metric("remote_frees", static_cast<double>(stats.RemoteFrees)).Report();
+}
@@ -0,0 +1,63 @@
+#include "BenchUtil.h"
+#include "MySocket.h"
+using namespace std;
+
+static const int BATCH_BENCH_PORT = 27016;
+static const int BATCH_BENCH_PACKETS = 200000;
+
+// Packets/sec for a DRIVE-sized datagram sent and drained over loopback,
+// per-packet (SendData/GetData) versus batched (SendBatch/GetDataBatch).
+static void RunBatch(int batchSize, bool batched)
+{
+    MySocket server(SERVER, "127.0.0.1", BATCH_BENCH_PORT, UDP, 2048);
+    MySocket client(CLIENT, "127.0.0.1", BATCH_BENCH_PORT, UDP, 2048);
+
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+    PktDef::DriveBody body = { PktDef::FORWARD, 1, 90 };
+    pkt.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+    pkt.CalcCRC();
+    char* raw = pkt.GenPacket();
+    int length = pkt.GetLength();
+
+    vector<UdpDatagram> tx(batchSize);
+    vector<UdpDatagram> rx(batchSize);
+    vector<char> storage(batchSize * 64);
+    for (int i = 0; i < batchSize; ++i) {
+        tx[i].Data = raw;
+        tx[i].Length = length;
+        tx[i].Capacity = length;
+        tx[i].Addr = MySocket::MakeAddress("127.0.0.1", BATCH_BENCH_PORT);
+        rx[i].Data = &storage[i * 64];
+        rx[i].Capacity = 64;
+    }
+
+    long long start = NowNs();
+    int rounds = BATCH_BENCH_PACKETS / batchSize;
+    for (int r = 0; r < rounds; ++r) {
+        if (batched) {
+            client.SendBatch(tx.data(), batchSize);
+            int got = 0;
+            while (got < batchSize)
+                got += server.GetDataBatch(rx.data() + got, batchSize - got);
+        }
+        else {
+            for (int i = 0; i < batchSize; ++i)
+                client.SendData(raw, length);
+            for (int i = 0; i < batchSize; ++i)
+                server.GetData(rx[i].Data, rx[i].Capacity);
+        }
+    }
+    long long elapsed = NowNs() - start;
+    double pps = (static_cast<double>(rounds) * batchSize) / (elapsed / 1e9);
+    BenchResult(batched ? "udp/batched" : "udp/loop").Param("batch", batchSize)
+        .Metric("pkts_per_s", static_cast<double>(static_cast<long long>(pps))).Report();
+}
+
+BENCHMARK(UdpBatchThroughput)
+{
+    for (int batchSize = 1; batchSize <= MAX_BATCH; batchSize *= 2) {
+        RunBatch(batchSize, false);
+        RunBatch(batchSize, true);
+    }
+}
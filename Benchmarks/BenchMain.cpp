@@ -0,0 +1,48 @@
+#include "BenchUtil.h"
+#include <cstring>
+using namespace std;
+
+// Usage: Benchmarks [filter] [--json <file>]
+// Runs every registered benchmark, or only those whose name contains the filter.
+// With --json the results are also written to file ("-" for stdout) so CI can
+// compare them against a previous run.
+int main(int argc, char* argv[])
+{
+    const char* filter = nullptr;
+    const char* jsonPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else
+            filter = argv[i];
+    }
+
+    for (const BenchEntry& entry : BenchRegistry()) {
+        if (filter && strstr(entry.Name, filter) == nullptr)
+            continue;
+        printf("== %s\n", entry.Name);
+        entry.Fn();
+    }
+
+    if (jsonPath) {
+        if (strcmp(jsonPath, "-") == 0) {
+            WriteBenchJson(stdout);
+        }
+        else {
+            FILE* out = nullptr;
+#ifdef _MSC_VER
+            if (fopen_s(&out, jsonPath, "w") != 0)
+                out = nullptr;
+#else
+            out = fopen(jsonPath, "w");
+#endif
+            if (!out) {
+                fprintf(stderr, "Cannot open %s\n", jsonPath);
+                return 1;
+            }
+            WriteBenchJson(out);
+            fclose(out);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdio>
+using namespace std;
+
+// Signature shared by every benchmark. Each benchmark reports its own results.
+typedef void (*BenchFn)();
+
+// A named benchmark registered with the runner.
+struct BenchEntry {
+    const char* Name;
+    BenchFn Fn;
+};
+
+// Global list of benchmarks, filled in by BENCHMARK() before main() runs.
+inline vector<BenchEntry>& BenchRegistry() {
+    static vector<BenchEntry> entries;
+    return entries;
+}
+
+// Adds a benchmark to the registry when its translation unit is loaded.
+struct BenchRegistrar {
+    BenchRegistrar(const char* name, BenchFn fn) {
+        BenchEntry entry = { name, fn };
+        BenchRegistry().push_back(entry);
+    }
+};
+
+// Declares and registers a benchmark function.
+#define BENCHMARK(name) \
+    static void name(); \
+    static BenchRegistrar name##_registrar(#name, name); \
+    static void name()
+
+// Monotonic timestamp in nanoseconds.
+inline long long NowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Keeps the optimizer from discarding a computed value.
+inline void DoNotOptimize(const void* p) {
+    static volatile const void* sink;
+    sink = p;
+    (void)sink;
+}
+
+// One result line: a benchmark name, the parameters it ran with and what it
+// measured. Report() prints it as "name key=value ..." and keeps it for the
+// JSON dump written by the runner.
+struct BenchResult {
+    string Name;
+    vector<pair<string, string>> Params;
+    vector<pair<string, double>> Metrics;
+
+    explicit BenchResult(const string& name) : Name(name) {}
+
+    BenchResult& Param(const string& key, const string& value) {
+        Params.push_back(make_pair(key, value));
+        return *this;
+    }
+    BenchResult& Param(const string& key, long long value) {
+        return Param(key, to_string(value));
+    }
+    BenchResult& Metric(const string& key, double value) {
+        Metrics.push_back(make_pair(key, value));
+        return *this;
+    }
+    void Report();
+};
+
+// Every result reported so far, in order.
+inline vector<BenchResult>& BenchResults() {
+    static vector<BenchResult> results;
+    return results;
+}
+
+inline void BenchResult::Report() {
+    printf("%s", Name.c_str());
+    for (const pair<string, string>& p : Params)
+        printf(" %s=%s", p.first.c_str(), p.second.c_str());
+    for (const pair<string, double>& m : Metrics) {
+        if (m.second == static_cast<double>(static_cast<long long>(m.second)))
+            printf(" %s=%lld", m.first.c_str(), static_cast<long long>(m.second));
+        else
+            printf(" %s=%.2f", m.first.c_str(), m.second);
+    }
+    printf("\n");
+    fflush(stdout);
+    BenchResults().push_back(*this);
+}
+
+// Latency samples in nanoseconds; percentiles are read after the run.
+class LatencySamples {
+public:
+    void Reserve(size_t count) { Samples.reserve(count); }
+    void Add(long long ns) { Samples.push_back(ns); Sorted = false; }
+    void Merge(const LatencySamples& other) {
+        Samples.insert(Samples.end(), other.Samples.begin(), other.Samples.end());
+        Sorted = false;
+    }
+    size_t Count() const { return Samples.size(); }
+
+    // Nearest-rank percentile, p in [0, 100]. Returns 0 with no samples.
+    long long Percentile(double p) {
+        if (Samples.empty())
+            return 0;
+        if (!Sorted) {
+            sort(Samples.begin(), Samples.end());
+            Sorted = true;
+        }
+        size_t rank = static_cast<size_t>(p / 100.0 * Samples.size() + 0.5);
+        if (rank < 1)
+            rank = 1;
+        if (rank > Samples.size())
+            rank = Samples.size();
+        return Samples[rank - 1];
+    }
+
+    // Add p50/p99/p99.9 (in microseconds, or nanoseconds for microbenchmarks) to a result.
+    void AddTo(BenchResult& result, bool micros) {
+        double scale = micros ? 1000.0 : 1.0;
+        const char* unit = micros ? "_us" : "_ns";
+        result.Metric(string("p50") + unit, Percentile(50.0) / scale);
+        result.Metric(string("p99") + unit, Percentile(99.0) / scale);
+        result.Metric(string("p99_9") + unit, Percentile(99.9) / scale);
+    }
+
+private:
+    vector<long long> Samples;
+    bool Sorted = false;
+};
+
+// Escapes a string for a JSON document.
+inline string JsonEscape(const string& text) {
+    string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Writes every reported result as a JSON array of
+//   {"name": ..., "params": {...}, "metrics": {...}}
+inline void WriteBenchJson(FILE* out) {
+    fprintf(out, "[\n");
+    const vector<BenchResult>& results = BenchResults();
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        fprintf(out, "  {\"name\": \"%s\", \"params\": {", JsonEscape(r.Name).c_str());
+        for (size_t j = 0; j < r.Params.size(); ++j)
+            fprintf(out, "%s\"%s\": \"%s\"", j ? ", " : "", JsonEscape(r.Params[j].first).c_str(),
+                JsonEscape(r.Params[j].second).c_str());
+        fprintf(out, "}, \"metrics\": {");
+        for (size_t j = 0; j < r.Metrics.size(); ++j)
+            fprintf(out, "%s\"%s\": %.3f", j ? ", " : "", JsonEscape(r.Metrics[j].first).c_str(),
+                r.Metrics[j].second);
+        fprintf(out, "}}%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
@@ -0,0 +1,78 @@
+#include "BenchUtil.h"
+#include "BulkParser.h"
+#include "PktDef.h"
+#include "PktFramer.h"
+using namespace std;
+
+static const int BULK_BENCH_PACKETS = 100000;
+static const int BULK_BENCH_ROUNDS = 20;
+
+// Builds a recorded stream of framed packets with the given body size and CRC.
+static vector<char> BuildStream(int bodySize, CrcAlgorithm alg)
+{
+    vector<char> stream;
+    vector<char> body(bodySize, 0x42);
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+    pkt.SetCrcType(alg);
+    for (int i = 0; i < BULK_BENCH_PACKETS; ++i) {
+        pkt.SetPktCount(i);
+        pkt.SetBodyData(body.data(), bodySize);
+        pkt.CalcCRC();
+        size_t offset = stream.size();
+        stream.resize(offset + PktFramer::PREFIXSIZE + pkt.GetLength());
+        PktFramer::Frame(pkt.GenPacket(), pkt.GetLength(), &stream[offset], pkt.GetLength() + PktFramer::PREFIXSIZE);
+    }
+    return stream;
+}
+
+// Validates the whole stream per object (one PktDef + CheckCRC per frame) and
+// with BulkParser, reporting validation throughput for each.
+static void RunBulk(int bodySize, CrcAlgorithm alg, const char* algName)
+{
+    vector<char> stream = BuildStream(bodySize, alg);
+    int length = static_cast<int>(stream.size());
+
+    long long valid = 0;
+    PktDef pkt;
+    long long start = NowNs();
+    for (int r = 0; r < BULK_BENCH_ROUNDS; ++r) {
+        int pos = 0;
+        while (pos + PktFramer::PREFIXSIZE <= length) {
+            int frameLen = static_cast<unsigned char>(stream[pos]) | (static_cast<unsigned char>(stream[pos + 1]) << 8);
+            char* frame = &stream[pos + PktFramer::PREFIXSIZE];
+            PktDef decoded(frame, frameLen);
+            valid += decoded.CheckCRC(frame, frameLen) ? 1 : 0;
+            pos += PktFramer::PREFIXSIZE + frameLen;
+        }
+    }
+    long long objectNs = NowNs() - start;
+    DoNotOptimize(&valid);
+
+    BulkParser parser(BULK_BENCH_PACKETS);
+    start = NowNs();
+    for (int r = 0; r < BULK_BENCH_ROUNDS; ++r) {
+        parser.Parse(stream.data(), length);
+        valid += parser.GetInvalid();
+    }
+    long long bulkNs = NowNs() - start;
+    DoNotOptimize(&valid);
+
+    double bytes = static_cast<double>(length) * BULK_BENCH_ROUNDS;
+    double packets = static_cast<double>(BULK_BENCH_PACKETS) * BULK_BENCH_ROUNDS;
+    BenchResult("bulk/per_object").Param("body", bodySize).Param("crc", algName)
+        .Metric("mb_per_s", static_cast<double>(static_cast<long long>(bytes / 1e6 / (objectNs / 1e9))))
+        .Metric("pkts_per_s", static_cast<double>(static_cast<long long>(packets / (objectNs / 1e9)))).Report();
+    BenchResult("bulk/parser").Param("body", bodySize).Param("crc", algName)
+        .Metric("mb_per_s", static_cast<double>(static_cast<long long>(bytes / 1e6 / (bulkNs / 1e9))))
+        .Metric("pkts_per_s", static_cast<double>(static_cast<long long>(packets / (bulkNs / 1e9)))).Report();
+}
+
+BENCHMARK(BulkValidate)
+{
+    const int sizes[] = { 12, 64, 256, 1024 };
+    for (int size : sizes) {
+        RunBulk(size, CRC_XOR, "xor");
+        RunBulk(size, CRC_32C, "crc32c");
+    }
+}
@@ -0,0 +1,157 @@
+#include "BenchUtil.h"
+#include "AsyncSocket.h"
+#include "MySocket.h"
+#include "PktFramer.h"
+#include "ReactorServer.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+using namespace std;
+
+// Many robot conversations against one ReactorServer: a thread per
+// conversation with blocking MySockets, versus coroutines on one IoLoop
+// thread. Each conversation sends a command and waits for the reply,
+// CONVERSATION_EXCHANGES times.
+static const int CONVERSATION_EXCHANGES = 200;
+
+// Resident set size in KiB, or 0 where it is not available.
+static long long ResidentKb()
+{
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    long long pages = 0;
+    long long resident = 0;
+    if (statm) {
+        if (fscanf(statm, "%lld %lld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return 0;
+#endif
+}
+
+static void MakeCommand(PktDef& pkt, int count)
+{
+    char body[12] = { 0 };
+    pkt.SetCmd(PktDef::DRIVE);
+    pkt.SetBodyData(body, sizeof(body));
+    pkt.SetPktCount(count);
+    pkt.CalcCRC();
+}
+
+static void BlockingConversation(int port, atomic<long long>& exchanges, atomic<int>& started, atomic<bool>& go)
+{
+    MySocket client(CLIENT, "127.0.0.1", port, TCP, 1024);
+    client.ConnectTCP();
+    client.SetNoDelay(true);
+    PktDef pkt;
+    char wire[64];
+    char recvBuf[1024];
+    char frame[1024];
+    PktFramer framer(4096, 1024);
+    started.fetch_add(1);
+    while (!go.load())
+        this_thread::yield();
+    for (int i = 0; i < CONVERSATION_EXCHANGES; ++i) {
+        MakeCommand(pkt, i);
+        int n = PktFramer::Frame(pkt.GenPacket(), pkt.GetLength(), wire, sizeof(wire));
+        client.SendData(wire, n);
+        while (framer.NextFrame(frame, sizeof(frame)) == 0) {
+            int got = client.GetData(recvBuf, sizeof(recvBuf));
+            if (got <= 0)
+                return;
+            framer.Feed(recvBuf, got);
+        }
+        exchanges.fetch_add(1, memory_order_relaxed);
+    }
+    client.DisconnectTCP();
+}
+
+static Task<void> Connect(AsyncSocket& sock, int& connected)
+{
+    co_await sock.ConnectTCP(5000);
+    ++connected;
+}
+
+static Task<void> CoroutineConversation(AsyncSocket& sock, long long& exchanges)
+{
+    PktDef pkt;
+    for (int i = 0; i < CONVERSATION_EXCHANGES; ++i) {
+        MakeCommand(pkt, i);
+        co_await sock.SendPacket(pkt, 5000);
+        if (!co_await sock.GetPacket(pkt, 5000))
+            co_return;
+        ++exchanges;
+    }
+    sock.DisconnectTCP();
+}
+
+static void RunConversations(bool coroutines, int conversations)
+{
+    ReactorServer server("127.0.0.1", 0, TCP, 1);
+    server.OnPacket([](ReactorSession& session, PktDef& pkt) {
+        session.Send(pkt);
+    });
+    server.Start();
+
+    // Memory is measured once every conversation is connected and parked.
+    long long baseKb = ResidentKb();
+    long long connectedKb = 0;
+    long long exchanges = 0;
+    long long elapsedNs = 0;
+    if (coroutines) {
+        IoLoop loop;
+        vector<unique_ptr<AsyncSocket>> sockets;
+        int connected = 0;
+        for (int i = 0; i < conversations; ++i) {
+            sockets.push_back(unique_ptr<AsyncSocket>(new AsyncSocket(loop, "127.0.0.1", server.GetPort())));
+            loop.Spawn(Connect(*sockets.back(), connected));
+        }
+        loop.Run();
+        connectedKb = ResidentKb();
+        long long start = NowNs();
+        for (int i = 0; i < conversations; ++i)
+            loop.Spawn(CoroutineConversation(*sockets[i], exchanges));
+        loop.Run();
+        elapsedNs = NowNs() - start;
+    }
+    else {
+        atomic<long long> done(0);
+        atomic<int> started(0);
+        atomic<bool> go(false);
+        vector<thread> threads;
+        for (int i = 0; i < conversations; ++i)
+            threads.push_back(thread(BlockingConversation, server.GetPort(), ref(done), ref(started), ref(go)));
+        while (started.load() < conversations)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        connectedKb = ResidentKb();
+        long long start = NowNs();
+        go.store(true);
+        for (thread& t : threads)
+            t.join();
+        elapsedNs = NowNs() - start;
+        exchanges = done.load();
+    }
+    server.Stop();
+
+    BenchResult result("conversations/tcp");
+    result.Param("model", coroutines ? "coroutine" : "thread").Param("conversations", conversations)
+        .Metric("exchanges_per_s", static_cast<double>(static_cast<long long>(exchanges / (elapsedNs / 1e9))));
+    if (baseKb > 0)
+        result.Metric("rss_kb_per_conversation", static_cast<double>((connectedKb - baseKb) / conversations));
+    result.Report();
+}
+
+BENCHMARK(Conversations)
+{
+    const int counts[] = { 16, 128, 400 };
+    for (int conversations : counts) {
+        RunConversations(false, conversations);
+        RunConversations(true, conversations);
+    }
+}
@@ -0,0 +1,32 @@
+#include "BenchUtil.h"
+#include "Checksum.h"
+using namespace std;
+
+// Reports checksum throughput for every algorithm at several body sizes.
+BENCHMARK(ChecksumThroughput)
+{
+    const int sizes[] = { 16, 256, 4096, 65536 };
+    const CrcAlgorithm algs[] = { CRC_XOR, CRC_8, CRC_16, CRC_32C };
+    const char* names[] = { "xor", "crc8", "crc16", "crc32c" };
+    const long long bytesPerRun = 64LL * 1024 * 1024;
+
+    BenchResult("crc32c").Metric("hardware", Checksum::HardwareAccelerated() ? 1 : 0).Report();
+    for (int size : sizes) {
+        vector<char> data(size);
+        for (int i = 0; i < size; ++i)
+            data[i] = static_cast<char>(i * 13);
+
+        for (int a = 0; a < 4; ++a) {
+            long long iterations = bytesPerRun / size;
+            unsigned int sink = 0;
+            long long start = NowNs();
+            for (long long i = 0; i < iterations; ++i)
+                sink ^= Checksum::Compute(algs[a], data.data(), size);
+            long long elapsed = NowNs() - start;
+            DoNotOptimize(&sink);
+            double mbps = (iterations * size) / 1e6 / (elapsed / 1e9);
+            BenchResult(string("crc/") + names[a]).Param("size", size)
+                .Metric("mb_per_s", static_cast<double>(static_cast<long long>(mbps))).Report();
+        }
+    }
+}
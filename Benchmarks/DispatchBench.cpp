@@ -0,0 +1,72 @@
+#include "BenchUtil.h"
+#include "CommandDispatcher.h"
+#include "PktDef.h"
+#include <atomic>
+#include <thread>
+using namespace std;
+
+static const int DISPATCH_SESSIONS = 256;
+static const int DISPATCH_PACKETS = 200000;
+
+// Stand-in for a handler's work (kinematics, logging): about workNs of spinning.
+static void SpinFor(long long workNs)
+{
+    long long end = NowNs() + workNs;
+    while (NowNs() < end)
+        ;
+}
+
+// One I/O thread submits DISPATCH_PACKETS packets round-robin over the
+// sessions; reports end-to-end throughput and how often workers stole.
+// workers = 0 runs the handler inline on the I/O thread as the baseline.
+static void RunDispatch(int workers, long long workNs)
+{
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+    char body[12] = { 0 };
+    pkt.SetBodyData(body, sizeof(body));
+    atomic<long long> handled(0);
+    auto handler = [&handled, workNs](unsigned long long, PktDef&) {
+        SpinFor(workNs);
+        handled.fetch_add(1, memory_order_relaxed);
+    };
+
+    long long start = NowNs();
+    long long steals = 0;
+    if (workers == 0) {
+        PktDef decoded;
+        for (int i = 0; i < DISPATCH_PACKETS; ++i) {
+            pkt.SetPktCount(i / DISPATCH_SESSIONS);
+            pkt.CalcCRC();
+            decoded.Parse(pkt.GenPacket(), pkt.GetLength());
+            handler(static_cast<unsigned long long>(i % DISPATCH_SESSIONS), decoded);
+        }
+    }
+    else {
+        CommandDispatcher dispatcher(workers, handler);
+        dispatcher.Start();
+        for (int i = 0; i < DISPATCH_PACKETS; ++i) {
+            pkt.SetPktCount(i / DISPATCH_SESSIONS);
+            pkt.CalcCRC();
+            dispatcher.Submit(static_cast<unsigned long long>(i % DISPATCH_SESSIONS), pkt.GenPacket(), pkt.GetLength());
+        }
+        dispatcher.WaitIdle(60000);
+        steals = dispatcher.GetSteals();
+    }
+    long long elapsedNs = NowNs() - start;
+
+    BenchResult("dispatch/throughput").Param("workers", workers).Param("work_ns", static_cast<int>(workNs))
+        .Metric("pkts_per_s", static_cast<double>(static_cast<long long>(handled.load() / (elapsedNs / 1e9))))
+        .Metric("steals", static_cast<double>(steals)).Report();
+}
+
+BENCHMARK(Dispatch)
+{
+    int cores = static_cast<int>(thread::hardware_concurrency());
+    const long long work[] = { 0, 2000 };
+    for (long long workNs : work) {
+        RunDispatch(0, workNs);
+        for (int workers = 1; workers <= cores && workers <= 64; workers *= 2)
+            RunDispatch(workers, workNs);
+    }
+}
@@ -0,0 +1,83 @@
+#include "BenchUtil.h"
+#include "UdpIngest.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+using namespace std;
+
+// Ingest throughput against the number of SO_REUSEPORT shards. Sender threads,
+// each with its own socket (so the kernel's address hash spreads them), blast
+// 12-byte DRIVE packets with sendmmsg for a fixed time. Every shard parses and
+// CRC-checks what it receives. Packets the shards could not keep up with are
+// dropped by the kernel, so received packets per second is the ingest rate.
+static const int INGEST_BENCH_PORT = 27173;
+static const int INGEST_BENCH_SENDERS = 8;
+static const int INGEST_BENCH_MS = 500;
+
+static void IngestSender(atomic<bool>& running, atomic<long long>& sent)
+{
+    MySocket sock(CLIENT, "127.0.0.1", INGEST_BENCH_PORT, UDP, DEFAULT_SIZE);
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+    char body[3] = { 1, 10, 80 };
+    pkt.SetBodyData(body, sizeof(body));
+    pkt.CalcCRC();
+    char* raw = pkt.GenPacket();
+
+    UdpDatagram batch[MAX_BATCH];
+    for (int i = 0; i < MAX_BATCH; ++i) {
+        batch[i].Data = raw;
+        batch[i].Length = pkt.GetLength();
+        batch[i].Capacity = pkt.GetLength();
+        batch[i].Addr = MySocket::MakeAddress("127.0.0.1", INGEST_BENCH_PORT);
+    }
+    long long total = 0;
+    while (running.load(memory_order_relaxed))
+        total += sock.SendBatch(batch, MAX_BATCH);
+    sent.fetch_add(total);
+}
+
+static void RunIngestBench(int shards)
+{
+    atomic<long long> valid(0);
+    UdpIngest ingest("127.0.0.1", INGEST_BENCH_PORT, shards,
+        [&valid](int, const char* data, int length, const sockaddr_in&) {
+            PktDef pkt(const_cast<char*>(data), length);
+            if (pkt.CheckCRC(const_cast<char*>(data), length))
+                valid.fetch_add(1, memory_order_relaxed);
+        });
+    ingest.Start();
+
+    atomic<bool> running(true);
+    atomic<long long> sent(0);
+    vector<thread> senders;
+    long long start = NowNs();
+    for (int i = 0; i < INGEST_BENCH_SENDERS; ++i)
+        senders.emplace_back(IngestSender, ref(running), ref(sent));
+    this_thread::sleep_for(chrono::milliseconds(INGEST_BENCH_MS));
+    running.store(false);
+    for (thread& t : senders)
+        t.join();
+    double seconds = (NowNs() - start) / 1e9;
+    // Let the shards drain what is still queued.
+    this_thread::sleep_for(chrono::milliseconds(100));
+    ingest.Stop();
+
+    long long received = ingest.GetReceived();
+    BenchResult result("udp_ingest/shards_" + to_string(shards));
+    result.Param("shards", shards);
+    result.Param("senders", INGEST_BENCH_SENDERS);
+    result.Param("cores", static_cast<long long>(thread::hardware_concurrency()));
+    result.Metric("received_pps", received / seconds);
+    result.Metric("valid_pps", valid.load() / seconds);
+    result.Metric("drop_pct", sent.load() > 0 ? 100.0 * (sent.load() - received) / sent.load() : 0.0);
+    result.Report();
+}
+
+BENCHMARK(ShardedIngestScaling)
+{
+    int cores = static_cast<int>(thread::hardware_concurrency());
+    int most = cores > 4 ? cores : 4;
+    for (int shards = 1; shards <= most; shards *= 2)
+        RunIngestBench(shards);
+}
@@ -0,0 +1,141 @@
+#include "BenchUtil.h"
+#include "MySocket.h"
+#include "PktFramer.h"
+#include "ReactorServer.h"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+using namespace std;
+
+// End-to-end round trips over loopback: client MySockets send a command to a
+// ReactorServer that echoes it back, and time each send-to-reply interval.
+static const int LOOPBACK_BENCH_ROUNDTRIPS = 4000;
+static const int LOOPBACK_BENCH_TIMEOUT_MS = 200;
+
+// Reply matching: the echo carries the request's PktCount, so a late reply
+// to a round trip already counted as lost is recognised and dropped.
+static bool IsReplyTo(char* raw, int length, int count)
+{
+    try {
+        PktDef reply(raw, length);
+        return reply.GetPktCount() == count;
+    }
+    catch (const runtime_error&) {
+        return false;
+    }
+}
+
+// One client thread's share of the round trips. Returns lost (timed-out) replies.
+static int RunLoopbackClient(ConnectionType type, int port, int payloadSize, int count, LatencySamples& samples)
+{
+    MySocket client(CLIENT, "127.0.0.1", port, type, 4096);
+    if (type == TCP)
+        client.ConnectTCP();
+
+    vector<char> body(payloadSize, 0x33);
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+    pkt.SetBodyData(body.data(), payloadSize);
+
+    vector<char> wire(PktFramer::PREFIXSIZE + pkt.GetLength() + Checksum::MAX_SIZE);
+    vector<char> recvBuf(4096);
+    vector<char> frame(4096);
+    PktFramer framer(16384, 4096);
+    int lost = 0;
+    bool closed = false;
+
+    samples.Reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (closed) {
+            // The server hung up; nothing more will come back.
+            lost += count - i;
+            break;
+        }
+        pkt.SetPktCount(i);
+        pkt.CalcCRC();
+        long long start = NowNs();
+        long long deadline = start + LOOPBACK_BENCH_TIMEOUT_MS * 1000000LL;
+        if (type == TCP) {
+            int n = PktFramer::Frame(pkt.GenPacket(), pkt.GetLength(), wire.data(), static_cast<int>(wire.size()));
+            client.SendData(wire.data(), n);
+        }
+        else
+            client.SendData(pkt.GenPacket(), pkt.GetLength());
+
+        bool replied = false;
+        while (!replied) {
+            int length = 0;
+            if (type == TCP && (length = framer.NextFrame(frame.data(), static_cast<int>(frame.size()))) > 0) {
+                replied = IsReplyTo(frame.data(), length, i);
+                continue;
+            }
+            int waitMs = static_cast<int>((deadline - NowNs()) / 1000000);
+            if (waitMs <= 0 || !client.WaitForData(waitMs))
+                break;
+            int got = client.GetData(recvBuf.data(), static_cast<int>(recvBuf.size()));
+            if (type == UDP)
+                replied = got > 0 && IsReplyTo(recvBuf.data(), got, i);
+            else if (got > 0)
+                framer.Feed(recvBuf.data(), got);
+            else {
+                closed = true;
+                break;
+            }
+        }
+        if (!replied) {
+            ++lost;
+            continue;
+        }
+        samples.Add(NowNs() - start);
+    }
+    if (type == TCP)
+        client.DisconnectTCP();
+    return lost;
+}
+
+static void RunLoopback(ConnectionType type, int payloadSize, int concurrency)
+{
+    ReactorServer server("127.0.0.1", 0, type, 2);
+    server.OnPacket([](ReactorSession& session, PktDef& pkt) {
+        session.Send(pkt);
+    });
+    server.Start();
+
+    int perClient = LOOPBACK_BENCH_ROUNDTRIPS / concurrency;
+    vector<LatencySamples> perThread(concurrency);
+    atomic<int> lost(0);
+    vector<thread> clients;
+
+    long long start = NowNs();
+    for (int c = 0; c < concurrency; ++c) {
+        clients.push_back(thread([&, c]() {
+            lost += RunLoopbackClient(type, server.GetPort(), payloadSize, perClient, perThread[c]);
+        }));
+    }
+    for (thread& t : clients)
+        t.join();
+    long long elapsed = NowNs() - start;
+    server.Stop();
+
+    LatencySamples all;
+    for (LatencySamples& s : perThread)
+        all.Merge(s);
+
+    BenchResult result(type == TCP ? "loopback/tcp" : "loopback/udp");
+    result.Param("payload", payloadSize).Param("clients", concurrency);
+    all.AddTo(result, true);
+    result.Metric("pkts_per_s", static_cast<double>(static_cast<long long>(all.Count() / (elapsed / 1e9))))
+        .Metric("lost", lost.load()).Report();
+}
+
+BENCHMARK(LoopbackRoundTrip)
+{
+    const int payloads[] = { 16, 256, 1024 };
+    const int concurrency[] = { 1, 4, 8 };
+    for (ConnectionType type : { TCP, UDP }) {
+        for (int payload : payloads) {
+            for (int clients : concurrency)
+                RunLoopback(type, payload, clients);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#include "BenchUtil.h"
+#include "PktDef.h"
+#include "Commands.h"
+using namespace std;
+
+static const int PKTDEF_BENCH_BATCH = 256;
+static const int PKTDEF_BENCH_SAMPLES = 2000;
+
+// Times one PktDef operation in batches and reports per-operation percentiles
+// (each sample is the average over one batch, so timer overhead stays out of it).
+template <typename Op>
+static void RunPktDefOp(const char* name, int bodySize, Op op)
+{
+    LatencySamples samples;
+    samples.Reserve(PKTDEF_BENCH_SAMPLES);
+    long long totalNs = 0;
+    for (int s = 0; s < PKTDEF_BENCH_SAMPLES; ++s) {
+        long long start = NowNs();
+        for (int i = 0; i < PKTDEF_BENCH_BATCH; ++i)
+            op(i);
+        long long elapsed = NowNs() - start;
+        totalNs += elapsed;
+        samples.Add(elapsed / PKTDEF_BENCH_BATCH);
+    }
+    BenchResult result(string("pktdef/") + name);
+    result.Param("body", bodySize);
+    samples.AddTo(result, false);
+    double ops = static_cast<double>(PKTDEF_BENCH_SAMPLES) * PKTDEF_BENCH_BATCH;
+    result.Metric("ops_per_s", static_cast<double>(static_cast<long long>(ops / (totalNs / 1e9)))).Report();
+}
+
+static void RunPktDefSuite(int bodySize)
+{
+    vector<char> body(bodySize, 0x5A);
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+
+    RunPktDefOp("construct", bodySize, [](int i) {
+        PktDef p;
+        p.SetPktCount(i);
+        DoNotOptimize(&p);
+    });
+    RunPktDefOp("set_body", bodySize, [&](int) {
+        pkt.SetBodyData(body.data(), bodySize);
+        DoNotOptimize(pkt.GetBodyData());
+    });
+    RunPktDefOp("calc_crc", bodySize, [&](int i) {
+        pkt.SetPktCount(i);
+        pkt.CalcCRC();
+        DoNotOptimize(&pkt);
+    });
+    RunPktDefOp("gen_packet", bodySize, [&](int) {
+        DoNotOptimize(pkt.GenPacket());
+    });
+
+    vector<char> wire(pkt.GetLength());
+    pkt.GenPacket(wire.data(), static_cast<int>(wire.size()));
+    PktDef rx;
+    RunPktDefOp("parse", bodySize, [&](int) {
+        rx.Parse(wire.data(), static_cast<int>(wire.size()));
+        DoNotOptimize(rx.GetBodyData());
+    });
+
+    // Same parse with per-packet timestamps on, to track the tracing overhead.
+    SetPacketTracing(true);
+    RunPktDefOp("parse_traced", bodySize, [&](int) {
+        rx.Parse(wire.data(), static_cast<int>(wire.size()));
+        DoNotOptimize(rx.GetBodyData());
+    });
+    SetPacketTracing(false);
+}
+
+BENCHMARK(PktDefMicro)
+{
+    RunPktDefSuite(static_cast<int>(sizeof(PktDef::DriveBody)));
+    RunPktDefSuite(256);
+    RunPktDefSuite(1024);
+}
+
+// Typed EXTENDED commands through CommandCodec, compared with building the
+// same packet with PktDef (SetBodyData + CalcCRC + GenPacket, then Parse).
+BENCHMARK(TypedCommands)
+{
+    TelemetryReport report = { 123456, 12400, 300, -300, 9000, 36.5f };
+    const int size = CommandCodec<TelemetryReport>::PacketSize(CRC_XOR);
+    const int body = CommandCodec<TelemetryReport>::BodySize;
+    char wire[64];
+    CommandCodec<TelemetryReport>::Encode(report, 1, wire, sizeof(wire));
+
+    RunPktDefOp("schema_encode", body, [&](int i) {
+        DoNotOptimize(wire + CommandCodec<TelemetryReport>::Encode(report, static_cast<unsigned short>(i), wire, sizeof(wire)));
+    });
+    TelemetryReport decoded;
+    RunPktDefOp("schema_decode", body, [&](int) {
+        DoNotOptimize(&decoded + CommandCodec<TelemetryReport>::Decode(wire, size, decoded));
+    });
+
+    PktDef pkt;
+    RunPktDefOp("pktdef_encode", body, [&](int i) {
+        pkt.SetPktCount(i);
+        CommandCodec<TelemetryReport>::ToPacket(report, pkt);
+        pkt.CalcCRC();
+        DoNotOptimize(wire + pkt.GenPacket(wire, sizeof(wire)));
+    });
+    RunPktDefOp("pktdef_decode", body, [&](int) {
+        pkt.Parse(wire, size);
+        DoNotOptimize(&decoded + (pkt.CheckCRC(wire, size) && CommandCodec<TelemetryReport>::FromPacket(pkt, decoded)));
+    });
+}
@@ -0,0 +1,137 @@
+#include "BenchUtil.h"
+#include "AsyncSender.h"
+#include "PktFramer.h"
+#include "PrioritySender.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+using namespace std;
+
+// Stop-command latency while bulk data saturates a TCP connection. A receiver
+// drains the socket at a throttled rate, and the sender keeps about 1 MB of
+// 60 KB bulk packets queued. Every few milliseconds a SLEEP is queued; its
+// latency runs from Enqueue() until the receiver has parsed it. The FIFO
+// AsyncSender puts it behind the whole queue, while PrioritySender lets it
+// overtake everything but one chunk and the socket buffers.
+static const int PRIORITY_BENCH_PORT = 27171;
+static const int PRIORITY_BENCH_STOPS = 40;
+static const int PRIORITY_BENCH_BULK = 60000;
+static const long long PRIORITY_BENCH_QUEUE = 1 << 20;
+static const int PRIORITY_BENCH_RATE = 64 << 20;   // Receiver bytes per second.
+
+struct StopTimes {
+    atomic<long long> Sent[PRIORITY_BENCH_STOPS];
+    LatencySamples Latency;
+};
+
+// Read until every stop has arrived, pacing the reads to PRIORITY_BENCH_RATE.
+static void ThrottledReceiver(MySocket& server, StopTimes& times)
+{
+    PktFramer framer(1 << 18, PktFramer::MAX_FRAME);
+    ChunkAssembler assembler;
+    vector<char> buffer(16384);
+    vector<char> frame(PktFramer::MAX_FRAME);
+    long long start = NowNs();
+    long long bytes = 0;
+    int stops = 0;
+    while (stops < PRIORITY_BENCH_STOPS) {
+        int got = server.GetData(buffer.data(), static_cast<int>(buffer.size()), 5000);
+        if (got <= 0)
+            break;
+        framer.Feed(buffer.data(), got);
+        int n;
+        while ((n = framer.NextFrame(frame.data(), static_cast<int>(frame.size()))) > 0) {
+            PktDef pkt(frame.data(), n);
+            if (!assembler.Receive(pkt) || pkt.GetCmd() != PktDef::SLEEP)
+                continue;
+            times.Latency.Add(NowNs() - times.Sent[pkt.GetPktCount()].load());
+            ++stops;
+        }
+        bytes += got;
+        long long due = start + bytes * 1000000000LL / PRIORITY_BENCH_RATE;
+        long long now = NowNs();
+        if (due > now)
+            this_thread::sleep_for(chrono::nanoseconds(due - now));
+    }
+}
+
+static PktDef MakeStop(int index)
+{
+    PktDef stop;
+    stop.SetCmd(PktDef::SLEEP);
+    stop.SetPktCount(index);
+    stop.CalcCRC();
+    return stop;
+}
+
+static void RunPriorityBench(bool prioritized)
+{
+    MySocket server(SERVER, "127.0.0.1", PRIORITY_BENCH_PORT, TCP, 16384);
+    MySocket client(CLIENT, "127.0.0.1", PRIORITY_BENCH_PORT, TCP, 16384);
+    client.ConnectTCP();
+    server.ConnectTCP();
+
+    vector<char> body(PRIORITY_BENCH_BULK, 0x5A);
+    PktDef bulk;
+    bulk.SetCmd(PktDef::DRIVE);
+    bulk.SetPktCount(0xFFFF);
+    bulk.SetBodyData(body.data(), PRIORITY_BENCH_BULK);
+    bulk.CalcCRC();
+
+    StopTimes times;
+    times.Latency.Reserve(PRIORITY_BENCH_STOPS);
+    thread receiver(ThrottledReceiver, ref(server), ref(times));
+
+    // High watermark well above the top-up level, so a stop is never refused.
+    AsyncSender fifo(client, static_cast<int>(PRIORITY_BENCH_QUEUE * 4), static_cast<int>(PRIORITY_BENCH_QUEUE));
+    PrioritySender lanes(client, POLICY_STRICT, 4096);
+    if (prioritized)
+        lanes.Start();
+    else
+        fifo.Start();
+
+    // Keep the bulk queue topped up, queuing a stop every 5 ms.
+    long long nextStop = NowNs();
+    for (int index = 0; index < PRIORITY_BENCH_STOPS;) {
+        if (prioritized) {
+            while (lanes.GetQueuedBytes(LANE_BULK) < PRIORITY_BENCH_QUEUE)
+                lanes.Enqueue(bulk, LANE_BULK);
+        }
+        else {
+            while (fifo.GetQueuedBytes() < PRIORITY_BENCH_QUEUE && fifo.Enqueue(bulk))
+                ;
+        }
+        if (NowNs() >= nextStop) {
+            PktDef stop = MakeStop(index);
+            times.Sent[index].store(NowNs());
+            if (prioritized)
+                lanes.Enqueue(stop, LANE_CONTROL);
+            else
+                fifo.Enqueue(stop);
+            ++index;
+            nextStop = NowNs() + 5000000;
+        }
+        this_thread::sleep_for(chrono::microseconds(500));
+    }
+
+    // The writers may be blocked on a full socket; closing the receiving end
+    // fails their send instead.
+    receiver.join();
+    fifo.Stop();
+    server.DisconnectTCP();
+    lanes.Stop();
+    client.DisconnectTCP();
+
+    BenchResult result(prioritized ? "stop_latency/priority_lanes" : "stop_latency/fifo");
+    result.Param("bulk", PRIORITY_BENCH_BULK);
+    result.Param("queued", PRIORITY_BENCH_QUEUE);
+    times.Latency.AddTo(result, true);
+    result.Metric("max_us", times.Latency.Percentile(100.0) / 1000.0);
+    result.Report();
+}
+
+BENCHMARK(StopUnderBulkLoad)
+{
+    RunPriorityBench(false);
+    RunPriorityBench(true);
+}
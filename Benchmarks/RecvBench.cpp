@@ -0,0 +1,70 @@
+#include "BenchUtil.h"
+#include "MySocket.h"
+#include <cstring>
+using namespace std;
+
+// Compares the three UDP receive paths over loopback:
+//   legacy - receive into a staging buffer, then memcpy to the caller (old GetData behaviour)
+//   direct - GetData(dest, capacity) straight into caller memory
+//   borrow - BorrowData()/ReleaseData() view into the socket's pooled buffer
+enum RecvMode { RECV_LEGACY, RECV_DIRECT, RECV_BORROW };
+
+static const int RECV_BENCH_PORT = 27015;
+static const int RECV_BENCH_BURST = 64;
+static const int RECV_BENCH_ROUNDS = 200;
+
+static void RunRecvBench(RecvMode mode, const char* label, int payloadSize)
+{
+    const int maxSize = 2048;
+    MySocket server(SERVER, "127.0.0.1", RECV_BENCH_PORT, UDP, maxSize);
+    MySocket client(CLIENT, "127.0.0.1", RECV_BENCH_PORT, UDP, maxSize);
+
+    vector<char> payload(payloadSize, 'x');
+    vector<char> staging(maxSize);
+    vector<char> dest(maxSize);
+
+    long long totalNs = 0;
+    long long bytesCopied = 0;
+    long long packets = 0;
+
+    for (int round = 0; round < RECV_BENCH_ROUNDS; ++round) {
+        // Queue a burst so the timed section measures only the receive path.
+        for (int i = 0; i < RECV_BENCH_BURST; ++i)
+            client.SendData(payload.data(), payloadSize);
+
+        for (int i = 0; i < RECV_BENCH_BURST; ++i) {
+            long long start = NowNs();
+            if (mode == RECV_LEGACY) {
+                int n = server.GetData(staging.data(), maxSize);
+                memcpy(dest.data(), staging.data(), n);
+                bytesCopied += n;
+                DoNotOptimize(dest.data());
+            }
+            else if (mode == RECV_DIRECT) {
+                int n = server.GetData(dest.data(), maxSize);
+                DoNotOptimize(dest.data() + n);
+            }
+            else {
+                RecvView view = server.BorrowData();
+                DoNotOptimize(view.Data);
+                server.ReleaseData(view);
+            }
+            totalNs += NowNs() - start;
+            ++packets;
+        }
+    }
+
+    BenchResult(string("recv/udp/") + label).Param("payload", payloadSize)
+        .Metric("bytes_copied_per_pkt", static_cast<double>(bytesCopied / packets))
+        .Metric("avg_ns", static_cast<double>(totalNs / packets)).Report();
+}
+
+BENCHMARK(RecvCopyPaths)
+{
+    const int sizes[] = { 16, 256, 1400 };
+    for (int size : sizes) {
+        RunRecvBench(RECV_LEGACY, "legacy", size);
+        RunRecvBench(RECV_DIRECT, "direct", size);
+        RunRecvBench(RECV_BORROW, "borrow", size);
+    }
+}
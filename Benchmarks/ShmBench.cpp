@@ -0,0 +1,94 @@
+#include "BenchUtil.h"
+#include "MySocket.h"
+#include <thread>
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// Command round trips between two processes on the same host: TCP over
+// 127.0.0.1 against the SHM shared-memory transport. The child process echoes
+// every message back; the parent times send-to-reply. Where fork() is not
+// available the echo side runs on a thread instead.
+static const int SHM_BENCH_ROUNDTRIPS = 20000;
+static const int SHM_BENCH_PORT = 27170;
+
+// Echo until the peer disconnects.
+static void EchoPeer(ConnectionType type, int port)
+{
+    MySocket peer(CLIENT, "127.0.0.1", port, type, 2048);
+    peer.ConnectTCP();
+    if (type == TCP)
+        peer.SetNoDelay(true);
+    char buffer[2048];
+    for (;;) {
+        int n = peer.GetData(buffer, sizeof(buffer));
+        if (n <= 0)
+            break;
+        peer.SendData(buffer, n);
+    }
+    peer.DisconnectTCP();
+}
+
+static void RunShmRoundTrip(ConnectionType type, int payloadSize)
+{
+    MySocket server(SERVER, "127.0.0.1", SHM_BENCH_PORT, type, 2048);
+#ifdef __linux__
+    pid_t child = fork();
+    if (child == 0) {
+        try {
+            EchoPeer(type, SHM_BENCH_PORT);
+        }
+        catch (...) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+#else
+    thread echo(EchoPeer, type, SHM_BENCH_PORT);
+#endif
+    server.ConnectTCP(5000);
+    if (type == TCP)
+        server.SetNoDelay(true);
+
+    vector<char> body(payloadSize, 0x21);
+    PktDef pkt;
+    pkt.SetCmd(PktDef::DRIVE);
+    pkt.SetBodyData(body.data(), payloadSize);
+    char reply[2048];
+    LatencySamples samples;
+    samples.Reserve(SHM_BENCH_ROUNDTRIPS);
+    for (int i = 0; i < SHM_BENCH_ROUNDTRIPS; ++i) {
+        pkt.SetPktCount(i);
+        pkt.CalcCRC();
+        long long start = NowNs();
+        server.SendData(pkt.GenPacket(), pkt.GetLength());
+        // TCP may split the echo; SHM always returns it whole.
+        int got = 0;
+        while (got < pkt.GetLength())
+            got += server.GetData(reply, sizeof(reply), 5000);
+        samples.Add(NowNs() - start);
+    }
+    server.DisconnectTCP();
+#ifdef __linux__
+    int status = 0;
+    waitpid(child, &status, 0);
+#else
+    echo.join();
+#endif
+
+    BenchResult result(type == TCP ? "intrahost/tcp" : "intrahost/shm");
+    result.Param("payload", payloadSize);
+    samples.AddTo(result, false);
+    result.Report();
+}
+
+BENCHMARK(IntraHostRoundTrip)
+{
+    const int payloads[] = { 12, 256, 1024 };
+    for (int payload : payloads) {
+        RunShmRoundTrip(TCP, payload);
+        RunShmRoundTrip(SHM, payload);
+    }
+}
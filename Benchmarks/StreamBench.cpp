@@ -0,0 +1,88 @@
+#include "BenchUtil.h"
+#include "MySocket.h"
+#include "PktStream.h"
+#include <atomic>
+#include <thread>
+using namespace std;
+
+// Large bodies over loopback TCP, built two ways: SetBodyData + CalcCRC +
+// GenPacket and one SendData of the whole packet, versus PktStreamWriter
+// sending the body straight from the caller's memory. The wire bytes are the
+// same, so one PktStreamReader thread drains and verifies both. held_bytes is
+// what the sender keeps besides the caller's body while the packet goes out.
+static const int STREAM_BENCH_PORT = 27175;
+static const long long STREAM_BENCH_BYTES = 64LL << 20;
+
+static void RunStreamBench(bool streaming, int bodySize)
+{
+    MySocket server(SERVER, "127.0.0.1", STREAM_BENCH_PORT, TCP, DEFAULT_SIZE);
+    MySocket client(CLIENT, "127.0.0.1", STREAM_BENCH_PORT, TCP, DEFAULT_SIZE);
+    client.ConnectTCP();
+    server.ConnectTCP(1000);
+    server.SetTimeouts(-1, -1, 5000);
+
+    int packets = static_cast<int>(STREAM_BENCH_BYTES / bodySize);
+    if (packets < 1)
+        packets = 1;
+    atomic<int> valid(0);
+    thread receiver([&]() {
+        PktStreamReader reader(server);
+        vector<char> chunk(STREAM_CHUNK_SIZE);
+        for (int i = 0; i < packets && reader.Begin(); ++i) {
+            while (reader.Read(chunk.data(), STREAM_CHUNK_SIZE) > 0) {
+            }
+            if (reader.End())
+                ++valid;
+        }
+    });
+
+    vector<char> body(bodySize, 0x5A);
+    PktDef header;
+    header.SetCmd(PktDef::RESPONSE);
+    header.SetCrcType(CRC_32C);
+    long long held = 0;
+    long long start = NowNs();
+    if (streaming) {
+        PktStreamWriter stream(client);
+        for (int i = 0; i < packets; ++i) {
+            stream.Begin(header, bodySize);
+            stream.Write(body.data(), bodySize);
+            stream.End();
+        }
+        held = PktStreamWriter::PREFIXSIZE + PktDef::HEADERSIZE;
+    }
+    else {
+        PktDef pkt;
+        pkt.SetCmd(PktDef::RESPONSE);
+        pkt.SetCrcType(CRC_32C);
+        char prefix[PktStreamWriter::PREFIXSIZE];
+        for (int i = 0; i < packets; ++i) {
+            pkt.SetBodyData(body.data(), bodySize);
+            pkt.CalcCRC();
+            char* raw = pkt.GenPacket();
+            WireFormat::Store32(prefix, static_cast<uint32_t>(pkt.GetLength()));
+            client.SendData(prefix, sizeof(prefix));
+            client.SendData(raw, pkt.GetLength());
+        }
+        // The body copy in the packet plus the serialized packet.
+        held = static_cast<long long>(bodySize) + pkt.GetLength();
+    }
+    receiver.join();
+    double seconds = (NowNs() - start) / 1e9;
+    client.DisconnectTCP();
+
+    BenchResult result(streaming ? "large_body/stream" : "large_body/pktdef");
+    result.Param("body", bodySize).Param("packets", packets);
+    result.Metric("mb_per_s", packets * static_cast<double>(bodySize) / seconds / (1 << 20));
+    result.Metric("held_bytes", static_cast<double>(held));
+    result.Metric("valid", valid.load()).Report();
+}
+
+BENCHMARK(LargeBodySend)
+{
+    const int sizes[] = { 64 * 1024, 1 << 20, 16 << 20 };
+    for (int size : sizes) {
+        RunStreamBench(false, size);
+        RunStreamBench(true, size);
+    }
+}
@@ -0,0 +1,84 @@
+#include "BenchUtil.h"
+#include "Commands.h"
+#include "TelemetryCodec.h"
+#include <vector>
+using namespace std;
+
+// Telemetry streams through TelemetryEncoder/TelemetryDecoder, compared with
+// sending every sample raw. A sample is one TelemetryReport body, or several
+// (e.g. one per wheel module) back to back; the values drift the way a
+// moving robot's do.
+static const int TELEMETRY_BENCH_SAMPLES = 200000;
+
+static void MakeSample(int i, int reports, char* body)
+{
+    for (int r = 0; r < reports; ++r) {
+        TelemetryReport report;
+        report.TimestampMs = 100000 + 20 * i;
+        report.BatteryMv = static_cast<unsigned short>(12400 - i / 500);
+        report.LeftRpm = static_cast<short>(300 + (i / 7 + r) % 5);
+        report.RightRpm = static_cast<short>(-300 - (i / 11 + r) % 5);
+        report.HeadingCentiDeg = static_cast<unsigned short>((9000 + i / 3) % 36000);
+        report.TemperatureC = 36.5f + static_cast<float>((i / 1000) % 4) * 0.25f;
+        char* dest = body + r * (1 + TelemetryReport::Schema::Size);
+        dest[0] = static_cast<char>(TelemetryReport::Code);
+        TelemetryReport::Schema::Encode(report, dest + 1);
+    }
+}
+
+// ackLag: how many packets behind the newest the receiver's acks arrive.
+static void RunTelemetryStream(int reports, int ackLag)
+{
+    const int size = reports * (1 + TelemetryReport::Schema::Size);
+    vector<vector<char>> samples(TELEMETRY_BENCH_SAMPLES, vector<char>(size));
+    for (int i = 0; i < TELEMETRY_BENCH_SAMPLES; ++i)
+        MakeSample(i, reports, samples[i].data());
+
+    TelemetryEncoder encoder(size);
+    TelemetryDecoder decoder(size);
+    vector<char> decoded(size);
+    PktDef pkt;
+    pkt.SetCmd(PktDef::RESPONSE);
+    PktDef received;
+    long long encodeNs = 0;
+    long long decodeNs = 0;
+    long long codecWire = 0;
+    long long mismatches = 0;
+    for (int i = 0; i < TELEMETRY_BENCH_SAMPLES; ++i) {
+        long long start = NowNs();
+        pkt.SetPktCount(i);
+        encoder.Encode(pkt, samples[i].data(), size);
+        pkt.CalcCRC();
+        char* wire = pkt.GenPacket();
+        long long encoded = NowNs();
+        received.Parse(wire, pkt.GetLength());
+        int n = decoder.Decode(received, decoded.data(), size);
+        decodeNs += NowNs() - encoded;
+        encodeNs += encoded - start;
+        codecWire += pkt.GetLength();
+        if (n != size || memcmp(decoded.data(), samples[i].data(), size) != 0)
+            ++mismatches;
+        if (i >= ackLag)
+            encoder.OnAck(i - ackLag);
+    }
+
+    long long rawWire = static_cast<long long>(TELEMETRY_BENCH_SAMPLES) * (PktDef::HEADERSIZE + size + 1);
+    BenchResult("telemetry/codec").Param("body", size).Param("ack_lag", ackLag)
+        .Metric("raw_bytes_per_pkt", static_cast<double>(rawWire) / TELEMETRY_BENCH_SAMPLES)
+        .Metric("codec_bytes_per_pkt", static_cast<double>(codecWire) / TELEMETRY_BENCH_SAMPLES)
+        .Metric("wire_ratio", static_cast<double>(codecWire) / rawWire)
+        .Metric("keyframes", static_cast<double>(encoder.GetKeyframes()))
+        .Metric("encode_ns", static_cast<double>(encodeNs / TELEMETRY_BENCH_SAMPLES))
+        .Metric("decode_ns", static_cast<double>(decodeNs / TELEMETRY_BENCH_SAMPLES))
+        .Metric("mismatches", static_cast<double>(mismatches))
+        .Report();
+}
+
+BENCHMARK(TelemetryCodec)
+{
+    const int reports[] = { 1, 8 };
+    for (int r : reports) {
+        RunTelemetryStream(r, 0);
+        RunTelemetryStream(r, 4);
+    }
+}
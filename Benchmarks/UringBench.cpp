@@ -0,0 +1,149 @@
+#include "BenchUtil.h"
+#include "MySocket.h"
+#include "ReactorServer.h"
+#include "UringEngine.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+using namespace std;
+
+// UDP echo over loopback through each I/O path: a MySocket server on plain
+// syscalls, the epoll ReactorServer, and a MySocket server on io_uring (with
+// an io_uring client). The client first times single round trips, then keeps
+// a window of DRIVE packets in flight with SendBatch/GetDataBatch. Syscalls
+// are counted by the MySockets; the reactor does not count its own.
+static const int URING_BENCH_PORT = 27174;
+static const int URING_BENCH_PINGS = 4000;
+static const int URING_BENCH_WINDOWS = 2000;
+static const int URING_BENCH_WINDOW = 32;
+static const int URING_BENCH_TIMEOUT_MS = 200;
+static const int URING_BENCH_POLL_MS = 50;
+
+enum EchoServerKind { ECHO_SYSCALL, ECHO_EPOLL, ECHO_URING };
+
+// Echo everything back in batches until running is cleared.
+static void MySocketEcho(MySocket& server, atomic<bool>& running)
+{
+    vector<char> storage(MAX_BATCH * DEFAULT_SIZE);
+    UdpDatagram batch[MAX_BATCH];
+    for (int i = 0; i < MAX_BATCH; ++i) {
+        batch[i].Data = storage.data() + i * DEFAULT_SIZE;
+        batch[i].Capacity = DEFAULT_SIZE;
+    }
+    server.SetTimeouts(-1, -1, URING_BENCH_POLL_MS);
+    while (running.load()) {
+        try {
+            int n = server.GetDataBatch(batch, MAX_BATCH);
+            server.SendBatch(batch, n);
+        }
+        catch (SocketTimeout&) {
+        }
+    }
+}
+
+static void RunUringBench(EchoServerKind kind)
+{
+    const char* names[] = { "uring_loopback/syscall", "uring_loopback/epoll", "uring_loopback/uring" };
+    IoEngine engine = kind == ECHO_URING ? ENGINE_URING : ENGINE_SYSCALL;
+    atomic<bool> running(true);
+    MySocket* echo = nullptr;
+    ReactorServer* reactor = nullptr;
+    thread echoThread;
+    if (kind == ECHO_EPOLL) {
+        reactor = new ReactorServer("127.0.0.1", URING_BENCH_PORT, UDP, 1);
+        reactor->OnPacket([](ReactorSession& session, PktDef& pkt) { session.Send(pkt); });
+        reactor->Start();
+    }
+    else {
+        echo = new MySocket(SERVER, "127.0.0.1", URING_BENCH_PORT, UDP, DEFAULT_SIZE);
+        if (echo->SetIoEngine(engine) != engine) {
+            printf("%s skipped: io_uring is not supported here\n", names[kind]);
+            delete echo;
+            return;
+        }
+        echoThread = thread(MySocketEcho, ref(*echo), ref(running));
+    }
+
+    MySocket client(CLIENT, "127.0.0.1", URING_BENCH_PORT, UDP, DEFAULT_SIZE);
+    client.SetIoEngine(engine);
+    PktDef pkt;
+    PktDef::DriveBody body = { PktDef::FORWARD, 5, 90 };
+    pkt.SetCmd(PktDef::DRIVE);
+    pkt.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+    pkt.CalcCRC();
+    char* raw = pkt.GenPacket();
+    char reply[DEFAULT_SIZE];
+    int lost = 0;
+
+    LatencySamples samples;
+    samples.Reserve(URING_BENCH_PINGS);
+    for (int i = 0; i < URING_BENCH_PINGS; ++i) {
+        long long start = NowNs();
+        client.SendData(raw, pkt.GetLength());
+        try {
+            client.GetData(reply, sizeof(reply), URING_BENCH_TIMEOUT_MS);
+            samples.Add(NowNs() - start);
+        }
+        catch (SocketTimeout&) {
+            ++lost;
+        }
+    }
+    unsigned long long pingSyscalls = client.GetCounters().Syscalls.load();
+
+    UdpDatagram out[URING_BENCH_WINDOW];
+    UdpDatagram in[URING_BENCH_WINDOW];
+    vector<char> storage(URING_BENCH_WINDOW * DEFAULT_SIZE);
+    for (int i = 0; i < URING_BENCH_WINDOW; ++i) {
+        out[i].Data = raw;
+        out[i].Length = pkt.GetLength();
+        out[i].Addr = MySocket::MakeAddress("127.0.0.1", URING_BENCH_PORT);
+        in[i].Data = storage.data() + i * DEFAULT_SIZE;
+        in[i].Capacity = DEFAULT_SIZE;
+    }
+    client.SetTimeouts(-1, -1, URING_BENCH_TIMEOUT_MS);
+    long long packets = 0;
+    long long start = NowNs();
+    for (int w = 0; w < URING_BENCH_WINDOWS; ++w) {
+        int sent = client.SendBatch(out, URING_BENCH_WINDOW);
+        int got = 0;
+        try {
+            while (got < sent)
+                got += client.GetDataBatch(in, sent - got);
+        }
+        catch (SocketTimeout&) {
+            lost += sent - got;
+        }
+        packets += got;
+    }
+    double seconds = (NowNs() - start) / 1e9;
+    unsigned long long windowSyscalls = client.GetCounters().Syscalls.load() - pingSyscalls;
+
+    running.store(false);
+    if (reactor) {
+        reactor->Stop();
+        delete reactor;
+    }
+    else {
+        echoThread.join();
+    }
+
+    BenchResult result(names[kind]);
+    result.Param("payload", static_cast<long long>(sizeof(body))).Param("window", URING_BENCH_WINDOW);
+    samples.AddTo(result, true);
+    result.Metric("pipelined_pkts_per_s", packets / seconds);
+    result.Metric("client_syscalls_per_ping", static_cast<double>(pingSyscalls) / URING_BENCH_PINGS);
+    result.Metric("client_syscalls_per_pkt", packets ? static_cast<double>(windowSyscalls) / packets : 0.0);
+    if (echo) {
+        unsigned long long echoed = echo->GetCounters().PacketsIn.load();
+        result.Metric("server_syscalls_per_pkt", echoed ? static_cast<double>(echo->GetCounters().Syscalls.load()) / echoed : 0.0);
+        delete echo;
+    }
+    result.Metric("lost", lost).Report();
+}
+
+BENCHMARK(UringLoopback)
+{
+    RunUringBench(ECHO_SYSCALL);
+    RunUringBench(ECHO_EPOLL);
+    RunUringBench(ECHO_URING);
+}
@@ -0,0 +1,88 @@
+#include "CaptureReader.h"
+#include "MySocket.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+static void Usage()
+{
+    fprintf(stderr,
+        "Usage: CaptureReplay <capture> --list\n"
+        "       CaptureReplay <capture> <ip> <port> <tcp|udp> [--stream N] [--dir out|in] [--speed X]\n"
+        "  --stream N   replay only stream N (default: every stream)\n"
+        "  --dir        replay frames the recording socket sent (out, default) or received (in)\n"
+        "  --speed X    1 = original pacing (default), 2 = twice as fast, 0 = as fast as possible\n");
+}
+
+// Print each stream with its frame counts.
+static void ListCapture(CaptureReader& reader)
+{
+    vector<long long> outFrames(reader.GetStreamCount(), 0);
+    vector<long long> inFrames(reader.GetStreamCount(), 0);
+    CaptureRecord record;
+    long long lastNs = 0;
+    while (reader.Next(record)) {
+        if (record.Stream >= static_cast<int>(outFrames.size())) {
+            outFrames.resize(record.Stream + 1, 0);
+            inFrames.resize(record.Stream + 1, 0);
+        }
+        ++(record.Direction == CAPTURE_OUT ? outFrames : inFrames)[record.Stream];
+        if (record.TimestampNs > lastNs)
+            lastNs = record.TimestampNs;
+    }
+    printf("%s, %.3f s\n", reader.HasIndex() ? "indexed" : "no index (capture was not closed)", lastNs / 1e9);
+    for (size_t i = 0; i < outFrames.size(); ++i)
+        printf("  stream %zu  %-40s  out %lld  in %lld\n", i, reader.GetStreamLabel(static_cast<int>(i)).c_str(),
+            outFrames[i], inFrames[i]);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        Usage();
+        return 1;
+    }
+    try {
+        CaptureReader reader(argv[1]);
+        if (strcmp(argv[2], "--list") == 0) {
+            ListCapture(reader);
+            return 0;
+        }
+        if (argc < 5) {
+            Usage();
+            return 1;
+        }
+
+        int stream = -1;
+        CaptureDirection direction = CAPTURE_OUT;
+        double speed = 1.0;
+        for (int i = 5; i < argc; ++i) {
+            if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+                stream = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+                direction = strcmp(argv[++i], "in") == 0 ? CAPTURE_IN : CAPTURE_OUT;
+            else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+                speed = atof(argv[++i]);
+            else {
+                Usage();
+                return 1;
+            }
+        }
+
+        ConnectionType type = strcmp(argv[4], "tcp") == 0 ? TCP : UDP;
+        MySocket socket(CLIENT, argv[2], static_cast<unsigned int>(atoi(argv[3])), type, DEFAULT_SIZE);
+        if (type == TCP)
+            socket.ConnectTCP();
+        int sent = ReplayCapture(reader, socket, stream, direction, speed);
+        if (type == TCP)
+            socket.DisconnectTCP();
+        printf("Replayed %d frames\n", sent);
+    }
+    catch (const runtime_error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "AsyncSender.h"
+#include "AsyncSender.cpp"
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    // Read framed packets from a connected socket until count have arrived.
+    static vector<PktDef> ReadFrames(MySocket& sock, PktFramer& framer, int count)
+    {
+        vector<PktDef> packets;
+        char buffer[2048];
+        char frame[2048];
+        while (static_cast<int>(packets.size()) < count) {
+            int n;
+            while ((n = framer.NextFrame(frame, sizeof(frame))) > 0)
+                packets.push_back(PktDef(frame, n));
+            if (static_cast<int>(packets.size()) >= count)
+                break;
+            if (!sock.WaitForData(2000))
+                break;
+            int got = sock.GetData(buffer, sizeof(buffer));
+            if (got <= 0)
+                break;
+            framer.Feed(buffer, got);
+        }
+        return packets;
+    }
+
+    TEST_CLASS(AsyncSenderTests)
+    {
+    public:
+        // Test that packets queued from several threads arrive intact, in per-thread order, in few sends.
+        TEST_METHOD(CoalescedMultiProducerTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27130, TCP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27130, TCP, 1024);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            AsyncSender sender(client);
+
+            const int producers = 4;
+            const int perProducer = 50;
+            vector<thread> threads;
+            for (int p = 0; p < producers; ++p) {
+                threads.push_back(thread([&sender, p]() {
+                    for (int i = 0; i < perProducer; ++i) {
+                        PktDef pkt;
+                        pkt.SetCmd(PktDef::DRIVE);
+                        pkt.SetPktCount(p * 1000 + i);
+                        pkt.CalcCRC();
+                        sender.Enqueue(pkt);
+                    }
+                }));
+            }
+            for (thread& t : threads)
+                t.join();
+            Assert::AreEqual(producers * perProducer, sender.GetQueueDepth());
+
+            sender.FlushOnce();
+            Assert::AreEqual(0, sender.GetQueueDepth());
+            Assert::AreEqual(0LL, sender.GetQueuedBytes());
+            Assert::IsTrue(sender.GetFlushes() < 10, L"Packets were not coalesced");
+
+            PktFramer framer(8192, 1024);
+            vector<PktDef> received = ReadFrames(server, framer, producers * perProducer);
+            Assert::AreEqual(producers * perProducer, static_cast<int>(received.size()));
+            vector<int> lastSeen(producers, -1);
+            for (PktDef& pkt : received) {
+                int p = pkt.GetPktCount() / 1000;
+                int i = pkt.GetPktCount() % 1000;
+                Assert::IsTrue(i > lastSeen[p], L"Per-producer order was not kept");
+                lastSeen[p] = i;
+            }
+        }
+
+        // Test the high/low watermark hysteresis.
+        TEST_METHOD(WatermarkBackpressureTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27131, TCP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27131, TCP, 1024);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            AsyncSender sender(client, 200, 50);
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::SLEEP);
+            pkt.CalcCRC();
+            int accepted = 0;
+            while (sender.Enqueue(pkt))
+                ++accepted;
+            Assert::IsTrue(sender.IsCongested());
+            Assert::IsTrue(sender.GetQueuedBytes() >= 200);
+            Assert::IsTrue(accepted > 0);
+
+            sender.FlushOnce();
+            Assert::IsFalse(sender.IsCongested());
+            Assert::IsTrue(sender.Enqueue(pkt));
+        }
+
+        // Test that a flush interrupted by a full socket buffer resumes without losing or reordering bytes.
+        TEST_METHOD(PartialWriteResumeTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27132, TCP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27132, TCP, 1024);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            AsyncSender sender(client, 64 << 20, 1 << 20);
+
+            // Far more than the loopback socket buffers hold while nobody reads.
+            const int count = 20000;
+            char body[250];
+            for (int i = 0; i < count; ++i) {
+                PktDef pkt;
+                pkt.SetCmd(PktDef::DRIVE);
+                pkt.SetPktCount(i);
+                memset(body, i & 0xFF, sizeof(body));
+                pkt.SetBodyData(body, sizeof(body));
+                pkt.CalcCRC();
+                Assert::IsTrue(sender.Enqueue(pkt));
+            }
+            while (sender.FlushOnce() > 0) {}
+            Assert::IsTrue(sender.GetQueueDepth() > 0, L"Socket buffer never filled");
+
+            sender.Start(100);
+            PktFramer framer(1 << 16, 1024);
+            vector<PktDef> received = ReadFrames(server, framer, count);
+            sender.Stop();
+            Assert::AreEqual(count, static_cast<int>(received.size()));
+            for (int i = 0; i < count; ++i) {
+                Assert::AreEqual(i & 0xFFFF, static_cast<int>(received[i].GetPktCount()));
+                Assert::AreEqual(static_cast<char>(i & 0xFF), received[i].GetBodyData()[0]);
+            }
+        }
+
+        // Test that a connection reset stops the background flusher with the
+        // error recorded, instead of the exception ending the process.
+        TEST_METHOD(PeerResetTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27133, TCP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27133, TCP, 1024);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            AsyncSender sender(client);
+            sender.Start(100);
+            server.DisconnectTCP();
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            pkt.CalcCRC();
+            for (int i = 0; i < 500 && !sender.HasFailed(); ++i) {
+                sender.Enqueue(pkt);
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+            Assert::IsTrue(sender.HasFailed(), L"Sending to a closed peer fails");
+            Assert::IsFalse(sender.GetError().empty());
+            Assert::AreEqual(1LL, sender.GetFailures());
+            Assert::IsFalse(sender.Enqueue(pkt), L"A failed sender refuses packets");
+            Assert::IsFalse(sender.Stop());
+        }
+    };
+}
@@ -0,0 +1,194 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "AsyncSocket.h"
+#include "AsyncSocket.cpp"
+#include "IoLoop.cpp"
+#include "ReactorServer.h"
+#include <memory>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    static const int CONVERSATIONS = 200;
+    static const int EXCHANGES = 5;
+
+    static void MakeDrive(PktDef& pkt, int count)
+    {
+        char body[3] = { 1, 2, 3 };
+        pkt.SetCmd(PktDef::DRIVE);
+        pkt.SetBodyData(body, sizeof(body));
+        pkt.SetPktCount(count);
+        pkt.CalcCRC();
+    }
+
+    // Acknowledge every packet until the client hangs up.
+    static Task<void> ServeConnection(unique_ptr<AsyncSocket> conn)
+    {
+        PktDef pkt;
+        while (co_await conn->GetPacket(pkt, 5000)) {
+            pkt.SetAck(true);
+            pkt.CalcCRC();
+            co_await conn->SendPacket(pkt, 5000);
+        }
+    }
+
+    static Task<void> AcceptConnections(IoLoop& loop, AsyncListener& listener, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            loop.Spawn(ServeConnection(co_await listener.Accept(5000)));
+    }
+
+    // One robot conversation: send a command, wait for its ACK, repeat.
+    static Task<void> Converse(IoLoop& loop, int port, int id, int& acked)
+    {
+        AsyncSocket sock(loop, "127.0.0.1", port);
+        co_await sock.ConnectTCP(2000);
+        PktDef pkt;
+        PktDef reply;
+        for (int i = 0; i < EXCHANGES; ++i) {
+            MakeDrive(pkt, id * EXCHANGES + i);
+            co_await sock.SendPacket(pkt, 2000);
+            if (!co_await sock.GetPacket(reply, 2000))
+                throw runtime_error("Server hung up");
+            if (reply.GetAck() && reply.GetPktCount() == pkt.GetPktCount())
+                ++acked;
+        }
+        sock.DisconnectTCP();
+    }
+
+    struct WaitOutcome {
+        string TimeoutError;
+        long long WaitedMs = 0;
+        string CancelError;
+        string SleepError;
+        string ConnectError;
+    };
+
+    static Task<void> AcceptAndHold(AsyncListener& listener, unique_ptr<AsyncSocket>& held)
+    {
+        held = co_await listener.Accept(2000);
+    }
+
+    static Task<void> CancelAfter(IoLoop& loop, CancelSource& cancel, int ms)
+    {
+        co_await loop.Sleep(ms);
+        cancel.Cancel();
+    }
+
+    static Task<void> WaitOnSilentPeer(IoLoop& loop, int port, WaitOutcome& outcome)
+    {
+        AsyncSocket sock(loop, "127.0.0.1", port);
+        co_await sock.ConnectTCP(2000);
+        PktDef pkt;
+        long long start = IoLoop::NowMs();
+        try {
+            co_await sock.GetPacket(pkt, 50);
+        }
+        catch (const runtime_error& e) {
+            outcome.TimeoutError = e.what();
+        }
+        outcome.WaitedMs = IoLoop::NowMs() - start;
+
+        CancelSource cancel;
+        loop.Spawn(CancelAfter(loop, cancel, 20));
+        try {
+            co_await sock.GetPacket(pkt, -1, &cancel);
+        }
+        catch (const runtime_error& e) {
+            outcome.CancelError = e.what();
+        }
+        // A canceled source fails later operations without waiting.
+        try {
+            co_await loop.Sleep(10000, &cancel);
+        }
+        catch (const runtime_error& e) {
+            outcome.SleepError = e.what();
+        }
+
+        AsyncSocket refused(loop, "127.0.0.1", 1);
+        try {
+            co_await refused.ConnectTCP(1000);
+        }
+        catch (const runtime_error& e) {
+            outcome.ConnectError = e.what();
+        }
+    }
+
+    // Send a burst without waiting, then collect the ACKs.
+    static Task<void> PipelinedBurst(IoLoop& loop, int port, int count, int& acked)
+    {
+        AsyncSocket sock(loop, "127.0.0.1", port);
+        co_await sock.ConnectTCP(2000);
+        PktDef pkt;
+        for (int i = 0; i < count; ++i) {
+            MakeDrive(pkt, i);
+            co_await sock.SendPacket(pkt, 2000);
+        }
+        for (int i = 0; i < count; ++i) {
+            if (!co_await sock.GetPacket(pkt, 2000))
+                break;
+            if (pkt.GetAck() && pkt.GetPktCount() == i)
+                ++acked;
+        }
+    }
+
+    TEST_CLASS(AsyncSocketTests)
+    {
+    public:
+        // Test that hundreds of concurrent conversations complete on one thread.
+        TEST_METHOD(ManyConversationsTest)
+        {
+            IoLoop loop;
+            AsyncListener listener(loop, "127.0.0.1", 0);
+            int acked = 0;
+            loop.Spawn(AcceptConnections(loop, listener, CONVERSATIONS));
+            for (int i = 0; i < CONVERSATIONS; ++i)
+                loop.Spawn(Converse(loop, listener.GetPort(), i, acked));
+            loop.Run();
+
+            Assert::AreEqual(0LL, loop.GetTaskErrors());
+            Assert::AreEqual(0, loop.GetTaskCount());
+            Assert::AreEqual(CONVERSATIONS * EXCHANGES, acked);
+        }
+
+        // Test timeouts, cancellation and a refused connect surface as exceptions.
+        TEST_METHOD(TimeoutAndCancelTest)
+        {
+            IoLoop loop;
+            AsyncListener listener(loop, "127.0.0.1", 0);
+            unique_ptr<AsyncSocket> held;
+            WaitOutcome outcome;
+            loop.Spawn(AcceptAndHold(listener, held));
+            loop.Spawn(WaitOnSilentPeer(loop, listener.GetPort(), outcome));
+            loop.Run();
+
+            Assert::AreEqual(0LL, loop.GetTaskErrors());
+            Assert::IsTrue(outcome.TimeoutError == "GetPacket timed out");
+            Assert::IsTrue(outcome.WaitedMs >= 45 && outcome.WaitedMs < 1000);
+            Assert::IsTrue(outcome.CancelError == "GetPacket canceled");
+            Assert::IsTrue(outcome.SleepError == "Sleep canceled");
+            Assert::IsTrue(outcome.ConnectError == "TCP Connect failed");
+        }
+
+        // Test that the framing matches ReactorServer's.
+        TEST_METHOD(ReactorInteropTest)
+        {
+            ReactorServer server("127.0.0.1", 0, TCP, 1);
+            server.OnPacket([](ReactorSession& session, PktDef& pkt) {
+                pkt.SetAck(true);
+                pkt.CalcCRC();
+                session.Send(pkt);
+            });
+            server.Start();
+
+            IoLoop loop;
+            int acked = 0;
+            loop.Spawn(PipelinedBurst(loop, server.GetPort(), 20, acked));
+            loop.Run();
+            Assert::AreEqual(0LL, loop.GetTaskErrors());
+            Assert::AreEqual(20, acked);
+        }
+    };
+}
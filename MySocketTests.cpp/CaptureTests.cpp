@@ -0,0 +1,174 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "CaptureReader.h"
+#include "CaptureReader.cpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    TEST_CLASS(CaptureTests)
+    {
+    public:
+        // Test that both ends of a UDP exchange are captured and can be replayed byte for byte.
+        TEST_METHOD(CaptureAndReplayTest)
+        {
+            const char* path = "capture_replay_test.rbcap";
+            const char* frames[] = { "drive forward", "sleep", "status please" };
+            {
+                PacketCapture capture;
+                capture.Open(path);
+                MySocket server(SERVER, "127.0.0.1", 27140, UDP, 1024);
+                MySocket client(CLIENT, "127.0.0.1", 27140, UDP, 1024);
+                server.SetCapture(&capture);
+                client.SetCapture(&capture);
+                char buffer[1024];
+                for (const char* frame : frames) {
+                    client.SendData(frame, static_cast<int>(strlen(frame)));
+                    server.GetData(buffer);
+                }
+                client.SetCapture(nullptr);
+                client.SendData("not captured", 12);
+                server.SetCapture(nullptr);
+                capture.Close();
+                Assert::AreEqual(6LL, capture.GetRecorded());
+                Assert::AreEqual(0LL, capture.GetDropped());
+            }
+
+            CaptureReader reader(path);
+            Assert::IsTrue(reader.HasIndex());
+            Assert::AreEqual(2, reader.GetStreamCount());
+            Assert::IsTrue(reader.GetStreamLabel(0).find("udp/server/127.0.0.1:27140/") == 0);
+            Assert::IsTrue(reader.GetStreamLabel(1).find("udp/client/127.0.0.1:27140/") == 0);
+
+            CaptureRecord record;
+            int outFrames = 0;
+            int inFrames = 0;
+            long long lastNs = 0;
+            while (reader.Next(record)) {
+                int& seen = record.Direction == CAPTURE_OUT ? outFrames : inFrames;
+                Assert::AreEqual(record.Direction == CAPTURE_OUT ? 1 : 0, record.Stream);
+                Assert::IsTrue(string(record.Data, record.Length) == frames[seen]);
+                Assert::IsTrue(record.TimestampNs >= lastNs);
+                lastNs = record.TimestampNs;
+                ++seen;
+            }
+            Assert::AreEqual(3, outFrames);
+            Assert::AreEqual(3, inFrames);
+
+            MySocket target(SERVER, "127.0.0.1", 27141, UDP, 1024);
+            MySocket replayer(CLIENT, "127.0.0.1", 27141, UDP, 1024);
+            reader.Rewind();
+            Assert::AreEqual(3, ReplayCapture(reader, replayer, 1, CAPTURE_OUT, 0));
+            char buffer[1024];
+            for (const char* frame : frames) {
+                Assert::IsTrue(target.WaitForData(1000));
+                int n = target.GetData(buffer);
+                Assert::IsTrue(string(buffer, n) == frame);
+            }
+            remove(path);
+        }
+
+        // Test that concurrent producers lose nothing they were told was recorded and keep per-thread order.
+        TEST_METHOD(MultiProducerTest)
+        {
+            const char* path = "capture_producers_test.rbcap";
+            const int threads = 4;
+            const int perThread = 5000;
+            PacketCapture capture(1 << 16);
+            capture.Open(path);
+            int stream = capture.OpenStream("producers");
+            vector<thread> workers;
+            for (int t = 0; t < threads; ++t) {
+                workers.push_back(thread([&capture, stream, t, perThread]() {
+                    int frame[2] = { t, 0 };
+                    for (int i = 0; i < perThread; ++i) {
+                        frame[1] = i;
+                        capture.Record(stream, CAPTURE_OUT, reinterpret_cast<const char*>(frame), sizeof(frame));
+                    }
+                }));
+            }
+            for (thread& w : workers)
+                w.join();
+            capture.Close();
+            Assert::AreEqual(static_cast<long long>(threads * perThread), capture.GetRecorded() + capture.GetDropped());
+
+            CaptureReader reader(path);
+            vector<int> last(threads, -1);
+            long long frames = 0;
+            CaptureRecord record;
+            while (reader.Next(record)) {
+                Assert::AreEqual(8, record.Length);
+                int frame[2];
+                memcpy(frame, record.Data, sizeof(frame));
+                Assert::IsTrue(frame[0] >= 0 && frame[0] < threads);
+                Assert::IsTrue(frame[1] > last[frame[0]], L"Frames from one thread out of order");
+                last[frame[0]] = frame[1];
+                ++frames;
+            }
+            Assert::AreEqual(capture.GetRecorded(), frames);
+            remove(path);
+        }
+
+        // Test index seeks, oversized frames and reading a log whose writer never closed it.
+        TEST_METHOD(IndexAndTruncationTest)
+        {
+            const char* path = "capture_index_test.rbcap";
+            const int count = 2000;
+            PacketCapture capture(1 << 20);
+            capture.Open(path);
+            int stream = capture.OpenStream("index");
+            vector<char> huge(1 << 19, 'x');
+            Assert::IsFalse(capture.Record(stream, CAPTURE_OUT, huge.data(), static_cast<int>(huge.size())));
+            Assert::AreEqual(1LL, capture.GetDropped());
+            for (int i = 0; i < count; ++i)
+                capture.Record(stream, CAPTURE_IN, reinterpret_cast<const char*>(&i), sizeof(i));
+            capture.Close();
+
+            vector<long long> stamps;
+            {
+                CaptureReader reader(path);
+                CaptureRecord record;
+                while (reader.Next(record))
+                    stamps.push_back(record.TimestampNs);
+                Assert::AreEqual(count, static_cast<int>(stamps.size()));
+
+                reader.SeekTime(stamps[1500]);
+                Assert::IsTrue(reader.Next(record));
+                int value;
+                memcpy(&value, record.Data, sizeof(value));
+                Assert::IsTrue(record.TimestampNs == stamps[1500] && value <= 1500);
+            }
+
+            // Chop off the index and half of the last frame, as a crash would.
+            size_t keep = static_cast<size_t>(PacketCapture::FILE_HEADER_SIZE)
+                + PacketCapture::AlignRecord(PacketCapture::RECORD_HEADER_SIZE + 5)
+                + static_cast<size_t>(count - 1) * PacketCapture::AlignRecord(PacketCapture::RECORD_HEADER_SIZE + 4) + 10;
+            string contents;
+            {
+                ifstream in(path, ios::binary);
+                contents.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            }
+            Assert::IsTrue(keep < contents.size());
+            {
+                ofstream out(path, ios::binary | ios::trunc);
+                out.write(contents.data(), keep);
+            }
+
+            CaptureReader truncated(path);
+            Assert::IsFalse(truncated.HasIndex());
+            Assert::IsTrue(truncated.GetStreamLabel(0) == "index");
+            CaptureRecord record;
+            int frames = 0;
+            while (truncated.Next(record))
+                ++frames;
+            Assert::AreEqual(count - 1, frames);
+            remove(path);
+        }
+    };
+}
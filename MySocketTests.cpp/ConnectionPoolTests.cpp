@@ -0,0 +1,169 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "ConnectionPool.h"
+#include "ConnectionPool.cpp"
+#include "ReactorServer.h"
+#include "PktFramer.h"
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    // Server that answers every packet with an ACK of the same count.
+    static unique_ptr<ReactorServer> StartAckServer(int port)
+    {
+        unique_ptr<ReactorServer> server(new ReactorServer("127.0.0.1", port, TCP, 1));
+        server->OnPacket([](ReactorSession& session, PktDef& pkt) {
+            pkt.SetAck(true);
+            pkt.CalcCRC();
+            session.Send(pkt);
+        });
+        server->Start();
+        return server;
+    }
+
+    // Poll until condition holds or about two seconds pass.
+    template <typename F>
+    static bool WaitFor(F condition)
+    {
+        for (int i = 0; i < 400; ++i) {
+            if (condition())
+                return true;
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        return condition();
+    }
+
+    // Listener with a full accept queue: further handshakes hang until they time out.
+    static SOCKET StartBlackHole(int port, MySocket& filler)
+    {
+        SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<unsigned short>(port));
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        Assert::IsTrue(::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        Assert::IsTrue(listen(listener, 0) == 0);
+        filler.ConnectTCP(1000);
+        return listener;
+    }
+
+    TEST_CLASS(ConnectionPoolTests)
+    {
+    public:
+        // Test that warm connections are handed out without a handshake and reused once returned.
+        TEST_METHOD(WarmAcquireTest)
+        {
+            unique_ptr<ReactorServer> server = StartAckServer(27150);
+            PoolOptions options;
+            options.WarmConnections = 2;
+            ConnectionPool pool(options);
+            pool.AddEndpoint("127.0.0.1", 27150);
+            Assert::IsTrue(WaitFor([&]() { return pool.GetIdleCount("127.0.0.1", 27150) == 2; }));
+
+            auto start = chrono::steady_clock::now();
+            PooledConnection lease = pool.Acquire("127.0.0.1", 27150, 0);
+            auto micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            Assert::IsTrue(micros < 5000, L"Acquire from a warm pool took too long");
+            Assert::AreEqual(1LL, pool.GetHits());
+            Assert::IsTrue(ConnectionPool::PingProbe(1000, true)(*lease));
+
+            MySocket* socket = lease.Get();
+            lease.Release();
+            Assert::IsFalse(static_cast<bool>(lease));
+            PooledConnection again = pool.Acquire("127.0.0.1", 27150, 1000);
+            Assert::IsTrue(again.Get() == socket, L"Returned socket was not reused first");
+            again.MarkBroken();
+            again.Release();
+            Assert::IsTrue(WaitFor([&]() { return pool.GetIdleCount("127.0.0.1", 27150) == 2; }));
+            Assert::AreEqual(3LL, pool.GetConnects());
+        }
+
+        // Test backoff while the robot is unreachable and recovery when it comes back.
+        TEST_METHOD(ReconnectWithBackoffTest)
+        {
+            PoolOptions options;
+            options.WarmConnections = 1;
+            options.MinBackoffMs = 10;
+            options.MaxBackoffMs = 40;
+            options.ProbeIntervalMs = 20;
+            options.Probe = ConnectionPool::PingProbe(500, true);
+            ConnectionPool pool(options);
+
+            Assert::ExpectException<runtime_error>([&]() { pool.Acquire("127.0.0.1", 27151, 100); });
+            long long failures = pool.GetConnectFailures();
+            // 100 ms of 10-40 ms jittered backoff is a handful of attempts, not a spin.
+            Assert::IsTrue(failures >= 2 && failures <= 12);
+
+            unique_ptr<ReactorServer> server = StartAckServer(27151);
+            {
+                PooledConnection lease = pool.Acquire("127.0.0.1", 27151, 2000);
+                Assert::IsTrue(static_cast<bool>(lease));
+            }
+
+            // The robot drops off: idle sockets fail their probes and are replaced once it is back.
+            server.reset();
+            Assert::IsTrue(WaitFor([&]() { return pool.GetProbeFailures() > 0 && pool.GetIdleCount("127.0.0.1", 27151) == 0; }));
+            server = StartAckServer(27151);
+            PooledConnection lease = pool.Acquire("127.0.0.1", 27151, 2000);
+            Assert::IsTrue(ConnectionPool::PingProbe(1000, true)(*lease));
+        }
+
+        // Test that a robot whose handshakes hang does not hold up refills for another one.
+        TEST_METHOD(UnreachableEndpointTest)
+        {
+            MySocket filler(CLIENT, "127.0.0.1", 27152, TCP, DEFAULT_SIZE);
+            SOCKET blackHole = StartBlackHole(27152, filler);
+            unique_ptr<ReactorServer> server = StartAckServer(27153);
+            PoolOptions options;
+            options.WarmConnections = 1;
+            options.ConnectTimeoutMs = 1500;
+            {
+                ConnectionPool pool(options);
+                pool.AddEndpoint("127.0.0.1", 27152);
+                this_thread::sleep_for(chrono::milliseconds(50));
+
+                auto start = chrono::steady_clock::now();
+                PooledConnection lease = pool.Acquire("127.0.0.1", 27153, 1000);
+                auto millis = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+                Assert::IsTrue(millis < 500, L"Refill waited behind the hanging endpoint");
+                Assert::AreEqual(0, pool.GetIdleCount("127.0.0.1", 27152));
+            }
+            CloseSocket(blackHole);
+        }
+
+        // Test that the ping probe finds an ACK that arrives split across reads
+        // behind another reply.
+        TEST_METHOD(PingProbeSplitReplyTest)
+        {
+            MySocket robot(SERVER, "127.0.0.1", 27154, TCP, DEFAULT_SIZE);
+            MySocket client(CLIENT, "127.0.0.1", 27154, TCP, DEFAULT_SIZE);
+            client.ConnectTCP();
+            robot.ConnectTCP(1000);
+
+            thread replier([&]() {
+                char buffer[DEFAULT_SIZE];
+                robot.GetData(buffer, sizeof(buffer));
+                PktDef status;
+                status.SetCmd(PktDef::RESPONSE);
+                status.CalcCRC();
+                PktDef ack;
+                ack.SetCmd(PktDef::RESPONSE);
+                ack.SetAck(true);
+                ack.CalcCRC();
+                int first = PktFramer::Frame(status.GenPacket(), status.GetLength(), buffer, sizeof(buffer));
+                int second = PktFramer::Frame(ack.GenPacket(), ack.GetLength(), buffer + first, sizeof(buffer) - first);
+                // The status reply and the start of the ACK in one segment, the rest later.
+                robot.SendData(buffer, first + 3);
+                this_thread::sleep_for(chrono::milliseconds(30));
+                robot.SendData(buffer + first + 3, second - 3);
+            });
+            bool alive = ConnectionPool::PingProbe(1000, true)(client);
+            replier.join();
+            Assert::IsTrue(alive);
+        }
+    };
+}
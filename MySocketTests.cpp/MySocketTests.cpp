@@ -2,7 +2,14 @@
 #include "CppUnitTest.h"
 #include "MySocket.h"   
 #include "MySocket.cpp"
+#include "NetPlatform.cpp"
+#include "NetMetrics.cpp"
+#include "PacketCapture.cpp"
+#include "BufferPool.cpp"
 #include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -89,5 +96,213 @@ namespace MySocketTests
             socket.SetType(SERVER);
             Assert::AreEqual(SERVER, socket.GetType());
         }
+
+        // Test that GetData with an explicit capacity receives straight into the caller's buffer.
+        TEST_METHOD(GetDataWithCapacityTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27100, UDP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27100, UDP, 1024);
+            const char msg[] = "status";
+            client.SendData(msg, sizeof(msg));
+
+            char dest[64] = { 0 };
+            int received = server.GetData(dest, sizeof(dest));
+            Assert::AreEqual(static_cast<int>(sizeof(msg)), received);
+            Assert::AreEqual(0, memcmp(dest, msg, sizeof(msg)));
+
+            // A datagram larger than capacity is cut short, not an error, and
+            // its tail does not leak into the next read.
+            const char longMsg[] = "battery voltage report";
+            client.SendData(longMsg, sizeof(longMsg));
+            client.SendData(msg, sizeof(msg));
+            char small[8] = { 0 };
+            Assert::AreEqual(static_cast<int>(sizeof(small)), server.GetData(small, sizeof(small)));
+            Assert::AreEqual(0, memcmp(small, longMsg, sizeof(small)));
+            Assert::AreEqual(static_cast<int>(sizeof(msg)), server.GetData(dest, sizeof(dest)));
+        }
+
+        // Test that a borrowed view exposes the received bytes and can be released back to the pool.
+        TEST_METHOD(BorrowAndReleaseDataTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27101, UDP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27101, UDP, 1024);
+            const char msg[] = "telemetry";
+            client.SendData(msg, sizeof(msg));
+
+            RecvView view = server.BorrowData();
+            Assert::AreEqual(static_cast<int>(sizeof(msg)), view.Length);
+            Assert::AreEqual(0, memcmp(view.Data, msg, sizeof(msg)));
+            server.ReleaseData(view);
+            Assert::AreEqual(-1, view.Slot);
+
+            // Releasing the same view twice is an error.
+            Assert::ExpectException<runtime_error>([&]() { server.ReleaseData(view); });
+        }
+
+        // Test that destroying one socket does not tear down networking for the others.
+        TEST_METHOD(SharedNetworkInitTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27102, UDP, 1024);
+            {
+                MySocket shortLived(CLIENT, "127.0.0.1", 27102, UDP, 1024);
+            }
+            MySocket client(CLIENT, "127.0.0.1", 27102, UDP, 1024);
+            const char msg[] = "ping";
+            client.SendData(msg, sizeof(msg));
+
+            char dest[16];
+            Assert::AreEqual(static_cast<int>(sizeof(msg)), server.GetData(dest, sizeof(dest)));
+        }
+
+        // Test that a batch of datagrams is sent and received with source addresses.
+        TEST_METHOD(UdpBatchTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27103, UDP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27103, UDP, 1024);
+
+            PktDef packets[3];
+            vector<pair<PktDef*, sockaddr_in>> batch;
+            for (int i = 0; i < 3; ++i) {
+                packets[i].SetPktCount(100 + i);
+                packets[i].SetCmd(PktDef::SLEEP);
+                packets[i].CalcCRC();
+                batch.push_back(make_pair(&packets[i], MySocket::MakeAddress("127.0.0.1", 27103)));
+            }
+            Assert::AreEqual(3, client.SendPacketBatch(batch));
+
+            char buffers[4][64];
+            UdpDatagram received[4];
+            for (int i = 0; i < 4; ++i) {
+                received[i].Data = buffers[i];
+                received[i].Capacity = sizeof(buffers[i]);
+            }
+            int total = 0;
+            while (total < 3)
+                total += server.GetDataBatch(received + total, 4 - total);
+            Assert::AreEqual(3, total);
+            for (int i = 0; i < 3; ++i) {
+                PktDef pkt(received[i].Data, received[i].Length);
+                Assert::AreEqual(100 + i, pkt.GetPktCount());
+                char source[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &received[i].Addr.sin_addr, source, sizeof(source));
+                Assert::AreEqual(string("127.0.0.1"), string(source));
+            }
+        }
+
+        // Test that socket counters track traffic and show up in the Prometheus dump.
+        TEST_METHOD(SocketCountersTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27104, UDP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27104, UDP, 1024);
+            const char msg[] = "counted";
+            client.SendData(msg, sizeof(msg));
+            client.SendData(msg, sizeof(msg));
+            char dest[64];
+            server.GetData(dest, sizeof(dest));
+
+            SocketCounters& out = client.GetCounters();
+            SocketCounters& in = server.GetCounters();
+#ifdef ROBOTNET_METRICS
+            Assert::AreEqual(2ULL, out.PacketsOut.load());
+            Assert::AreEqual(2ULL * sizeof(msg), out.BytesOut.load());
+            Assert::AreEqual(2ULL, out.Syscalls.load());
+            Assert::AreEqual(1ULL, in.PacketsIn.load());
+            Assert::AreEqual(static_cast<unsigned long long>(sizeof(msg)), in.BytesIn.load());
+
+            string dump = MetricsRegistry::Instance().RenderPrometheus();
+            string line = "robotnet_socket_packets_out_total{socket=\"" + client.GetMetricsLabel() + "\"} 2";
+            Assert::IsTrue(dump.find(line) != string::npos);
+#else
+            Assert::AreEqual(0ULL, out.PacketsOut.load());
+            Assert::AreEqual(0ULL, in.PacketsIn.load());
+#endif
+        }
+
+        // Test that send stamps are taken when the socket accepts the data, not
+        // when the packet is serialized.
+        TEST_METHOD(SendTraceTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27108, UDP, 1024);
+            MySocket client(CLIENT, "127.0.0.1", 27108, UDP, 1024);
+            PktDef pkt;
+            pkt.SetCmd(PktDef::SLEEP);
+            pkt.CalcCRC();
+            vector<pair<PktDef*, sockaddr_in>> batch(1, make_pair(&pkt, MySocket::MakeAddress("127.0.0.1", 27108)));
+
+            SetPacketTracing(true);
+            pkt.GenPacket();
+            Assert::AreEqual(0LL, pkt.GetTrace().SendNs);
+            long long before = MetricsNowNs();
+            client.SendData(pkt.GenPacket(), pkt.GetLength());
+            long long dataNs = client.GetLastSendNs();
+            Assert::AreEqual(1, client.SendPacketBatch(batch));
+            SetPacketTracing(false);
+#ifdef ROBOTNET_METRICS
+            Assert::IsTrue(dataNs >= before);
+            Assert::IsTrue(pkt.GetTrace().SendNs >= dataNs);
+            Assert::AreEqual(client.GetLastSendNs(), pkt.GetTrace().SendNs);
+#else
+            Assert::AreEqual(0LL, dataNs);
+            Assert::AreEqual(0LL, pkt.GetTrace().SendNs);
+#endif
+        }
+
+        // Test that a TCP client can connect again after a disconnect or a refused attempt.
+        TEST_METHOD(ReconnectTCPTest)
+        {
+            MySocket client(CLIENT, "127.0.0.1", 27105, TCP, 1024);
+            Assert::ExpectException<runtime_error>([&]() { client.ConnectTCP(); });
+            Assert::IsFalse(client.IsConnected());
+
+            MySocket server(SERVER, "127.0.0.1", 27105, TCP, 1024);
+            char buffer[16];
+            for (int round = 0; round < 2; ++round) {
+                if (round == 0)
+                    client.ConnectTCP();
+                else
+                    client.ConnectTCP(1000);
+                server.ConnectTCP();
+                Assert::IsTrue(client.IsConnected());
+                Assert::IsFalse(client.PeerClosed());
+                client.SendData("hi", 2);
+                Assert::AreEqual(2, server.GetData(buffer, sizeof(buffer)));
+                server.SendData("ok", 2);
+                Assert::IsTrue(client.WaitForData(1000));
+                Assert::IsFalse(client.PeerClosed(), L"Unread data is not a close");
+                Assert::AreEqual(2, client.GetData(buffer, sizeof(buffer)));
+                server.DisconnectTCP();
+                for (int i = 0; i < 100 && !client.PeerClosed(); ++i)
+                    this_thread::sleep_for(chrono::milliseconds(5));
+                Assert::IsTrue(client.PeerClosed());
+                client.DisconnectTCP();
+            }
+        }
+
+        // Test that receive, accept and send deadlines end in SocketTimeout, on time, and leave the socket usable.
+        TEST_METHOD(TimeoutTest)
+        {
+            char buffer[64];
+            MySocket udp(SERVER, "127.0.0.1", 27106, UDP, 1024);
+            udp.SetTimeouts(-1, -1, 50);
+            auto start = chrono::steady_clock::now();
+            Assert::ExpectException<SocketTimeout>([&]() { udp.GetData(buffer, sizeof(buffer)); });
+            long long waited = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+            Assert::IsTrue(waited >= 45 && waited < 1000);
+            Assert::ExpectException<SocketTimeout>([&]() { udp.BorrowData(); });
+            Assert::AreEqual(2ULL, static_cast<unsigned long long>(udp.GetCounters().Timeouts.load()));
+
+            MySocket server(SERVER, "127.0.0.1", 27107, TCP, 1024);
+            Assert::ExpectException<SocketTimeout>([&]() { server.ConnectTCP(30); });
+            MySocket client(CLIENT, "127.0.0.1", 27107, TCP, 1024);
+            client.ConnectTCP(1000);
+            server.ConnectTCP(1000);
+            Assert::ExpectException<SocketTimeout>([&]() { client.GetData(buffer, sizeof(buffer), 30); });
+            server.SendData("late", 4);
+            Assert::AreEqual(4, client.GetData(buffer, sizeof(buffer), 1000));
+
+            // The server never reads, so the socket buffers fill and the send runs out of time.
+            vector<char> bulk(64 << 20, 'x');
+            Assert::ExpectException<SocketTimeout>([&]() { client.SendData(bulk.data(), static_cast<int>(bulk.size()), 100); });
+        }
     };
-}
\ No newline at end of file
+}
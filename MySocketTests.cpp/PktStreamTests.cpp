@@ -0,0 +1,192 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "PktStream.cpp"
+#include "PktStream.h"
+#include "WireFormat.h"
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    static FILE* OpenTempFile()
+    {
+        FILE* file = nullptr;
+#ifdef _MSC_VER
+        tmpfile_s(&file);
+#else
+        file = tmpfile();
+#endif
+        Assert::IsNotNull(file);
+        return file;
+    }
+
+    static vector<char> PatternBody(int size)
+    {
+        vector<char> body(size);
+        for (int i = 0; i < size; ++i)
+            body[i] = static_cast<char>(i * 7 + (i >> 11));
+        return body;
+    }
+
+    TEST_CLASS(PktStreamTests)
+    {
+    public:
+        // Test that a megabyte body sent in uneven slices and a gather arrives
+        // intact through odd-sized reads, that an empty body and a legacy XOR
+        // packet follow it, and that a clean close ends the stream.
+        TEST_METHOD(MemoryRoundTripTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27195, TCP, DEFAULT_SIZE);
+            MySocket client(CLIENT, "127.0.0.1", 27195, TCP, DEFAULT_SIZE);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+            server.SetTimeouts(-1, -1, 5000);
+
+            const int size = 1 << 20;
+            vector<char> body = PatternBody(size);
+            thread writer([&]() {
+                PktStreamWriter stream(client);
+                PktDef header;
+                header.SetCmd(PktDef::RESPONSE);
+                header.SetCrcType(CRC_32C);
+                header.SetPktCount(41);
+                stream.Begin(header, size);
+                stream.Write(body.data(), 1000);
+                IoSlice slices[3] = { { body.data() + 1000, 3 }, { body.data() + 1003, 0 }, { body.data() + 1003, 70000 } };
+                stream.Write(slices, 3);
+                stream.Write(body.data() + 71003, size - 71003);
+                stream.End();
+
+                header.SetCmd(PktDef::SLEEP);
+                stream.Begin(header, 0);
+                stream.End();
+                header.SetCrcType(CRC_XOR);
+                stream.Begin(header, 5);
+                stream.Write("hello", 5);
+                stream.End();
+                client.DisconnectTCP();
+            });
+
+            PktStreamReader reader(server);
+            Assert::IsTrue(reader.Begin());
+            Assert::IsTrue(reader.GetHeader().GetCmd() == PktDef::RESPONSE);
+            Assert::AreEqual(41, reader.GetHeader().GetPktCount());
+            Assert::AreEqual(static_cast<long long>(size), reader.GetBodyLength());
+            vector<char> received;
+            char chunk[777];
+            int n;
+            while ((n = reader.Read(chunk, sizeof(chunk))) > 0)
+                received.insert(received.end(), chunk, chunk + n);
+            Assert::IsTrue(reader.End(), L"CRC-32C matches");
+            Assert::IsTrue(received == body);
+
+            Assert::IsTrue(reader.Begin());
+            Assert::IsTrue(reader.GetHeader().GetCmd() == PktDef::SLEEP);
+            Assert::AreEqual(0, reader.Read(chunk, sizeof(chunk)));
+            Assert::IsTrue(reader.End());
+
+            Assert::IsTrue(reader.Begin());
+            Assert::IsTrue(reader.GetHeader().GetCrcType() == CRC_XOR);
+            Assert::AreEqual(5, reader.Read(chunk, sizeof(chunk)));
+            Assert::IsTrue(reader.End());
+            Assert::IsFalse(reader.Begin(), L"Clean close ends the stream");
+            writer.join();
+        }
+
+        // Test that after the prefix the stream is byte for byte the packet
+        // PktDef would build, that a damaged body fails the check, and that
+        // misuse of the writer throws.
+        TEST_METHOD(WireFormatTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27196, TCP, DEFAULT_SIZE);
+            MySocket client(CLIENT, "127.0.0.1", 27196, TCP, DEFAULT_SIZE);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+            server.SetTimeouts(-1, -1, 5000);
+
+            vector<char> body = PatternBody(100);
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            pkt.SetCrcType(CRC_16);
+            pkt.SetAck(true);
+            pkt.SetPktCount(7);
+            pkt.SetBodyData(body.data(), 100);
+            pkt.CalcCRC();
+
+            PktStreamWriter stream(client);
+            stream.Begin(pkt, 100);
+            stream.Write(body.data(), 60);
+            stream.Write(body.data() + 60, 40);
+            stream.End();
+
+            int length = pkt.GetLength();
+            vector<char> wire(PktStreamWriter::PREFIXSIZE + length);
+            int got = 0;
+            while (got < static_cast<int>(wire.size()))
+                got += server.GetData(wire.data() + got, static_cast<int>(wire.size()) - got);
+            Assert::AreEqual(static_cast<unsigned int>(length), static_cast<unsigned int>(WireFormat::Load32(wire.data())));
+            Assert::AreEqual(0, memcmp(wire.data() + PktStreamWriter::PREFIXSIZE, pkt.GenPacket(), length));
+
+            // Resend with one body byte flipped and the original trailer.
+            wire[PktStreamWriter::PREFIXSIZE + PktDef::HEADERSIZE + 50] ^= 0x10;
+            client.SendData(wire.data(), static_cast<int>(wire.size()));
+            PktStreamReader reader(server);
+            Assert::IsTrue(reader.Begin());
+            Assert::IsTrue(reader.GetHeader().GetAck());
+            char chunk[128];
+            while (reader.Read(chunk, sizeof(chunk)) > 0) {
+            }
+            Assert::IsFalse(reader.End(), L"Damaged body fails the CRC");
+
+            stream.Begin(pkt, 10);
+            Assert::ExpectException<runtime_error>([&]() { stream.Write(body.data(), 11); });
+            Assert::ExpectException<runtime_error>([&]() { stream.End(); });
+            Assert::ExpectException<runtime_error>([&]() { stream.Begin(pkt, 10); });
+        }
+
+        // Test that a body streamed from one file lands in another unchanged,
+        // moving it through fixed-size chunks.
+        TEST_METHOD(FileRoundTripTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27197, TCP, DEFAULT_SIZE);
+            MySocket client(CLIENT, "127.0.0.1", 27197, TCP, DEFAULT_SIZE);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+            server.SetTimeouts(-1, -1, 5000);
+
+            const int size = 300000;
+            vector<char> body = PatternBody(size);
+            FILE* source = OpenTempFile();
+            fwrite(body.data(), 1, size, source);
+            rewind(source);
+
+            thread writer([&]() {
+                PktStreamWriter stream(client, 4096);
+                PktDef header;
+                header.SetCmd(PktDef::RESPONSE);
+                header.SetCrcType(CRC_8);
+                stream.Begin(header, size);
+                stream.WriteFile(source, size);
+                stream.End();
+            });
+
+            FILE* target = OpenTempFile();
+            PktStreamReader reader(server, 5000);
+            Assert::IsTrue(reader.Begin());
+            Assert::AreEqual(static_cast<long long>(size), reader.ReadFile(target));
+            Assert::IsTrue(reader.End());
+            writer.join();
+
+            rewind(target);
+            vector<char> copy(size + 1);
+            Assert::AreEqual(static_cast<size_t>(size), fread(copy.data(), 1, copy.size(), target));
+            copy.resize(size);
+            Assert::IsTrue(copy == body);
+            fclose(source);
+            fclose(target);
+        }
+    };
+}
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Commands.h"
+#include "PktFramer.h"
+#include "PrioritySender.cpp"
+#include "PrioritySender.h"
+#include "WireFormat.h"
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    // Read framed packets through a ChunkAssembler until count whole packets have arrived.
+    static vector<PktDef> ReadAssembled(MySocket& sock, ChunkAssembler& assembler, int count)
+    {
+        PktFramer framer(1 << 18, PktFramer::MAX_FRAME);
+        vector<PktDef> packets;
+        vector<char> buffer(65536);
+        vector<char> frame(PktFramer::MAX_FRAME);
+        while (static_cast<int>(packets.size()) < count) {
+            int n;
+            while ((n = framer.NextFrame(frame.data(), static_cast<int>(frame.size()))) > 0) {
+                PktDef pkt(frame.data(), n);
+                if (assembler.Receive(pkt))
+                    packets.push_back(pkt);
+            }
+            if (static_cast<int>(packets.size()) >= count)
+                break;
+            if (!sock.WaitForData(5000))
+                break;
+            int got = sock.GetData(buffer.data(), static_cast<int>(buffer.size()));
+            if (got <= 0)
+                break;
+            framer.Feed(buffer.data(), got);
+        }
+        return packets;
+    }
+
+    static PktDef MakeLanePacket(int count, int bodySize)
+    {
+        PktDef pkt;
+        vector<char> body(bodySize);
+        for (int i = 0; i < bodySize; ++i)
+            body[i] = static_cast<char>(count + i);
+        pkt.SetCmd(PktDef::RESPONSE);
+        pkt.SetCrcType(CRC_16);
+        pkt.SetPktCount(count);
+        pkt.SetBodyData(body.data(), bodySize);
+        pkt.CalcCRC();
+        return pkt;
+    }
+
+    TEST_CLASS(PrioritySenderTests)
+    {
+    public:
+        // Test that a packet larger than the chunk size is cut into CMD_CHUNK
+        // packets and put back together byte for byte by the ChunkAssembler.
+        TEST_METHOD(ChunkRoundTripTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27180, TCP, 65536);
+            MySocket client(CLIENT, "127.0.0.1", 27180, TCP, 65536);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            PrioritySender sender(client, POLICY_STRICT, 1024);
+
+            PktDef big = MakeLanePacket(7, 5000);
+            PktDef small = MakeLanePacket(8, 100);
+            Assert::IsTrue(sender.Enqueue(big, LANE_BULK));
+            Assert::IsTrue(sender.Enqueue(small, LANE_TELEMETRY));
+            sender.Start();
+            Assert::IsTrue(sender.Flush(5000));
+
+            ChunkAssembler assembler;
+            vector<PktDef> received = ReadAssembled(server, assembler, 2);
+            Assert::AreEqual(2, static_cast<int>(received.size()));
+            Assert::AreEqual(8, received[0].GetPktCount(), L"Strict policy sends TELEMETRY first");
+            Assert::AreEqual(7, received[1].GetPktCount());
+            Assert::AreEqual(big.GetLength(), received[1].GetLength());
+            Assert::AreEqual(0, memcmp(big.GetBodyData(), received[1].GetBodyData(), 5000));
+            Assert::IsTrue(received[1].GetCrcType() == CRC_16);
+            Assert::AreEqual(5LL, sender.GetChunks());
+            Assert::AreEqual(1LL, assembler.GetReassembled());
+            Assert::AreEqual(1LL, sender.GetSentPackets(LANE_BULK));
+            Assert::AreEqual(0LL, sender.GetQueuedBytes(LANE_BULK));
+        }
+
+        // Test that a control packet overtakes bulk data: first when both are
+        // queued before the writer starts, then in the middle of a transfer
+        // that has filled the socket buffers.
+        TEST_METHOD(ControlOvertakesBulkTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27181, TCP, 65536);
+            MySocket client(CLIENT, "127.0.0.1", 27181, TCP, 65536);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            PrioritySender sender(client, POLICY_STRICT, 4096);
+            sender.SetLaneLimit(LANE_BULK, 64 << 20);
+
+            const int bulkCount = 200;
+            for (int i = 0; i < bulkCount; ++i) {
+                PktDef bulk = MakeLanePacket(1000 + i, 60000);
+                Assert::IsTrue(sender.Enqueue(bulk, LANE_BULK));
+            }
+            PktDef stop;
+            stop.SetCmd(PktDef::SLEEP);
+            stop.SetPktCount(1);
+            stop.CalcCRC();
+            sender.Enqueue(stop, LANE_CONTROL);
+            sender.Start();
+
+            // Nobody reads yet, so the transfer stalls once the receive buffer
+            // and the send backlog are full, with most bulk still queued.
+            while (sender.GetChunks() < 10)
+                this_thread::sleep_for(chrono::milliseconds(1));
+            this_thread::sleep_for(chrono::milliseconds(50));
+            Assert::IsTrue(sender.GetQueuedPackets(LANE_BULK) > bulkCount / 2);
+            PktDef second;
+            second.SetCmd(PktDef::SLEEP);
+            second.SetPktCount(2);
+            second.CalcCRC();
+            sender.Enqueue(second, LANE_CONTROL);
+
+            ChunkAssembler assembler(1 << 16);
+            vector<PktDef> received = ReadAssembled(server, assembler, bulkCount + 2);
+            Assert::IsTrue(sender.Flush(5000));
+            Assert::AreEqual(bulkCount + 2, static_cast<int>(received.size()));
+            Assert::AreEqual(1, received[0].GetPktCount(), L"Queued control leaves first");
+            int position = -1;
+            for (int i = 0; i < static_cast<int>(received.size()); ++i)
+                if (received[i].GetPktCount() == 2)
+                    position = i;
+            Assert::IsTrue(position > 0 && position < bulkCount / 2, L"Control is not stuck behind the queued bulk");
+            Assert::AreEqual(0LL, assembler.GetDropped());
+            Assert::AreEqual(2ULL, sender.GetLatencyHistogram(LANE_CONTROL).GetCount());
+        }
+
+        // Test that POLICY_WEIGHTED splits the link between TELEMETRY and BULK
+        // by weight while both are busy.
+        TEST_METHOD(WeightedShareTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27182, TCP, 65536);
+            MySocket client(CLIENT, "127.0.0.1", 27182, TCP, 65536);
+            client.ConnectTCP();
+            server.ConnectTCP();
+            PrioritySender sender(client, POLICY_WEIGHTED, 1024);
+            sender.SetWeight(LANE_TELEMETRY, 3);
+
+            for (int i = 0; i < 100; ++i) {
+                PktDef telemetry = MakeLanePacket(i, 1000);
+                PktDef bulk = MakeLanePacket(1000 + i, 1000);
+                sender.Enqueue(telemetry, LANE_TELEMETRY);
+                sender.Enqueue(bulk, LANE_BULK);
+            }
+            sender.Start();
+
+            ChunkAssembler assembler;
+            vector<PktDef> received = ReadAssembled(server, assembler, 200);
+            Assert::IsTrue(sender.Flush(5000));
+            Assert::AreEqual(200, static_cast<int>(received.size()));
+            int telemetry = 0;
+            for (int i = 0; i < 80; ++i)
+                if (received[i].GetPktCount() < 1000)
+                    ++telemetry;
+            Assert::IsTrue(telemetry >= 58 && telemetry <= 62, L"3 : 1 share while both lanes are busy");
+            Assert::AreEqual(0LL, sender.GetChunks());
+        }
+
+        // Test that the assembler drops a stream with a missing chunk and
+        // passes ordinary packets through untouched.
+        TEST_METHOD(AssemblerGapTest)
+        {
+            ChunkAssembler assembler;
+            PktDef plain = MakeLanePacket(3, 10);
+            Assert::IsTrue(assembler.Receive(plain));
+            Assert::AreEqual(3, plain.GetPktCount());
+
+            char body[PrioritySender::CHUNK_HEADER + 4] = { 0 };
+            body[0] = static_cast<char>(CMD_CHUNK);
+            WireFormat::Store16(body + 1, 9);
+            WireFormat::Store32(body + 3, 0);
+            WireFormat::Store32(body + 7, 12);
+            PktDef chunk;
+            chunk.SetCmd(PktDef::EXTENDED);
+            chunk.SetBodyData(body, sizeof(body));
+            chunk.CalcCRC();
+            Assert::IsFalse(assembler.Receive(chunk));
+
+            WireFormat::Store32(body + 3, 8);
+            chunk.SetBodyData(body, sizeof(body));
+            chunk.CalcCRC();
+            Assert::IsFalse(assembler.Receive(chunk), L"Bytes 4-7 never arrived");
+            Assert::AreEqual(1LL, assembler.GetDropped());
+            Assert::AreEqual(0LL, assembler.GetReassembled());
+        }
+    };
+}
@@ -0,0 +1,222 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "ReactorServer.h"
+#include "ReactorServer.cpp"
+#include "EventPoller.cpp"
+#include "PktDef.cpp"
+#include "PktFramer.cpp"
+#include "Checksum.cpp"
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    // Builds a RESPONSE packet carrying a single byte.
+    static int BuildPacket(int count, char value, char* dest, int capacity)
+    {
+        PktDef pkt;
+        pkt.SetPktCount(count);
+        pkt.SetCmd(PktDef::RESPONSE);
+        pkt.SetBodyData(&value, 1);
+        pkt.CalcCRC();
+        return pkt.GenPacket(dest, capacity);
+    }
+
+    // Reads from a TCP client until one framed packet is available.
+    static int ReadFramedPacket(MySocket& client, PktFramer& framer, char* dest, int capacity)
+    {
+        int length = 0;
+        while ((length = framer.NextFrame(dest, capacity)) == 0) {
+            int space = 0;
+            char* ring = framer.WritePtr(space);
+            framer.Commit(client.GetData(ring, space));
+        }
+        return length;
+    }
+
+    TEST_CLASS(ReactorServerTests)
+    {
+    public:
+        // Test that several TCP clients are served concurrently and get their own replies.
+        TEST_METHOD(TcpEchoManyClientsTest)
+        {
+            ReactorServer server("127.0.0.1", 27110, TCP, 2);
+            server.OnPacket([](ReactorSession& session, PktDef& pkt) {
+                // Echo the packet back with its count incremented.
+                pkt.SetPktCount(pkt.GetPktCount() + 1);
+                pkt.CalcCRC();
+                session.Send(pkt);
+            });
+            server.Start();
+
+            const int CLIENTS = 8;
+            unique_ptr<MySocket> clients[CLIENTS];
+            for (int i = 0; i < CLIENTS; ++i) {
+                clients[i].reset(new MySocket(CLIENT, "127.0.0.1", 27110, TCP, 1024));
+                clients[i]->ConnectTCP();
+            }
+
+            // Two packets coalesced into one send from every client.
+            for (int i = 0; i < CLIENTS; ++i) {
+                char raw[32];
+                char wire[64];
+                int len = BuildPacket(i * 10, static_cast<char>(i), raw, sizeof(raw));
+                int wireLen = PktFramer::Frame(raw, len, wire, sizeof(wire));
+                len = BuildPacket(i * 10 + 5, static_cast<char>(i), raw, sizeof(raw));
+                wireLen += PktFramer::Frame(raw, len, wire + wireLen, sizeof(wire) - wireLen);
+                clients[i]->SendData(wire, wireLen);
+            }
+
+            for (int i = 0; i < CLIENTS; ++i) {
+                PktFramer framer(256, 0);
+                char out[64];
+                int len = ReadFramedPacket(*clients[i], framer, out, sizeof(out));
+                PktDef first(out, len);
+                Assert::AreEqual(i * 10 + 1, first.GetPktCount());
+                len = ReadFramedPacket(*clients[i], framer, out, sizeof(out));
+                PktDef second(out, len);
+                Assert::AreEqual(i * 10 + 6, second.GetPktCount());
+                Assert::AreEqual(static_cast<int>(i), static_cast<int>(second.GetBodyData()[0]));
+            }
+            Assert::AreEqual(CLIENTS, server.GetSessionCount());
+            server.Stop();
+            Assert::AreEqual(0, server.GetSessionCount());
+        }
+
+        // Test that UDP peers get separate sessions and corrupt or truncated datagrams are dropped.
+        TEST_METHOD(UdpSessionsTest)
+        {
+            ReactorServer server("127.0.0.1", 27111, UDP, 1);
+            server.OnPacket([](ReactorSession& session, PktDef& pkt) {
+                session.Send(pkt);
+            });
+            server.Start();
+
+            MySocket a(CLIENT, "127.0.0.1", 27111, UDP, 1024);
+            MySocket b(CLIENT, "127.0.0.1", 27111, UDP, 1024);
+            char raw[32];
+            int len = BuildPacket(3, 'x', raw, sizeof(raw));
+
+            char corrupt[32];
+            memcpy(corrupt, raw, len);
+            corrupt[PktDef::HEADERSIZE] ^= 0x40;
+            a.SendData(corrupt, len);
+            a.SendData(raw, 3);     // Too short to hold a header.
+            a.SendData(raw, len);
+            b.SendData(raw, len);
+
+            char out[64];
+            Assert::AreEqual(len, a.GetData(out, sizeof(out)));
+            Assert::AreEqual(len, b.GetData(out, sizeof(out)));
+            Assert::AreEqual(2, server.GetSessionCount());
+            Assert::AreEqual(2LL, server.GetCrcErrors());
+#ifdef ROBOTNET_METRICS
+            Assert::AreEqual(2ULL, server.GetCounters().CrcFailures.load());
+            Assert::AreEqual(2ULL, server.GetCounters().PacketsIn.load());
+#endif
+        }
+
+        // Test that the UDP session table is capped, that new peers are
+        // turned away while it is full of active ones, and that idle
+        // sessions are released and make room again.
+        TEST_METHOD(UdpSessionLimitTest)
+        {
+            ReactorServer server("127.0.0.1", 27113, UDP, 1);
+            atomic<int> disconnects(0);
+            server.OnPacket([](ReactorSession& session, PktDef& pkt) {
+                session.Send(pkt);
+            });
+            server.OnDisconnect([&](ReactorSession&) { ++disconnects; });
+            server.SetUdpLimits(500, 3);
+            server.Start();
+
+            char raw[32];
+            int len = BuildPacket(1, 'x', raw, sizeof(raw));
+            char out[64];
+            vector<unique_ptr<MySocket>> peers;
+            for (int i = 0; i < 5; ++i) {
+                peers.emplace_back(new MySocket(CLIENT, "127.0.0.1", 27113, UDP, 1024));
+                peers.back()->SendData(raw, len);
+            }
+            for (int i = 0; i < 3; ++i)
+                Assert::AreEqual(len, peers[i]->GetData(out, sizeof(out), 1000));
+            Assert::ExpectException<SocketTimeout>([&]() { peers[3]->GetData(out, sizeof(out), 100); });
+            Assert::AreEqual(3, server.GetSessionCount());
+            Assert::AreEqual(2LL, server.GetRejectedPeers());
+
+            for (int i = 0; i < 200 && server.GetSessionCount() > 0; ++i)
+                this_thread::sleep_for(chrono::milliseconds(10));
+            Assert::AreEqual(0, server.GetSessionCount(), L"Idle sessions are released");
+            Assert::AreEqual(3, disconnects.load());
+
+            peers[4]->SendData(raw, len);
+            Assert::AreEqual(len, peers[4]->GetData(out, sizeof(out), 1000));
+            Assert::AreEqual(1, server.GetSessionCount());
+        }
+
+        // Test that a client disconnect releases its session.
+        TEST_METHOD(DisconnectTest)
+        {
+            ReactorServer server("127.0.0.1", 27112, TCP, 1);
+            atomic<int> disconnects(0);
+            server.OnDisconnect([&](ReactorSession&) { ++disconnects; });
+            server.Start();
+            {
+                MySocket client(CLIENT, "127.0.0.1", 27112, TCP, 1024);
+                client.ConnectTCP();
+                client.DisconnectTCP();
+            }
+            for (int i = 0; i < 100 && disconnects.load() == 0; ++i)
+                this_thread::sleep_for(chrono::milliseconds(10));
+            Assert::AreEqual(1, disconnects.load());
+            Assert::AreEqual(0, server.GetSessionCount());
+        }
+
+        // Test that a robot with a backlog of data does not keep the worker
+        // from reading another robot's packet until the backlog is drained.
+        TEST_METHOD(ReadFairnessTest)
+        {
+            ReactorServer server("127.0.0.1", 27114, TCP, 1);
+            const int BURST = 20000;
+            atomic<int> fromA(0);
+            atomic<int> fromABeforeB(-1);
+            server.OnPacket([&](ReactorSession&, PktDef& pkt) {
+                if (pkt.GetBodyData()[0] == 'a')
+                    ++fromA;
+                else
+                    fromABeforeB.store(fromA.load());
+            });
+
+            // Both robots are connected and have sent before the worker starts.
+            MySocket a(CLIENT, "127.0.0.1", 27114, TCP, 1024);
+            a.ConnectTCP();
+            vector<char> wire;
+            for (int i = 0; i < BURST; ++i) {
+                char raw[32];
+                char framed[64];
+                int len = BuildPacket(i, 'a', raw, sizeof(raw));
+                int framedLen = PktFramer::Frame(raw, len, framed, sizeof(framed));
+                wire.insert(wire.end(), framed, framed + framedLen);
+            }
+            a.SendData(wire.data(), static_cast<int>(wire.size()));
+            MySocket b(CLIENT, "127.0.0.1", 27114, TCP, 1024);
+            b.ConnectTCP();
+            char raw[32];
+            char framed[64];
+            int len = BuildPacket(0, 'b', raw, sizeof(raw));
+            b.SendData(framed, PktFramer::Frame(raw, len, framed, sizeof(framed)));
+            this_thread::sleep_for(chrono::milliseconds(50));
+
+            server.Start();
+            for (int i = 0; i < 500 && (fromA.load() < BURST || fromABeforeB.load() < 0); ++i)
+                this_thread::sleep_for(chrono::milliseconds(10));
+            Assert::AreEqual(BURST, fromA.load());
+            Assert::IsTrue(fromABeforeB.load() >= 0);
+            Assert::IsTrue(fromABeforeB.load() < BURST);
+            server.Stop();
+        }
+    };
+}
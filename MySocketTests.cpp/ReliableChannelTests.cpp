@@ -0,0 +1,184 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "ReliableChannel.h"
+#include "ReliableChannel.cpp"
+#include <set>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    TEST_CLASS(ReliableChannelTests)
+    {
+    public:
+        // Test delivery of a stream that crosses the 16-bit PktCount wraparound.
+        TEST_METHOD(WraparoundDeliveryTest)
+        {
+            MySocket serverSock(SERVER, "127.0.0.1", 27120, UDP, 1024);
+            MySocket clientSock(CLIENT, "127.0.0.1", 27120, UDP, 1024);
+            ReliableChannel client(clientSock, 8, 65530);
+            ReliableChannel server(serverSock, 8, 65530);
+
+            set<int> seen;
+            int sent = 0;
+            while (sent < 20) {
+                PktDef pkt;
+                pkt.SetCmd(PktDef::DRIVE);
+                while (sent < 20 && client.Send(pkt))
+                    ++sent;
+                PktDef received;
+                while (server.Receive(received, 20))
+                    seen.insert(received.GetPktCount());
+                Assert::IsTrue(client.Flush(500), L"Window did not drain");
+            }
+            Assert::AreEqual(20, static_cast<int>(seen.size()));
+            Assert::IsTrue(seen.count(65535) == 1 && seen.count(0) == 1 && seen.count(13) == 1);
+            Assert::AreEqual(0LL, client.GetRetransmits());
+        }
+
+        // Test that an unacknowledged packet is retransmitted and then cleared by an ACK.
+        TEST_METHOD(RetransmitUntilAckedTest)
+        {
+            MySocket robot(SERVER, "127.0.0.1", 27121, UDP, 1024);
+            MySocket clientSock(CLIENT, "127.0.0.1", 27121, UDP, 1024);
+            ReliableChannel client(clientSock, 4);
+            client.SetRtoLimits(5, 50);
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            Assert::IsTrue(client.Send(pkt));
+
+            // The "robot" drops the first copy and waits for the retransmission.
+            char raw[64];
+            int n = robot.GetData(raw, sizeof(raw));
+            PktDef first(raw, n);
+            PktDef idle;
+            Assert::IsFalse(client.Receive(idle, 300));
+            Assert::IsTrue(client.GetRetransmits() >= 1);
+            n = robot.GetData(raw, sizeof(raw));
+            PktDef second(raw, n);
+            Assert::AreEqual(first.GetPktCount(), second.GetPktCount());
+
+            // Acknowledge it by hand: next expected = seq + 1, empty bitmap.
+            PktDef ack;
+            ack.SetAck(true);
+            ack.SetPktCount(second.GetPktCount());
+            char body[ReliableChannel::ACK_BODY_SIZE] = { 1, 0, 0, 0, 0, 0 };
+            ack.SetBodyData(body, sizeof(body));
+            ack.CalcCRC();
+            robot.SendData(ack.GenPacket(), ack.GetLength());
+
+            Assert::IsTrue(client.Flush(500));
+            Assert::AreEqual(0, client.GetInFlight());
+        }
+
+        // Test that a data packet arriving while Flush() waits for an ACK is
+        // acknowledged and then returned by the next Receive().
+        TEST_METHOD(FlushKeepsDataTest)
+        {
+            MySocket robot(SERVER, "127.0.0.1", 27124, UDP, 1024);
+            MySocket clientSock(CLIENT, "127.0.0.1", 27124, UDP, 1024);
+            ReliableChannel client(clientSock, 4);
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            Assert::IsTrue(client.Send(pkt));
+            char raw[64];
+            int n = robot.GetData(raw, sizeof(raw));
+            PktDef sent(raw, n);
+
+            // The robot sends a reading of its own ahead of the ACK.
+            PktDef data;
+            data.SetCmd(PktDef::RESPONSE);
+            data.SetPktCount(0);
+            char reading[] = { 42 };
+            data.SetBodyData(reading, sizeof(reading));
+            data.CalcCRC();
+            robot.SendData(data.GenPacket(), data.GetLength());
+            PktDef ack;
+            ack.SetAck(true);
+            ack.SetPktCount(sent.GetPktCount());
+            char body[ReliableChannel::ACK_BODY_SIZE] = { 1, 0, 0, 0, 0, 0 };
+            ack.SetBodyData(body, sizeof(body));
+            ack.CalcCRC();
+            robot.SendData(ack.GenPacket(), ack.GetLength());
+
+            Assert::IsTrue(client.Flush(500));
+            n = robot.GetData(raw, sizeof(raw));
+            PktDef dataAck(raw, n);
+            Assert::IsTrue(dataAck.GetAck());
+
+            PktDef received;
+            Assert::IsTrue(client.Receive(received, 0));
+            Assert::IsTrue(received.GetCmd() == PktDef::RESPONSE);
+            Assert::AreEqual(42, static_cast<int>(received.GetBodyData()[0]));
+            Assert::IsFalse(client.Receive(received, 20));
+        }
+
+        // Test that a retransmitted copy of a delivered packet is not delivered twice.
+        TEST_METHOD(DuplicateSuppressionTest)
+        {
+            MySocket serverSock(SERVER, "127.0.0.1", 27122, UDP, 1024);
+            MySocket sender(CLIENT, "127.0.0.1", 27122, UDP, 1024);
+            ReliableChannel server(serverSock, 4);
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::SLEEP);
+            pkt.SetPktCount(0);
+            pkt.CalcCRC();
+            sender.SendData(pkt.GenPacket(), pkt.GetLength());
+            sender.SendData(pkt.GenPacket(), pkt.GetLength());
+
+            PktDef received;
+            Assert::IsTrue(server.Receive(received, 500));
+            Assert::IsTrue(received.GetCmd() == PktDef::SLEEP);
+            Assert::IsFalse(server.Receive(received, 50));
+            Assert::AreEqual(1LL, server.GetDuplicates());
+
+            // Both copies were acknowledged.
+            char raw[64];
+            for (int i = 0; i < 2; ++i) {
+                int n = sender.GetData(raw, sizeof(raw));
+                PktDef ack(raw, n);
+                Assert::IsTrue(ack.GetAck());
+                Assert::AreEqual(0, ack.GetPktCount());
+            }
+        }
+
+        // Test that a packet abandoned after MaxRetries does not stall the
+        // receiver once more than RECV_WINDOW packets have followed it.
+        TEST_METHOD(AbandonedGapTest)
+        {
+            MySocket serverSock(SERVER, "127.0.0.1", 27123, UDP, 1024);
+            MySocket clientSock(CLIENT, "127.0.0.1", 27123, UDP, 1024);
+            ReliableChannel client(clientSock, 64);
+            ReliableChannel server(serverSock, 64);
+            client.SetRtoLimits(5, 50);
+            client.SetMaxRetries(0);
+
+            // Lose packet 0 by reading it off the server socket before the channel does.
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            Assert::IsTrue(client.Send(pkt));
+            char raw[64];
+            serverSock.GetData(raw, sizeof(raw));
+            Assert::IsTrue(client.Flush(500));
+            Assert::AreEqual(1LL, client.GetFailures());
+            client.SetMaxRetries(10);
+
+            const int total = ReliableChannel::RECV_WINDOW + 100;
+            int sent = 0;
+            int delivered = 0;
+            while (sent < total) {
+                while (sent < total && client.Send(pkt))
+                    ++sent;
+                PktDef received;
+                while (server.Receive(received, 20))
+                    ++delivered;
+                Assert::IsTrue(client.Flush(500), L"Window did not drain");
+            }
+            Assert::AreEqual(total, delivered);
+            Assert::AreEqual(1LL, client.GetFailures());
+        }
+    };
+}
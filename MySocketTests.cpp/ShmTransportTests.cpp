@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "MySocket.h"
+#include "ShmTransport.cpp"
+#include "ShmTransport.h"
+#include <string>
+#include <thread>
+#ifdef __linux__
+#include <sys/wait.h>
+#endif
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    TEST_CLASS(ShmTransportTests)
+    {
+    public:
+        // Test that packets cross a shared-memory link both ways with their
+        // boundaries intact, exactly as over TCP.
+        TEST_METHOD(RoundTripTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27160, SHM, 256);
+            MySocket client(CLIENT, "127.0.0.1", 27160, SHM, 256);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+            Assert::IsTrue(server.IsConnected() && client.IsConnected());
+
+            PktDef pkt;
+            PktDef::DriveBody body = { PktDef::FORWARD, 5, 90 };
+            pkt.SetCmd(PktDef::DRIVE);
+            pkt.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+            pkt.SetPktCount(7);
+            pkt.CalcCRC();
+            client.SendData(pkt.GenPacket(), pkt.GetLength());
+            client.SendData("ab", 2);
+
+            char buffer[256];
+            int n = server.GetData(buffer, sizeof(buffer), 1000);
+            Assert::AreEqual(pkt.GetLength(), n);
+            PktDef received(buffer, n);
+            Assert::IsTrue(received.CheckCRC(buffer, n));
+            Assert::AreEqual(7, received.GetPktCount());
+            Assert::AreEqual(2, server.GetData(buffer, sizeof(buffer), 1000), L"Messages must not merge");
+
+            IoSlice slices[2] = { { "he", 2 }, { "llo", 3 } };
+            Assert::AreEqual(5, server.SendGather(slices, 2, false));
+            Assert::AreEqual(5, client.GetData(buffer, sizeof(buffer), 1000));
+            Assert::AreEqual(0, memcmp(buffer, "hello", 5));
+            Assert::IsTrue(server.GetMetricsLabel().rfind("shm/server/", 0) == 0);
+            Assert::AreEqual(2LL, static_cast<long long>(server.GetCounters().PacketsIn.load()));
+        }
+
+        // Test that a disconnect reads as end of stream, and that a new session
+        // works after it.
+        TEST_METHOD(DisconnectAndReconnectTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27161, SHM, 64);
+            MySocket client(CLIENT, "127.0.0.1", 27161, SHM, 64);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+
+            MySocket intruder(CLIENT, "127.0.0.1", 27161, SHM, 64);
+            Assert::ExpectException<runtime_error>([&]() { intruder.ConnectTCP(); });
+
+            client.SendData("last", 4);
+            client.DisconnectTCP();
+            char buffer[64];
+            Assert::AreEqual(4, server.GetData(buffer, sizeof(buffer), 1000), L"Data sent before closing is still delivered");
+            Assert::AreEqual(0, server.GetData(buffer, sizeof(buffer), 1000));
+            Assert::IsTrue(server.PeerClosed());
+
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+            Assert::IsFalse(server.PeerClosed());
+            server.SendData("again", 5);
+            Assert::AreEqual(5, client.GetData(buffer, sizeof(buffer), 1000));
+
+            // Leave messages unread both ways and reconnect before the server
+            // has noticed: neither side may see the other session's traffic.
+            server.SendData("stale", 5);
+            client.SendData("unread", 6);
+            client.DisconnectTCP();
+            client.ConnectTCP();
+            client.SendData("fresh", 5);
+            Assert::AreEqual(6, server.GetData(buffer, sizeof(buffer), 1000), L"The old session's data is still delivered to it");
+            Assert::AreEqual(0, server.GetData(buffer, sizeof(buffer), 1000), L"The new session's data is left for the next accept");
+            server.ConnectTCP(1000);
+            Assert::AreEqual(5, server.GetData(buffer, sizeof(buffer), 1000));
+            Assert::AreEqual(0, memcmp(buffer, "fresh", 5));
+            server.SendData("hi", 2);
+            Assert::AreEqual(2, client.GetData(buffer, sizeof(buffer), 1000), L"The reply queued for the old client is dropped");
+            Assert::AreEqual(0, memcmp(buffer, "hi", 2));
+
+            server.DisconnectTCP();
+            Assert::AreEqual(0, client.GetData(buffer, sizeof(buffer), 1000));
+            Assert::IsTrue(client.PeerClosed());
+        }
+
+        // Test the failure paths: no server, an empty receive and a full ring
+        // time out, and an oversized message is refused.
+        TEST_METHOD(TimeoutTest)
+        {
+            MySocket orphan(CLIENT, "127.0.0.1", 27162, SHM, 64);
+            Assert::ExpectException<runtime_error>([&]() { orphan.ConnectTCP(); });
+
+            MySocket server(SERVER, "127.0.0.1", 27162, SHM, 64);
+            Assert::ExpectException<SocketTimeout>([&]() { server.ConnectTCP(50); });
+            MySocket client(CLIENT, "127.0.0.1", 27162, SHM, 64);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+
+            char buffer[64];
+            Assert::ExpectException<SocketTimeout>([&]() { server.GetData(buffer, sizeof(buffer), 50); });
+            for (int i = 0; i < SHM_RING_SLOTS; ++i)
+                client.SendData("x", 1, 0);
+            Assert::ExpectException<SocketTimeout>([&]() { client.SendData("x", 1, 50); });
+            IoSlice slice = { "x", 1 };
+            Assert::AreEqual(0, client.SendGather(&slice, 1, true), L"A full ring takes nothing without waiting");
+            char big[65] = { 0 };
+            Assert::ExpectException<runtime_error>([&]() { client.SendData(big, sizeof(big)); });
+            Assert::IsTrue(client.GetCounters().Timeouts.load() >= 1);
+        }
+
+        // Test that a blocked receiver and a blocked sender wake each other
+        // through the futexes, with nothing lost or reordered.
+        TEST_METHOD(StreamingTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27163, SHM, 64);
+            MySocket client(CLIENT, "127.0.0.1", 27163, SHM, 64);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+
+            const int count = 20000;
+            bool inOrder = true;
+            thread reader([&]() {
+                char buffer[64];
+                for (int i = 0; i < count; ++i) {
+                    int n = server.GetData(buffer, sizeof(buffer), 5000);
+                    int value = -1;
+                    if (n == sizeof(int))
+                        memcpy(&value, buffer, sizeof(value));
+                    if (value != i)
+                        inOrder = false;
+                }
+            });
+            for (int i = 0; i < count; ++i)
+                client.SendData(reinterpret_cast<const char*>(&i), sizeof(i), 5000);
+            reader.join();
+            Assert::IsTrue(inOrder);
+        }
+
+#ifdef __linux__
+        // Test that a client killed between claiming a slot and filling it
+        // does not wedge the ring for the client that replaces it.
+        TEST_METHOD(DeadClientTakeoverTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27164, SHM, 64);
+            pid_t child = fork();
+            if (child == 0) {
+                MySocket doomed(CLIENT, "127.0.0.1", 27164, SHM, 64);
+                doomed.ConnectTCP();
+                int fd = shm_open("/robotnet-127.0.0.1-27164", O_RDWR, 0);
+                struct stat st;
+                fstat(fd, &st);
+                char* base = static_cast<char*>(mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+                uint32_t pos;
+                Claim(reinterpret_cast<ShmRingHeader*>(base + sizeof(ShmSegment)), pos);
+                _exit(0);
+            }
+            Assert::IsTrue(child > 0);
+            int status = 0;
+            waitpid(child, &status, 0);
+
+            MySocket client(CLIENT, "127.0.0.1", 27164, SHM, 64);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+            client.SendData("alive", 5);
+            char buffer[64];
+            Assert::AreEqual(5, server.GetData(buffer, sizeof(buffer), 1000));
+            Assert::AreEqual(0, memcmp(buffer, "alive", 5));
+        }
+#endif
+    };
+}
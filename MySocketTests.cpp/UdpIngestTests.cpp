@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "UdpIngest.cpp"
+#include "UdpIngest.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    // Wait until ingest has seen total datagrams, or give up after timeoutMs.
+    static bool WaitForIngest(UdpIngest& ingest, long long total, int timeoutMs)
+    {
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        while (ingest.GetReceived() < total) {
+            if (chrono::steady_clock::now() > deadline)
+                return false;
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        return true;
+    }
+
+    TEST_CLASS(UdpIngestTests)
+    {
+    public:
+        // Test that senders spread over the shards and that each sender is
+        // tracked, with all of its datagrams, by exactly one shard.
+        TEST_METHOD(ShardedReceiveTest)
+        {
+            const int clients = 8;
+            const int perClient = 50;
+            atomic<long long> handled(0);
+            UdpIngest ingest("127.0.0.1", 27190, 2,
+                [&handled](int, const char*, int length, const sockaddr_in&) { handled.fetch_add(length); });
+            Assert::AreEqual(2, ingest.GetShardCount());
+            ingest.Start();
+
+            vector<unique_ptr<MySocket>> senders;
+            char payload[12] = { 0 };
+            for (int c = 0; c < clients; ++c) {
+                senders.emplace_back(new MySocket(CLIENT, "127.0.0.1", 27190, UDP, DEFAULT_SIZE));
+                for (int i = 0; i < perClient; ++i)
+                    senders.back()->SendData(payload, sizeof(payload));
+                // One sender's burst at a time, so the shards' receive buffers cannot overflow.
+                Assert::IsTrue(WaitForIngest(ingest, (c + 1) * perClient, 5000), L"All datagrams arrive");
+            }
+
+            ingest.Stop();
+            Assert::AreEqual(static_cast<long long>(clients * perClient * sizeof(payload)), handled.load());
+
+            int peers = 0;
+            for (int shard = 0; shard < ingest.GetShardCount(); ++shard) {
+                for (const IngestPeer& peer : ingest.GetPeers(shard)) {
+                    Assert::AreEqual(static_cast<long long>(perClient), peer.Packets);
+                    Assert::AreEqual(static_cast<long long>(perClient * sizeof(payload)), peer.Bytes);
+                    ++peers;
+                }
+            }
+            Assert::AreEqual(clients, peers, L"Each sender lives in exactly one shard");
+        }
+
+        // Test that with payload steering the first byte picks the shard,
+        // whichever port the datagram comes from.
+        TEST_METHOD(SteerByIdTest)
+        {
+            vector<int> landed(4, -1);
+            mutex landedLock;
+            UdpIngest ingest("127.0.0.1", 27191, 2,
+                [&landed, &landedLock](int shard, const char* data, int, const sockaddr_in&) {
+                    lock_guard<mutex> guard(landedLock);
+                    landed[static_cast<unsigned char>(data[0]) % 4] = shard;
+                });
+            ingest.SteerByPayloadByte(0);
+            ingest.Start();
+
+            MySocket sender(CLIENT, "127.0.0.1", 27191, UDP, DEFAULT_SIZE);
+            for (char id = 0; id < 4; ++id) {
+                char payload[4] = { id, 1, 2, 3 };
+                sender.SendData(payload, sizeof(payload));
+            }
+
+            Assert::IsTrue(WaitForIngest(ingest, 4, 5000), L"All datagrams arrive");
+            ingest.Stop();
+            for (int id = 0; id < 4; ++id)
+                Assert::AreEqual(id % 2, landed[id]);
+            Assert::AreEqual(2LL, ingest.GetReceived(0));
+            Assert::AreEqual(2LL, ingest.GetReceived(1));
+        }
+
+        // Test that the peer table is capped, that datagrams from untracked
+        // senders still reach the handler, and that idle peers are forgotten.
+        TEST_METHOD(PeerLimitTest)
+        {
+            atomic<int> handled(0);
+            UdpIngest ingest("127.0.0.1", 27198, 1,
+                [&handled](int, const char*, int, const sockaddr_in&) { ++handled; });
+            ingest.SetPeerLimits(200, 2);
+            ingest.Start();
+
+            MySocket a(CLIENT, "127.0.0.1", 27198, UDP, DEFAULT_SIZE);
+            MySocket b(CLIENT, "127.0.0.1", 27198, UDP, DEFAULT_SIZE);
+            MySocket c(CLIENT, "127.0.0.1", 27198, UDP, DEFAULT_SIZE);
+            char payload[4] = { 1, 2, 3, 4 };
+            a.SendData(payload, sizeof(payload));
+            b.SendData(payload, sizeof(payload));
+            Assert::IsTrue(WaitForIngest(ingest, 2, 5000), L"Tracked senders arrive");
+            c.SendData(payload, sizeof(payload));
+            Assert::IsTrue(WaitForIngest(ingest, 3, 5000), L"Untracked sender arrives");
+            Assert::AreEqual(3, handled.load());
+            Assert::AreEqual(2, static_cast<int>(ingest.GetPeers(0).size()));
+            Assert::AreEqual(1LL, ingest.GetRejectedPeers());
+
+            // Once a and b fall silent they are swept and c gets a place.
+            for (int i = 0; i < 200 && !ingest.GetPeers(0).empty(); ++i)
+                this_thread::sleep_for(chrono::milliseconds(10));
+            Assert::AreEqual(0, static_cast<int>(ingest.GetPeers(0).size()));
+            c.SendData(payload, sizeof(payload));
+            Assert::IsTrue(WaitForIngest(ingest, 4, 5000), L"Sender arrives after the sweep");
+            ingest.Stop();
+            Assert::AreEqual(1, static_cast<int>(ingest.GetPeers(0).size()));
+            Assert::AreEqual(1LL, ingest.GetRejectedPeers());
+        }
+    };
+}
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "MySocket.h"
+#include "UringEngine.cpp"
+#include "UringEngine.h"
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MySocketTests
+{
+    // Switch a socket to io_uring; where the kernel has no support it must
+    // stay on syscalls, and the tests below then cover that path instead.
+    static void UseUring(MySocket& sock)
+    {
+        IoEngine engine = sock.SetIoEngine(ENGINE_URING);
+        Assert::IsTrue(engine == (UringEngine::IsSupported() ? ENGINE_URING : ENGINE_SYSCALL));
+        Assert::IsTrue(sock.GetIoEngine() == engine);
+    }
+
+    TEST_CLASS(UringEngineTests)
+    {
+    public:
+        // Test that datagrams keep their boundaries and sources both ways,
+        // including batches, and that replies reach the last sender.
+        TEST_METHOD(UdpRoundTripTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27192, UDP, 256);
+            MySocket client(CLIENT, "127.0.0.1", 27192, UDP, 256);
+            UseUring(server);
+            UseUring(client);
+
+            PktDef pkt;
+            PktDef::DriveBody body = { PktDef::FORWARD, 5, 90 };
+            pkt.SetCmd(PktDef::DRIVE);
+            pkt.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+            pkt.SetPktCount(9);
+            pkt.CalcCRC();
+            client.SendData(pkt.GenPacket(), pkt.GetLength());
+            client.SendData("ab", 2);
+
+            char buffer[256];
+            int n = server.GetData(buffer, sizeof(buffer), 1000);
+            Assert::AreEqual(pkt.GetLength(), n);
+            PktDef received(buffer, n);
+            Assert::IsTrue(received.CheckCRC(buffer, n));
+            Assert::AreEqual(9, received.GetPktCount());
+            Assert::AreEqual(2, server.GetData(buffer, sizeof(buffer), 1000), L"Datagrams must not merge");
+
+            server.SendData("reply", 5);
+            Assert::AreEqual(5, client.GetData(buffer, sizeof(buffer), 1000));
+            Assert::AreEqual(0, memcmp(buffer, "reply", 5));
+
+            const int count = 20;
+            vector<string> payloads;
+            vector<UdpDatagram> out(count);
+            for (int i = 0; i < count; ++i)
+                payloads.push_back("datagram " + to_string(i));
+            for (int i = 0; i < count; ++i) {
+                out[i].Data = &payloads[i][0];
+                out[i].Length = static_cast<int>(payloads[i].size());
+                out[i].Addr = MySocket::MakeAddress("127.0.0.1", 27192);
+            }
+            Assert::AreEqual(count, client.SendBatch(out.data(), count));
+
+            vector<char> storage(count * 64);
+            vector<UdpDatagram> in(count);
+            for (int i = 0; i < count; ++i) {
+                in[i].Data = storage.data() + i * 64;
+                in[i].Capacity = 64;
+            }
+            server.SetTimeouts(-1, -1, 1000);
+            int got = 0;
+            while (got < count)
+                got += server.GetDataBatch(in.data() + got, count - got);
+            for (int i = 0; i < count; ++i) {
+                Assert::AreEqual(payloads[i], string(in[i].Data, in[i].Length));
+                Assert::AreEqual(ntohs(in[0].Addr.sin_port), ntohs(in[i].Addr.sin_port));
+            }
+            Assert::AreEqual(static_cast<long long>(count + 2), static_cast<long long>(server.GetCounters().PacketsIn.load()));
+        }
+
+        // Test that a stream arrives whole and in order when small staged
+        // sends, a message larger than a staging slot and a gather are mixed,
+        // and that a disconnect reads as end of stream.
+        TEST_METHOD(TcpStreamTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27193, TCP, 512);
+            MySocket client(CLIENT, "127.0.0.1", 27193, TCP, 512);
+            UseUring(server);
+            UseUring(client);
+            client.ConnectTCP();
+            server.ConnectTCP(1000);
+
+            string expected;
+            for (int i = 0; i < 200; ++i) {
+                string piece = "<" + to_string(i) + ">";
+                client.SendData(piece.data(), static_cast<int>(piece.size()));
+                expected += piece;
+            }
+            string large(5000, 'L');
+            client.SendData(large.data(), static_cast<int>(large.size()));
+            expected += large;
+            IoSlice slices[2] = { { "he", 2 }, { "llo", 3 } };
+            Assert::AreEqual(5, client.SendGather(slices, 2, false));
+            expected += "hello";
+
+            string stream;
+            char buffer[300];
+            while (stream.size() < expected.size()) {
+                int n = server.GetData(buffer, sizeof(buffer), 1000);
+                Assert::IsTrue(n > 0);
+                stream.append(buffer, n);
+            }
+            Assert::IsTrue(stream == expected, L"Bytes arrive in order");
+
+            client.SendData("last", 4);
+            client.DisconnectTCP();
+            Assert::AreEqual(4, server.GetData(buffer, sizeof(buffer), 1000));
+            Assert::AreEqual(0, server.GetData(buffer, sizeof(buffer), 1000));
+            Assert::AreEqual(0, server.GetData(buffer, sizeof(buffer), 1000), L"End of stream persists");
+            Assert::IsTrue(server.PeerClosed());
+        }
+
+        // Test that receive deadlines work without any data arriving.
+        TEST_METHOD(TimeoutTest)
+        {
+            MySocket server(SERVER, "127.0.0.1", 27194, UDP, 128);
+            UseUring(server);
+            Assert::IsFalse(server.WaitForData(20));
+            char buffer[128];
+            Assert::ExpectException<SocketTimeout>([&]() { server.GetData(buffer, sizeof(buffer), 30); });
+            Assert::AreEqual(1ULL, server.GetCounters().Timeouts.load());
+        }
+    };
+}
@@ -0,0 +1,206 @@
+#include "AsyncSender.h"
+#include "BufferPool.h"
+#include "PktFramer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+AsyncSender::AsyncSender(MySocket& socket, int highWatermark, int lowWatermark)
+    : Socket(socket), HighWatermark(highWatermark), LowWatermark(lowWatermark),
+    Incoming(nullptr), Depth(0), QueuedBytes(0), Congested(false),
+    PendingHead(0), HeadOffset(0), Flushes(0), BytesSent(0), Failed(false), Failures(0),
+    Running(false), TickUs(200)
+{
+    if (LowWatermark > HighWatermark)
+        LowWatermark = HighWatermark;
+    // Coalescing replaces Nagle: segments leave on the flush tick, not after an ACK.
+    // SetNoDelay throws for a UDP socket.
+    Socket.SetNoDelay(true);
+    METRIC_ONLY(MetricsRegistry::Instance().Add("queue_wait/" + Socket.GetMetricsLabel(), &QueueWait));
+}
+
+AsyncSender::~AsyncSender() {
+    Stop();
+    METRIC_ONLY(MetricsRegistry::Instance().Remove(&QueueWait));
+    Node* node = Incoming.exchange(nullptr);
+    while (node) {
+        Node* next = node->Next;
+        FreeNode(node);
+        node = next;
+    }
+    for (size_t i = PendingHead; i < Pending.size(); ++i)
+        FreeNode(Pending[i]);
+}
+
+bool AsyncSender::Enqueue(PktDef& pkt) {
+    METRIC_STAMP(pkt.GetTrace().EnqueueNs);
+    return Enqueue(pkt.GenPacket(), pkt.GetLength());
+}
+
+bool AsyncSender::Enqueue(const char* data, int length) {
+    if (Congested.load(memory_order_relaxed) || Failed.load(memory_order_acquire))
+        return false;
+    if (length <= 0 || length > PktFramer::MAX_FRAME)
+        throw runtime_error("AsyncSender frame size out of range");
+
+    int total = PktFramer::PREFIXSIZE + length;
+    // Nodes are freed on the flusher thread; the pool returns them to this one.
+    Node* node = PoolNew<Node>();
+    node->Data = total <= INLINE_NODE_SIZE ? node->Inline : BufferPool::Allocate(total);
+    node->Length = PktFramer::Frame(data, length, node->Data, total);
+    node->EnqueueNs = 0;
+    METRIC_STAMP(node->EnqueueNs);
+    return Push(node);
+}
+
+bool AsyncSender::Push(Node* node) {
+    Node* head = Incoming.load(memory_order_relaxed);
+    do {
+        node->Next = head;
+    } while (!Incoming.compare_exchange_weak(head, node, memory_order_release, memory_order_relaxed));
+
+    Depth.fetch_add(1, memory_order_relaxed);
+    if (QueuedBytes.fetch_add(node->Length, memory_order_relaxed) + node->Length >= HighWatermark)
+        Congested.store(true, memory_order_relaxed);
+    return true;
+}
+
+void AsyncSender::FreeNode(Node* node) {
+    if (node->Data != node->Inline)
+        BufferPool::Free(node->Data);
+    PoolDelete(node);
+}
+
+void AsyncSender::TakeIncoming() {
+    Node* batch = Incoming.exchange(nullptr, memory_order_acquire);
+    if (!batch)
+        return;
+    // Compact the consumed prefix before appending so Pending does not grow forever.
+    if (PendingHead > 0) {
+        Pending.erase(Pending.begin(), Pending.begin() + PendingHead);
+        PendingHead = 0;
+    }
+    // The list is newest-first; append it reversed to keep FIFO order.
+    size_t start = Pending.size();
+    for (Node* node = batch; node; node = node->Next)
+        Pending.push_back(node);
+    reverse(Pending.begin() + start, Pending.end());
+}
+
+int AsyncSender::FlushOnce() {
+    TakeIncoming();
+
+    int written = 0;
+    IoSlice slices[MAX_BATCH];
+    while (PendingHead < Pending.size()) {
+        int count = 0;
+        for (size_t i = PendingHead; i < Pending.size() && count < MAX_BATCH; ++i, ++count) {
+            int offset = (i == PendingHead) ? HeadOffset : 0;
+            slices[count].Data = Pending[i]->Data + offset;
+            slices[count].Length = Pending[i]->Length - offset;
+        }
+
+        int n = Socket.SendGather(slices, count, true);
+        ++Flushes;
+        if (n <= 0)
+            break;
+        written += n;
+
+        // Retire every fully written node; remember how far into the next one we got.
+        METRIC_ONLY(long long now = 0;)
+        METRIC_STAMP(now);
+        int remaining = n;
+        while (remaining > 0) {
+            Node* head = Pending[PendingHead];
+            int left = head->Length - HeadOffset;
+            if (remaining < left) {
+                HeadOffset += remaining;
+                break;
+            }
+            remaining -= left;
+            HeadOffset = 0;
+            ++PendingHead;
+            Depth.fetch_sub(1, memory_order_relaxed);
+            METRIC_ONLY(if (now && head->EnqueueNs) QueueWait.Record(now - head->EnqueueNs));
+            FreeNode(head);
+        }
+        // The socket buffer filled up mid-batch; try again next tick.
+        int requested = 0;
+        for (int i = 0; i < count; ++i)
+            requested += slices[i].Length;
+        if (n < requested)
+            break;
+    }
+
+    BytesSent += written;
+    if (QueuedBytes.fetch_sub(written, memory_order_relaxed) - written <= LowWatermark)
+        Congested.store(false, memory_order_relaxed);
+    return written;
+}
+
+void AsyncSender::Start(int tickUs) {
+    if (Running.exchange(true))
+        return;
+    TickUs = tickUs > 0 ? tickUs : 1;
+    Flusher = thread([this]() {
+        // An exception escaping this thread would terminate the process.
+        try {
+            while (Running.load()) {
+                FlushOnce();
+                this_thread::sleep_for(chrono::microseconds(TickUs));
+            }
+            FlushOnce();
+        }
+        catch (const runtime_error& e) {
+            Error = e.what();
+            Failures.fetch_add(1);
+            Failed.store(true, memory_order_release);
+        }
+    });
+}
+
+bool AsyncSender::Stop() {
+    if (!Running.exchange(false))
+        return !HasFailed();
+    if (Flusher.joinable())
+        Flusher.join();
+    return !HasFailed();
+}
+
+bool AsyncSender::IsCongested() {
+    return Congested.load(memory_order_relaxed);
+}
+
+int AsyncSender::GetQueueDepth() {
+    return Depth.load(memory_order_relaxed);
+}
+
+long long AsyncSender::GetQueuedBytes() {
+    return QueuedBytes.load(memory_order_relaxed);
+}
+
+long long AsyncSender::GetFlushes() {
+    return Flushes;
+}
+
+LatencyHistogram& AsyncSender::GetQueueWaitHistogram() {
+    return QueueWait;
+}
+
+long long AsyncSender::GetBytesSent() {
+    return BytesSent;
+}
+
+bool AsyncSender::HasFailed() {
+    return Failed.load(memory_order_acquire);
+}
+
+string AsyncSender::GetError() {
+    return HasFailed() ? Error : string();
+}
+
+long long AsyncSender::GetFailures() {
+    return Failures.load();
+}
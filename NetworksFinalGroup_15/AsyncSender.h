@@ -0,0 +1,102 @@
+#pragma once
+#include "MySocket.h"
+#include "PktDef.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Non-blocking, coalescing send path for a connected TCP MySocket.
+//
+// Any number of threads may Enqueue() packets; they are pushed onto a lock-free
+// multi-producer list and return immediately. A single flusher (the background
+// thread started by Start(), or whoever calls FlushOnce()) takes everything
+// queued so far and writes it with one gather send per flush tick, so a burst
+// of small DRIVE commands leaves in one segment even with TCP_NODELAY on.
+// Partial writes are resumed on the next tick rather than retried in a loop.
+//
+// Packets are framed with PktFramer's 2-byte length prefix so the receiver can
+// split a coalesced segment back into packets.
+//
+// Backpressure: once the queued bytes reach the high watermark IsCongested()
+// turns true and Enqueue() refuses new packets until the queue drains to the
+// low watermark.
+//
+// If a send fails (the peer reset or closed the connection), the background
+// flusher records the error and stops. Enqueue() then refuses every packet
+// and HasFailed()/GetError() tell why.
+class AsyncSender {
+public:
+    // Packets up to this size are stored inside the queue node.
+    static const int INLINE_NODE_SIZE = 64;
+
+    // Constructor: the socket must be a connected TCP socket. Turns Nagle off.
+    AsyncSender(MySocket& socket, int highWatermark = 1 << 20, int lowWatermark = 1 << 18);
+    ~AsyncSender();
+
+    // Queue a framed copy of the packet (GenPacket() is called here).
+    // Returns false, queuing nothing, while the sender is congested or
+    // after a send has failed.
+    bool Enqueue(PktDef& pkt);
+    // Queue raw bytes as one frame.
+    bool Enqueue(const char* data, int length);
+
+    // Write as much queued data as the socket accepts without blocking.
+    // Returns the number of bytes written. Throws if the send fails.
+    int FlushOnce();
+
+    // Start/stop the background flusher; it runs FlushOnce() every tickUs.
+    // Stop() returns false if the flusher had already stopped on a failed send.
+    void Start(int tickUs = 200);
+    bool Stop();
+
+    // Getters
+    bool IsCongested();
+    int GetQueueDepth();            // Packets not yet fully written.
+    long long GetQueuedBytes();     // Bytes not yet written.
+    long long GetFlushes();         // Gather sends issued.
+    long long GetBytesSent();
+    bool HasFailed();               // The flusher stopped on a send error.
+    string GetError();              // What the failed send threw; empty if none.
+    long long GetFailures();        // Send errors caught by the flusher.
+    // Enqueue-to-written time of each packet, in nanoseconds (packet tracing only).
+    LatencyHistogram& GetQueueWaitHistogram();
+
+private:
+    struct Node {
+        Node* Next;
+        int Length;
+        long long EnqueueNs;        // Set while packet tracing is on.
+        char* Data;                 // Points at Inline or a heap block.
+        char Inline[INLINE_NODE_SIZE];
+    };
+
+    bool Push(Node* node);
+    void TakeIncoming();
+    static void FreeNode(Node* node);
+
+    MySocket& Socket;
+    int HighWatermark;
+    int LowWatermark;
+
+    atomic<Node*> Incoming;         // Producer side: LIFO list, newest first.
+    atomic<int> Depth;
+    atomic<long long> QueuedBytes;
+    atomic<bool> Congested;
+
+    // Flusher side only.
+    vector<Node*> Pending;          // FIFO of packets taken from Incoming.
+    size_t PendingHead;             // First unsent entry of Pending.
+    int HeadOffset;                 // Bytes of Pending[PendingHead] already written.
+    long long Flushes;
+    long long BytesSent;
+    LatencyHistogram QueueWait;     // Exported as "queue_wait/<socket label>".
+
+    atomic<bool> Failed;
+    string Error;                   // Written by the flusher before Failed is set.
+    atomic<long long> Failures;
+
+    atomic<bool> Running;
+    int TickUs;
+    thread Flusher;
+};
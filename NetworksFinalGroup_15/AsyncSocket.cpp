@@ -0,0 +1,272 @@
+#include "AsyncSocket.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+using namespace std;
+
+// Turn a wait that did not end in readiness into the operation's exception.
+static void ThrowIfNotReady(WaitResult result, const char* operation) {
+    if (result == WAIT_TIMEOUT)
+        throw SocketTimeout(string(operation) + " timed out");
+    if (result == WAIT_CANCELED)
+        throw runtime_error(string(operation) + " canceled");
+}
+
+// Marks a send or receive as in flight for the lifetime of the coroutine body.
+class InFlight {
+public:
+    InFlight(bool& flag, const char* operation) : Flag(flag) {
+        if (Flag)
+            throw runtime_error(string(operation) + " is already in progress on this socket");
+        Flag = true;
+    }
+    ~InFlight() { Flag = false; }
+private:
+    bool& Flag;
+};
+
+static int RingSizeFor(int maxPacket) {
+    return max(8192, 2 * (maxPacket + PktFramer::PREFIXSIZE));
+}
+
+AsyncSocket::AsyncSocket(IoLoop& loop, string ip, int port, int maxPacket)
+    : Loop(loop), SvrAddr(MySocket::MakeAddress(ip, port)), MaxPacket(maxPacket > 0 ? maxPacket : DEFAULT_SIZE),
+    bTCPConnect(false), Sending(false), Receiving(false), Framer(RingSizeFor(MaxPacket), MaxPacket), CrcErrors(0)
+{
+    NetworkStartup();
+    RecvScratch.resize(MaxPacket);
+    Register(ip + ":" + to_string(port));
+}
+
+AsyncSocket::AsyncSocket(IoLoop& loop, SOCKET accepted, int maxPacket)
+    : Loop(loop), MaxPacket(maxPacket), bTCPConnect(true), Sending(false), Receiving(false),
+    Framer(RingSizeFor(MaxPacket), MaxPacket), CrcErrors(0)
+{
+    memset(&SvrAddr, 0, sizeof(SvrAddr));
+    RecvScratch.resize(MaxPacket);
+    Adopt(accepted);
+    Register("accepted");
+}
+
+AsyncSocket::~AsyncSocket() {
+    METRIC_ONLY(MetricsRegistry::Instance().Remove(&Counters));
+    Close();
+}
+
+void AsyncSocket::Register(const string& endpoint) {
+    // The sequence number keeps sockets on the same endpoint apart, as MySocket does.
+    static atomic<int> socketSequence(0);
+    METRIC_ONLY(MetricsRegistry::Instance().Add("async/" + endpoint + "/" + to_string(++socketSequence), &Counters));
+}
+
+void AsyncSocket::Adopt(SOCKET sock) {
+    Handle.Sock = sock;
+    SetNonBlocking(sock, true);
+    // Commands are small and latency-bound.
+    int flag = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag));
+}
+
+void AsyncSocket::Close() {
+    if (Handle.Sock == INVALID_SOCKET)
+        return;
+    Loop.Detach(Handle);
+    CloseSocket(Handle.Sock);
+    Handle.Sock = INVALID_SOCKET;
+    bTCPConnect = false;
+}
+
+Task<void> AsyncSocket::ConnectTCP(int timeoutMs, CancelSource* cancel) {
+    if (bTCPConnect)
+        throw runtime_error("ConnectTCP called on a connected socket");
+    long long deadline = IoLoop::DeadlineAfter(timeoutMs);
+    Close();
+    Framer.Reset();
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        throw runtime_error("Failed to create TCP socket");
+    Adopt(sock);
+
+    if (connect(sock, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) == SOCKET_ERROR) {
+        if (!WouldBlock(LastSocketError())) {
+            Close();
+            throw runtime_error("TCP Connect failed");
+        }
+        // The handshake is in flight; the socket turns writable when it completes or fails.
+        IoWait wait(Loop, &Handle, EVENT_WRITE, deadline, cancel);
+        WaitResult result = co_await wait;
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (result == WAIT_READY && getsockopt(Handle.Sock, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == SOCKET_ERROR)
+            error = -1;
+        if (result != WAIT_READY || error != 0) {
+            Close();
+            ThrowIfNotReady(result, "TCP Connect");
+            throw runtime_error("TCP Connect failed");
+        }
+    }
+    bTCPConnect = true;
+}
+
+void AsyncSocket::DisconnectTCP() {
+    Close();
+}
+
+Task<void> AsyncSocket::SendAll(const char* data, int numBytes, long long deadlineMs, CancelSource* cancel) {
+    int sent = 0;
+    while (sent < numBytes) {
+        int n = send(Handle.Sock, data + sent, numBytes - sent, 0);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n == SOCKET_ERROR && WouldBlock(LastSocketError())) {
+            IoWait wait(Loop, &Handle, EVENT_WRITE, deadlineMs, cancel);
+            ThrowIfNotReady(co_await wait, "SendData");
+            continue;
+        }
+        bTCPConnect = false;
+        throw runtime_error("SendData failed");
+    }
+}
+
+Task<void> AsyncSocket::SendData(const char* data, int numBytes, int timeoutMs, CancelSource* cancel) {
+    if (!bTCPConnect)
+        throw runtime_error("SendData called on an unconnected socket");
+    InFlight busy(Sending, "SendData");
+    co_await SendAll(data, numBytes, IoLoop::DeadlineAfter(timeoutMs), cancel);
+}
+
+Task<void> AsyncSocket::SendPacket(PktDef& pkt, int timeoutMs, CancelSource* cancel) {
+    if (!bTCPConnect)
+        throw runtime_error("SendPacket called on an unconnected socket");
+    InFlight busy(Sending, "SendPacket");
+    int length = pkt.GetLength();
+    SendScratch.resize(length + PktFramer::PREFIXSIZE);
+    int framed = PktFramer::Frame(pkt.GenPacket(), length, SendScratch.data(), static_cast<int>(SendScratch.size()));
+    if (framed == 0)
+        throw runtime_error("Packet is too large to frame");
+    co_await SendAll(SendScratch.data(), framed, IoLoop::DeadlineAfter(timeoutMs), cancel);
+}
+
+Task<int> AsyncSocket::GetData(char* destBuffer, int capacity, int timeoutMs, CancelSource* cancel) {
+    if (!bTCPConnect)
+        throw runtime_error("GetData called on an unconnected socket");
+    InFlight busy(Receiving, "GetData");
+    long long deadline = IoLoop::DeadlineAfter(timeoutMs);
+    for (;;) {
+        int n = recv(Handle.Sock, destBuffer, capacity, 0);
+        if (n >= 0) {
+            if (n == 0)
+                bTCPConnect = false;
+            co_return n;
+        }
+        if (!WouldBlock(LastSocketError())) {
+            bTCPConnect = false;
+            throw runtime_error("GetData failed");
+        }
+        IoWait wait(Loop, &Handle, EVENT_READ, deadline, cancel);
+        ThrowIfNotReady(co_await wait, "GetData");
+    }
+}
+
+Task<bool> AsyncSocket::GetPacket(PktDef& pkt, int timeoutMs, CancelSource* cancel) {
+    if (!bTCPConnect)
+        throw runtime_error("GetPacket called on an unconnected socket");
+    InFlight busy(Receiving, "GetPacket");
+    long long deadline = IoLoop::DeadlineAfter(timeoutMs);
+    for (;;) {
+        // Packets already reassembled are handed out before touching the socket.
+        int length;
+        while ((length = Framer.NextFrame(RecvScratch.data(), MaxPacket)) > 0) {
+            bool valid = true;
+            try {
+                pkt.Parse(RecvScratch.data(), length);
+            }
+            catch (const runtime_error&) {
+                valid = false;
+            }
+            if (valid && pkt.CheckCRC(RecvScratch.data(), length)) {
+                METRIC_ADD(Counters.PacketsIn, 1);
+                co_return true;
+            }
+            METRIC_ADD(Counters.CrcFailures, 1);
+            ++CrcErrors;
+        }
+
+        int space;
+        char* dest = Framer.WritePtr(space);
+        int n = recv(Handle.Sock, dest, space, 0);
+        if (n > 0) {
+            Framer.Commit(n);
+            continue;
+        }
+        if (n == SOCKET_ERROR && WouldBlock(LastSocketError())) {
+            IoWait wait(Loop, &Handle, EVENT_READ, deadline, cancel);
+            ThrowIfNotReady(co_await wait, "GetPacket");
+            continue;
+        }
+        // Orderly shutdown by the peer, or a hard error.
+        bTCPConnect = false;
+        co_return false;
+    }
+}
+
+bool AsyncSocket::IsConnected() {
+    return bTCPConnect;
+}
+
+long long AsyncSocket::GetCrcErrors() {
+    return CrcErrors;
+}
+
+SocketCounters& AsyncSocket::GetCounters() {
+    return Counters;
+}
+
+AsyncListener::AsyncListener(IoLoop& loop, string ip, int port, int maxPacket)
+    : Loop(loop), Port(port), MaxPacket(maxPacket > 0 ? maxPacket : DEFAULT_SIZE)
+{
+    NetworkStartup();
+    sockaddr_in addr = MySocket::MakeAddress(ip, port);
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        throw runtime_error("Failed to create TCP socket");
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        CloseSocket(sock);
+        throw runtime_error("TCP Bind failed");
+    }
+    if (listen(sock, SOMAXCONN) == SOCKET_ERROR) {
+        CloseSocket(sock);
+        throw runtime_error("TCP Listen failed");
+    }
+    SetNonBlocking(sock, true);
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(sock, (struct sockaddr*)&addr, &addrLen) == 0)
+        Port = ntohs(addr.sin_port);
+    Handle.Sock = sock;
+}
+
+AsyncListener::~AsyncListener() {
+    Loop.Detach(Handle);
+    CloseSocket(Handle.Sock);
+}
+
+Task<unique_ptr<AsyncSocket>> AsyncListener::Accept(int timeoutMs, CancelSource* cancel) {
+    long long deadline = IoLoop::DeadlineAfter(timeoutMs);
+    for (;;) {
+        SOCKET sock = accept(Handle.Sock, nullptr, nullptr);
+        if (sock != INVALID_SOCKET)
+            co_return unique_ptr<AsyncSocket>(new AsyncSocket(Loop, sock, MaxPacket));
+        if (!WouldBlock(LastSocketError()))
+            throw runtime_error("TCP Accept failed");
+        IoWait wait(Loop, &Handle, EVENT_READ, deadline, cancel);
+        ThrowIfNotReady(co_await wait, "Accept");
+    }
+}
+
+int AsyncListener::GetPort() {
+    return Port;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "IoLoop.h"
+#include "MySocket.h"
+#include "PktDef.h"
+#include "PktFramer.h"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Coroutine version of a TCP MySocket, driven by an IoLoop.
+//
+// Every operation returns a Task to co_await. It completes without
+// suspending when the socket is ready, and otherwise parks the coroutine
+// until the socket is ready. Each one takes a timeout (-1 waits forever) and
+// an optional CancelSource. A timeout throws SocketTimeout and cancellation
+// throws runtime_error. Packets use PktFramer's 2-byte length prefix, the
+// same framing ReactorServer and AsyncSender use.
+//
+// One send and one receive may be in flight at a time (a reader coroutine and
+// a writer coroutine can share a socket). A send that times out or is
+// canceled part way leaves a partial frame on the wire, so disconnect after
+// one. Do not mix GetData() and GetPacket() on the same connection.
+class AsyncSocket {
+public:
+    // Client socket for ip:port. Call ConnectTCP() before sending.
+    AsyncSocket(IoLoop& loop, string ip, int port, int maxPacket = DEFAULT_SIZE);
+    ~AsyncSocket();
+
+    // Connect, or reconnect after DisconnectTCP() or a failed attempt.
+    Task<void> ConnectTCP(int timeoutMs = -1, CancelSource* cancel = nullptr);
+    void DisconnectTCP();
+
+    // Send every byte of data.
+    Task<void> SendData(const char* data, int numBytes, int timeoutMs = -1, CancelSource* cancel = nullptr);
+    // Send one framed packet. CalcCRC() must already have been called.
+    Task<void> SendPacket(PktDef& pkt, int timeoutMs = -1, CancelSource* cancel = nullptr);
+    // Receive up to capacity bytes. Returns 0 once the peer has closed.
+    Task<int> GetData(char* destBuffer, int capacity, int timeoutMs = -1, CancelSource* cancel = nullptr);
+    // Receive the next framed packet that passes its CRC check (others are
+    // dropped and counted). Returns false once the peer has closed or reset
+    // the connection.
+    Task<bool> GetPacket(PktDef& pkt, int timeoutMs = -1, CancelSource* cancel = nullptr);
+
+    // Getters
+    bool IsConnected();
+    long long GetCrcErrors();
+    // Exported as "async/<ip>:<port>/<n>" ("async/accepted/<n>"): packets
+    // returned by GetPacket() (PacketsIn) and packets failing their CRC or too malformed to parse (CrcFailures).
+    SocketCounters& GetCounters();
+
+private:
+    friend class AsyncListener;
+    // Wrap a connection returned by accept().
+    AsyncSocket(IoLoop& loop, SOCKET accepted, int maxPacket);
+    AsyncSocket(const AsyncSocket&);
+    AsyncSocket& operator=(const AsyncSocket&);
+
+    void Adopt(SOCKET sock);
+    void Register(const string& endpoint);
+    void Close();
+    Task<void> SendAll(const char* data, int numBytes, long long deadlineMs, CancelSource* cancel);
+
+    IoLoop& Loop;
+    IoHandle Handle;
+    sockaddr_in SvrAddr;
+    int MaxPacket;
+    bool bTCPConnect;
+    bool Sending;               // A send is in flight.
+    bool Receiving;             // A receive is in flight.
+    PktFramer Framer;           // Reassembles received frames.
+    vector<char> SendScratch;   // Framed copy of the packet being sent.
+    vector<char> RecvScratch;   // Packet handed to PktDef::Parse().
+    long long CrcErrors;
+    SocketCounters Counters;
+};
+
+// Listening TCP socket whose Accept() can be co_awaited.
+class AsyncListener {
+public:
+    // Port 0 picks a free port; see GetPort().
+    AsyncListener(IoLoop& loop, string ip, int port, int maxPacket = DEFAULT_SIZE);
+    ~AsyncListener();
+
+    Task<unique_ptr<AsyncSocket>> Accept(int timeoutMs = -1, CancelSource* cancel = nullptr);
+
+    int GetPort();
+
+private:
+    AsyncListener(const AsyncListener&);
+    AsyncListener& operator=(const AsyncListener&);
+
+    IoLoop& Loop;
+    IoHandle Handle;
+    int Port;
+    int MaxPacket;
+};
@@ -0,0 +1,212 @@
+#include "BufferPool.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+struct PoolCache;
+
+// Every block is preceded by this header; the caller's pointer follows it.
+struct alignas(16) PoolBlockHeader {
+    PoolCache* Owner;    // nullptr for a large (plain new[]) block.
+    int SizeClass;              // -1 for a large block.
+    int Capacity;
+};
+
+// Free blocks are linked through their own first bytes.
+struct PoolFreeBlock {
+    PoolFreeBlock* Next;
+};
+
+struct PoolCache {
+    PoolFreeBlock* Local[BufferPool::CLASS_COUNT];          // Owner thread only.
+    atomic<PoolFreeBlock*> Remote[BufferPool::CLASS_COUNT];  // Pushed by other threads.
+    atomic<long long> RemoteFrees;
+    vector<char*> Slabs;
+};
+
+static const int POOL_HEADER = static_cast<int>(sizeof(PoolBlockHeader));
+static const int POOL_SLAB_BYTES = 64 * 1024;
+static const int POOL_MIN_BLOCKS_PER_SLAB = 4;
+
+static atomic<bool> PoolEnabled(true);
+static atomic<long long> PoolSlabs(0);
+static atomic<long long> PoolSlabBytes(0);
+static atomic<long long> PoolLargeBlocks(0);
+
+// Never destroyed: blocks may be freed from static destructors after main().
+static mutex& PoolLock() {
+    static mutex* lock = new mutex;
+    return *lock;
+}
+static vector<PoolCache*>& PoolAllCaches() {
+    static vector<PoolCache*>* caches = new vector<PoolCache*>;
+    return *caches;
+}
+static vector<PoolCache*>& PoolOrphans() {
+    static vector<PoolCache*>* orphans = new vector<PoolCache*>;
+    return *orphans;
+}
+
+// Trivial thread-locals, so they stay usable while other thread-local
+// destructors free their buffers.
+static thread_local PoolCache* PoolThreadCache = nullptr;
+static thread_local bool PoolThreadRetired = false;
+
+// Hands the thread's cache on when the thread exits.
+struct PoolCacheRetirer {
+    bool Armed = false;
+    ~PoolCacheRetirer() {
+        PoolThreadRetired = true;
+        if (!PoolThreadCache)
+            return;
+        lock_guard<mutex> guard(PoolLock());
+        PoolOrphans().push_back(PoolThreadCache);
+        PoolThreadCache = nullptr;
+    }
+};
+static thread_local PoolCacheRetirer PoolRetirer;
+
+static PoolCache* AcquireCache() {
+    lock_guard<mutex> guard(PoolLock());
+    vector<PoolCache*>& orphans = PoolOrphans();
+    if (!orphans.empty()) {
+        PoolCache* cache = orphans.back();
+        orphans.pop_back();
+        return cache;
+    }
+    PoolCache* cache = new PoolCache;
+    for (int i = 0; i < BufferPool::CLASS_COUNT; ++i) {
+        cache->Local[i] = nullptr;
+        cache->Remote[i].store(nullptr, memory_order_relaxed);
+    }
+    cache->RemoteFrees.store(0, memory_order_relaxed);
+    PoolAllCaches().push_back(cache);
+    return cache;
+}
+
+static int ClassSize(int sizeClass) {
+    return BufferPool::MIN_CLASS_SIZE << sizeClass;
+}
+
+static int ClassFor(int size) {
+    int sizeClass = 0;
+    while (sizeClass < BufferPool::CLASS_COUNT && ClassSize(sizeClass) < size)
+        ++sizeClass;
+    return sizeClass < BufferPool::CLASS_COUNT ? sizeClass : -1;
+}
+
+static char* AllocateLarge(int size) {
+    char* raw = new char[POOL_HEADER + size];
+    PoolBlockHeader* header = reinterpret_cast<PoolBlockHeader*>(raw);
+    header->Owner = nullptr;
+    header->SizeClass = -1;
+    header->Capacity = size;
+    PoolLargeBlocks.fetch_add(1, memory_order_relaxed);
+    return raw + POOL_HEADER;
+}
+
+// Carve a new slab into blocks of one class and return the first of them.
+static PoolFreeBlock* Refill(PoolCache* cache, int sizeClass) {
+    int stride = POOL_HEADER + ClassSize(sizeClass);
+    int count = POOL_SLAB_BYTES / stride;
+    if (count < POOL_MIN_BLOCKS_PER_SLAB)
+        count = POOL_MIN_BLOCKS_PER_SLAB;
+    char* slab = new char[static_cast<size_t>(stride) * count];
+    cache->Slabs.push_back(slab);
+    PoolSlabs.fetch_add(1, memory_order_relaxed);
+    PoolSlabBytes.fetch_add(static_cast<long long>(stride) * count, memory_order_relaxed);
+
+    PoolFreeBlock* head = nullptr;
+    for (int i = count - 1; i >= 0; --i) {
+        char* raw = slab + static_cast<size_t>(stride) * i;
+        PoolBlockHeader* header = reinterpret_cast<PoolBlockHeader*>(raw);
+        header->Owner = cache;
+        header->SizeClass = sizeClass;
+        header->Capacity = ClassSize(sizeClass);
+        PoolFreeBlock* block = reinterpret_cast<PoolFreeBlock*>(raw + POOL_HEADER);
+        block->Next = head;
+        head = block;
+    }
+    return head;
+}
+
+char* BufferPool::Allocate(int size) {
+    if (size < 1)
+        size = 1;
+    int sizeClass = ClassFor(size);
+    if (sizeClass < 0 || !PoolEnabled.load(memory_order_relaxed))
+        return AllocateLarge(size);
+
+    PoolCache* cache = PoolThreadCache;
+    if (!cache) {
+        // Thread-local destructors are running; no cache to hand out from.
+        if (PoolThreadRetired)
+            return AllocateLarge(size);
+        PoolRetirer.Armed = true;
+        cache = PoolThreadCache = AcquireCache();
+    }
+
+    PoolFreeBlock* block = cache->Local[sizeClass];
+    if (!block) {
+        // Take back everything other threads have freed since the last time.
+        block = cache->Remote[sizeClass].exchange(nullptr, memory_order_acquire);
+        if (!block)
+            block = Refill(cache, sizeClass);
+    }
+    cache->Local[sizeClass] = block->Next;
+    return reinterpret_cast<char*>(block);
+}
+
+void BufferPool::Free(void* block) {
+    if (!block)
+        return;
+    char* user = static_cast<char*>(block);
+    PoolBlockHeader* header = reinterpret_cast<PoolBlockHeader*>(user - POOL_HEADER);
+    if (header->SizeClass < 0) {
+        delete[] reinterpret_cast<char*>(header);
+        return;
+    }
+
+    PoolFreeBlock* freed = reinterpret_cast<PoolFreeBlock*>(user);
+    PoolCache* owner = header->Owner;
+    int sizeClass = header->SizeClass;
+    if (owner == PoolThreadCache) {
+        freed->Next = owner->Local[sizeClass];
+        owner->Local[sizeClass] = freed;
+        return;
+    }
+    // Push-only from here; the owner empties the list with a single exchange,
+    // so there is no ABA to worry about.
+    PoolFreeBlock* head = owner->Remote[sizeClass].load(memory_order_relaxed);
+    do {
+        freed->Next = head;
+    } while (!owner->Remote[sizeClass].compare_exchange_weak(head, freed, memory_order_release, memory_order_relaxed));
+    owner->RemoteFrees.fetch_add(1, memory_order_relaxed);
+}
+
+int BufferPool::Capacity(const void* block) {
+    const PoolBlockHeader* header = reinterpret_cast<const PoolBlockHeader*>(static_cast<const char*>(block) - POOL_HEADER);
+    return header->Capacity;
+}
+
+void BufferPool::SetEnabled(bool enable) {
+    PoolEnabled.store(enable, memory_order_relaxed);
+}
+
+bool BufferPool::IsEnabled() {
+    return PoolEnabled.load(memory_order_relaxed);
+}
+
+BufferPool::Stats BufferPool::GetStats() {
+    Stats stats;
+    stats.Slabs = PoolSlabs.load(memory_order_relaxed);
+    stats.SlabBytes = PoolSlabBytes.load(memory_order_relaxed);
+    stats.LargeBlocks = PoolLargeBlocks.load(memory_order_relaxed);
+    stats.RemoteFrees = 0;
+    lock_guard<mutex> guard(PoolLock());
+    for (PoolCache* cache : PoolAllCaches())
+        stats.RemoteFrees += cache->RemoteFrees.load(memory_order_relaxed);
+    stats.Caches = static_cast<int>(PoolAllCaches().size());
+    return stats;
+}
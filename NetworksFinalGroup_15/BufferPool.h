@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+using namespace std;
+
+// Thread-local slab allocator for packet bodies, serialization buffers, queue
+// nodes and socket receive buffers.
+//
+// Sizes are rounded up to a power-of-two class from 64 bytes to 64 KB, which
+// covers HEADERSIZE + body + CRC of anything PktFramer can carry and the usual
+// socket MaxSize. Every thread allocates from its own cache: one free list per
+// class, refilled a 64 KB slab at a time, so the common case is a pointer pop
+// with no lock and no malloc. Each block remembers the cache that carved it.
+// Freeing on that thread pushes it back onto the local list; freeing on any
+// other thread (a packet built by a producer and retired by a worker) pushes
+// it onto the owner's lock-free return list, which the owner takes back in
+// one exchange when its local list runs dry.
+//
+// Slabs are never returned to the system. A cache outlives its thread and is
+// handed to the next thread that starts, so blocks still in flight when a
+// thread exits are not lost. Larger requests, and every request while the
+// pool is disabled, go straight to new[].
+class BufferPool {
+public:
+    static const int MIN_CLASS_SIZE = 64;
+    static const int MAX_CLASS_SIZE = 64 * 1024;
+    static const int CLASS_COUNT = 11;
+
+    struct Stats {
+        long long Slabs;            // Slab allocations (each one new[] call).
+        long long SlabBytes;
+        long long LargeBlocks;      // Requests served by new[] directly.
+        long long RemoteFrees;      // Blocks freed by a thread other than their owner.
+        int Caches;                 // Thread caches created so far.
+    };
+
+    // A block of at least size bytes, aligned to 16. Never returns nullptr.
+    static char* Allocate(int size);
+    // Return a block from Allocate() on any thread. nullptr is ignored.
+    static void Free(void* block);
+    // Usable size of a block, which may exceed what was asked for.
+    static int Capacity(const void* block);
+
+    // Off makes Allocate() plain new[], e.g. to compare against the pool or
+    // to let a leak checker see every buffer. Blocks may be freed either way.
+    static void SetEnabled(bool enable);
+    static bool IsEnabled();
+    static Stats GetStats();
+
+private:
+    BufferPool();
+};
+
+// new/delete for pooled objects. The object is constructed in a pool block and
+// may be deleted on any thread.
+template <typename T, typename... Args>
+T* PoolNew(Args&&... args) {
+    static_assert(alignof(T) <= 16, "Pool blocks are 16-byte aligned");
+    char* block = BufferPool::Allocate(static_cast<int>(sizeof(T)));
+    try {
+        return new (block) T(forward<Args>(args)...);
+    }
+    catch (...) {
+        BufferPool::Free(block);
+        throw;
+    }
+}
+
+template <typename T>
+void PoolDelete(T* object) {
+    if (!object)
+        return;
+    object->~T();
+    BufferPool::Free(object);
+}
@@ -0,0 +1,151 @@
+#include "BulkParser.h"
+#include "PktFramer.h"
+using namespace std;
+
+// Packets whose CRCs are computed per ComputeBatch() call.
+static const int CRC_BATCH = 64;
+// How far ahead of the frame walk to prefetch. Each length prefix depends on
+// the previous one, so without this every frame of a large replay waits on
+// its own cache miss.
+static const int PREFETCH_AHEAD = 4096;
+static const int CACHE_LINE = 64;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define BULK_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define BULK_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BULK_PREFETCH(p) ((void)0)
+#endif
+
+BulkParser::BulkParser(int reserve) : Source(nullptr), Consumed(0), Invalid(0),
+    CrcIndex(CRC_BATCH), CrcData(CRC_BATCH), CrcSizes(CRC_BATCH), CrcResults(CRC_BATCH)
+{
+    Columns.Count = 0;
+    Grow(reserve > 0 ? reserve : 1);
+}
+
+void BulkParser::Grow(int packets) {
+    if (static_cast<int>(Columns.PktCount.size()) >= packets)
+        return;
+    Columns.PktCount.resize(packets);
+    Columns.Flags.resize(packets);
+    Columns.BodyOffset.resize(packets);
+    Columns.BodyLength.resize(packets);
+    Columns.Valid.resize(packets);
+}
+
+int BulkParser::Parse(const char* buffer, int length, bool validateCrc) {
+    // Every non-empty frame gets a row, even one too short to hold a header,
+    // so prefix + 1 byte is what bounds the packet count.
+    const int minFrame = PktFramer::PREFIXSIZE + 1;
+    Grow(length / minFrame + 1);
+
+    Source = buffer;
+    Invalid = 0;
+    unsigned short* counts = Columns.PktCount.data();
+    unsigned char* flags = Columns.Flags.data();
+    unsigned int* offsets = Columns.BodyOffset.data();
+    unsigned short* lengths = Columns.BodyLength.data();
+    unsigned char* valid = Columns.Valid.data();
+
+    // Walk the length prefixes and split out the header fields. CRCs are
+    // checked every CRC_BATCH packets, while those frames are still in cache.
+    int n = 0;
+    int checked = 0;
+    int pos = 0;
+    int prefetched = 0;
+    while (pos + PktFramer::PREFIXSIZE <= length) {
+        int horizon = (pos + PREFETCH_AHEAD < length) ? pos + PREFETCH_AHEAD : length;
+        for (; prefetched < horizon; prefetched += CACHE_LINE)
+            BULK_PREFETCH(buffer + prefetched);
+
+        int frameLen = WireFormat::Load16(buffer + pos);
+        if (pos + PktFramer::PREFIXSIZE + frameLen > length)
+            break;
+        const char* pkt = buffer + pos + PktFramer::PREFIXSIZE;
+        pos += PktFramer::PREFIXSIZE + frameLen;
+        if (frameLen == 0)
+            continue;       // Keep-alive frame, as in PktFramer.
+
+        unsigned char f = (frameLen >= WireFormat::HEADER_SIZE) ? static_cast<unsigned char>(pkt[2]) : 0;
+        int crcSize = Checksum::Size(static_cast<CrcAlgorithm>((f & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT));
+        int bodyLen = frameLen - WireFormat::HEADER_SIZE - crcSize;
+        bool wellFormed = bodyLen >= 0;
+
+        counts[n] = wellFormed ? WireFormat::Load16(pkt) : 0;
+        flags[n] = f;
+        offsets[n] = static_cast<unsigned int>(pkt - buffer) + WireFormat::HEADER_SIZE;
+        lengths[n] = static_cast<unsigned short>(wellFormed ? bodyLen : 0);
+        valid[n] = wellFormed ? 1 : 0;
+        ++n;
+        if (validateCrc && n - checked == CRC_BATCH) {
+            ValidateRange(checked, n);
+            checked = n;
+        }
+    }
+    if (validateCrc)
+        ValidateRange(checked, n);
+    Columns.Count = n;
+    Consumed = pos;
+
+    for (int i = 0; i < n; ++i)
+        Invalid += valid[i] ^ 1;
+    return n;
+}
+
+void BulkParser::ValidateRange(int first, int end) {
+    const unsigned char* flags = Columns.Flags.data();
+    // Split into runs that share an algorithm; normally the whole range is one run.
+    while (first < end) {
+        int last = first + 1;
+        while (last < end && ((flags[last] ^ flags[first]) & WireFormat::CRC_TYPE_MASK) == 0)
+            ++last;
+        ValidateRun(static_cast<CrcAlgorithm>((flags[first] & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT),
+            first, last);
+        first = last;
+    }
+}
+
+void BulkParser::ValidateRun(CrcAlgorithm alg, int first, int last) {
+    int count = 0;
+    for (int i = first; i < last; ++i) {
+        if (!Columns.Valid[i])
+            continue;       // Too short to hold a CRC.
+        // The CRC covers header + body, which sit right before the trailer.
+        CrcIndex[count] = i;
+        CrcData[count] = Source + Columns.BodyOffset[i] - WireFormat::HEADER_SIZE;
+        CrcSizes[count] = WireFormat::HEADER_SIZE + Columns.BodyLength[i];
+        ++count;
+    }
+    Checksum::ComputeBatch(alg, CrcData.data(), CrcSizes.data(), CrcResults.data(), count);
+    for (int k = 0; k < count; ++k) {
+        unsigned int stored = Checksum::Load(alg, CrcData[k] + CrcSizes[k]);
+        Columns.Valid[CrcIndex[k]] = (stored == CrcResults[k]) ? 1 : 0;
+    }
+}
+
+const PacketColumns& BulkParser::GetColumns() {
+    return Columns;
+}
+
+const char* BulkParser::GetBody(int i) {
+    return Source + Columns.BodyOffset[i];
+}
+
+bool BulkParser::IsAck(int i) {
+    return (Columns.Flags[i] & WireFormat::FLAG_ACK) != 0;
+}
+
+CrcAlgorithm BulkParser::GetCrcType(int i) {
+    return static_cast<CrcAlgorithm>((Columns.Flags[i] & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT);
+}
+
+int BulkParser::GetConsumed() {
+    return Consumed;
+}
+
+int BulkParser::GetInvalid() {
+    return Invalid;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "Checksum.h"
+#include "WireFormat.h"
+#include <vector>
+using namespace std;
+
+// Decoded header fields of a run of packets, one array per field
+// (structure-of-arrays), so validation and filtering passes touch only the
+// columns they need. Bodies are not copied: BodyOffset indexes the buffer
+// that was parsed.
+struct PacketColumns {
+    vector<unsigned short> PktCount;
+    vector<unsigned char> Flags;        // Wire flags byte: WireFormat::FLAG_* and CRC type bits.
+    vector<unsigned int> BodyOffset;    // Start of the body within the parsed buffer.
+    vector<unsigned short> BodyLength;
+    vector<unsigned char> Valid;        // 1 if the frame is well-formed and its CRC matches.
+    int Count;                          // Entries in use; the vectors may be longer.
+};
+
+// Bulk decoder for recorded or streamed command traffic: a contiguous buffer
+// of back-to-back frames in PktFramer's format ([len lo][len hi][packet]).
+//
+// One Parse() call walks every complete frame, fills PacketColumns and checks
+// all CRCs in batches (Checksum::ComputeBatch), without building a PktDef or
+// allocating once the columns have grown to the working size.
+class BulkParser {
+public:
+    // Constructor: reserve room for this many packets up front.
+    explicit BulkParser(int reserve = 1024);
+
+    // Decode every complete frame in buffer. Returns the number of packets;
+    // GetConsumed() tells where the first incomplete frame starts, so a
+    // streaming caller can keep the remainder for the next call. The buffer
+    // must stay alive while GetBody() pointers are used.
+    int Parse(const char* buffer, int length, bool validateCrc = true);
+
+    const PacketColumns& GetColumns();
+    // Body of packet i, pointing into the parsed buffer.
+    const char* GetBody(int i);
+    // Accessors over the flags column.
+    bool IsAck(int i);
+    CrcAlgorithm GetCrcType(int i);
+
+    int GetConsumed();          // Bytes of whole frames in the last Parse().
+    int GetInvalid();           // Packets in the last Parse() with Valid == 0.
+
+private:
+    void Grow(int packets);
+    void ValidateRange(int first, int end);
+    void ValidateRun(CrcAlgorithm alg, int first, int last);
+
+    PacketColumns Columns;
+    const char* Source;
+    int Consumed;
+    int Invalid;
+
+    // CRC batch scratch, reused between calls.
+    vector<int> CrcIndex;
+    vector<const char*> CrcData;
+    vector<int> CrcSizes;
+    vector<unsigned int> CrcResults;
+};
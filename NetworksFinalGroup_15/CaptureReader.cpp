@@ -0,0 +1,243 @@
+#include "CaptureReader.h"
+#include "MySocket.h"
+#include "WireFormat.h"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const size_t HEADER = PacketCapture::RECORD_HEADER_SIZE;
+
+CaptureReader::CaptureReader(const string& path)
+    : Base(nullptr), FileSize(0), DataEnd(0), Position(0), StartWallNs(0), Indexed(false)
+{
+#ifdef _WIN32
+    FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    MappingHandle = NULL;
+    if (FileHandle == INVALID_HANDLE_VALUE)
+        throw runtime_error("Failed to open capture file " + path);
+    LARGE_INTEGER size;
+    GetFileSizeEx(FileHandle, &size);
+    FileSize = static_cast<size_t>(size.QuadPart);
+    if (FileSize >= static_cast<size_t>(PacketCapture::FILE_HEADER_SIZE)) {
+        MappingHandle = CreateFileMappingA(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (MappingHandle)
+            Base = static_cast<const char*>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!Base) {
+        if (MappingHandle)
+            CloseHandle(MappingHandle);
+        CloseHandle(FileHandle);
+        throw runtime_error("Failed to map capture file " + path);
+    }
+#else
+    Fd = open(path.c_str(), O_RDONLY);
+    if (Fd < 0)
+        throw runtime_error("Failed to open capture file " + path);
+    struct stat st;
+    if (fstat(Fd, &st) == 0)
+        FileSize = static_cast<size_t>(st.st_size);
+    if (FileSize >= static_cast<size_t>(PacketCapture::FILE_HEADER_SIZE)) {
+        void* mapped = mmap(nullptr, FileSize, PROT_READ, MAP_PRIVATE, Fd, 0);
+        if (mapped != MAP_FAILED) {
+            Base = static_cast<const char*>(mapped);
+            madvise(mapped, FileSize, MADV_SEQUENTIAL);
+        }
+    }
+    if (!Base) {
+        close(Fd);
+        throw runtime_error("Failed to map capture file " + path);
+    }
+#endif
+    if (memcmp(Base, "RBTCAP01", 8) != 0 || WireFormat::Load32(Base + 8) != PacketCapture::FORMAT_VERSION) {
+        Unmap();
+        throw runtime_error("Not a capture file: " + path);
+    }
+    StartWallNs = static_cast<long long>(WireFormat::Load64(Base + 16));
+    DataEnd = FileSize;
+
+    // A clean log ends with the trailer; use its index if it checks out.
+    if (FileSize >= static_cast<size_t>(PacketCapture::FILE_HEADER_SIZE + PacketCapture::TRAILER_SIZE)) {
+        const char* trailer = Base + FileSize - PacketCapture::TRAILER_SIZE;
+        size_t indexOffset = static_cast<size_t>(WireFormat::Load64(trailer));
+        size_t indexSize = 0;
+        if (memcmp(trailer + 8, "RBTCAPIX", 8) == 0 && indexOffset >= static_cast<size_t>(PacketCapture::FILE_HEADER_SIZE)
+            && indexOffset < FileSize - PacketCapture::TRAILER_SIZE) {
+            DataEnd = FileSize - PacketCapture::TRAILER_SIZE;
+            if (ReadRecord(indexOffset, indexSize) && Base[indexOffset + 7] == PacketCapture::RECORD_INDEX) {
+                LoadIndex(indexOffset);
+                DataEnd = indexOffset;
+                Indexed = true;
+            }
+            else {
+                DataEnd = FileSize;
+            }
+        }
+    }
+    if (!Indexed)
+        ScanStreams();
+    Rewind();
+}
+
+CaptureReader::~CaptureReader() {
+    Unmap();
+}
+
+void CaptureReader::Unmap() {
+    if (!Base)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(Base);
+    CloseHandle(MappingHandle);
+    CloseHandle(FileHandle);
+#else
+    munmap(const_cast<char*>(Base), FileSize);
+    close(Fd);
+#endif
+    Base = nullptr;
+}
+
+bool CaptureReader::ReadRecord(size_t offset, size_t& size) {
+    // Rejects a record cut short by a crash as well as one past DataEnd.
+    if (offset + HEADER > DataEnd)
+        return false;
+    size = PacketCapture::AlignRecord(HEADER + WireFormat::Load32(Base + offset));
+    return size <= DataEnd - offset;
+}
+
+void CaptureReader::LoadIndex(size_t offset) {
+    const char* p = Base + offset + HEADER;
+    const char* end = p + WireFormat::Load32(Base + offset);
+    if (end - p < 4)
+        return;
+    uint32_t streams = WireFormat::Load32(p);
+    p += 4;
+    for (uint32_t i = 0; i < streams && end - p >= 4; ++i) {
+        int id = WireFormat::Load16(p);
+        int length = WireFormat::Load16(p + 2);
+        if (end - p - 4 < length)
+            return;
+        if (id >= static_cast<int>(StreamLabels.size()))
+            StreamLabels.resize(id + 1);
+        StreamLabels[id] = string(p + 4, length);
+        p += 4 + length;
+    }
+    if (end - p < 4)
+        return;
+    uint32_t entries = WireFormat::Load32(p);
+    p += 4;
+    for (uint32_t i = 0; i < entries && end - p >= 16; ++i, p += 16)
+        Index.push_back(make_pair(static_cast<long long>(WireFormat::Load64(p)), static_cast<long long>(WireFormat::Load64(p + 8))));
+}
+
+void CaptureReader::ScanStreams() {
+    size_t offset = PacketCapture::FILE_HEADER_SIZE;
+    size_t size;
+    while (ReadRecord(offset, size)) {
+        if (Base[offset + 7] == PacketCapture::RECORD_STREAM) {
+            int id = WireFormat::Load16(Base + offset + 4);
+            if (id >= static_cast<int>(StreamLabels.size()))
+                StreamLabels.resize(id + 1);
+            StreamLabels[id] = string(Base + offset + HEADER, WireFormat::Load32(Base + offset));
+        }
+        offset += size;
+    }
+    // Anything after the last complete record is a torn write.
+    DataEnd = offset;
+}
+
+bool CaptureReader::Next(CaptureRecord& record) {
+    size_t size;
+    while (ReadRecord(Position, size)) {
+        const char* header = Base + Position;
+        Position += size;
+        if (header[7] != PacketCapture::RECORD_DATA)
+            continue;
+        record.Length = static_cast<int>(WireFormat::Load32(header));
+        record.Stream = WireFormat::Load16(header + 4);
+        record.Direction = header[6] == CAPTURE_IN ? CAPTURE_IN : CAPTURE_OUT;
+        record.TimestampNs = static_cast<long long>(WireFormat::Load64(header + 8));
+        record.Data = header + HEADER;
+        return true;
+    }
+    return false;
+}
+
+void CaptureReader::Rewind() {
+    Position = PacketCapture::FILE_HEADER_SIZE;
+}
+
+void CaptureReader::SeekTime(long long timestampNs) {
+    // Jump to the last index entry before the target, then walk forward. With
+    // several recording threads timestamps are only roughly ordered, so start
+    // one entry early.
+    Rewind();
+    size_t i = 0;
+    while (i < Index.size() && Index[i].first < timestampNs)
+        ++i;
+    if (i >= 2)
+        Position = static_cast<size_t>(Index[i - 2].second);
+
+    size_t size;
+    while (ReadRecord(Position, size)) {
+        const char* header = Base + Position;
+        if (header[7] == PacketCapture::RECORD_DATA && static_cast<long long>(WireFormat::Load64(header + 8)) >= timestampNs)
+            return;
+        Position += size;
+    }
+}
+
+bool CaptureReader::HasIndex() {
+    return Indexed;
+}
+
+long long CaptureReader::GetStartWallNs() {
+    return StartWallNs;
+}
+
+int CaptureReader::GetStreamCount() {
+    return static_cast<int>(StreamLabels.size());
+}
+
+string CaptureReader::GetStreamLabel(int stream) {
+    if (stream < 0 || stream >= static_cast<int>(StreamLabels.size()))
+        return string();
+    return StreamLabels[stream];
+}
+
+int ReplayCapture(CaptureReader& reader, MySocket& socket, int stream, CaptureDirection direction, double speed) {
+    CaptureRecord record;
+    int sent = 0;
+    bool first = true;
+    long long firstNs = 0;
+    chrono::steady_clock::time_point start;
+    while (reader.Next(record)) {
+        if (record.Direction != direction || (stream >= 0 && record.Stream != stream))
+            continue;
+        if (first) {
+            first = false;
+            firstNs = record.TimestampNs;
+            start = chrono::steady_clock::now();
+        }
+        else if (speed > 0) {
+            long long offsetNs = static_cast<long long>((record.TimestampNs - firstNs) / speed);
+            this_thread::sleep_until(start + chrono::nanoseconds(offsetNs));
+        }
+        socket.SendData(record.Data, record.Length);
+        ++sent;
+    }
+    return sent;
+}
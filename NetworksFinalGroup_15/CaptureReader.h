@@ -0,0 +1,68 @@
+#pragma once
+#include "PacketCapture.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+class MySocket;
+
+// One captured frame. Data points into the mapped file and stays valid for
+// the lifetime of the reader.
+struct CaptureRecord {
+    long long TimestampNs;      // Since the start of the capture.
+    int Stream;
+    CaptureDirection Direction;
+    const char* Data;
+    int Length;
+};
+
+// Read-only view of a PacketCapture log. The whole file is memory-mapped, so
+// walking it costs no reads or copies; frames are handed out as pointers into
+// the mapping.
+class CaptureReader {
+public:
+    // Map the file. Throws if it cannot be opened or is not a capture log.
+    explicit CaptureReader(const string& path);
+    ~CaptureReader();
+
+    // Step to the next data frame. Returns false at the end of the log.
+    bool Next(CaptureRecord& record);
+    // Go back to the first frame.
+    void Rewind();
+    // Position so the next Next() returns the first frame at or after
+    // timestampNs. Uses the index when the log has one.
+    void SeekTime(long long timestampNs);
+
+    // True if the log was closed cleanly and carries an index.
+    bool HasIndex();
+    long long GetStartWallNs();         // Capture start, ns since the Unix epoch.
+    int GetStreamCount();
+    string GetStreamLabel(int stream);  // Empty if the stream is unknown.
+
+private:
+    void Unmap();
+    bool ReadRecord(size_t offset, size_t& size);
+    void LoadIndex(size_t offset);
+    void ScanStreams();
+
+    const char* Base;
+    size_t FileSize;
+    size_t DataEnd;             // Start of the index, or end of the last complete record.
+    size_t Position;
+    long long StartWallNs;
+    bool Indexed;
+    vector<string> StreamLabels;
+    vector<pair<long long, long long>> Index;
+#ifdef _WIN32
+    void* FileHandle;
+    void* MappingHandle;
+#else
+    int Fd;
+#endif
+};
+
+// Send the frames of one stream (or every stream, with stream = -1) that
+// were captured in the given direction through socket. speed scales the
+// original pacing: 1.0 replays in real time, 2.0 twice as fast, and 0 sends
+// back to back. Returns the number of frames sent.
+int ReplayCapture(CaptureReader& reader, MySocket& socket, int stream, CaptureDirection direction, double speed);
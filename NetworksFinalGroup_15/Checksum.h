@@ -0,0 +1,49 @@
+#pragma once
+
+// Checksum algorithms a PktDef trailer can carry. The numeric value is what
+// is stored in the header's CrcType bits, so CRC_XOR must stay 0: packets
+// from legacy peers (padding bits all zero) are then verified as XOR.
+enum CrcAlgorithm { CRC_XOR = 0, CRC_8 = 1, CRC_16 = 2, CRC_32C = 3 };
+
+// Table-driven checksum engine used by PktDef.
+//
+//   CRC_XOR  - legacy 1-byte XOR of all bytes.
+//   CRC_8    - CRC-8/ROHC   (poly 0x07, reflected, init 0xFF), 1 byte.
+//   CRC_16   - CRC-16/X-25  (poly 0x1021, reflected, init/xorout 0xFFFF), 2 bytes.
+//   CRC_32C  - CRC-32C      (Castagnoli, reflected, init/xorout 0xFFFFFFFF), 4 bytes.
+//
+// All CRCs run slicing-by-8 (eight bytes per table step). CRC-32C switches to
+// the SSE4.2 / ARMv8 CRC32 instructions when the CPU supports them.
+//
+// Checksums can be computed in one call with Compute(), or incrementally:
+//   unsigned int state = Checksum::Init(alg);
+//   state = Checksum::Update(alg, state, part1, len1);
+//   state = Checksum::Update(alg, state, part2, len2);
+//   unsigned int crc = Checksum::Final(alg, state);
+class Checksum {
+public:
+    // Largest trailer any algorithm produces.
+    static const int MAX_SIZE = 4;
+
+    // Number of trailer bytes the algorithm writes.
+    static int Size(CrcAlgorithm alg);
+
+    // Incremental interface.
+    static unsigned int Init(CrcAlgorithm alg);
+    static unsigned int Update(CrcAlgorithm alg, unsigned int state, const char* data, int size);
+    static unsigned int Final(CrcAlgorithm alg, unsigned int state);
+
+    // One-shot checksum of a buffer.
+    static unsigned int Compute(CrcAlgorithm alg, const char* data, int size);
+    // Checksums of count independent buffers: out[i] = Compute(alg, data[i], sizes[i]).
+    // Hardware CRC-32C interleaves four buffers at a time, which is much
+    // faster than separate calls when the buffers are short packets.
+    static void ComputeBatch(CrcAlgorithm alg, const char* const* data, const int* sizes, unsigned int* out, int count);
+
+    // Write / read a checksum as Size(alg) little-endian bytes.
+    static void Store(CrcAlgorithm alg, unsigned int crc, char* dest);
+    static unsigned int Load(CrcAlgorithm alg, const char* src);
+
+    // True if CRC_32C is being computed with CPU instructions.
+    static bool HardwareAccelerated();
+};
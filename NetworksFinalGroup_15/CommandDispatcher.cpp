@@ -0,0 +1,462 @@
+#include "CommandDispatcher.h"
+#include "BufferPool.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+using namespace std;
+
+// Failed FindWork() rounds (each followed by a yield) before a worker sleeps.
+static const int IDLE_SPINS = 64;
+static const long long INITIAL_DEQUE_SIZE = 64;
+
+// splitmix64 finalizer: spreads sequential session ids over shards and workers.
+static unsigned long long MixKey(unsigned long long key) {
+    key += 0x9E3779B97F4A7C15ULL;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+CommandDispatcher::StealDeque::StealDeque()
+    : Top(0), Bottom(0)
+{
+    Array* a = new Array;
+    a->Size = INITIAL_DEQUE_SIZE;
+    a->Slots = new atomic<Strand*>[INITIAL_DEQUE_SIZE];
+    Items.store(a, memory_order_relaxed);
+}
+
+CommandDispatcher::StealDeque::~StealDeque() {
+    Retired.push_back(Items.load(memory_order_relaxed));
+    for (Array* a : Retired) {
+        delete[] a->Slots;
+        delete a;
+    }
+}
+
+void CommandDispatcher::StealDeque::Push(Strand* strand) {
+    long long b = Bottom.load(memory_order_relaxed);
+    long long t = Top.load(memory_order_acquire);
+    Array* a = Items.load(memory_order_relaxed);
+    if (b - t > a->Size - 1)
+        a = Grow(a, b, t);
+    a->Slots[b & (a->Size - 1)].store(strand, memory_order_relaxed);
+    Bottom.store(b + 1, memory_order_release);
+}
+
+CommandDispatcher::Strand* CommandDispatcher::StealDeque::Pop() {
+    long long b = Bottom.load(memory_order_relaxed) - 1;
+    Array* a = Items.load(memory_order_relaxed);
+    // The store to Bottom must be visible before Top is read; seq_cst on both
+    // stands in for the paper's full fence.
+    Bottom.store(b, memory_order_seq_cst);
+    long long t = Top.load(memory_order_seq_cst);
+    if (t > b) {
+        Bottom.store(b + 1, memory_order_relaxed);
+        return nullptr;
+    }
+    Strand* strand = a->Slots[b & (a->Size - 1)].load(memory_order_relaxed);
+    if (t == b) {
+        // Last item: race the thieves for it.
+        if (!Top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            strand = nullptr;
+        Bottom.store(b + 1, memory_order_relaxed);
+    }
+    return strand;
+}
+
+CommandDispatcher::Strand* CommandDispatcher::StealDeque::Steal() {
+    long long t = Top.load(memory_order_seq_cst);
+    long long b = Bottom.load(memory_order_seq_cst);
+    if (t >= b)
+        return nullptr;
+    Array* a = Items.load(memory_order_acquire);
+    Strand* strand = a->Slots[t & (a->Size - 1)].load(memory_order_relaxed);
+    if (!Top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        return nullptr;     // Lost to the owner or another thief.
+    return strand;
+}
+
+bool CommandDispatcher::StealDeque::Empty() {
+    return Bottom.load(memory_order_relaxed) <= Top.load(memory_order_relaxed);
+}
+
+CommandDispatcher::StealDeque::Array* CommandDispatcher::StealDeque::Grow(Array* old, long long bottom, long long top) {
+    Array* a = new Array;
+    a->Size = old->Size * 2;
+    a->Slots = new atomic<Strand*>[a->Size];
+    for (long long i = top; i < bottom; ++i)
+        a->Slots[i & (a->Size - 1)].store(old->Slots[i & (old->Size - 1)].load(memory_order_relaxed), memory_order_relaxed);
+    Retired.push_back(old);
+    Items.store(a, memory_order_release);
+    return a;
+}
+
+CommandDispatcher::CommandDispatcher(int numWorkers, Handler handler, DispatchOrder order)
+    : PacketHandler(handler), Order(order), Shards(new Shard[SHARD_COUNT]), Running(false), Sleepers(0),
+    Queued(0), Handled(0), Steals(0), Stale(0), Rejected(0), HandlerErrors(0)
+{
+    if (numWorkers < 1)
+        numWorkers = static_cast<int>(thread::hardware_concurrency());
+    if (numWorkers < 1)
+        numWorkers = 1;
+    for (int i = 0; i < numWorkers; ++i) {
+        unique_ptr<Worker> w(new Worker);
+        w->Inbox.store(nullptr, memory_order_relaxed);
+        w->Rng = static_cast<unsigned int>(i) * 2654435761u + 1;
+        Workers.push_back(move(w));
+    }
+}
+
+CommandDispatcher::~CommandDispatcher() {
+    Stop();
+    for (int i = 0; i < SHARD_COUNT; ++i) {
+        for (auto& entry : Shards[i].Strands) {
+            Strand* s = entry.second.get();
+            Node* node = s->Incoming.exchange(nullptr);
+            while (node) {
+                Node* next = node->Next;
+                PoolDelete(node);
+                node = next;
+            }
+            for (size_t j = s->PendingHead; j < s->Pending.size(); ++j)
+                PoolDelete(s->Pending[j]);
+        }
+    }
+}
+
+void CommandDispatcher::Start() {
+    if (Running.exchange(true))
+        return;
+    for (size_t i = 0; i < Workers.size(); ++i)
+        Workers[i]->Thread = thread(&CommandDispatcher::Run, this, static_cast<int>(i));
+}
+
+void CommandDispatcher::Stop() {
+    if (!Running.exchange(false))
+        return;
+    {
+        lock_guard<mutex> lock(SleepLock);
+        SleepSignal.notify_all();
+    }
+    for (unique_ptr<Worker>& w : Workers) {
+        if (w->Thread.joinable())
+            w->Thread.join();
+    }
+}
+
+bool CommandDispatcher::Submit(unsigned long long session, char* raw, int length) {
+    Node* node = PoolNew<Node>();
+    try {
+        node->Packet.Parse(raw, length);
+    }
+    catch (const runtime_error&) {
+        PoolDelete(node);
+        Rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    if (!node->Packet.CheckCRC(raw, length)) {
+        PoolDelete(node);
+        Rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    node->End = false;
+    Shard& shard = ShardFor(session);
+    lock_guard<mutex> lock(shard.Lock);
+    Enqueue(GetStrand(shard, session), node);
+    return true;
+}
+
+void CommandDispatcher::Submit(unsigned long long session, PktDef& pkt) {
+    Node* node = PoolNew<Node>();
+    node->Packet = pkt;
+    node->End = false;
+    Shard& shard = ShardFor(session);
+    lock_guard<mutex> lock(shard.Lock);
+    Enqueue(GetStrand(shard, session), node);
+}
+
+void CommandDispatcher::EndSession(unsigned long long session) {
+    Shard& shard = ShardFor(session);
+    lock_guard<mutex> lock(shard.Lock);
+    auto it = shard.Strands.find(session);
+    if (it == shard.Strands.end())
+        return;
+    Node* node = PoolNew<Node>();
+    node->End = true;
+    Enqueue(it->second.get(), node);
+}
+
+CommandDispatcher::Shard& CommandDispatcher::ShardFor(unsigned long long session) {
+    return Shards[MixKey(session) % SHARD_COUNT];
+}
+
+CommandDispatcher::Strand* CommandDispatcher::GetStrand(Shard& shard, unsigned long long session) {
+    unique_ptr<Strand>& slot = shard.Strands[session];
+    if (!slot) {
+        slot.reset(new Strand);
+        slot->Key = session;
+        slot->Home = static_cast<int>((MixKey(session) / SHARD_COUNT) % Workers.size());
+        slot->Incoming.store(nullptr, memory_order_relaxed);
+        slot->Scheduled.store(false, memory_order_relaxed);
+        slot->NextReady = nullptr;
+        slot->PendingHead = 0;
+        slot->LastCount = 0;
+        slot->HasLast = false;
+    }
+    return slot.get();
+}
+
+void CommandDispatcher::Enqueue(Strand* strand, Node* node) {
+    Queued.fetch_add(1, memory_order_relaxed);
+    Node* head = strand->Incoming.load(memory_order_relaxed);
+    do {
+        node->Next = head;
+    } while (!strand->Incoming.compare_exchange_weak(head, node, memory_order_seq_cst, memory_order_relaxed));
+    // Whoever flips Scheduled schedules the strand; it is never queued twice.
+    if (!strand->Scheduled.exchange(true, memory_order_seq_cst))
+        PushInbox(*Workers[strand->Home], strand);
+}
+
+void CommandDispatcher::PushInbox(Worker& w, Strand* strand) {
+    Strand* head = w.Inbox.load(memory_order_relaxed);
+    do {
+        strand->NextReady = head;
+    } while (!w.Inbox.compare_exchange_weak(head, strand, memory_order_seq_cst, memory_order_relaxed));
+    if (Sleepers.load(memory_order_seq_cst) > 0) {
+        lock_guard<mutex> lock(SleepLock);
+        SleepSignal.notify_one();
+    }
+}
+
+void CommandDispatcher::TakeInbox(Worker& into, Worker& from) {
+    Strand* list = from.Inbox.exchange(nullptr, memory_order_acquire);
+    // Oldest first, so the owner's LIFO pops serve the newest strand first
+    // while thieves take the oldest from the top.
+    vector<Strand*> order;
+    for (; list; list = list->NextReady)
+        order.push_back(list);
+    for (size_t i = order.size(); i-- > 0;)
+        into.Local.Push(order[i]);
+}
+
+CommandDispatcher::Strand* CommandDispatcher::FindWork(int index) {
+    Worker& w = *Workers[index];
+    Strand* strand = w.Local.Pop();
+    if (strand)
+        return strand;
+    if (w.Inbox.load(memory_order_relaxed)) {
+        TakeInbox(w, w);
+        if ((strand = w.Local.Pop()) != nullptr)
+            return strand;
+    }
+
+    int count = static_cast<int>(Workers.size());
+    w.Rng = w.Rng * 1103515245u + 12345u;
+    int start = static_cast<int>((w.Rng >> 16) % static_cast<unsigned int>(count));
+    for (int i = 0; i < count; ++i) {
+        int victim = (start + i) % count;
+        if (victim == index)
+            continue;
+        Worker& v = *Workers[victim];
+        if ((strand = v.Local.Steal()) != nullptr) {
+            Steals.fetch_add(1, memory_order_relaxed);
+            return strand;
+        }
+        // The victim is busy in a handler and has not looked at its inbox yet.
+        if (v.Inbox.load(memory_order_relaxed)) {
+            TakeInbox(w, v);
+            if ((strand = w.Local.Pop()) != nullptr) {
+                Steals.fetch_add(1, memory_order_relaxed);
+                return strand;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool CommandDispatcher::HasWork() {
+    for (unique_ptr<Worker>& w : Workers) {
+        if (w->Inbox.load(memory_order_seq_cst) || !w->Local.Empty())
+            return true;
+    }
+    return false;
+}
+
+void CommandDispatcher::Idle() {
+    unique_lock<mutex> lock(SleepLock);
+    // Announce the sleep before the final check; PushInbox reads Sleepers
+    // after publishing, so one side always sees the other.
+    Sleepers.fetch_add(1, memory_order_seq_cst);
+    if (Running.load(memory_order_relaxed) && !HasWork())
+        SleepSignal.wait(lock);
+    Sleepers.fetch_sub(1, memory_order_relaxed);
+}
+
+short CommandDispatcher::SeqDiff(unsigned short a, unsigned short b) {
+    return static_cast<short>(static_cast<unsigned short>(a - b));
+}
+
+void CommandDispatcher::SortPending(Strand* s) {
+    // Counts restart after an EndSession() marker, so each run between markers is sorted on its own.
+    vector<Node*>::iterator first = s->Pending.begin() + s->PendingHead;
+    bool hasLast = s->HasLast;
+    for (;;) {
+        vector<Node*>::iterator last = find_if(first, s->Pending.end(), [](Node* n) { return n->End; });
+        if (first != last) {
+            // Ordered relative to the last delivered count, so the sort is correct across the 16-bit wrap.
+            unsigned short base = hasLast ? s->LastCount
+                : static_cast<unsigned short>((*first)->Packet.GetPktCount() - 1);
+            auto byCount = [base](Node* a, Node* b) {
+                return SeqDiff(static_cast<unsigned short>(a->Packet.GetPktCount()), base)
+                    < SeqDiff(static_cast<unsigned short>(b->Packet.GetPktCount()), base);
+            };
+            if (!is_sorted(first, last, byCount))
+                stable_sort(first, last, byCount);
+        }
+        if (last == s->Pending.end())
+            return;
+        first = last + 1;
+        hasLast = false;
+    }
+}
+
+bool CommandDispatcher::FreeIfIdle(Strand* s) {
+    unsigned long long key = s->Key;
+    Shard& shard = ShardFor(key);
+    lock_guard<mutex> lock(shard.Lock);
+    // Submit() enqueues under this lock, so once the strand is erased nothing can reach it.
+    if (s->Incoming.load(memory_order_acquire))
+        return false;
+    shard.Strands.erase(key);
+    return true;
+}
+
+void CommandDispatcher::RunStrand(int index, Strand* s) {
+    // Move newly submitted packets, oldest first, behind what is still pending.
+    Node* list = s->Incoming.exchange(nullptr, memory_order_acquire);
+    size_t at = s->Pending.size();
+    for (; list; list = list->Next)
+        s->Pending.push_back(list);
+    reverse(s->Pending.begin() + at, s->Pending.end());
+
+    if (Order == ORDER_PKTCOUNT && at != s->Pending.size())
+        SortPending(s);
+
+    for (int budget = STRAND_BUDGET; budget > 0 && s->PendingHead < s->Pending.size(); --budget) {
+        Node* node = s->Pending[s->PendingHead++];
+        if (node->End) {
+            s->HasLast = false;
+            PoolDelete(node);
+            Queued.fetch_sub(1, memory_order_release);
+            if (s->PendingHead == s->Pending.size() && FreeIfIdle(s))
+                return;
+            continue;
+        }
+        bool deliver = true;
+        if (Order == ORDER_PKTCOUNT) {
+            unsigned short count = static_cast<unsigned short>(node->Packet.GetPktCount());
+            if (s->HasLast && SeqDiff(count, s->LastCount) <= 0) {
+                deliver = false;
+                Stale.fetch_add(1, memory_order_relaxed);
+            }
+            else {
+                s->LastCount = count;
+                s->HasLast = true;
+            }
+        }
+        if (deliver) {
+            try {
+                PacketHandler(s->Key, node->Packet);
+            }
+            catch (const exception&) {
+                HandlerErrors.fetch_add(1, memory_order_relaxed);
+            }
+            Handled.fetch_add(1, memory_order_relaxed);
+        }
+        PoolDelete(node);
+        Queued.fetch_sub(1, memory_order_release);
+    }
+    if (s->PendingHead == s->Pending.size()) {
+        s->Pending.clear();
+        s->PendingHead = 0;
+
+        s->Scheduled.store(false, memory_order_seq_cst);
+        // A Submit() between the exchange above and here saw Scheduled still
+        // set and left the strand to us.
+        if (!s->Incoming.load(memory_order_seq_cst) || s->Scheduled.exchange(true, memory_order_seq_cst))
+            return;
+    }
+    // More to do: requeue behind the other runnable strands, where idle workers can steal it.
+    Workers[index]->Local.Push(s);
+    if (Sleepers.load(memory_order_relaxed) > 0) {
+        lock_guard<mutex> lock(SleepLock);
+        SleepSignal.notify_one();
+    }
+}
+
+void CommandDispatcher::Run(int index) {
+    int misses = 0;
+    while (Running.load(memory_order_relaxed)) {
+        Strand* strand = FindWork(index);
+        if (strand) {
+            misses = 0;
+            RunStrand(index, strand);
+            continue;
+        }
+        if (++misses < IDLE_SPINS) {
+            this_thread::yield();
+            continue;
+        }
+        misses = 0;
+        Idle();
+    }
+}
+
+bool CommandDispatcher::WaitIdle(int timeoutMs) {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    while (Queued.load(memory_order_acquire) > 0) {
+        if (chrono::steady_clock::now() >= deadline)
+            return false;
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+    return true;
+}
+
+int CommandDispatcher::GetWorkerCount() {
+    return static_cast<int>(Workers.size());
+}
+
+int CommandDispatcher::GetSessions() {
+    int total = 0;
+    for (int i = 0; i < SHARD_COUNT; ++i) {
+        lock_guard<mutex> lock(Shards[i].Lock);
+        total += static_cast<int>(Shards[i].Strands.size());
+    }
+    return total;
+}
+
+long long CommandDispatcher::GetQueued() {
+    return Queued.load(memory_order_relaxed);
+}
+
+long long CommandDispatcher::GetHandled() {
+    return Handled.load(memory_order_relaxed);
+}
+
+long long CommandDispatcher::GetSteals() {
+    return Steals.load(memory_order_relaxed);
+}
+
+long long CommandDispatcher::GetStale() {
+    return Stale.load(memory_order_relaxed);
+}
+
+long long CommandDispatcher::GetRejected() {
+    return Rejected.load(memory_order_relaxed);
+}
+
+long long CommandDispatcher::GetHandlerErrors() {
+    return HandlerErrors.load(memory_order_relaxed);
+}
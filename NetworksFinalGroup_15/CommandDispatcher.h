@@ -0,0 +1,167 @@
+#pragma once
+#include "PktDef.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// How a session's packets are ordered before they reach the handler.
+enum DispatchOrder {
+    ORDER_ARRIVAL,      // Exactly as submitted.
+    ORDER_PKTCOUNT      // Ascending PktCount (16-bit wrap aware); late or repeated counts are dropped.
+};
+
+// Work-stealing pool that runs packet handlers off the I/O threads.
+//
+// I/O threads call Submit() with the raw bytes they received; the packet is
+// decoded and CRC-checked right there, then queued on its session's strand.
+// A strand is a per-session FIFO that at most one worker runs at a time, so a
+// robot's commands are handled one after another, in PktCount order, while
+// different robots run in parallel on every worker.
+//
+// Each strand has a home worker (from a hash of the session key) whose inbox
+// receives it when it becomes runnable. A worker runs strands from its own
+// Chase-Lev deque; when that is empty it drains its inbox into the deque, and
+// after that steals from other workers' deques and inboxes. A slow handler
+// therefore holds up only its own session: everything queued behind it on
+// the same worker is picked up by idle workers.
+//
+// Handlers run on worker threads and must not touch ReactorSession objects
+// (those belong to the reactor's threads); reply through a socket or queue the
+// handler owns. A session lives until EndSession(), which also forgets its
+// last PktCount, so a robot that reconnects under the same key starts over.
+class CommandDispatcher {
+public:
+    typedef function<void(unsigned long long session, PktDef& pkt)> Handler;
+
+    // Packets a strand handles before it goes back in the queue, so one busy
+    // session cannot starve the others on its worker.
+    static const int STRAND_BUDGET = 32;
+
+    // numWorkers < 1 uses one worker per hardware thread.
+    CommandDispatcher(int numWorkers, Handler handler, DispatchOrder order = ORDER_PKTCOUNT);
+    // Stops the workers; packets still queued are discarded.
+    ~CommandDispatcher();
+
+    // Start / stop the worker threads. Packets submitted before Start() wait in the queues.
+    void Start();
+    void Stop();
+
+    // Decode raw (header + body + CRC) and queue it for session. Returns
+    // false, queuing nothing, if the packet is malformed or fails its CRC.
+    bool Submit(unsigned long long session, char* raw, int length);
+    // Queue a copy of an already decoded packet.
+    void Submit(unsigned long long session, PktDef& pkt);
+    // Close session, e.g. from the reactor's disconnect handler. Packets
+    // already submitted are still handled; after them ORDER_PKTCOUNT forgets
+    // the last count, and the strand is freed unless more packets arrived.
+    void EndSession(unsigned long long session);
+
+    // Wait until every submitted packet has been handled or dropped.
+    bool WaitIdle(int timeoutMs);
+
+    // Getters
+    int GetWorkerCount();
+    int GetSessions();              // Sessions holding a strand.
+    long long GetQueued();          // Submitted but not yet handled or dropped.
+    long long GetHandled();
+    long long GetSteals();          // Strands a worker took from another worker.
+    long long GetStale();           // Dropped by ORDER_PKTCOUNT as late or repeated.
+    long long GetRejected();        // Refused by Submit() for a bad length or CRC.
+    long long GetHandlerErrors();   // Handler calls that threw.
+
+private:
+    struct Node {
+        Node* Next;
+        PktDef Packet;
+        bool End;                   // EndSession() marker, not a packet.
+    };
+
+    struct Strand {
+        unsigned long long Key;
+        int Home;                   // Worker whose inbox the strand goes to.
+        atomic<Node*> Incoming;     // Submitted packets, newest first.
+        atomic<bool> Scheduled;     // Sitting in a queue or being run.
+        Strand* NextReady;          // Inbox link.
+        // Touched only by the worker running the strand.
+        vector<Node*> Pending;
+        size_t PendingHead;
+        unsigned short LastCount;
+        bool HasLast;
+    };
+
+    // Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+    // Work-Stealing for Weak Memory Models"). The owner pushes and pops at
+    // the bottom; thieves take from the top. Grown arrays are kept until
+    // destruction because a thief may still be reading the old one.
+    class StealDeque {
+    public:
+        StealDeque();
+        ~StealDeque();
+        void Push(Strand* strand);
+        Strand* Pop();
+        Strand* Steal();
+        bool Empty();
+    private:
+        struct Array {
+            long long Size;
+            atomic<Strand*>* Slots;
+        };
+        Array* Grow(Array* old, long long bottom, long long top);
+        atomic<long long> Top;
+        atomic<long long> Bottom;
+        atomic<Array*> Items;
+        vector<Array*> Retired;
+    };
+
+    struct Worker {
+        StealDeque Local;
+        atomic<Strand*> Inbox;      // Strands made runnable by other threads, newest first.
+        thread Thread;
+        unsigned int Rng;           // Victim selection.
+    };
+
+    // Session lookup is sharded so I/O threads rarely contend.
+    static const int SHARD_COUNT = 64;
+    struct Shard {
+        mutex Lock;
+        unordered_map<unsigned long long, unique_ptr<Strand>> Strands;
+    };
+
+    Shard& ShardFor(unsigned long long session);
+    // Both need the shard's lock held.
+    Strand* GetStrand(Shard& shard, unsigned long long session);
+    void Enqueue(Strand* strand, Node* node);
+    void SortPending(Strand* s);
+    bool FreeIfIdle(Strand* s);
+    void PushInbox(Worker& w, Strand* strand);
+    void TakeInbox(Worker& into, Worker& from);
+    Strand* FindWork(int index);
+    bool HasWork();
+    void Idle();
+    void RunStrand(int index, Strand* strand);
+    void Run(int index);
+    static short SeqDiff(unsigned short a, unsigned short b);
+
+    Handler PacketHandler;
+    DispatchOrder Order;
+    vector<unique_ptr<Worker>> Workers;
+    unique_ptr<Shard[]> Shards;
+    atomic<bool> Running;
+
+    mutex SleepLock;
+    condition_variable SleepSignal;
+    atomic<int> Sleepers;
+
+    atomic<long long> Queued;
+    atomic<long long> Handled;
+    atomic<long long> Steals;
+    atomic<long long> Stale;
+    atomic<long long> Rejected;
+    atomic<long long> HandlerErrors;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include "PktSchema.h"
+
+// Typed command bodies. Legacy DRIVE bodies keep their header flag; everything
+// newer is an EXTENDED packet whose first body byte is one of these codes.
+enum CommandCode : unsigned char {
+    CMD_ARM = 0x10,
+    CMD_CAMERA = 0x11,
+    CMD_TELEMETRY = 0x12,
+    CMD_CHUNK = 0x13,       // Piece of a larger packet; see PrioritySender.h.
+};
+
+// Wire schema of the legacy DRIVE body: three little-endian 32-bit ints,
+// byte-identical to what x86 peers have always sent with memcpy.
+typedef PktSchema<PktDef::DriveBody,
+    SCHEMA_FIELD(PktDef::DriveBody, Direction),
+    SCHEMA_FIELD(PktDef::DriveBody, Duration),
+    SCHEMA_FIELD(PktDef::DriveBody, Speed)> DriveBodySchema;
+static_assert(DriveBodySchema::Size == 12, "DRIVE body is 12 bytes on the wire");
+
+// Move one arm joint to an absolute angle.
+struct ArmCommand {
+    static const unsigned char Code = CMD_ARM;
+    unsigned char Joint;        // Joint index, 0 = shoulder.
+    short AngleCentiDeg;        // Target angle in 0.01 degree steps.
+    unsigned char Speed;        // Percent of maximum joint speed.
+
+    typedef PktSchema<ArmCommand,
+        SCHEMA_FIELD(ArmCommand, Joint),
+        SCHEMA_FIELD(ArmCommand, AngleCentiDeg),
+        SCHEMA_FIELD(ArmCommand, Speed)> Schema;
+};
+static_assert(ArmCommand::Schema::Size == 4, "ArmCommand wire size changed");
+
+// Point the camera and optionally take a still.
+struct CameraCommand {
+    static const unsigned char Code = CMD_CAMERA;
+    short PanCentiDeg;
+    short TiltCentiDeg;
+    unsigned char Zoom;         // 1x-255x.
+    unsigned char Capture;      // Non-zero to take a still after moving.
+
+    typedef PktSchema<CameraCommand,
+        SCHEMA_FIELD(CameraCommand, PanCentiDeg),
+        SCHEMA_FIELD(CameraCommand, TiltCentiDeg),
+        SCHEMA_FIELD(CameraCommand, Zoom),
+        SCHEMA_FIELD(CameraCommand, Capture)> Schema;
+};
+static_assert(CameraCommand::Schema::Size == 6, "CameraCommand wire size changed");
+
+// Periodic status report from the robot.
+struct TelemetryReport {
+    static const unsigned char Code = CMD_TELEMETRY;
+    unsigned int TimestampMs;   // Robot uptime.
+    unsigned short BatteryMv;
+    short LeftRpm;
+    short RightRpm;
+    unsigned short HeadingCentiDeg;
+    float TemperatureC;
+
+    typedef PktSchema<TelemetryReport,
+        SCHEMA_FIELD(TelemetryReport, TimestampMs),
+        SCHEMA_FIELD(TelemetryReport, BatteryMv),
+        SCHEMA_FIELD(TelemetryReport, LeftRpm),
+        SCHEMA_FIELD(TelemetryReport, RightRpm),
+        SCHEMA_FIELD(TelemetryReport, HeadingCentiDeg),
+        SCHEMA_FIELD(TelemetryReport, TemperatureC)> Schema;
+};
+static_assert(TelemetryReport::Schema::Size == 16, "TelemetryReport wire size changed");
@@ -0,0 +1,340 @@
+#include "ConnectionPool.h"
+#include "PktFramer.h"
+#include <chrono>
+#include <stdexcept>
+using namespace std;
+
+// Upper bound on how long a maintainer sleeps between passes.
+static const int MAINTAIN_TICK_MS = 50;
+
+PoolOptions::PoolOptions()
+    : WarmConnections(2), ConnectTimeoutMs(1000), MinBackoffMs(50), MaxBackoffMs(5000),
+    ProbeIntervalMs(1000), KeepAliveIdleSeconds(5), BufferSize(DEFAULT_SIZE)
+{
+}
+
+PooledConnection::PooledConnection()
+    : Pool(nullptr), Owner(nullptr), Socket(nullptr), Broken(false)
+{
+}
+
+PooledConnection::PooledConnection(ConnectionPool* pool, void* endpoint, MySocket* socket)
+    : Pool(pool), Owner(endpoint), Socket(socket), Broken(false)
+{
+}
+
+PooledConnection::PooledConnection(PooledConnection&& other)
+    : Pool(other.Pool), Owner(other.Owner), Socket(other.Socket), Broken(other.Broken)
+{
+    other.Socket = nullptr;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) {
+    if (this != &other) {
+        Release();
+        Pool = other.Pool;
+        Owner = other.Owner;
+        Socket = other.Socket;
+        Broken = other.Broken;
+        other.Socket = nullptr;
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() {
+    Release();
+}
+
+MySocket* PooledConnection::operator->() {
+    return Socket;
+}
+
+MySocket& PooledConnection::operator*() {
+    return *Socket;
+}
+
+MySocket* PooledConnection::Get() {
+    return Socket;
+}
+
+PooledConnection::operator bool() const {
+    return Socket != nullptr;
+}
+
+void PooledConnection::MarkBroken() {
+    Broken = true;
+}
+
+void PooledConnection::Release() {
+    if (!Socket)
+        return;
+    Pool->Return(Owner, Socket, Broken);
+    Socket = nullptr;
+}
+
+ConnectionPool::ConnectionPool(const PoolOptions& options)
+    : Options(options), Stopping(false), Rng(static_cast<unsigned int>(NowMs()) | 1u),
+    Connects(0), ConnectFailures(0), ProbeFailures(0), Hits(0), Misses(0)
+{
+    if (Options.WarmConnections < 1)
+        Options.WarmConnections = 1;
+    if (Options.MinBackoffMs < 1)
+        Options.MinBackoffMs = 1;
+    if (Options.MaxBackoffMs < Options.MinBackoffMs)
+        Options.MaxBackoffMs = Options.MinBackoffMs;
+}
+
+ConnectionPool::~ConnectionPool() {
+    {
+        lock_guard<mutex> lock(Lock);
+        Stopping = true;
+        for (unique_ptr<Endpoint>& e : Endpoints)
+            e->Wake.notify_all();
+    }
+    // Each maintainer finishes its current handshake or probe first.
+    for (unique_ptr<Endpoint>& e : Endpoints)
+        e->Maintainer.join();
+    // Close the idle sockets with the pool.
+    Endpoints.clear();
+}
+
+long long ConnectionPool::NowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ConnectionPool::Endpoint* ConnectionPool::FindEndpoint(const string& ip, int port, bool create) {
+    for (unique_ptr<Endpoint>& e : Endpoints) {
+        if (e->Port == port && e->IP == ip)
+            return e.get();
+    }
+    if (!create)
+        return nullptr;
+    unique_ptr<Endpoint> e(new Endpoint);
+    e->IP = ip;
+    e->Port = port;
+    e->Connecting = 0;
+    e->BackoffMs = 0;
+    e->NextAttemptMs = 0;
+    e->Maintainer = thread(&ConnectionPool::Maintain, this, e.get());
+    Endpoints.push_back(move(e));
+    return Endpoints.back().get();
+}
+
+void ConnectionPool::AddEndpoint(const string& ip, int port) {
+    lock_guard<mutex> lock(Lock);
+    FindEndpoint(ip, port, true);
+}
+
+PooledConnection ConnectionPool::Acquire(const string& ip, int port, int timeoutMs) {
+    unique_lock<mutex> lock(Lock);
+    Endpoint* e = FindEndpoint(ip, port, true);
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    bool waited = false;
+    for (;;) {
+        while (!e->Idle.empty()) {
+            unique_ptr<MySocket> socket = move(e->Idle.back().Socket);
+            e->Idle.pop_back();
+            // Top the endpoint back up in the background.
+            e->Wake.notify_one();
+            lock.unlock();
+            if (!socket->PeerClosed()) {
+                (waited ? Misses : Hits).fetch_add(1, memory_order_relaxed);
+                return PooledConnection(this, e, socket.release());
+            }
+            ProbeFailures.fetch_add(1, memory_order_relaxed);
+            socket.reset();
+            lock.lock();
+        }
+        waited = true;
+        if (e->Ready.wait_until(lock, deadline) == cv_status::timeout && e->Idle.empty())
+            throw SocketTimeout("No connection to " + ip + ":" + to_string(port) + " became available");
+    }
+}
+
+void ConnectionPool::Return(void* endpoint, MySocket* socket, bool broken) {
+    unique_ptr<MySocket> owned(socket);
+    Endpoint* e = static_cast<Endpoint*>(endpoint);
+    unique_lock<mutex> lock(Lock);
+    // Keep at most twice the warm count; the rest are closed.
+    if (broken || Stopping || !socket->IsConnected()
+        || static_cast<int>(e->Idle.size()) >= 2 * Options.WarmConnections) {
+        e->Wake.notify_one();
+        lock.unlock();
+        return;     // owned closes the socket outside the lock.
+    }
+    IdleSocket idle;
+    idle.Socket = move(owned);
+    idle.CheckedMs = NowMs();
+    e->Idle.push_back(move(idle));
+    e->Ready.notify_one();
+}
+
+unique_ptr<MySocket> ConnectionPool::Connect(const string& ip, int port) {
+    unique_ptr<MySocket> socket(new MySocket(CLIENT, ip, static_cast<unsigned int>(port), TCP,
+        static_cast<unsigned int>(Options.BufferSize)));
+    socket->ConnectTCP(Options.ConnectTimeoutMs);
+    socket->SetNoDelay(true);
+    if (Options.KeepAliveIdleSeconds > 0)
+        socket->SetKeepAlive(true, Options.KeepAliveIdleSeconds, 1, 3);
+    return socket;
+}
+
+int ConnectionPool::JitteredDelayMs(int backoffMs) {
+    // Equal jitter: half the backoff fixed, half random.
+    Rng = Rng * 1103515245u + 12345u;
+    int half = backoffMs / 2;
+    return half + static_cast<int>((Rng >> 8) % static_cast<unsigned int>(backoffMs - half + 1));
+}
+
+bool ConnectionPool::Refill(Endpoint& e, unique_lock<mutex>& lock, long long now) {
+    if (static_cast<int>(e.Idle.size()) + e.Connecting >= Options.WarmConnections || now < e.NextAttemptMs)
+        return false;
+
+    ++e.Connecting;
+    string ip = e.IP;
+    int port = e.Port;
+    lock.unlock();
+    unique_ptr<MySocket> socket;
+    try {
+        socket = Connect(ip, port);
+    }
+    catch (const runtime_error&) {
+        socket.reset();
+    }
+    lock.lock();
+    --e.Connecting;
+
+    if (!socket) {
+        ConnectFailures.fetch_add(1, memory_order_relaxed);
+        e.BackoffMs = e.BackoffMs == 0 ? Options.MinBackoffMs
+            : (e.BackoffMs > Options.MaxBackoffMs / 2 ? Options.MaxBackoffMs : e.BackoffMs * 2);
+        e.NextAttemptMs = NowMs() + JitteredDelayMs(e.BackoffMs);
+        return false;
+    }
+    Connects.fetch_add(1, memory_order_relaxed);
+    e.BackoffMs = 0;
+    e.NextAttemptMs = 0;
+    IdleSocket idle;
+    idle.Socket = move(socket);
+    idle.CheckedMs = NowMs();
+    e.Idle.push_back(move(idle));
+    e.Ready.notify_all();
+    return true;
+}
+
+void ConnectionPool::ProbeIdle(Endpoint& e, unique_lock<mutex>& lock, long long now) {
+    // The oldest checks are at the front; take the ones that are due.
+    vector<unique_ptr<MySocket>> due;
+    while (!e.Idle.empty() && now - e.Idle.front().CheckedMs >= Options.ProbeIntervalMs) {
+        due.push_back(move(e.Idle.front().Socket));
+        e.Idle.pop_front();
+    }
+    if (due.empty())
+        return;
+
+    lock.unlock();
+    for (unique_ptr<MySocket>& socket : due) {
+        if (socket->PeerClosed() || (Options.Probe && !Options.Probe(*socket))) {
+            ProbeFailures.fetch_add(1, memory_order_relaxed);
+            socket.reset();
+        }
+    }
+    lock.lock();
+    long long checked = NowMs();
+    for (unique_ptr<MySocket>& socket : due) {
+        if (!socket)
+            continue;
+        IdleSocket idle;
+        idle.Socket = move(socket);
+        idle.CheckedMs = checked;
+        e.Idle.push_back(move(idle));
+        e.Ready.notify_one();
+    }
+}
+
+void ConnectionPool::Maintain(Endpoint* e) {
+    unique_lock<mutex> lock(Lock);
+    while (!Stopping) {
+        long long now = NowMs();
+        long long wakeAt = now + MAINTAIN_TICK_MS;
+        ProbeIdle(*e, lock, now);
+        while (!Stopping && Refill(*e, lock, NowMs()))
+            ;
+        if (static_cast<int>(e->Idle.size()) < Options.WarmConnections && e->NextAttemptMs > now && e->NextAttemptMs < wakeAt)
+            wakeAt = e->NextAttemptMs;
+        if (!Stopping)
+            e->Wake.wait_for(lock, chrono::milliseconds(wakeAt > now ? wakeAt - now : 1));
+    }
+}
+
+function<bool(MySocket&)> ConnectionPool::PingProbe(int timeoutMs, bool framed) {
+    return [timeoutMs, framed](MySocket& socket) {
+        PktDef ping;
+        ping.SetCmd(PktDef::RESPONSE);
+        ping.CalcCRC();
+        char buffer[DEFAULT_SIZE];
+        try {
+            if (framed) {
+                int length = PktFramer::Frame(ping.GenPacket(), ping.GetLength(), buffer, sizeof(buffer));
+                socket.SendData(buffer, length);
+            }
+            else {
+                socket.SendData(ping.GenPacket(), ping.GetLength());
+            }
+            // TCP may split the ACK or coalesce it with other replies, so a
+            // framed reply is reassembled before it is parsed.
+            PktFramer framer(4 * DEFAULT_SIZE, DEFAULT_SIZE);
+            char frame[DEFAULT_SIZE];
+            long long deadline = NowMs() + timeoutMs;
+            for (;;) {
+                long long remaining = deadline - NowMs();
+                if (remaining <= 0 || !socket.WaitForData(static_cast<int>(remaining)))
+                    return false;
+                int n = socket.GetData(buffer, sizeof(buffer));
+                if (n <= 0)
+                    return false;
+                if (!framed) {
+                    if (n >= PktDef::HEADERSIZE && PktDef(buffer, n).GetAck())
+                        return true;
+                    continue;
+                }
+                framer.Feed(buffer, n);
+                int length;
+                while ((length = framer.NextFrame(frame, sizeof(frame))) > 0) {
+                    if (length >= PktDef::HEADERSIZE && PktDef(frame, length).GetAck())
+                        return true;
+                }
+            }
+        }
+        catch (const runtime_error&) {
+            return false;
+        }
+    };
+}
+
+int ConnectionPool::GetIdleCount(const string& ip, int port) {
+    lock_guard<mutex> lock(Lock);
+    Endpoint* e = FindEndpoint(ip, port, false);
+    return e ? static_cast<int>(e->Idle.size()) : 0;
+}
+
+long long ConnectionPool::GetConnects() {
+    return Connects.load(memory_order_relaxed);
+}
+
+long long ConnectionPool::GetConnectFailures() {
+    return ConnectFailures.load(memory_order_relaxed);
+}
+
+long long ConnectionPool::GetProbeFailures() {
+    return ProbeFailures.load(memory_order_relaxed);
+}
+
+long long ConnectionPool::GetHits() {
+    return Hits.load(memory_order_relaxed);
+}
+
+long long ConnectionPool::GetMisses() {
+    return Misses.load(memory_order_relaxed);
+}
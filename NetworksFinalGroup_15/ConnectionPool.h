@@ -0,0 +1,139 @@
+#pragma once
+#include "MySocket.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Tuning for a ConnectionPool. The defaults suit robots on a roaming Wi-Fi link.
+struct PoolOptions {
+    int WarmConnections;        // Idle, connected sockets kept ready per endpoint.
+    int ConnectTimeoutMs;       // Give up on one handshake after this long.
+    int MinBackoffMs;           // First retry delay after a failed connect...
+    int MaxBackoffMs;           // ...doubling per failure up to this, with jitter.
+    int ProbeIntervalMs;        // Health-check idle sockets this often.
+    int KeepAliveIdleSeconds;   // TCP keepalive on pooled sockets; 0 turns it off.
+    int BufferSize;             // maxSize for the MySocket objects.
+    // Optional active check run on idle sockets, e.g. PingProbe(). Return
+    // false to have the socket closed and replaced.
+    function<bool(MySocket&)> Probe;
+
+    PoolOptions();
+};
+
+class ConnectionPool;
+
+// A connected socket on loan from a ConnectionPool; handed back when the
+// lease is destroyed or Release() is called. Call MarkBroken() after an I/O
+// error so the socket is closed and replaced instead of reused.
+class PooledConnection {
+public:
+    PooledConnection();
+    PooledConnection(PooledConnection&& other);
+    PooledConnection& operator=(PooledConnection&& other);
+    ~PooledConnection();
+
+    MySocket* operator->();
+    MySocket& operator*();
+    MySocket* Get();
+    explicit operator bool() const;
+
+    void MarkBroken();
+    void Release();
+
+private:
+    friend class ConnectionPool;
+    PooledConnection(ConnectionPool* pool, void* endpoint, MySocket* socket);
+    PooledConnection(const PooledConnection&);
+    PooledConnection& operator=(const PooledConnection&);
+
+    ConnectionPool* Pool;
+    void* Owner;            // The pool's endpoint record.
+    MySocket* Socket;
+    bool Broken;
+};
+
+// Client-side pool of pre-connected TCP sockets, one set per robot endpoint.
+//
+// A background thread per endpoint keeps WarmConnections sockets connected
+// to every endpoint that has been added (or acquired from), so a robot that
+// is unreachable, with every handshake waiting out ConnectTimeoutMs, does not
+// hold up refills and probes for the others. Acquiring takes an idle
+// socket, checks it has not been closed by the peer (one poll, no round
+// trip) and returns it, so the control path does not wait for a handshake.
+// Failed connects are retried with exponential backoff and equal jitter, so
+// a fleet of controllers does not reconnect in lockstep after an access point
+// change. Idle sockets are health-checked every ProbeIntervalMs, with TCP
+// keepalive and the optional Probe callback.
+//
+// The pool must outlive every lease taken from it.
+class ConnectionPool {
+public:
+    explicit ConnectionPool(const PoolOptions& options = PoolOptions());
+    ~ConnectionPool();
+
+    // Start keeping connections to ip:port warm. Acquire() does this on first use.
+    void AddEndpoint(const string& ip, int port);
+    // Take a ready connection to ip:port, waiting up to timeoutMs for the
+    // background thread to establish one. Throws SocketTimeout if none
+    // becomes available.
+    PooledConnection Acquire(const string& ip, int port, int timeoutMs);
+
+    // Probe that sends a RESPONSE (status) request and expects an ACK within
+    // timeoutMs. framed selects PktFramer's length prefix (ReactorServer).
+    static function<bool(MySocket&)> PingProbe(int timeoutMs, bool framed);
+
+    // Getters
+    int GetIdleCount(const string& ip, int port);
+    long long GetConnects();        // Handshakes completed.
+    long long GetConnectFailures();
+    long long GetProbeFailures();   // Idle sockets found dead and replaced.
+    long long GetHits();            // Acquires served without waiting.
+    long long GetMisses();          // Acquires that had to wait for a connect.
+
+private:
+    friend class PooledConnection;
+
+    struct IdleSocket {
+        unique_ptr<MySocket> Socket;
+        long long CheckedMs;        // Last time it was known to be alive.
+    };
+    struct Endpoint {
+        string IP;
+        int Port;
+        deque<IdleSocket> Idle;     // Most recently checked at the back.
+        int Connecting;
+        int BackoffMs;              // 0 until a connect fails.
+        long long NextAttemptMs;
+        condition_variable Ready;
+        condition_variable Wake;    // Rouses the endpoint's maintainer.
+        thread Maintainer;
+    };
+
+    Endpoint* FindEndpoint(const string& ip, int port, bool create);
+    void Return(void* endpoint, MySocket* socket, bool broken);
+    void Maintain(Endpoint* e);
+    bool Refill(Endpoint& e, unique_lock<mutex>& lock, long long now);
+    void ProbeIdle(Endpoint& e, unique_lock<mutex>& lock, long long now);
+    unique_ptr<MySocket> Connect(const string& ip, int port);
+    int JitteredDelayMs(int backoffMs);
+    static long long NowMs();
+
+    PoolOptions Options;
+    mutex Lock;                     // Guards every endpoint.
+    vector<unique_ptr<Endpoint>> Endpoints;
+    bool Stopping;
+    unsigned int Rng;
+
+    atomic<long long> Connects;
+    atomic<long long> ConnectFailures;
+    atomic<long long> ProbeFailures;
+    atomic<long long> Hits;
+    atomic<long long> Misses;
+};
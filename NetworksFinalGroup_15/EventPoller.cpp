@@ -0,0 +1,152 @@
+#include "EventPoller.h"
+#include <stdexcept>
+#ifdef __linux__
+#include <sys/epoll.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+using namespace std;
+
+#ifdef __linux__
+
+static unsigned int ToEpoll(int events) {
+    unsigned int mask = 0;
+    if (events & EVENT_READ)
+        mask |= EPOLLIN;
+    if (events & EVENT_WRITE)
+        mask |= EPOLLOUT;
+    return mask;
+}
+
+EventPoller::EventPoller() : EpollFd(epoll_create1(EPOLL_CLOEXEC)) {
+    if (EpollFd < 0)
+        throw runtime_error("epoll_create1 failed");
+}
+
+EventPoller::~EventPoller() {
+    close(EpollFd);
+}
+
+void EventPoller::Add(SOCKET s, int events, void* context) {
+    epoll_event ev;
+    ev.events = ToEpoll(events);
+    ev.data.ptr = context;
+#ifdef EPOLLEXCLUSIVE
+    if (events & EVENT_EXCLUSIVE) {
+        ev.events |= EPOLLEXCLUSIVE;
+        if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, s, &ev) == 0)
+            return;
+        // Kernels before 4.5 reject the flag; wake every poller instead.
+        ev.events &= ~EPOLLEXCLUSIVE;
+    }
+#endif
+    if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, s, &ev) != 0)
+        throw runtime_error("epoll_ctl add failed");
+}
+
+void EventPoller::Modify(SOCKET s, int events, void* context) {
+    epoll_event ev;
+    ev.events = ToEpoll(events);
+    ev.data.ptr = context;
+    if (epoll_ctl(EpollFd, EPOLL_CTL_MOD, s, &ev) != 0)
+        throw runtime_error("epoll_ctl modify failed");
+}
+
+void EventPoller::Remove(SOCKET s) {
+    epoll_event ev = {};
+    epoll_ctl(EpollFd, EPOLL_CTL_DEL, s, &ev);
+}
+
+int EventPoller::Wait(PollEvent* events, int maxEvents, int timeoutMs) {
+    const int BATCH = 64;
+    epoll_event ready[BATCH];
+    int n = epoll_wait(EpollFd, ready, (maxEvents < BATCH) ? maxEvents : BATCH, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        throw runtime_error("epoll_wait failed");
+    }
+    for (int i = 0; i < n; ++i) {
+        events[i].Context = ready[i].data.ptr;
+        events[i].Events = 0;
+        if (ready[i].events & EPOLLIN)
+            events[i].Events |= EVENT_READ;
+        if (ready[i].events & EPOLLOUT)
+            events[i].Events |= EVENT_WRITE;
+        if (ready[i].events & (EPOLLERR | EPOLLHUP))
+            events[i].Events |= EVENT_CLOSED;
+    }
+    return n;
+}
+
+#else
+
+EventPoller::EventPoller() {
+}
+
+EventPoller::~EventPoller() {
+}
+
+void EventPoller::Add(SOCKET s, int events, void* context) {
+    Watch w = { s, events, context };
+    Watches.push_back(w);
+}
+
+void EventPoller::Modify(SOCKET s, int events, void* context) {
+    for (Watch& w : Watches) {
+        if (w.Sock == s) {
+            w.Events = events;
+            w.Context = context;
+            return;
+        }
+    }
+    throw runtime_error("Modify called for a socket that is not watched");
+}
+
+void EventPoller::Remove(SOCKET s) {
+    for (size_t i = 0; i < Watches.size(); ++i) {
+        if (Watches[i].Sock == s) {
+            Watches[i] = Watches.back();
+            Watches.pop_back();
+            return;
+        }
+    }
+}
+
+int EventPoller::Wait(PollEvent* events, int maxEvents, int timeoutMs) {
+    vector<pollfd> fds(Watches.size());
+    for (size_t i = 0; i < Watches.size(); ++i) {
+        fds[i].fd = Watches[i].Sock;
+        fds[i].events = 0;
+        if (Watches[i].Events & EVENT_READ)
+            fds[i].events |= POLLIN;
+        if (Watches[i].Events & EVENT_WRITE)
+            fds[i].events |= POLLOUT;
+        fds[i].revents = 0;
+    }
+#ifdef _WIN32
+    int rc = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeoutMs);
+#else
+    int rc = poll(fds.data(), fds.size(), timeoutMs);
+#endif
+    if (rc <= 0)
+        return 0;
+
+    int n = 0;
+    for (size_t i = 0; i < fds.size() && n < maxEvents; ++i) {
+        if (fds[i].revents == 0)
+            continue;
+        events[n].Context = Watches[i].Context;
+        events[n].Events = 0;
+        if (fds[i].revents & POLLIN)
+            events[n].Events |= EVENT_READ;
+        if (fds[i].revents & POLLOUT)
+            events[n].Events |= EVENT_WRITE;
+        if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            events[n].Events |= EVENT_CLOSED;
+        ++n;
+    }
+    return n;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#include "NetPlatform.h"
+#include <vector>
+using namespace std;
+
+// Readiness flags reported by EventPoller. EVENT_EXCLUSIVE is only passed to
+// Add(): when several pollers watch one socket (a shared listen socket), a
+// ready event wakes one of them instead of all. Ignored where unsupported.
+enum PollFlags { EVENT_READ = 1, EVENT_WRITE = 2, EVENT_CLOSED = 4, EVENT_EXCLUSIVE = 8 };
+
+// One ready socket returned by EventPoller::Wait().
+struct PollEvent {
+    void* Context;  // Pointer registered with Add()/Modify().
+    int Events;     // Combination of PollFlags.
+};
+
+// Socket readiness notification. Uses epoll on Linux and falls back to
+// poll()/WSAPoll() elsewhere. Sockets should be non-blocking. Not thread-safe:
+// each poller is owned by one I/O thread.
+class EventPoller {
+public:
+    EventPoller();
+    ~EventPoller();
+
+    // Start watching s for the given PollFlags; context is returned in events.
+    void Add(SOCKET s, int events, void* context);
+    // Change the flags (and context) for a watched socket. Not allowed for
+    // sockets added with EVENT_EXCLUSIVE.
+    void Modify(SOCKET s, int events, void* context);
+    // Stop watching s. Must be called before the socket is closed.
+    void Remove(SOCKET s);
+    // Wait up to timeoutMs (-1 = forever) and fill at most maxEvents entries.
+    // Returns the number of ready sockets (0 on timeout).
+    int Wait(PollEvent* events, int maxEvents, int timeoutMs);
+
+private:
+    EventPoller(const EventPoller&);
+    EventPoller& operator=(const EventPoller&);
+
+#ifdef __linux__
+    int EpollFd;
+#else
+    struct Watch {
+        SOCKET Sock;
+        int Events;
+        void* Context;
+    };
+    vector<Watch> Watches;
+#endif
+};
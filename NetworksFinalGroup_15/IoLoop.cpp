@@ -0,0 +1,257 @@
+#include "IoLoop.h"
+#include <chrono>
+#include <climits>
+#include <stdexcept>
+using namespace std;
+
+static const int MAX_EVENTS = 64;
+
+CancelSource::CancelSource() : Canceled(false) {
+}
+
+CancelSource::~CancelSource() {
+    // Waits still linked here keep their other wake-up conditions.
+    for (IoWait* wait : Waits)
+        wait->Cancel = nullptr;
+}
+
+void CancelSource::Cancel() {
+    Canceled = true;
+    while (!Waits.empty())
+        Waits.back()->Loop.Complete(*Waits.back(), WAIT_CANCELED);
+}
+
+bool CancelSource::IsCanceled() {
+    return Canceled;
+}
+
+IoWait::IoWait(IoLoop& loop, IoHandle* handle, int events, long long deadlineMs, CancelSource* cancel)
+    : Loop(loop), Handle(handle), Events(events), DeadlineMs(deadlineMs), Cancel(cancel),
+    Result(WAIT_PENDING), Armed(false), CancelSlot(0)
+{
+}
+
+IoWait::~IoWait() {
+    // The awaiting frame was destroyed while parked.
+    if (Armed)
+        Loop.Disarm(*this);
+}
+
+bool IoWait::await_ready() {
+    if (Cancel && Cancel->IsCanceled())
+        Result = WAIT_CANCELED;
+    else if (DeadlineMs >= 0 && IoLoop::NowMs() >= DeadlineMs)
+        Result = WAIT_TIMEOUT;
+    return Result != WAIT_PENDING;
+}
+
+void IoWait::await_suspend(coroutine_handle<> waiter) {
+    Waiter = waiter;
+    Loop.Arm(*this);
+}
+
+WaitResult IoWait::await_resume() {
+    return Result;
+}
+
+IoLoop::IoLoop() : ArmedWaits(0), Stopping(false), TaskErrors(0) {
+    NetworkStartup();
+}
+
+IoLoop::~IoLoop() {
+    for (void* frame : Tasks)
+        coroutine_handle<>::from_address(frame).destroy();
+    Tasks.clear();
+}
+
+void IoLoop::Spawn(Task<void>&& task) {
+    Task<void>::Handle frame = task.Release();
+    if (!frame)
+        return;
+    frame.promise().OnDone = &IoLoop::TaskDone;
+    frame.promise().DoneContext = this;
+    Tasks.insert(frame.address());
+    ReadyQueue.push_back(frame);
+}
+
+void IoLoop::Run() {
+    Stopping = false;
+    PollEvent events[MAX_EVENTS];
+    for (;;) {
+        while (!ReadyQueue.empty() && !Stopping) {
+            coroutine_handle<> next = ReadyQueue.front();
+            ReadyQueue.pop_front();
+            next.resume();
+        }
+        Reap();
+        if (Stopping || Tasks.empty())
+            return;
+
+        int timeoutMs = -1;
+        if (!Timers.empty()) {
+            long long wait = Timers.begin()->first - NowMs();
+            timeoutMs = (wait <= 0) ? 0 : (wait > INT_MAX ? INT_MAX : static_cast<int>(wait));
+        }
+        else if (ArmedWaits == 0) {
+            throw runtime_error("IoLoop stalled: tasks are suspended but nothing can wake them");
+        }
+
+        int n = Poller.Wait(events, MAX_EVENTS, timeoutMs);
+        for (int i = 0; i < n; ++i)
+            Dispatch(*static_cast<IoHandle*>(events[i].Context), events[i].Events);
+
+        if (!Timers.empty()) {
+            long long now = NowMs();
+            while (!Timers.empty() && Timers.begin()->first <= now)
+                Complete(*Timers.begin()->second, WAIT_TIMEOUT);
+        }
+    }
+}
+
+void IoLoop::Stop() {
+    Stopping = true;
+}
+
+Task<void> IoLoop::Sleep(int ms, CancelSource* cancel) {
+    IoWait wait(*this, nullptr, 0, DeadlineAfter(ms < 0 ? 0 : ms), cancel);
+    if (co_await wait == WAIT_CANCELED)
+        throw runtime_error("Sleep canceled");
+}
+
+void IoLoop::Detach(IoHandle& handle) {
+    if (handle.Reader)
+        Complete(*handle.Reader, WAIT_CANCELED);
+    if (handle.Writer)
+        Complete(*handle.Writer, WAIT_CANCELED);
+    if (handle.Registered)
+        Poller.Remove(handle.Sock);
+    handle.Registered = false;
+    handle.Interest = 0;
+}
+
+long long IoLoop::NowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long long IoLoop::DeadlineAfter(int timeoutMs) {
+    return (timeoutMs < 0) ? -1 : NowMs() + timeoutMs;
+}
+
+void IoLoop::Arm(IoWait& wait) {
+    if (wait.Handle) {
+        IoHandle& handle = *wait.Handle;
+        IoWait*& slot = (wait.Events & EVENT_READ) ? handle.Reader : handle.Writer;
+        if (slot)
+            throw runtime_error("Another coroutine is already waiting on this socket");
+        // Interest is only ever widened here; Dispatch() narrows it when the
+        // socket reports readiness nobody is waiting for. A coroutine that
+        // reads, replies and reads again costs no poller updates.
+        int want = handle.Interest | wait.Events;
+        if (!handle.Registered)
+            Poller.Add(handle.Sock, want, &handle);
+        else if (want != handle.Interest)
+            Poller.Modify(handle.Sock, want, &handle);
+        handle.Registered = true;
+        handle.Interest = want;
+        slot = &wait;
+    }
+    if (wait.DeadlineMs >= 0)
+        wait.Timer = Timers.insert(make_pair(wait.DeadlineMs, &wait));
+    if (wait.Cancel) {
+        wait.CancelSlot = wait.Cancel->Waits.size();
+        wait.Cancel->Waits.push_back(&wait);
+    }
+    wait.Armed = true;
+    ++ArmedWaits;
+}
+
+void IoLoop::Disarm(IoWait& wait) {
+    if (!wait.Armed)
+        return;
+    if (wait.Handle) {
+        if (wait.Handle->Reader == &wait)
+            wait.Handle->Reader = nullptr;
+        if (wait.Handle->Writer == &wait)
+            wait.Handle->Writer = nullptr;
+    }
+    if (wait.DeadlineMs >= 0)
+        Timers.erase(wait.Timer);
+    if (wait.Cancel) {
+        vector<IoWait*>& waits = wait.Cancel->Waits;
+        waits[wait.CancelSlot] = waits.back();
+        waits[wait.CancelSlot]->CancelSlot = wait.CancelSlot;
+        waits.pop_back();
+    }
+    wait.Armed = false;
+    --ArmedWaits;
+}
+
+void IoLoop::Complete(IoWait& wait, WaitResult result) {
+    Disarm(wait);
+    wait.Result = result;
+    ReadyQueue.push_back(wait.Waiter);
+}
+
+void IoLoop::Dispatch(IoHandle& handle, int events) {
+    int unwanted = 0;
+    if (events & (EVENT_READ | EVENT_CLOSED)) {
+        if (handle.Reader)
+            Complete(*handle.Reader, WAIT_READY);
+        else if (events & EVENT_READ)
+            unwanted |= EVENT_READ;
+    }
+    if (events & (EVENT_WRITE | EVENT_CLOSED)) {
+        if (handle.Writer)
+            Complete(*handle.Writer, WAIT_READY);
+        else if (events & EVENT_WRITE)
+            unwanted |= EVENT_WRITE;
+    }
+
+    if (events & EVENT_CLOSED) {
+        // A hung-up socket is reported whatever the interest, so stop watching
+        // it; the woken coroutines see the error on their next call.
+        Poller.Remove(handle.Sock);
+        handle.Registered = false;
+        handle.Interest = 0;
+    }
+    else if (unwanted) {
+        handle.Interest &= ~unwanted;
+        Poller.Modify(handle.Sock, handle.Interest, &handle);
+    }
+}
+
+void IoLoop::Reap() {
+    for (coroutine_handle<> done : Finished) {
+        Task<void>::Handle frame = Task<void>::Handle::from_address(done.address());
+        try {
+            frame.promise().TakeResult();
+        }
+        catch (const exception& e) {
+            ++TaskErrors;
+            LastTaskError = e.what();
+        }
+        catch (...) {
+            ++TaskErrors;
+            LastTaskError = "unknown exception";
+        }
+        Tasks.erase(done.address());
+        frame.destroy();
+    }
+    Finished.clear();
+}
+
+void IoLoop::TaskDone(void* context, coroutine_handle<> handle) {
+    static_cast<IoLoop*>(context)->Finished.push_back(handle);
+}
+
+int IoLoop::GetTaskCount() {
+    return static_cast<int>(Tasks.size());
+}
+
+long long IoLoop::GetTaskErrors() {
+    return TaskErrors;
+}
+
+string IoLoop::GetLastTaskError() {
+    return LastTaskError;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "EventPoller.h"
+#include "Task.h"
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+class IoLoop;
+class IoWait;
+
+// How an IoWait ended.
+enum WaitResult { WAIT_PENDING, WAIT_READY, WAIT_TIMEOUT, WAIT_CANCELED };
+
+// A socket as seen by an IoLoop. At most one coroutine may wait to read and
+// one to write on it at a time.
+struct IoHandle {
+    SOCKET Sock;
+    bool Registered;    // Added to the loop's poller.
+    int Interest;       // PollFlags the poller is watching for.
+    IoWait* Reader;
+    IoWait* Writer;
+
+    IoHandle() : Sock(INVALID_SOCKET), Registered(false), Interest(0), Reader(nullptr), Writer(nullptr) {}
+};
+
+// Cancels every pending operation it was passed to, and makes later ones
+// fail straight away. Use from the loop's thread only.
+class CancelSource {
+public:
+    CancelSource();
+    ~CancelSource();
+
+    void Cancel();
+    bool IsCanceled();
+
+private:
+    friend class IoLoop;
+    CancelSource(const CancelSource&);
+    CancelSource& operator=(const CancelSource&);
+
+    vector<IoWait*> Waits;
+    bool Canceled;
+};
+
+// Awaiter that suspends a coroutine until a socket is ready, a deadline
+// passes or a CancelSource fires. co_await returns the WaitResult; the
+// operations built on it turn timeouts and cancellation into exceptions.
+class IoWait {
+public:
+    // handle may be null for a plain timer. deadlineMs is an IoLoop::NowMs()
+    // value, or -1 for none.
+    IoWait(IoLoop& loop, IoHandle* handle, int events, long long deadlineMs, CancelSource* cancel);
+    ~IoWait();
+
+    bool await_ready();
+    void await_suspend(coroutine_handle<> waiter);
+    WaitResult await_resume();
+
+private:
+    friend class IoLoop;
+    friend class CancelSource;
+    IoWait(const IoWait&);
+    IoWait& operator=(const IoWait&);
+
+    IoLoop& Loop;
+    IoHandle* Handle;
+    int Events;
+    long long DeadlineMs;
+    CancelSource* Cancel;
+    coroutine_handle<> Waiter;
+    WaitResult Result;
+    bool Armed;
+    multimap<long long, IoWait*>::iterator Timer;
+    size_t CancelSlot;          // Index in Cancel->Waits.
+};
+
+// Single-threaded event loop that runs coroutines over non-blocking sockets.
+//
+// Each coroutine runs until it would block, then parks on an IoWait and the
+// loop moves on; when EventPoller reports the socket ready (or the wait's
+// deadline passes, or it is canceled) the coroutine is queued and resumed.
+// A conversation with a robot therefore costs one coroutine frame of a few
+// hundred bytes instead of a thread and its stack, and thousands of them can
+// run on one thread.
+//
+// Everything (spawning, socket operations, cancellation) must happen on the
+// thread that calls Run().
+class IoLoop {
+public:
+    IoLoop();
+    // Destroys any spawned tasks that have not finished.
+    ~IoLoop();
+
+    // Hand a task to the loop; it starts on the next Run() step. A task that
+    // ends with an exception is counted in GetTaskErrors().
+    void Spawn(Task<void>&& task);
+    // Run until every spawned task has finished or Stop() is called. Throws if
+    // tasks remain but none of them is waiting for anything.
+    void Run();
+    // Make Run() return after the current step. Unfinished tasks stay parked.
+    void Stop();
+
+    // Suspend the calling coroutine for ms milliseconds.
+    Task<void> Sleep(int ms, CancelSource* cancel = nullptr);
+
+    // Stop watching a socket before it is closed. Pending waits on it are canceled.
+    void Detach(IoHandle& handle);
+
+    // Monotonic milliseconds, and the deadline timeoutMs from now (-1 if timeoutMs < 0).
+    static long long NowMs();
+    static long long DeadlineAfter(int timeoutMs);
+
+    // Getters
+    int GetTaskCount();             // Spawned tasks not yet finished.
+    long long GetTaskErrors();
+    string GetLastTaskError();
+
+private:
+    friend class IoWait;
+    friend class CancelSource;
+    IoLoop(const IoLoop&);
+    IoLoop& operator=(const IoLoop&);
+
+    void Arm(IoWait& wait);
+    void Disarm(IoWait& wait);
+    void Complete(IoWait& wait, WaitResult result);
+    void Dispatch(IoHandle& handle, int events);
+    void Reap();
+    static void TaskDone(void* context, coroutine_handle<> handle);
+
+    EventPoller Poller;
+    deque<coroutine_handle<>> ReadyQueue;
+    multimap<long long, IoWait*> Timers;    // By deadline.
+    unordered_set<void*> Tasks;             // Frames of spawned tasks.
+    vector<coroutine_handle<>> Finished;    // Spawned tasks waiting to be reaped.
+    int ArmedWaits;
+    bool Stopping;
+    long long TaskErrors;
+    string LastTaskError;
+};
@@ -1,25 +1,79 @@
 #include "MySocket.h"
+#include "BufferPool.h"
+#include "ShmTransport.h"
+#include "UringEngine.h"
 #include <stdexcept>
 #include <string>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/filter.h>
+#include <linux/sockios.h>
+#endif
 using namespace std; 
 
-MySocket::MySocket(SocketType type, string ip, unsigned int port, ConnectionType connType, unsigned int maxSize)
+#ifdef MSG_DONTWAIT
+static const int NOWAIT_FLAG = MSG_DONTWAIT;
+#else
+static const int NOWAIT_FLAG = 0;
+#endif
+
+// Timed calls must never block in the syscall itself. Where there is no
+// MSG_DONTWAIT (Windows) the socket is made non-blocking for the call instead.
+class TimedCall {
+public:
+    TimedCall(SOCKET s, bool timed) : Sock(s), Active(timed && NOWAIT_FLAG == 0) {
+        if (Active)
+            SetNonBlocking(Sock, true);
+    }
+    ~TimedCall() {
+        if (Active)
+            SetNonBlocking(Sock, false);
+    }
+    int Flags() { return NOWAIT_FLAG; }
+private:
+    SOCKET Sock;
+    bool Active;
+};
+
+static long long NowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long long DeadlineAfter(int timeoutMs) {
+    return (timeoutMs < 0) ? -1 : NowMs() + timeoutMs;
+}
+
+// A datagram larger than the buffer: POSIX silently truncates it, Windows
+// fills the buffer with its front and then fails with WSAEMSGSIZE.
+static bool DatagramTruncated(int error) {
+#ifdef _WIN32
+    return error == WSAEMSGSIZE;
+#else
+    (void)error;
+    return false;
+#endif
+}
+
+MySocket::MySocket(SocketType type, string ip, unsigned int port, ConnectionType connType, unsigned int maxSize, bool reusePort)
     : Buffer(nullptr), WelcomeSocket(INVALID_SOCKET), ConnectionSocket(INVALID_SOCKET),
     mySocket(type), IPAddr(ip), Port(static_cast<int>(port)), connectionType(connType),
-    bTCPConnect(false), MaxSize((maxSize > 0) ? static_cast<int>(maxSize) : DEFAULT_SIZE)
+    bTCPConnect(false), MaxSize((maxSize > 0) ? static_cast<int>(maxSize) : DEFAULT_SIZE),
+    ConnectTimeoutMs(-1), SendTimeoutMs(-1), ReceiveTimeoutMs(-1),
+    LastReceiveNs(0), LastSendNs(0), Shm(nullptr), Engine(ENGINE_SYSCALL), Uring(nullptr), Capture(nullptr), CaptureStream(0)
 {
-    // Initialize Winsock.
-    WSADATA wsaData;
-    int wsResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (wsResult != 0)
-        throw std::runtime_error("WSAStartup failed");
+    // Initialize the network stack (once per process).
+    NetworkStartup();
 
-    // Allocate the communication buffer.
-    Buffer = new char[MaxSize];
+    // Allocate the communication buffer, one MaxSize slot per borrowable view.
+    Buffer = BufferPool::Allocate(MaxSize * RECV_POOL_SIZE);
+    for (int i = 0; i < RECV_POOL_SIZE; ++i)
+        SlotBusy[i] = false;
 
     // Prepare the server address structure.
-    ZeroMemory(&SvrAddr, sizeof(SvrAddr));
+    memset(&SvrAddr, 0, sizeof(SvrAddr));
     SvrAddr.sin_family = AF_INET;
     SvrAddr.sin_port = htons(Port);
     inet_pton(AF_INET, IPAddr.c_str(), &SvrAddr.sin_addr);
@@ -32,6 +86,9 @@ MySocket::MySocket(SocketType type, string ip, unsigned int port, ConnectionType
 
         if (mySocket == SERVER) {
             WelcomeSocket = sock;
+            // A restarted server must not fail on connections still in TIME_WAIT.
+            int reuse = 1;
+            setsockopt(WelcomeSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
             if (bind(WelcomeSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) == SOCKET_ERROR)
                 throw runtime_error("TCP Bind failed");
             if (listen(WelcomeSocket, SOMAXCONN) == SOCKET_ERROR)
@@ -41,89 +98,741 @@ MySocket::MySocket(SocketType type, string ip, unsigned int port, ConnectionType
             ConnectionSocket = sock;
         }
     }
+    else if (connectionType == SHM) {
+        Shm = new ShmTransport(IPAddr, Port, MaxSize, mySocket == SERVER);
+    }
     else { // UDP
         SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
         if (sock == INVALID_SOCKET)
             throw runtime_error("Failed to create UDP socket");
         ConnectionSocket = sock;
         if (mySocket == SERVER) {
+            if (reusePort) {
+#ifdef SO_REUSEPORT
+                int reuse = 1;
+                if (setsockopt(ConnectionSocket, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse)) == SOCKET_ERROR)
+                    throw runtime_error("SO_REUSEPORT failed");
+#else
+                throw runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+            }
             if (bind(ConnectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) == SOCKET_ERROR)
                 throw runtime_error("UDP Bind failed");
         }
     }
+
+    // e.g. "udp/server/127.0.0.1:5000/3"; the sequence number keeps sockets on the same endpoint apart.
+    static atomic<int> socketSequence(0);
+    MetricsLabel = string(connectionType == TCP ? "tcp/" : connectionType == UDP ? "udp/" : "shm/") + (mySocket == SERVER ? "server/" : "client/")
+        + IPAddr + ":" + to_string(Port) + "/" + to_string(++socketSequence);
+    METRIC_ONLY(MetricsRegistry::Instance().Add(MetricsLabel, &Counters));
 }
 
 MySocket::~MySocket() {
-    if (Buffer) {
-        delete[] Buffer;
-        Buffer = nullptr;
-    }
+    METRIC_ONLY(MetricsRegistry::Instance().Remove(&Counters));
+    DetachEngine();
+    BufferPool::Free(Buffer);
+    Buffer = nullptr;
+    delete Shm;
+    Shm = nullptr;
     if (ConnectionSocket != INVALID_SOCKET) {
-        closesocket(ConnectionSocket);
+        CloseSocket(ConnectionSocket);
         ConnectionSocket = INVALID_SOCKET;
     }
     if (WelcomeSocket != INVALID_SOCKET) {
-        closesocket(WelcomeSocket);
+        CloseSocket(WelcomeSocket);
         WelcomeSocket = INVALID_SOCKET;
     }
-    WSACleanup();
 }
 
 void MySocket::ConnectTCP() {
-    if (connectionType != TCP)
+    ConnectTCP(ConnectTimeoutMs);
+}
+
+void MySocket::ConnectTCP(int timeoutMs) {
+    if (connectionType == UDP)
         throw runtime_error("ConnectTCP called on a UDP socket");
-    if (mySocket == CLIENT) {
-        if (connect(ConnectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) == SOCKET_ERROR)
-            throw runtime_error("TCP Connect failed");
+    if (connectionType == SHM) {
+        if (mySocket == SERVER) {
+            if (!Shm->Accept(DeadlineAfter(timeoutMs)))
+                ThrowTimeout("SHM Accept timed out");
+        }
+        else {
+            Shm->Connect();
+        }
         bTCPConnect = true;
+        return;
     }
-    else { // SERVER
+    if (mySocket == SERVER) {
+        if (timeoutMs >= 0 && !WaitUntil(WelcomeSocket, POLLIN, DeadlineAfter(timeoutMs)))
+            ThrowTimeout("TCP Accept timed out");
         SOCKET clientSocket = accept(WelcomeSocket, NULL, NULL);
         if (clientSocket == INVALID_SOCKET)
             throw runtime_error("TCP Accept failed");
         ConnectionSocket = clientSocket;
         bTCPConnect = true;
+        AttachEngine();
+        return;
+    }
+
+    OpenClientSocket();
+    if (timeoutMs < 0) {
+        if (connect(ConnectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) == SOCKET_ERROR) {
+            // A socket whose connect failed cannot be reused; the next attempt gets a fresh one.
+            CloseClientSocket();
+            throw runtime_error("TCP Connect failed");
+        }
+        bTCPConnect = true;
+        AttachEngine();
+        return;
+    }
+
+    SetNonBlocking(ConnectionSocket, true);
+    if (connect(ConnectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) == SOCKET_ERROR) {
+        if (!WouldBlock(LastSocketError())) {
+            CloseClientSocket();
+            throw runtime_error("TCP Connect failed");
+        }
+        // The handshake is in flight; the socket turns writable when it completes or fails.
+        if (!WaitUntil(ConnectionSocket, POLLOUT, DeadlineAfter(timeoutMs))) {
+            CloseClientSocket();
+            ThrowTimeout("TCP Connect timed out");
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(ConnectionSocket, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == SOCKET_ERROR || error != 0) {
+            CloseClientSocket();
+            throw runtime_error("TCP Connect failed");
+        }
     }
+    SetNonBlocking(ConnectionSocket, false);
+    bTCPConnect = true;
+    AttachEngine();
+}
+
+void MySocket::OpenClientSocket() {
+    if (ConnectionSocket != INVALID_SOCKET)
+        return;
+    ConnectionSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (ConnectionSocket == INVALID_SOCKET)
+        throw runtime_error("Failed to create TCP socket");
+}
+
+void MySocket::CloseClientSocket() {
+    DetachEngine();
+    if (ConnectionSocket != INVALID_SOCKET)
+        CloseSocket(ConnectionSocket);
+    ConnectionSocket = INVALID_SOCKET;
+    bTCPConnect = false;
 }
 
 void MySocket::DisconnectTCP() {
-    if (connectionType != TCP)
+    if (connectionType == UDP)
         throw runtime_error("DisconnectTCP called on a UDP socket");
     if (!bTCPConnect)
         return;
+    if (connectionType == SHM) {
+        Shm->Disconnect();
+        bTCPConnect = false;
+        return;
+    }
+    DetachEngine();
     shutdown(ConnectionSocket, SD_SEND);
-    closesocket(ConnectionSocket);
+    CloseSocket(ConnectionSocket);
     ConnectionSocket = INVALID_SOCKET;
     bTCPConnect = false;
 }
 
 void MySocket::SendData(const char* data, int numBytes) {
-    if (connectionType == TCP) {
-        if (send(ConnectionSocket, data, numBytes, 0) == SOCKET_ERROR)
-            throw runtime_error("TCP Send failed");
+    SendData(data, numBytes, SendTimeoutMs);
+}
+
+void MySocket::SendData(const char* data, int numBytes, int timeoutMs) {
+    if (connectionType == SHM) {
+        IoSlice slice = { data, numBytes };
+        if (Shm->Send(&slice, 1, DeadlineAfter(timeoutMs)) < 0)
+            ThrowTimeout("SHM Send timed out");
+    }
+    else if (Uring) {
+        if (!Uring->Send(data, numBytes, connectionType == UDP ? &SvrAddr : nullptr, DeadlineAfter(timeoutMs)))
+            ThrowTimeout("Send timed out");
+    }
+    else if (connectionType == TCP) {
+        // send() may accept only part of the buffer; keep going until all of it is queued.
+        long long deadline = DeadlineAfter(timeoutMs);
+        TimedCall call(ConnectionSocket, timeoutMs >= 0);
+        int flags = (timeoutMs >= 0) ? call.Flags() : 0;
+        int sent = 0;
+        while (sent < numBytes) {
+            if (timeoutMs >= 0 && !WaitUntil(ConnectionSocket, POLLOUT, deadline))
+                ThrowTimeout("TCP Send timed out");
+            int n = send(ConnectionSocket, data + sent, numBytes - sent, flags);
+            METRIC_ADD(Counters.Syscalls, 1);
+            if (n == SOCKET_ERROR) {
+                if (timeoutMs >= 0 && WouldBlock(LastSocketError()))
+                    continue;
+                METRIC_ADD(Counters.Errors, 1);
+                throw runtime_error("TCP Send failed");
+            }
+            if (n < numBytes - sent)
+                METRIC_ADD(Counters.PartialSends, 1);
+            sent += n;
+        }
     }
     else { // UDP
-        int addrLen = sizeof(SvrAddr);
-        if (sendto(ConnectionSocket, data, numBytes, 0, (struct sockaddr*)&SvrAddr, addrLen) == SOCKET_ERROR)
+        socklen_t addrLen = sizeof(SvrAddr);
+        METRIC_ADD(Counters.Syscalls, 1);
+        if (sendto(ConnectionSocket, data, numBytes, 0, (struct sockaddr*)&SvrAddr, addrLen) == SOCKET_ERROR) {
+            METRIC_ADD(Counters.Errors, 1);
             throw runtime_error("UDP sendto failed");
+        }
     }
+    METRIC_ADD(Counters.BytesOut, numBytes);
+    METRIC_ADD(Counters.PacketsOut, 1);
+    METRIC_STAMP(LastSendNs);
+    if (Capture)
+        Capture->Record(CaptureStream, CAPTURE_OUT, data, numBytes);
 }
 
-int MySocket::GetData(char* destBuffer) {
-    int bytesReceived = 0;
-    if (connectionType == TCP) {
-        bytesReceived = recv(ConnectionSocket, Buffer, MaxSize, 0);
+int MySocket::SendGather(const IoSlice* slices, int count, bool dontWait) {
+    if (count > MAX_BATCH)
+        count = MAX_BATCH;
+    if (connectionType == SHM) {
+        // The slices become one message, copied straight into the ring.
+        int sent = Shm->Send(slices, count, dontWait ? 0 : -1);
+        if (sent < 0)
+            return 0;
+        METRIC_ONLY(CountGatherSent(slices, count, sent));
+        return sent;
     }
-    else { // UDP
-        int addrLen = sizeof(SvrAddr);
-        bytesReceived = recvfrom(ConnectionSocket, Buffer, MaxSize, 0, (struct sockaddr*)&SvrAddr, &addrLen);
+    if (Uring) {
+        int sent = Uring->SendGather(slices, count, connectionType == UDP ? &SvrAddr : nullptr, dontWait);
+        METRIC_ONLY(CountGatherSent(slices, count, sent));
+        return sent;
+    }
+#ifdef _WIN32
+    WSABUF bufs[MAX_BATCH];
+    for (int i = 0; i < count; ++i) {
+        bufs[i].buf = const_cast<char*>(slices[i].Data);
+        bufs[i].len = static_cast<ULONG>(slices[i].Length);
+    }
+    DWORD sent = 0;
+    int rc;
+    if (connectionType == TCP)
+        rc = WSASend(ConnectionSocket, bufs, count, &sent, 0, NULL, NULL);
+    else
+        rc = WSASendTo(ConnectionSocket, bufs, count, &sent, 0, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr), NULL, NULL);
+    METRIC_ADD(Counters.Syscalls, 1);
+    if (rc == SOCKET_ERROR) {
+        if (WouldBlock(LastSocketError()))
+            return 0;
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("Gather send failed");
+    }
+    METRIC_ONLY(CountGatherSent(slices, count, static_cast<int>(sent)));
+    return static_cast<int>(sent);
+#else
+    iovec iovs[MAX_BATCH];
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = const_cast<char*>(slices[i].Data);
+        iovs[i].iov_len = slices[i].Length;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    if (connectionType == UDP) {
+        msg.msg_name = &SvrAddr;
+        msg.msg_namelen = sizeof(SvrAddr);
+    }
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    int flags = dontWait ? MSG_DONTWAIT : 0;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    ssize_t n = sendmsg(ConnectionSocket, &msg, flags);
+    METRIC_ADD(Counters.Syscalls, 1);
+    if (n < 0) {
+        if (WouldBlock(errno))
+            return 0;
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("Gather send failed");
+    }
+    METRIC_ONLY(CountGatherSent(slices, count, static_cast<int>(n)));
+    return static_cast<int>(n);
+#endif
+}
+
+void MySocket::CountGatherSent(const IoSlice* slices, int count, int sent) {
+    Counters.BytesOut.fetch_add(sent, memory_order_relaxed);
+    // A slice counts as one packet out once its last byte has been accepted.
+    int completed = 0;
+    int remaining = sent;
+    while (completed < count && remaining >= slices[completed].Length)
+        remaining -= slices[completed++].Length;
+    Counters.PacketsOut.fetch_add(connectionType == UDP ? (sent > 0 ? 1 : 0) : completed, memory_order_relaxed);
+    if (completed < count)
+        Counters.PartialSends.fetch_add(1, memory_order_relaxed);
+    if (sent > 0)
+        METRIC_STAMP(LastSendNs);
+}
+
+void MySocket::SetNoDelay(bool enable) {
+    if (connectionType != TCP)
+        throw runtime_error("SetNoDelay needs a TCP socket");
+    int flag = enable ? 1 : 0;
+    if (setsockopt(ConnectionSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag)) == SOCKET_ERROR)
+        throw runtime_error("Failed to set TCP_NODELAY");
+}
+
+void MySocket::SetKeepAlive(bool enable, int idleSeconds, int intervalSeconds, int probes) {
+    if (connectionType != TCP || ConnectionSocket == INVALID_SOCKET)
+        throw runtime_error("SetKeepAlive needs a TCP connection");
+    int flag = enable ? 1 : 0;
+    if (setsockopt(ConnectionSocket, SOL_SOCKET, SO_KEEPALIVE, (const char*)&flag, sizeof(flag)) == SOCKET_ERROR)
+        throw runtime_error("Failed to set SO_KEEPALIVE");
+    if (!enable)
+        return;
+#ifdef _WIN32
+    tcp_keepalive settings;
+    settings.onoff = 1;
+    settings.keepalivetime = static_cast<ULONG>(idleSeconds) * 1000;
+    settings.keepaliveinterval = static_cast<ULONG>(intervalSeconds) * 1000;
+    DWORD returned = 0;
+    WSAIoctl(ConnectionSocket, SIO_KEEPALIVE_VALS, &settings, sizeof(settings), NULL, 0, &returned, NULL, NULL);
+    (void)probes;   // Fixed at 10 on Windows.
+#else
+#ifdef TCP_KEEPIDLE
+    setsockopt(ConnectionSocket, IPPROTO_TCP, TCP_KEEPIDLE, &idleSeconds, sizeof(idleSeconds));
+#elif defined(TCP_KEEPALIVE)
+    setsockopt(ConnectionSocket, IPPROTO_TCP, TCP_KEEPALIVE, &idleSeconds, sizeof(idleSeconds));
+#endif
+#ifdef TCP_KEEPINTVL
+    setsockopt(ConnectionSocket, IPPROTO_TCP, TCP_KEEPINTVL, &intervalSeconds, sizeof(intervalSeconds));
+#endif
+#ifdef TCP_KEEPCNT
+    setsockopt(ConnectionSocket, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+#endif
+#endif
+}
+
+bool MySocket::PeerClosed() {
+    if (connectionType == SHM)
+        return !bTCPConnect || Shm->PeerClosed();
+    if (connectionType != TCP || !bTCPConnect)
+        return true;
+    // The engine may already hold data the socket no longer shows.
+    if (Uring && Uring->HasData())
+        return false;
+    pollfd pfd;
+    pfd.fd = ConnectionSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+#ifdef _WIN32
+    int rc = WSAPoll(&pfd, 1, 0);
+#else
+    int rc = poll(&pfd, 1, 0);
+#endif
+    if (rc < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        return true;
+    if (rc == 0)
+        return false;
+    // Readable: either data is waiting or the peer sent FIN / RST.
+    char probe;
+    SetNonBlocking(ConnectionSocket, true);
+    int n = recv(ConnectionSocket, &probe, 1, MSG_PEEK);
+    bool closed = n == 0 || (n == SOCKET_ERROR && !WouldBlock(LastSocketError()));
+    SetNonBlocking(ConnectionSocket, false);
+    return closed;
+}
+
+IoEngine MySocket::SetIoEngine(IoEngine engine) {
+    if (engine == ENGINE_URING && (connectionType == SHM || !UringEngine::IsSupported()))
+        engine = ENGINE_SYSCALL;
+    Engine = engine;
+    if (Engine == ENGINE_SYSCALL)
+        DetachEngine();
+    else if (connectionType == UDP || bTCPConnect)
+        AttachEngine();
+    return Engine;
+}
+
+IoEngine MySocket::GetIoEngine() {
+    return Engine;
+}
+
+void MySocket::AttachEngine() {
+    if (Engine != ENGINE_URING || Uring || ConnectionSocket == INVALID_SOCKET)
+        return;
+    try {
+        Uring = new UringEngine(ConnectionSocket, connectionType == TCP, MaxSize, Counters);
     }
-    if (bytesReceived == SOCKET_ERROR)
+    catch (const runtime_error&) {
+        // e.g. the locked-memory limit is used up: carry on with plain syscalls.
+        Engine = ENGINE_SYSCALL;
+    }
+}
+
+void MySocket::DetachEngine() {
+    delete Uring;
+    Uring = nullptr;
+}
+
+bool MySocket::IsConnected() {
+    return bTCPConnect;
+}
+
+int MySocket::GetUnsentBytes() {
+#if defined(__linux__) && defined(SIOCOUTQ)
+    int unsent = 0;
+    if (connectionType == TCP && ConnectionSocket != INVALID_SOCKET && ioctl(ConnectionSocket, SIOCOUTQ, &unsent) == 0)
+        return unsent;
+#endif
+    return -1;
+}
+
+int MySocket::ReceiveInto(char* dest, int capacity, int timeoutMs) {
+    long long deadline = DeadlineAfter(timeoutMs);
+    if (connectionType == SHM) {
+        if (!bTCPConnect)
+            throw runtime_error("Receive failed");
+        int n = Shm->Receive(dest, capacity, deadline);
+        if (n < 0)
+            ThrowTimeout("Receive timed out");
+        METRIC_ADD(Counters.BytesIn, n);
+        METRIC_ADD(Counters.PacketsIn, 1);
+        METRIC_STAMP(LastReceiveNs);
+        if (Capture && n > 0)
+            Capture->Record(CaptureStream, CAPTURE_IN, dest, n);
+        return n;
+    }
+    if (Uring) {
+        int n = Uring->Receive(dest, capacity, connectionType == UDP ? &SvrAddr : nullptr, deadline);
+        if (n < 0)
+            ThrowTimeout("Receive timed out");
+        METRIC_ADD(Counters.BytesIn, n);
+        METRIC_ADD(Counters.PacketsIn, 1);
+        METRIC_STAMP(LastReceiveNs);
+        if (Capture && n > 0)
+            Capture->Record(CaptureStream, CAPTURE_IN, dest, n);
+        return n;
+    }
+    TimedCall call(ConnectionSocket, timeoutMs >= 0);
+    int flags = (timeoutMs >= 0) ? call.Flags() : 0;
+    int bytesReceived = 0;
+    for (;;) {
+        if (timeoutMs >= 0 && !WaitUntil(ConnectionSocket, POLLIN, deadline))
+            ThrowTimeout("Receive timed out");
+        if (connectionType == TCP) {
+            bytesReceived = recv(ConnectionSocket, dest, capacity, flags);
+        }
+        else { // UDP
+            socklen_t addrLen = sizeof(SvrAddr);
+            bytesReceived = recvfrom(ConnectionSocket, dest, capacity, flags, (struct sockaddr*)&SvrAddr, &addrLen);
+        }
+        METRIC_ADD(Counters.Syscalls, 1);
+        // Readable but nothing to take (a datagram that failed its checksum): wait again.
+        if (bytesReceived == SOCKET_ERROR && timeoutMs >= 0 && WouldBlock(LastSocketError()))
+            continue;
+        break;
+    }
+    if (bytesReceived == SOCKET_ERROR && connectionType == UDP && DatagramTruncated(LastSocketError()))
+        bytesReceived = capacity;
+    if (bytesReceived == SOCKET_ERROR) {
+        METRIC_ADD(Counters.Errors, 1);
         throw runtime_error("Receive failed");
-    memcpy(destBuffer, Buffer, bytesReceived);
+    }
+    METRIC_ADD(Counters.BytesIn, bytesReceived);
+    METRIC_ADD(Counters.PacketsIn, 1);
+    METRIC_STAMP(LastReceiveNs);
+    if (Capture && bytesReceived > 0)
+        Capture->Record(CaptureStream, CAPTURE_IN, dest, bytesReceived);
     return bytesReceived;
 }
 
+int MySocket::GetData(char* destBuffer) {
+    return ReceiveInto(destBuffer, MaxSize, ReceiveTimeoutMs);
+}
+
+int MySocket::GetData(char* destBuffer, int capacity) {
+    return GetData(destBuffer, capacity, ReceiveTimeoutMs);
+}
+
+int MySocket::GetData(char* destBuffer, int capacity, int timeoutMs) {
+    if (destBuffer == nullptr || capacity <= 0)
+        throw runtime_error("GetData requires a non-empty destination buffer");
+    return ReceiveInto(destBuffer, capacity, timeoutMs);
+}
+
+RecvView MySocket::BorrowData() {
+    int slot = 0;
+    while (slot < RECV_POOL_SIZE && SlotBusy[slot])
+        ++slot;
+    if (slot == RECV_POOL_SIZE)
+        throw runtime_error("No free receive buffers; release a borrowed view first");
+
+    char* slotBuffer = Buffer + slot * MaxSize;
+    int bytesReceived = ReceiveInto(slotBuffer, MaxSize, ReceiveTimeoutMs);
+    SlotBusy[slot] = true;
+
+    RecvView view;
+    view.Data = slotBuffer;
+    view.Length = bytesReceived;
+    view.Slot = slot;
+    return view;
+}
+
+void MySocket::ReleaseData(RecvView& view) {
+    if (view.Slot < 0 || view.Slot >= RECV_POOL_SIZE || !SlotBusy[view.Slot])
+        throw runtime_error("ReleaseData called with a view that is not borrowed");
+    SlotBusy[view.Slot] = false;
+    view.Data = nullptr;
+    view.Length = 0;
+    view.Slot = -1;
+}
+
+bool MySocket::WaitUntil(SOCKET s, short events, long long deadlineMs) {
+    for (;;) {
+        long long remaining = -1;
+        if (deadlineMs >= 0) {
+            remaining = deadlineMs - NowMs();
+            if (remaining < 0)
+                remaining = 0;
+        }
+        pollfd pfd;
+        pfd.fd = s;
+        pfd.events = events;
+        pfd.revents = 0;
+#ifdef _WIN32
+        int rc = WSAPoll(&pfd, 1, static_cast<int>(remaining));
+        bool interrupted = rc < 0 && LastSocketError() == WSAEINTR;
+#else
+        int rc = poll(&pfd, 1, static_cast<int>(remaining));
+        bool interrupted = rc < 0 && errno == EINTR;
+#endif
+        // Errors and hang-ups count as ready; the following call reports them.
+        if (rc > 0 || (rc < 0 && !interrupted))
+            return true;
+        if (deadlineMs >= 0 && NowMs() >= deadlineMs)
+            return false;
+    }
+}
+
+void MySocket::ThrowTimeout(const char* what) {
+    METRIC_ADD(Counters.Timeouts, 1);
+    throw SocketTimeout(what);
+}
+
+void MySocket::SetTimeouts(int connectMs, int sendMs, int receiveMs) {
+    ConnectTimeoutMs = connectMs;
+    SendTimeoutMs = sendMs;
+    ReceiveTimeoutMs = receiveMs;
+}
+
+bool MySocket::WaitForData(int timeoutMs) {
+    if (connectionType == SHM)
+        return bTCPConnect && Shm->WaitForData(DeadlineAfter(timeoutMs));
+    if (Uring)
+        return Uring->WaitForData(DeadlineAfter(timeoutMs));
+    pollfd pfd;
+    pfd.fd = ConnectionSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+#ifdef _WIN32
+    int rc = WSAPoll(&pfd, 1, timeoutMs);
+#else
+    int rc = poll(&pfd, 1, timeoutMs);
+#endif
+    return rc > 0;
+}
+
+int MySocket::SendBatch(UdpDatagram* datagrams, int count) {
+    if (connectionType != UDP)
+        throw runtime_error("SendBatch needs a UDP socket");
+    int sent = 0;
+    if (Uring) {
+        sent = Uring->SendBatch(datagrams, count);
+    }
+    else {
+#ifdef __linux__
+        mmsghdr msgs[MAX_BATCH];
+        iovec iovs[MAX_BATCH];
+        while (sent < count) {
+            int n = (count - sent < MAX_BATCH) ? count - sent : MAX_BATCH;
+            for (int i = 0; i < n; ++i) {
+                UdpDatagram& d = datagrams[sent + i];
+                iovs[i].iov_base = d.Data;
+                iovs[i].iov_len = d.Length;
+                memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+                msgs[i].msg_hdr.msg_name = &d.Addr;
+                msgs[i].msg_hdr.msg_namelen = sizeof(d.Addr);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int rc = sendmmsg(ConnectionSocket, msgs, n, 0);
+            METRIC_ADD(Counters.Syscalls, 1);
+            if (rc <= 0)
+                break;
+            sent += rc;
+        }
+#else
+        for (; sent < count; ++sent) {
+            UdpDatagram& d = datagrams[sent];
+            METRIC_ADD(Counters.Syscalls, 1);
+            if (sendto(ConnectionSocket, d.Data, d.Length, 0, (struct sockaddr*)&d.Addr, sizeof(d.Addr)) == SOCKET_ERROR)
+                break;
+        }
+#endif
+    }
+    if (sent == 0 && count > 0) {
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("UDP batch send failed");
+    }
+    METRIC_ONLY(
+        for (int i = 0; i < sent; ++i)
+            Counters.BytesOut.fetch_add(datagrams[i].Length, memory_order_relaxed);
+        Counters.PacketsOut.fetch_add(sent, memory_order_relaxed);
+    )
+    METRIC_STAMP(LastSendNs);
+    if (Capture) {
+        for (int i = 0; i < sent; ++i)
+            Capture->Record(CaptureStream, CAPTURE_OUT, datagrams[i].Data, datagrams[i].Length);
+    }
+    return sent;
+}
+
+int MySocket::SendPacketBatch(vector<pair<PktDef*, sockaddr_in>>& packets) {
+    BatchScratch.resize(packets.size());
+    for (size_t i = 0; i < packets.size(); ++i) {
+        UdpDatagram& d = BatchScratch[i];
+        d.Length = packets[i].first->GetLength();
+        d.Data = packets[i].first->GenPacket();
+        d.Capacity = d.Length;
+        d.Addr = packets[i].second;
+    }
+    int sent = SendBatch(BatchScratch.data(), static_cast<int>(BatchScratch.size()));
+    METRIC_ONLY(
+        if (PacketTracingEnabled()) {
+            for (int i = 0; i < sent; ++i)
+                packets[i].first->GetTrace().SendNs = LastSendNs;
+        }
+    )
+    return sent;
+}
+
+int MySocket::GetDataBatch(UdpDatagram* datagrams, int count) {
+    if (connectionType != UDP)
+        throw runtime_error("GetDataBatch needs a UDP socket");
+    if (count <= 0)
+        return 0;
+    if (count > MAX_BATCH)
+        count = MAX_BATCH;
+    if (Uring) {
+        int received = Uring->ReceiveBatch(datagrams, count, DeadlineAfter(ReceiveTimeoutMs));
+        if (received < 0)
+            ThrowTimeout("Receive timed out");
+        METRIC_ONLY(CountBatchReceived(datagrams, received));
+        CaptureBatchReceived(datagrams, received);
+        return received;
+    }
+    if (ReceiveTimeoutMs >= 0 && !WaitUntil(ConnectionSocket, POLLIN, DeadlineAfter(ReceiveTimeoutMs)))
+        ThrowTimeout("Receive timed out");
+#ifdef __linux__
+    mmsghdr msgs[MAX_BATCH];
+    iovec iovs[MAX_BATCH];
+    for (int i = 0; i < count; ++i) {
+        UdpDatagram& d = datagrams[i];
+        iovs[i].iov_base = d.Data;
+        iovs[i].iov_len = d.Capacity;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_name = &d.Addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(d.Addr);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    // MSG_WAITFORONE: block for the first datagram only, then take what is queued.
+    int received = recvmmsg(ConnectionSocket, msgs, count, MSG_WAITFORONE, nullptr);
+    METRIC_ADD(Counters.Syscalls, 1);
+    if (received < 0) {
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("Receive failed");
+    }
+    for (int i = 0; i < received; ++i)
+        datagrams[i].Length = static_cast<int>(msgs[i].msg_len);
+    METRIC_ONLY(CountBatchReceived(datagrams, received));
+    CaptureBatchReceived(datagrams, received);
+    return received;
+#else
+    int received = 0;
+    for (; received < count; ++received) {
+        UdpDatagram& d = datagrams[received];
+        socklen_t addrLen = sizeof(d.Addr);
+        int n = recvfrom(ConnectionSocket, d.Data, d.Capacity, 0, (struct sockaddr*)&d.Addr, &addrLen);
+        METRIC_ADD(Counters.Syscalls, 1);
+        if (n == SOCKET_ERROR && DatagramTruncated(LastSocketError()))
+            n = d.Capacity;
+        if (n == SOCKET_ERROR) {
+            if (received > 0 && WouldBlock(LastSocketError()))
+                break;
+            SetNonBlocking(ConnectionSocket, false);
+            METRIC_ADD(Counters.Errors, 1);
+            throw runtime_error("Receive failed");
+        }
+        d.Length = n;
+        // After the first datagram, only drain what is already queued.
+        if (received == 0)
+            SetNonBlocking(ConnectionSocket, true);
+    }
+    SetNonBlocking(ConnectionSocket, false);
+    METRIC_ONLY(CountBatchReceived(datagrams, received));
+    CaptureBatchReceived(datagrams, received);
+    return received;
+#endif
+}
+
+void MySocket::CountBatchReceived(const UdpDatagram* datagrams, int received) {
+    for (int i = 0; i < received; ++i)
+        Counters.BytesIn.fetch_add(datagrams[i].Length, memory_order_relaxed);
+    Counters.PacketsIn.fetch_add(received, memory_order_relaxed);
+    METRIC_STAMP(LastReceiveNs);
+}
+
+void MySocket::CaptureBatchReceived(const UdpDatagram* datagrams, int received) {
+    if (!Capture)
+        return;
+    for (int i = 0; i < received; ++i)
+        Capture->Record(CaptureStream, CAPTURE_IN, datagrams[i].Data, datagrams[i].Length);
+}
+
+sockaddr_in MySocket::MakeAddress(string ip, int port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+    return addr;
+}
+
+void MySocket::SteerReusePort(int byteOffset, int groupSize) {
+    if (connectionType != UDP || mySocket != SERVER)
+        throw runtime_error("SteerReusePort needs a UDP server socket");
+    if (byteOffset < 0 || groupSize <= 0)
+        throw runtime_error("SteerReusePort arguments out of range");
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    // The program sees the UDP payload and returns the index of the group
+    // member to deliver to. A datagram too short for the load goes to member 0.
+    sock_filter code[] = {
+        { BPF_LD | BPF_B | BPF_ABS, 0, 0, static_cast<unsigned int>(byteOffset) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<unsigned int>(groupSize) },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    sock_fprog program = { static_cast<unsigned short>(sizeof(code) / sizeof(code[0])), code };
+    if (setsockopt(ConnectionSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == SOCKET_ERROR)
+        throw runtime_error("SO_ATTACH_REUSEPORT_CBPF failed");
+#else
+    throw runtime_error("Payload steering is not supported on this platform");
+#endif
+}
+
 string MySocket::GetIPAddr() {
     return IPAddr;
 }
@@ -156,3 +865,25 @@ void MySocket::SetType(SocketType type) {
     mySocket = type;
 }
 
+
+SocketCounters& MySocket::GetCounters() {
+    return Counters;
+}
+
+string MySocket::GetMetricsLabel() {
+    return MetricsLabel;
+}
+
+long long MySocket::GetLastReceiveNs() {
+    return LastReceiveNs;
+}
+
+long long MySocket::GetLastSendNs() {
+    return LastSendNs;
+}
+
+void MySocket::SetCapture(PacketCapture* capture) {
+    if (capture)
+        CaptureStream = capture->OpenStream(MetricsLabel);
+    Capture = capture;
+}
@@ -1,47 +1,208 @@
 #pragma once
 
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "NetPlatform.h"
+#include "PktDef.h"
+#include "NetMetrics.h"
+#include "PacketCapture.h"
 #include <string>
+#include <vector>
+#include <utility>
 #include <stdexcept>
 #include <cstring>
 using namespace std;
-#pragma comment(lib, "Ws2_32.lib")
 
 // Global enumerations and a constant for default buffer size.
 enum SocketType { CLIENT, SERVER };
-enum ConnectionType { TCP, UDP };
+// SHM is a shared-memory link to a process on the same host (see ShmTransport.h):
+// ip:port only names the segment, ConnectTCP() and DisconnectTCP() open and end
+// the session, and messages keep their boundaries like UDP datagrams.
+enum ConnectionType { TCP, UDP, SHM };
+// How a TCP or UDP socket reaches the kernel: one syscall per operation, or
+// io_uring with multishot receive and batched submission (see UringEngine.h).
+enum IoEngine { ENGINE_SYSCALL, ENGINE_URING };
 static const int DEFAULT_SIZE = 1024;
+// Number of receive buffers that can be borrowed from a socket at the same time.
+static const int RECV_POOL_SIZE = 4;
+
+// Read-only view into one of a socket's pooled receive buffers.
+// The view stays valid until it is handed back with MySocket::ReleaseData().
+struct RecvView {
+    const char* Data;   // Start of the received bytes (nullptr if empty).
+    int Length;         // Number of bytes received.
+    int Slot;           // Pool slot that owns the bytes (-1 if empty).
+};
+
+// One datagram in a batched UDP send or receive.
+struct UdpDatagram {
+    char* Data;         // Send: bytes to send. Receive: caller-owned buffer.
+    int Length;         // Send: bytes in Data. Receive: set to the bytes received.
+    int Capacity;       // Receive: size of Data. Ignored for send.
+    sockaddr_in Addr;   // Send: destination. Receive: set to the source.
+};
+
+// One piece of a scatter/gather send.
+struct IoSlice {
+    const char* Data;
+    int Length;
+};
+
+// Largest number of datagrams handed to the kernel in one sendmmsg/recvmmsg call.
+static const int MAX_BATCH = 64;
+
+// Thrown when a socket operation runs out of time. It derives from
+// runtime_error, so existing handlers still catch it, but a control loop can
+// tell an unreachable robot apart from a broken socket.
+class SocketTimeout : public runtime_error {
+public:
+    explicit SocketTimeout(const string& what) : runtime_error(what) {}
+};
+
+class ShmTransport;
+class UringEngine;
 
 class MySocket {
 private:
-    char* Buffer;               // Dynamically allocated RAW buffer.
+    char* Buffer;               // Dynamically allocated RAW buffer (RECV_POOL_SIZE slots of MaxSize bytes).
+    bool SlotBusy[RECV_POOL_SIZE]; // Marks pool slots currently lent out through BorrowData().
     SOCKET WelcomeSocket;       // Listening socket for a TCP server.
     SOCKET ConnectionSocket;    // Socket used for client/server communications.
     struct sockaddr_in SvrAddr; // Structure to store connection information.
     SocketType mySocket;        // Indicates if this is a CLIENT or SERVER socket.
     string IPAddr;               // IPv4 address.
     int Port;                   // Port number.
-    ConnectionType connectionType; // TCP or UDP.
+    ConnectionType connectionType; // TCP, UDP or SHM.
     bool bTCPConnect;           // Indicates if a TCP connection is established.
     int MaxSize;                // Maximum buffer size.
 
+    // Defaults for calls without a timeout argument, in ms; -1 waits forever.
+    int ConnectTimeoutMs;
+    int SendTimeoutMs;
+    int ReceiveTimeoutMs;
+
+    vector<UdpDatagram> BatchScratch; // Reused by SendPacketBatch() to avoid per-call allocation.
+
+    SocketCounters Counters;    // Traffic counters, readable from any thread.
+    string MetricsLabel;        // Name the counters are exported under.
+    long long LastReceiveNs;    // MetricsNowNs() of the latest receive (tracing only).
+    long long LastSendNs;       // MetricsNowNs() of the latest completed send (tracing only).
+
+    ShmTransport* Shm;          // Shared-memory link for SHM sockets, otherwise nullptr.
+    IoEngine Engine;            // Engine chosen with SetIoEngine().
+    UringEngine* Uring;         // io_uring engine while in use, otherwise nullptr.
+
+    PacketCapture* Capture;     // Traffic log, or nullptr when not capturing.
+    int CaptureStream;          // This socket's stream id in Capture.
+
+    // TCP client: create the socket if a disconnect or failed connect closed it.
+    void OpenClientSocket();
+    void CloseClientSocket();
+    // Start or stop the io_uring engine on ConnectionSocket.
+    void AttachEngine();
+    void DetachEngine();
+    // Receive straight into dest, reading at most capacity bytes.
+    int ReceiveInto(char* dest, int capacity, int timeoutMs);
+    // Wait for events (POLLIN / POLLOUT) on s until deadlineMs (-1 = forever).
+    // Returns false if the deadline passed first.
+    bool WaitUntil(SOCKET s, short events, long long deadlineMs);
+    void ThrowTimeout(const char* what);
+    // Counter updates shared by the batch and gather paths.
+    void CountGatherSent(const IoSlice* slices, int count, int sent);
+    void CountBatchReceived(const UdpDatagram* datagrams, int received);
+    void CaptureBatchReceived(const UdpDatagram* datagrams, int received);
+
 public:
     // Constructor: configures the socket, sets IP and port, and allocates the buffer.
-    // If an invalid size is provided, DEFAULT_SIZE is used.
-    MySocket(SocketType type, string ip, unsigned int port, ConnectionType connType, unsigned int maxSize);
+    // If an invalid size is provided, DEFAULT_SIZE is used. With reusePort a
+    // UDP server shares its port with every other socket bound the same way
+    // (SO_REUSEPORT) and the kernel spreads senders across them; see UdpIngest.h.
+    MySocket(SocketType type, string ip, unsigned int port, ConnectionType connType, unsigned int maxSize, bool reusePort = false);
 
     // Destructor: cleans up dynamically allocated memory and closes sockets.
     ~MySocket();
 
-    // Establish a TCP connection (for TCP only).
+    // Establish a TCP connection (for TCP only). A client can connect again
+    // after DisconnectTCP() or a failed attempt; it gets a fresh socket.
+    // Uses the connect timeout from SetTimeouts().
     void ConnectTCP();
+    // As ConnectTCP(), but a client gives up after timeoutMs instead of
+    // waiting out the kernel's SYN retries, and a server stops waiting for a
+    // client to accept. Throws SocketTimeout; -1 waits forever.
+    void ConnectTCP(int timeoutMs);
     // Disconnect a TCP connection.
     void DisconnectTCP();
     // Transmit a block of RAW data.
     void SendData(const char* data, int numBytes);
+    // As SendData(), but throw SocketTimeout if a TCP peer has not taken all
+    // of the data within timeoutMs. The deadline covers the whole block; after
+    // a timeout part of it may already be on the wire. UDP sends never wait.
+    void SendData(const char* data, int numBytes, int timeoutMs);
     // Receive data into an external buffer and return the number of bytes received.
+    // destBuffer must be able to hold MaxSize bytes.
     int GetData(char* destBuffer);
+    // Receive directly into destBuffer, never writing more than capacity bytes.
+    // For UDP, any part of a datagram that does not fit is discarded and
+    // capacity is returned, on Windows too.
+    int GetData(char* destBuffer, int capacity);
+    // As above, but throw SocketTimeout if nothing arrives within timeoutMs.
+    int GetData(char* destBuffer, int capacity, int timeoutMs);
+    // Receive into a free pooled buffer and lend it to the caller without copying.
+    // Throws if every pool slot is already borrowed.
+    RecvView BorrowData();
+    // Return a buffer obtained from BorrowData() to the pool.
+    void ReleaseData(RecvView& view);
+
+    // Send the slices back to back in one writev-style call (sendmsg / WSASend)
+    // and return the number of bytes the socket accepted, which may be fewer
+    // than requested. With dontWait set (Linux/POSIX) the call never blocks and
+    // returns 0 if the socket buffer is full.
+    int SendGather(const IoSlice* slices, int count, bool dontWait);
+    // Default timeouts, in milliseconds, for ConnectTCP(), SendData() and the
+    // receive calls (GetData, BorrowData, GetDataBatch) made without one.
+    // -1, the default, waits forever. A call that runs out of time throws
+    // SocketTimeout and leaves the socket usable.
+    void SetTimeouts(int connectMs, int sendMs, int receiveMs);
+    // Enable or disable Nagle's algorithm on a TCP socket (TCP_NODELAY).
+    void SetNoDelay(bool enable);
+    // Turn on TCP keepalive: probe after idleSeconds of silence, every
+    // intervalSeconds, and drop the connection after probes misses.
+    void SetKeepAlive(bool enable, int idleSeconds, int intervalSeconds, int probes);
+    // Non-blocking check for a connection the peer has closed or reset.
+    // Data waiting to be read does not count as closed.
+    bool PeerClosed();
+    bool IsConnected();
+    // Choose the I/O engine for a TCP or UDP socket. ENGINE_URING is used
+    // only if UringEngine::IsSupported(); otherwise the socket stays on plain
+    // syscalls. Returns the engine in effect. A UDP socket switches at once and
+    // a TCP socket at its next ConnectTCP(); switch before any data arrives.
+    // SHM sockets always report ENGINE_SYSCALL.
+    IoEngine SetIoEngine(IoEngine engine);
+    IoEngine GetIoEngine();
+    // Bytes handed to a TCP socket that the peer has not acknowledged yet
+    // (SIOCOUTQ), or -1 where the platform cannot tell.
+    int GetUnsentBytes();
+
+    // Wait up to timeoutMs (-1 = forever) for data to arrive without reading it.
+    // Returns true if a following GetData() call will not block.
+    bool WaitForData(int timeoutMs);
+
+    // Batched UDP I/O. On Linux these map to sendmmsg/recvmmsg (MAX_BATCH
+    // datagrams per syscall); elsewhere they fall back to a loop.
+    // Send count datagrams, each to its own address. Returns the number sent.
+    int SendBatch(UdpDatagram* datagrams, int count);
+    // Generate and send each packet to its paired destination.
+    // Packets must already have had CalcCRC() called. Returns the number sent;
+    // those get their trace's SendNs stamped.
+    int SendPacketBatch(vector<pair<PktDef*, sockaddr_in>>& packets);
+    // Block until at least one datagram arrives, then also take any others
+    // already queued, up to count. Returns the number received.
+    int GetDataBatch(UdpDatagram* datagrams, int count);
+    // Build an IPv4 address for UdpDatagram::Addr.
+    static sockaddr_in MakeAddress(string ip, int port);
+    // For a reusePort UDP server: deliver each datagram to member
+    // (payload[byteOffset] % groupSize) of the port's group, in bind order,
+    // instead of hashing the sender's address. Linux only (classic BPF);
+    // throws elsewhere.
+    void SteerReusePort(int byteOffset, int groupSize);
 
     // Getters and setters for IP and port.
     string GetIPAddr();
@@ -52,5 +213,20 @@ public:
     // Get and set the socket type.
     SocketType GetType();
     void SetType(SocketType type);
+
+    // Metrics: live counters, their export label and the times of the latest
+    // receive and of the latest send the socket accepted (0 unless packet
+    // tracing is on).
+    SocketCounters& GetCounters();
+    string GetMetricsLabel();
+    long long GetLastReceiveNs();
+    long long GetLastSendNs();
+
+    // Tee everything sent with SendData/SendBatch and received with
+    // GetData/BorrowData/GetDataBatch into capture, as its own stream named
+    // after the metrics label. Pass nullptr to stop. The capture must be open
+    // and must outlive the socket or a later SetCapture(nullptr).
+    // SendGather traffic (AsyncSender) is not captured.
+    void SetCapture(PacketCapture* capture);
 };
 
@@ -0,0 +1,209 @@
+#include "NetMetrics.h"
+#include <chrono>
+#include <cstdio>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+using namespace std;
+
+long long MetricsNowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SocketCounters::SocketCounters() {
+    Reset();
+}
+
+void SocketCounters::Reset() {
+    BytesIn = 0;
+    BytesOut = 0;
+    PacketsIn = 0;
+    PacketsOut = 0;
+    Syscalls = 0;
+    PartialSends = 0;
+    Errors = 0;
+    Timeouts = 0;
+    CrcFailures = 0;
+}
+
+// Index of the highest set bit; value must be non-zero.
+static int HighestBit(unsigned long long value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() {
+    Reset();
+}
+
+void LatencyHistogram::Reset() {
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+        Counts[i] = 0;
+    Count = 0;
+    Sum = 0;
+    Max = 0;
+}
+
+int LatencyHistogram::BucketIndex(unsigned long long value) {
+    if (value < static_cast<unsigned long long>(SUB_BUCKETS))
+        return static_cast<int>(value);
+    // value >> shift lands in [SUB_BUCKETS, 2*SUB_BUCKETS); its low bits pick the sub-bucket.
+    int shift = HighestBit(value) - SUB_BUCKET_BITS;
+    int sub = static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+unsigned long long LatencyHistogram::BucketUpperBound(int index) {
+    if (index < SUB_BUCKETS)
+        return static_cast<unsigned long long>(index);
+    int shift = index / SUB_BUCKETS - 1;
+    unsigned long long sub = static_cast<unsigned long long>(index % SUB_BUCKETS);
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(long long value) {
+    if (value < 0)
+        value = 0;
+    Counts[BucketIndex(static_cast<unsigned long long>(value))].fetch_add(1, memory_order_relaxed);
+    Count.fetch_add(1, memory_order_relaxed);
+    Sum.fetch_add(static_cast<unsigned long long>(value), memory_order_relaxed);
+    long long seen = Max.load(memory_order_relaxed);
+    while (value > seen && !Max.compare_exchange_weak(seen, value, memory_order_relaxed)) {}
+}
+
+long long LatencyHistogram::Percentile(double p) {
+    // Sum the buckets first: Count may run ahead of them while a writer is mid-Record.
+    unsigned long long total = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+        total += Counts[i].load(memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    unsigned long long rank = static_cast<unsigned long long>(p / 100.0 * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += Counts[i].load(memory_order_relaxed);
+        if (seen >= rank) {
+            long long bound = static_cast<long long>(BucketUpperBound(i));
+            long long max = GetMax();
+            return (bound < max) ? bound : max;
+        }
+    }
+    return GetMax();
+}
+
+unsigned long long LatencyHistogram::GetCount() {
+    return Count.load(memory_order_relaxed);
+}
+
+unsigned long long LatencyHistogram::GetSum() {
+    return Sum.load(memory_order_relaxed);
+}
+
+long long LatencyHistogram::GetMax() {
+    return Max.load(memory_order_relaxed);
+}
+
+MetricsRegistry& MetricsRegistry::Instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+void MetricsRegistry::Add(const string& label, SocketCounters* counters) {
+    lock_guard<mutex> guard(Lock);
+    Sockets.push_back(make_pair(label, counters));
+}
+
+void MetricsRegistry::Add(const string& label, LatencyHistogram* histogram) {
+    lock_guard<mutex> guard(Lock);
+    Histograms.push_back(make_pair(label, histogram));
+}
+
+void MetricsRegistry::Remove(const void* source) {
+    lock_guard<mutex> guard(Lock);
+    for (size_t i = 0; i < Sockets.size(); ++i) {
+        if (Sockets[i].second == source) {
+            Sockets.erase(Sockets.begin() + i);
+            return;
+        }
+    }
+    for (size_t i = 0; i < Histograms.size(); ++i) {
+        if (Histograms[i].second == source) {
+            Histograms.erase(Histograms.begin() + i);
+            return;
+        }
+    }
+}
+
+string MetricsRegistry::RenderPrometheus() {
+    struct CounterField {
+        const char* Name;
+        MetricCounter SocketCounters::* Field;
+    };
+    static const CounterField fields[] = {
+        { "robotnet_socket_bytes_in_total", &SocketCounters::BytesIn },
+        { "robotnet_socket_bytes_out_total", &SocketCounters::BytesOut },
+        { "robotnet_socket_packets_in_total", &SocketCounters::PacketsIn },
+        { "robotnet_socket_packets_out_total", &SocketCounters::PacketsOut },
+        { "robotnet_socket_syscalls_total", &SocketCounters::Syscalls },
+        { "robotnet_socket_partial_sends_total", &SocketCounters::PartialSends },
+        { "robotnet_socket_errors_total", &SocketCounters::Errors },
+        { "robotnet_socket_timeouts_total", &SocketCounters::Timeouts },
+        { "robotnet_socket_crc_failures_total", &SocketCounters::CrcFailures },
+    };
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    lock_guard<mutex> guard(Lock);
+    string out;
+    char line[256];
+    for (const CounterField& f : fields) {
+        out += string("# TYPE ") + f.Name + " counter\n";
+        for (const pair<string, SocketCounters*>& s : Sockets) {
+            snprintf(line, sizeof(line), "%s{socket=\"%s\"} %llu\n", f.Name, s.first.c_str(),
+                (s.second->*f.Field).load(memory_order_relaxed));
+            out += line;
+        }
+    }
+
+    out += "# TYPE robotnet_latency_ns summary\n";
+    for (const pair<string, LatencyHistogram*>& h : Histograms) {
+        for (double q : quantiles) {
+            snprintf(line, sizeof(line), "robotnet_latency_ns{name=\"%s\",quantile=\"%g\"} %lld\n",
+                h.first.c_str(), q, h.second->Percentile(q * 100.0));
+            out += line;
+        }
+        snprintf(line, sizeof(line), "robotnet_latency_ns_sum{name=\"%s\"} %llu\n", h.first.c_str(), h.second->GetSum());
+        out += line;
+        snprintf(line, sizeof(line), "robotnet_latency_ns_count{name=\"%s\"} %llu\n", h.first.c_str(), h.second->GetCount());
+        out += line;
+    }
+    return out;
+}
+
+bool MetricsRegistry::WritePrometheus(const string& path) {
+    string text = RenderPrometheus();
+    string temp = path + ".tmp";
+    FILE* file = nullptr;
+#ifdef _MSC_VER
+    if (fopen_s(&file, temp.c_str(), "wb") != 0)
+        file = nullptr;
+#else
+    file = fopen(temp.c_str(), "wb");
+#endif
+    if (!file)
+        return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        return false;
+    // rename() will not replace an existing file on Windows.
+    remove(path.c_str());
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
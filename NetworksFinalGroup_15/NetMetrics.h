@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Hot-path instrumentation for sockets and packets.
+//
+// Counters and histograms are plain relaxed atomics: the thread doing the I/O
+// bumps them (one uncontended add, a few nanoseconds) and a stats thread may
+// read them at any time without locking. MetricsRegistry keeps track of the
+// live sources so WritePrometheus() can dump them all as Prometheus text.
+//
+// Define ROBOTNET_NO_METRICS to compile the updates out entirely; the types
+// stay so getters still build, but every METRIC_* macro expands to nothing.
+// Per-packet timestamps additionally need SetPacketTracing(true) at run time.
+#ifndef ROBOTNET_NO_METRICS
+#define ROBOTNET_METRICS 1
+#endif
+
+typedef atomic<unsigned long long> MetricCounter;
+
+// Monotonic timestamp in nanoseconds used for all trace stamps.
+long long MetricsNowNs();
+
+// Per-packet timestamps cost a clock read each, so they stay off until a
+// caller turns them on; counters are always live when compiled in.
+inline atomic<bool>& PacketTracingFlag() {
+    static atomic<bool> enabled(false);
+    return enabled;
+}
+inline void SetPacketTracing(bool enable) {
+    PacketTracingFlag().store(enable, memory_order_relaxed);
+}
+inline bool PacketTracingEnabled() {
+    return PacketTracingFlag().load(memory_order_relaxed);
+}
+
+#ifdef ROBOTNET_METRICS
+#define METRIC_ADD(counter, n) (counter).fetch_add((n), memory_order_relaxed)
+#define METRIC_STAMP(field) do { if (PacketTracingEnabled()) (field) = MetricsNowNs(); } while (0)
+#define METRIC_ONLY(statement) statement
+#else
+#define METRIC_ADD(counter, n) ((void)0)
+#define METRIC_STAMP(field) ((void)0)
+#define METRIC_ONLY(statement)
+#endif
+
+// Per-socket traffic counters.
+struct SocketCounters {
+    MetricCounter BytesIn;
+    MetricCounter BytesOut;
+    MetricCounter PacketsIn;
+    MetricCounter PacketsOut;
+    MetricCounter Syscalls;
+    MetricCounter PartialSends;     // Sends the kernel accepted only part of.
+    MetricCounter Errors;
+    MetricCounter Timeouts;         // Calls that gave up with SocketTimeout.
+    MetricCounter CrcFailures;      // Bad CRC or unparseable; reported by whoever validates packets from this socket.
+
+    SocketCounters();
+    void Reset();
+};
+
+// Timestamps (MetricsNowNs) of one packet's trip through the stack; 0 = not reached.
+struct PacketTrace {
+    long long EnqueueNs;    // Handed to a send queue.
+    long long SendNs;       // Accepted by the socket.
+    long long ReceiveNs;    // Read off the socket.
+    long long DecodeNs;     // Parsed into a PktDef.
+};
+
+// HDR-style log-linear latency histogram.
+//
+// Values below SUB_BUCKETS are counted exactly; above that each power of two
+// is split into SUB_BUCKETS equal buckets, so any recorded value is reported
+// within 1/SUB_BUCKETS (6.25%) of its true size across the full 64-bit range.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    // Record one value (negative values count as 0).
+    void Record(long long value);
+    void Reset();
+
+    // Value at percentile p in [0, 100] (upper edge of its bucket).
+    long long Percentile(double p);
+    unsigned long long GetCount();
+    unsigned long long GetSum();
+    long long GetMax();
+
+    static int BucketIndex(unsigned long long value);
+    static unsigned long long BucketUpperBound(int index);
+
+private:
+    MetricCounter Counts[BUCKET_COUNT];
+    MetricCounter Count;
+    MetricCounter Sum;
+    atomic<long long> Max;
+};
+
+// Process-wide list of metric sources for export.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& Instance();
+
+    // Sources register under a label and must be removed before they are destroyed.
+    void Add(const string& label, SocketCounters* counters);
+    void Add(const string& label, LatencyHistogram* histogram);
+    void Remove(const void* source);
+
+    // Prometheus text exposition of every registered source.
+    string RenderPrometheus();
+    // Write RenderPrometheus() to path via a temporary file and rename, so a
+    // scraper never sees a half-written dump. Returns false on I/O failure.
+    bool WritePrometheus(const string& path);
+
+private:
+    MetricsRegistry() {}
+
+    mutex Lock;     // Guards the lists only; metric values are read lock-free.
+    vector<pair<string, SocketCounters*>> Sockets;
+    vector<pair<string, LatencyHistogram*>> Histograms;
+};
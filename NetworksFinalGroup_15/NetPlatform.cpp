@@ -0,0 +1,73 @@
+#include "NetPlatform.h"
+#include <stdexcept>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+using namespace std;
+
+namespace {
+    // Owns the process-wide network initialization. Constructed on first use;
+    // destroyed (and WSACleanup called) during static destruction.
+    class NetworkRuntime {
+    public:
+        NetworkRuntime() {
+#ifdef _WIN32
+            WSADATA wsaData;
+            if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+                throw runtime_error("WSAStartup failed");
+#else
+            signal(SIGPIPE, SIG_IGN);
+#endif
+        }
+
+        ~NetworkRuntime() {
+#ifdef _WIN32
+            WSACleanup();
+#endif
+        }
+    };
+}
+
+void NetworkStartup() {
+    // C++11 guarantees this runs once, even with concurrent callers. If the
+    // constructor throws, the next call tries again.
+    static NetworkRuntime runtime;
+    (void)runtime;
+}
+
+int CloseSocket(SOCKET s) {
+#ifdef _WIN32
+    return closesocket(s);
+#else
+    return close(s);
+#endif
+}
+
+int LastSocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool WouldBlock(int error) {
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EAGAIN || error == EWOULDBLOCK || error == EINPROGRESS;
+#endif
+}
+
+bool SetNonBlocking(SOCKET s, bool enable) {
+#ifdef _WIN32
+    u_long mode = enable ? 1 : 0;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags < 0)
+        return false;
+    flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(s, F_SETFL, flags) == 0;
+#endif
+}
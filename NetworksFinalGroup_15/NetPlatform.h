@@ -0,0 +1,47 @@
+#pragma once
+
+// Platform abstraction for the socket layer. MySocket and friends include this
+// header instead of the OS socket headers, and use the names below on every
+// platform (SOCKET, INVALID_SOCKET, SOCKET_ERROR, SD_SEND, socklen_t).
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+typedef int SOCKET;
+static const SOCKET INVALID_SOCKET = -1;
+static const int SOCKET_ERROR = -1;
+#ifndef SD_SEND
+#define SD_SEND SHUT_WR
+#endif
+#endif
+
+// Process-wide network stack initialization.
+// On Windows the first call runs WSAStartup and WSACleanup runs once at process
+// exit; on POSIX it only makes sure SIGPIPE cannot kill the process when a peer
+// disconnects mid-send. Safe to call from any number of threads and objects.
+void NetworkStartup();
+
+// Close a socket handle (closesocket on Windows, close on POSIX).
+int CloseSocket(SOCKET s);
+
+// Last socket error code for the calling thread (WSAGetLastError / errno).
+int LastSocketError();
+
+// True if the last error means a non-blocking call would have blocked.
+bool WouldBlock(int error);
+
+// Switch a socket between blocking and non-blocking mode.
+bool SetNonBlocking(SOCKET s, bool enable);
@@ -0,0 +1,248 @@
+#include "PacketCapture.h"
+#include "NetMetrics.h"
+#include "WireFormat.h"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+static const char FILE_MAGIC[8] = { 'R', 'B', 'T', 'C', 'A', 'P', '0', '1' };
+static const char TRAILER_MAGIC[8] = { 'R', 'B', 'T', 'C', 'A', 'P', 'I', 'X' };
+// How long the writer sleeps when the ring is empty.
+static const int WRITER_IDLE_US = 1000;
+
+static size_t RingSize(int requested) {
+    size_t size = 4096;
+    while (size < static_cast<size_t>(requested) && size < (static_cast<size_t>(1) << 30))
+        size <<= 1;
+    return size;
+}
+
+PacketCapture::PacketCapture(int ringBytes)
+    : Ring(nullptr), Capacity(RingSize(ringBytes)), Mask(Capacity - 1), Ready(Capacity / 8),
+    Head(0), Tail(0), Running(false), NextStream(0), StartNs(0), Recorded(0), Dropped(0),
+    BytesWritten(0), File(nullptr), FileOffset(0), DataFrames(0)
+{
+    Ring = new char[Capacity];
+    for (atomic<uint32_t>& slot : Ready)
+        slot.store(0, memory_order_relaxed);
+}
+
+PacketCapture::~PacketCapture() {
+    Close();
+    delete[] Ring;
+}
+
+void PacketCapture::Open(const string& path) {
+    if (File)
+        throw runtime_error("Capture file is already open");
+#ifdef _MSC_VER
+    if (fopen_s(&File, path.c_str(), "wb") != 0)
+        File = nullptr;
+#else
+    File = fopen(path.c_str(), "wb");
+#endif
+    if (!File)
+        throw runtime_error("Failed to create capture file " + path);
+
+    long long wallNs = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    char header[FILE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    WireFormat::Store32(header + 8, FORMAT_VERSION);
+    WireFormat::Store32(header + 12, FILE_HEADER_SIZE);
+    WireFormat::Store64(header + 16, static_cast<uint64_t>(wallNs));
+    fwrite(header, 1, sizeof(header), File);
+
+    FileOffset = FILE_HEADER_SIZE;
+    BytesWritten.store(FileOffset, memory_order_relaxed);
+    DataFrames = 0;
+    Streams.clear();
+    Index.clear();
+    StartNs = MetricsNowNs();
+    Running.store(true, memory_order_release);
+    Writer = thread(&PacketCapture::WriterLoop, this);
+}
+
+void PacketCapture::Close() {
+    if (!File)
+        return;
+    // Callers should stop recording first; a frame still being copied in is lost.
+    Running.store(false, memory_order_release);
+    if (Writer.joinable())
+        Writer.join();
+    while (Drain() > 0)
+        ;
+    WriteIndex();
+    fclose(File);
+    File = nullptr;
+}
+
+bool PacketCapture::IsOpen() {
+    return Running.load(memory_order_acquire);
+}
+
+int PacketCapture::OpenStream(const string& label) {
+    if (!IsOpen())
+        throw runtime_error("OpenStream called before the capture file was opened");
+    int length = label.size() > 1024 ? 1024 : static_cast<int>(label.size());
+    int stream = NextStream.fetch_add(1);
+    while (!Reserve(RECORD_STREAM, stream, 0, label.data(), length))
+        this_thread::sleep_for(chrono::microseconds(WRITER_IDLE_US));
+    return stream;
+}
+
+bool PacketCapture::Record(int stream, CaptureDirection direction, const char* data, int length) {
+    if (!Running.load(memory_order_relaxed))
+        return false;
+    if (!Reserve(RECORD_DATA, stream, direction, data, length)) {
+        Dropped.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    Recorded.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+bool PacketCapture::Reserve(int type, int stream, int direction, const char* data, int length) {
+    size_t size = AlignRecord(RECORD_HEADER_SIZE + static_cast<size_t>(length));
+    if (length < 0 || size > Capacity / 4)
+        return false;
+
+    // Claim [head, head + total); a record never wraps, so if it does not fit
+    // before the end of the ring the remainder is claimed as padding.
+    uint64_t head = Head.load(memory_order_relaxed);
+    size_t offset;
+    size_t total;
+    do {
+        offset = static_cast<size_t>(head & Mask);
+        total = (offset + size > Capacity) ? size + (Capacity - offset) : size;
+        if (head + total - Tail.load(memory_order_acquire) > Capacity)
+            return false;
+    } while (!Head.compare_exchange_weak(head, head + total, memory_order_relaxed, memory_order_relaxed));
+
+    if (total != size) {
+        Ready[offset >> 3].store(PAD_FLAG | static_cast<uint32_t>(Capacity - offset), memory_order_release);
+        offset = 0;
+    }
+    char* record = Ring + offset;
+    WireFormat::Store32(record, static_cast<uint32_t>(length));
+    WireFormat::Store16(record + 4, static_cast<uint16_t>(stream));
+    record[6] = static_cast<char>(direction);
+    record[7] = static_cast<char>(type);
+    WireFormat::Store64(record + 8, static_cast<uint64_t>(MetricsNowNs() - StartNs));
+    if (length > 0)
+        memcpy(record + RECORD_HEADER_SIZE, data, length);
+    // Zero the alignment padding so the file contents are deterministic.
+    memset(record + RECORD_HEADER_SIZE + length, 0, size - RECORD_HEADER_SIZE - length);
+    Ready[offset >> 3].store(static_cast<uint32_t>(size), memory_order_release);
+    return true;
+}
+
+int PacketCapture::Drain() {
+    // Producers cannot claim past Tail + Capacity, so this loop is bounded.
+    uint64_t tail = Tail.load(memory_order_relaxed);
+    uint64_t runStart = tail;
+    int drained = 0;
+    for (;;) {
+        size_t offset = static_cast<size_t>(tail & Mask);
+        uint32_t slot = Ready[offset >> 3].load(memory_order_acquire);
+        if (slot == 0)
+            break;
+        Ready[offset >> 3].store(0, memory_order_relaxed);
+        if (slot & PAD_FLAG) {
+            WriteRun(runStart, tail);
+            tail += slot & ~PAD_FLAG;
+            runStart = tail;
+            continue;
+        }
+        NoteRecord(Ring + offset, FileOffset + static_cast<long long>(tail - runStart));
+        tail += slot;
+        ++drained;
+        // A run is written with one fwrite, so it must not cross the end of the ring.
+        if ((tail & Mask) == 0) {
+            WriteRun(runStart, tail);
+            runStart = tail;
+        }
+    }
+    WriteRun(runStart, tail);
+    // Space is handed back only after the bytes are in the file buffer.
+    Tail.store(tail, memory_order_release);
+    return drained;
+}
+
+void PacketCapture::WriteRun(uint64_t start, uint64_t end) {
+    if (end == start)
+        return;
+    size_t length = static_cast<size_t>(end - start);
+    fwrite(Ring + static_cast<size_t>(start & Mask), 1, length, File);
+    FileOffset += static_cast<long long>(length);
+    BytesWritten.store(FileOffset, memory_order_relaxed);
+}
+
+void PacketCapture::NoteRecord(const char* header, long long fileOffset) {
+    int type = static_cast<unsigned char>(header[7]);
+    if (type == RECORD_STREAM) {
+        int length = static_cast<int>(WireFormat::Load32(header));
+        Streams.push_back(make_pair(static_cast<int>(WireFormat::Load16(header + 4)),
+            string(header + RECORD_HEADER_SIZE, length)));
+        return;
+    }
+    if (DataFrames++ % INDEX_INTERVAL == 0)
+        Index.push_back(make_pair(static_cast<long long>(WireFormat::Load64(header + 8)), fileOffset));
+}
+
+void PacketCapture::WriteIndex() {
+    // Payload: u32 stream count, {u16 id, u16 length, label}..., u32 entry count, {u64 ns, u64 offset}...
+    vector<char> payload(4);
+    WireFormat::Store32(payload.data(), static_cast<uint32_t>(Streams.size()));
+    for (const pair<int, string>& stream : Streams) {
+        size_t at = payload.size();
+        payload.resize(at + 4 + stream.second.size());
+        WireFormat::Store16(&payload[at], static_cast<uint16_t>(stream.first));
+        WireFormat::Store16(&payload[at + 2], static_cast<uint16_t>(stream.second.size()));
+        memcpy(&payload[at + 4], stream.second.data(), stream.second.size());
+    }
+    size_t at = payload.size();
+    payload.resize(at + 4 + Index.size() * 16);
+    WireFormat::Store32(&payload[at], static_cast<uint32_t>(Index.size()));
+    for (size_t i = 0; i < Index.size(); ++i) {
+        WireFormat::Store64(&payload[at + 4 + i * 16], static_cast<uint64_t>(Index[i].first));
+        WireFormat::Store64(&payload[at + 12 + i * 16], static_cast<uint64_t>(Index[i].second));
+    }
+
+    size_t size = AlignRecord(RECORD_HEADER_SIZE + payload.size());
+    vector<char> record(size, 0);
+    WireFormat::Store32(record.data(), static_cast<uint32_t>(payload.size()));
+    record[7] = static_cast<char>(RECORD_INDEX);
+    WireFormat::Store64(record.data() + 8, static_cast<uint64_t>(MetricsNowNs() - StartNs));
+    memcpy(record.data() + RECORD_HEADER_SIZE, payload.data(), payload.size());
+
+    char trailer[TRAILER_SIZE];
+    WireFormat::Store64(trailer, static_cast<uint64_t>(FileOffset));
+    memcpy(trailer + 8, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+
+    fwrite(record.data(), 1, record.size(), File);
+    fwrite(trailer, 1, sizeof(trailer), File);
+    FileOffset += static_cast<long long>(record.size() + sizeof(trailer));
+    BytesWritten.store(FileOffset, memory_order_relaxed);
+}
+
+void PacketCapture::WriterLoop() {
+    while (Running.load(memory_order_acquire)) {
+        if (Drain() == 0)
+            this_thread::sleep_for(chrono::microseconds(WRITER_IDLE_US));
+    }
+}
+
+long long PacketCapture::GetRecorded() {
+    return Recorded.load(memory_order_relaxed);
+}
+
+long long PacketCapture::GetDropped() {
+    return Dropped.load(memory_order_relaxed);
+}
+
+long long PacketCapture::GetBytesWritten() {
+    return BytesWritten.load(memory_order_relaxed);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Direction of a captured frame relative to the socket that recorded it.
+enum CaptureDirection { CAPTURE_OUT = 0, CAPTURE_IN = 1 };
+
+// Append-only capture log of socket traffic.
+//
+// Any number of threads call Record() (MySocket does it from SendData/GetData
+// once SetCapture() is called). Record() claims space in a lock-free ring with
+// one CAS, copies the frame in and returns; it never blocks and never makes a
+// syscall. If the ring is full the frame is dropped and counted instead. A
+// background thread drains committed records to disk in large sequential
+// writes.
+//
+// File layout (little-endian, records 8-byte aligned):
+//   header   "RBTCAP01", u32 version, u32 header size, u64 wall-clock start
+//            (ns since the Unix epoch), u64 reserved
+//   records  u32 payload length, u16 stream, u8 direction, u8 type,
+//            u64 ns since capture start, payload, zero padding
+//   index    one INDEX record written by Close(): the stream labels and a
+//            (timestamp, file offset) entry every INDEX_INTERVAL frames
+//   trailer  u64 file offset of the index record, "RBTCAPIX"
+// A log cut short by a crash has no index or trailer; CaptureReader falls
+// back to scanning the records that made it to disk.
+class PacketCapture {
+public:
+    static const int FILE_HEADER_SIZE = 32;
+    static const int RECORD_HEADER_SIZE = 16;
+    static const int TRAILER_SIZE = 16;
+    static const int INDEX_INTERVAL = 256;
+    static const int FORMAT_VERSION = 1;
+
+    // Record types.
+    enum RecordType { RECORD_DATA = 0, RECORD_STREAM = 1, RECORD_INDEX = 2 };
+
+    // ringBytes is rounded up to a power of two (at least 4 KB). Frames larger
+    // than a quarter of the ring are always dropped.
+    explicit PacketCapture(int ringBytes = 1 << 22);
+    ~PacketCapture();
+
+    // Create the log file and start the writer thread. Throws on failure.
+    void Open(const string& path);
+    // Drain everything recorded so far, write the index and close the file.
+    void Close();
+    bool IsOpen();
+
+    // Register a stream (usually one per socket) and return its id.
+    // Cold path: waits for ring space rather than dropping the label.
+    int OpenStream(const string& label);
+
+    // Copy one frame into the ring. Returns false if it was dropped.
+    bool Record(int stream, CaptureDirection direction, const char* data, int length);
+
+    // Getters
+    long long GetRecorded();        // Frames accepted into the ring.
+    long long GetDropped();         // Frames refused because the ring was full.
+    long long GetBytesWritten();    // Bytes written to the file so far.
+
+    static size_t AlignRecord(size_t length) {
+        return (length + 7) & ~static_cast<size_t>(7);
+    }
+
+private:
+    // Set in a Ready slot to mark the unused tail of the ring before a wrap.
+    static const uint32_t PAD_FLAG = 0x80000000u;
+
+    bool Reserve(int type, int stream, int direction, const char* data, int length);
+    int Drain();
+    void WriteRun(uint64_t start, uint64_t end);
+    void NoteRecord(const char* header, long long fileOffset);
+    void WriteIndex();
+    void WriterLoop();
+
+    char* Ring;
+    size_t Capacity;
+    size_t Mask;
+    // One slot per 8 ring bytes; the slot at a record's start holds its size
+    // once the record is fully copied in (0 = not committed yet).
+    vector<atomic<uint32_t>> Ready;
+    atomic<uint64_t> Head;          // Next byte producers will claim.
+    atomic<uint64_t> Tail;          // First byte the writer has not drained.
+
+    atomic<bool> Running;
+    atomic<int> NextStream;
+    long long StartNs;              // MetricsNowNs() when the file was opened.
+    atomic<long long> Recorded;
+    atomic<long long> Dropped;
+    atomic<long long> BytesWritten;
+
+    // Writer thread only.
+    FILE* File;
+    long long FileOffset;
+    long long DataFrames;
+    vector<pair<int, string>> Streams;
+    vector<pair<long long, long long>> Index;  // (timestamp ns, file offset)
+    thread Writer;
+};
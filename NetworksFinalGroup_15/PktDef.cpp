@@ -1,22 +1,70 @@
 #include "PktDef.h"
+#include "BufferPool.h"
 #include <stdexcept> 
 #include <string> 
 #include <cstring> 
 #include <iostream>
 using namespace std;
 
-PktDef::PktDef() : RawBuffer(nullptr), dataLength(0) {
+PktDef::PktDef() : RawBuffer(nullptr), dataLength(0),
+    Arena(nullptr), arenaCapacity(0), HeapBody(nullptr), heapBodyCapacity(0),
+    HeapRaw(nullptr), heapRawCapacity(0), Trace() {
     memset(&packet.header, 0, sizeof(packet.header));
     packet.Data = nullptr;
     packet.CRC = 0;
 }
 
-PktDef::PktDef(char* rawBuffer) : RawBuffer(nullptr), dataLength(0) {
+PktDef::PktDef(char* rawBuffer) : RawBuffer(nullptr), dataLength(0),
+    Arena(nullptr), arenaCapacity(0), HeapBody(nullptr), heapBodyCapacity(0),
+    HeapRaw(nullptr), heapRawCapacity(0), Trace() {
     // Parse the header from rawBuffer.
-    memcpy(&packet.header, rawBuffer, HEADERSIZE);
+    DecodeHeader(rawBuffer, packet.header);
     packet.Data = nullptr;
-    // Assume the CRC is the byte immediately following the header.
-    packet.CRC = *(reinterpret_cast<unsigned char*>(rawBuffer + HEADERSIZE));
+    // Assume the CRC immediately follows the header.
+    packet.CRC = Checksum::Load(GetCrcType(), rawBuffer + HEADERSIZE);
+}
+
+PktDef::PktDef(char* rawBuffer, int size) : RawBuffer(nullptr), dataLength(0),
+    Arena(nullptr), arenaCapacity(0), HeapBody(nullptr), heapBodyCapacity(0),
+    HeapRaw(nullptr), heapRawCapacity(0), Trace() {
+    packet.Data = nullptr;
+    Parse(rawBuffer, size);
+}
+
+void PktDef::Parse(char* rawBuffer, int size) {
+    if (size < HEADERSIZE + 1)
+        throw runtime_error("Packet is shorter than header and CRC");
+    DecodeHeader(rawBuffer, packet.header);
+    int crcSize = Checksum::Size(GetCrcType());
+    if (size < HEADERSIZE + crcSize)
+        throw runtime_error("Packet is shorter than header and CRC");
+    // Everything between the header and the trailing CRC is body data.
+    int bodySize = size - HEADERSIZE - crcSize;
+    SetBodyData(rawBuffer + HEADERSIZE, bodySize);
+    packet.CRC = Checksum::Load(GetCrcType(), rawBuffer + size - crcSize);
+    METRIC_STAMP(Trace.DecodeNs);
+}
+
+PktDef::PktDef(const PktDef& other) : RawBuffer(nullptr), dataLength(0),
+    Arena(nullptr), arenaCapacity(0), HeapBody(nullptr), heapBodyCapacity(0),
+    HeapRaw(nullptr), heapRawCapacity(0), Trace() {
+    CopyFrom(other);
+}
+
+PktDef& PktDef::operator=(const PktDef& other) {
+    if (this != &other)
+        CopyFrom(other);
+    return *this;
+}
+
+void PktDef::CopyFrom(const PktDef& other) {
+    packet.header = other.packet.header;
+    packet.CRC = other.packet.CRC;
+    Trace = other.Trace;
+    packet.Data = nullptr;
+    dataLength = 0;
+    if (other.packet.Data)
+        SetBodyData(other.packet.Data, other.dataLength);
 }
 
 void PktDef::SetCmd(CmdType cmd) {
@@ -33,11 +81,28 @@ void PktDef::SetCmd(CmdType cmd) {
         packet.header.Status = 1;
 }
 
+char* PktDef::ReserveBody(int size) {
+    if (size <= INLINE_BODY_SIZE)
+        return InlineBody;
+    if (Arena && size <= arenaCapacity)
+        return Arena;
+    // Only grow the heap buffer; a body of the same or smaller size reuses it.
+    if (size > heapBodyCapacity) {
+        BufferPool::Free(HeapBody);
+        HeapBody = BufferPool::Allocate(size);
+        heapBodyCapacity = BufferPool::Capacity(HeapBody);
+    }
+    return HeapBody;
+}
+
 void PktDef::SetBodyData(char* data, int size) {
-    if (packet.Data)
-        delete[] packet.Data; 
-    packet.Data = new char[size];
-    memcpy(packet.Data, data, size);
+    if (size < 0)
+        throw runtime_error("Body size cannot be negative");
+    char* dest = ReserveBody(size);
+    // memmove so a body can be re-set from its own storage.
+    if (size > 0)
+        memmove(dest, data, size);
+    packet.Data = dest;
     dataLength = size;
 }
 
@@ -45,6 +110,42 @@ void PktDef::SetPktCount(int count) {
     packet.header.PktCount = static_cast<unsigned short>(count);
 }
 
+void PktDef::SetAck(bool ack) {
+    packet.header.Ack = ack ? 1 : 0;
+}
+
+void PktDef::SetCrcType(CrcAlgorithm alg) {
+    packet.header.CrcType = static_cast<unsigned char>(alg) & 0x3;
+}
+
+void PktDef::SetBodyCodec(BodyCodec codec) {
+    packet.header.Codec = static_cast<unsigned char>(codec) & 0x3;
+}
+
+void PktDef::SetBodyArena(char* arena, int capacity) {
+    Arena = (capacity > 0) ? arena : nullptr;
+    arenaCapacity = Arena ? capacity : 0;
+}
+
+void PktDef::EncodeHeader(const Header& header, char* dest) {
+    WireFormat::Store16(dest, header.PktCount);
+    dest[2] = static_cast<char>(
+        (header.Drive ? WireFormat::FLAG_DRIVE : 0) | (header.Status ? WireFormat::FLAG_STATUS : 0)
+        | (header.Sleep ? WireFormat::FLAG_SLEEP : 0) | (header.Ack ? WireFormat::FLAG_ACK : 0)
+        | (header.CrcType << WireFormat::CRC_TYPE_SHIFT) | (header.Codec << WireFormat::BODY_CODEC_SHIFT));
+}
+
+void PktDef::DecodeHeader(const char* src, Header& header) {
+    unsigned char flags = static_cast<unsigned char>(src[2]);
+    header.PktCount = WireFormat::Load16(src);
+    header.Drive = (flags & WireFormat::FLAG_DRIVE) ? 1 : 0;
+    header.Status = (flags & WireFormat::FLAG_STATUS) ? 1 : 0;
+    header.Sleep = (flags & WireFormat::FLAG_SLEEP) ? 1 : 0;
+    header.Ack = (flags & WireFormat::FLAG_ACK) ? 1 : 0;
+    header.CrcType = (flags & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT;
+    header.Codec = (flags & WireFormat::BODY_CODEC_MASK) >> WireFormat::BODY_CODEC_SHIFT;
+}
+
 PktDef::CmdType PktDef::GetCmd() {
     if (packet.header.Drive == 1)
         return DRIVE;
@@ -52,6 +153,8 @@ PktDef::CmdType PktDef::GetCmd() {
         return SLEEP;
     else if (packet.header.Status == 1)
         return RESPONSE;
+    else if (dataLength > 0)
+        return EXTENDED;  // No legacy flag: body[0] is the command code.
     return DRIVE;  // Default fallback.
 }
 
@@ -60,8 +163,8 @@ bool PktDef::GetAck() {
 }
 
 int PktDef::GetLength() {
-    // Total length = header + body data + 1 byte for CRC.
-    return HEADERSIZE + dataLength + 1;
+    // Total length = header + body data + CRC trailer (1 byte for XOR/CRC-8).
+    return HEADERSIZE + dataLength + Checksum::Size(GetCrcType());
 }
 
 char* PktDef::GetBodyData() {
@@ -72,61 +175,94 @@ int PktDef::GetPktCount() {
     return packet.header.PktCount;
 }
 
+PacketTrace& PktDef::GetTrace() {
+    return Trace;
+}
+
+CrcAlgorithm PktDef::GetCrcType() {
+    return static_cast<CrcAlgorithm>(packet.header.CrcType);
+}
+
+BodyCodec PktDef::GetBodyCodec() {
+    return static_cast<BodyCodec>(packet.header.Codec);
+}
+
 bool PktDef::CheckCRC(char* buffer, int size) {
     if (size < HEADERSIZE + 1)
         return false;
-    unsigned char computedCRC = 0;
-    for (int i = 0; i < size - 1; ++i) {
-        computedCRC ^= static_cast<unsigned char>(buffer[i]);
-    }
-    return (computedCRC == static_cast<unsigned char>(buffer[size - 1]));
+    // The sender's header says which checksum it used.
+    CrcAlgorithm alg = static_cast<CrcAlgorithm>(
+        (static_cast<unsigned char>(buffer[2]) & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT);
+    int crcSize = Checksum::Size(alg);
+    if (size < HEADERSIZE + crcSize)
+        return false;
+    unsigned int computedCRC = Checksum::Compute(alg, buffer, size - crcSize);
+    return computedCRC == Checksum::Load(alg, buffer + size - crcSize);
 }
 
 void PktDef::CalcCRC() {
-    unsigned char crc = 0;
-    // Process header.
-    unsigned char* headerBytes = reinterpret_cast<unsigned char*>(&packet.header);
-    for (int i = 0; i < HEADERSIZE; ++i) {
-        crc ^= headerBytes[i];
-    }
+    CrcAlgorithm alg = GetCrcType();
+    unsigned int state = Checksum::Init(alg);
+    // Process header, in its wire form.
+    char header[HEADERSIZE];
+    EncodeHeader(packet.header, header);
+    state = Checksum::Update(alg, state, header, HEADERSIZE);
     // Process body data.
-    for (int i = 0; i < dataLength; ++i) {
-        crc ^= static_cast<unsigned char>(packet.Data[i]);
-    }
-    packet.CRC = crc;
+    if (dataLength > 0 && packet.Data)
+        state = Checksum::Update(alg, state, packet.Data, dataLength);
+    packet.CRC = Checksum::Final(alg, state);
 }
 
 char* PktDef::GenPacket() {
-    if (RawBuffer)
-        delete[] RawBuffer; 
     int totalLength = GetLength();
-    RawBuffer = new char[totalLength];
+    if (totalLength <= static_cast<int>(sizeof(InlineRaw))) {
+        RawBuffer = InlineRaw;
+    }
+    else {
+        // Reuse the previous heap buffer unless the packet has grown.
+        if (totalLength > heapRawCapacity) {
+            BufferPool::Free(HeapRaw);
+            HeapRaw = BufferPool::Allocate(totalLength);
+            heapRawCapacity = BufferPool::Capacity(HeapRaw);
+        }
+        RawBuffer = HeapRaw;
+    }
+    GenPacket(RawBuffer, totalLength);
+    return RawBuffer;
+}
+
+int PktDef::GenPacket(char* dest, int capacity) {
+    int totalLength = GetLength();
+    if (capacity < totalLength)
+        return 0;
 
     // Serialize the header.
-    memcpy(RawBuffer, &packet.header, HEADERSIZE);
+    EncodeHeader(packet.header, dest);
     // Serialize the body data.
     if (dataLength > 0 && packet.Data)
-        memcpy(RawBuffer + HEADERSIZE, packet.Data, dataLength);
+        memcpy(dest + HEADERSIZE, packet.Data, dataLength);
     // Append the CRC.
-    RawBuffer[totalLength - 1] = static_cast<char>(packet.CRC);
-    return RawBuffer;
+    CrcAlgorithm alg = GetCrcType();
+    Checksum::Store(alg, packet.CRC, dest + totalLength - Checksum::Size(alg));
+    return totalLength;
 }
 
-PktDef::~PktDef() {
-    if (packet.Data) {
-        delete[] packet.Data;
-        packet.Data = nullptr;
-    }
-    if (RawBuffer) {
-        delete[] RawBuffer;
-        RawBuffer = nullptr;
-    }
+void PktDef::GenHeader(char* dest) {
+    EncodeHeader(packet.header, dest);
 }
 
-int main()
-{
-    
-    return 0;
+void PktDef::ParseHeader(const char* src) {
+    DecodeHeader(src, packet.header);
+    packet.Data = nullptr;
+    packet.CRC = 0;
+    dataLength = 0;
 }
 
-
+PktDef::~PktDef() {
+    BufferPool::Free(HeapBody);
+    HeapBody = nullptr;
+    BufferPool::Free(HeapRaw);
+    HeapRaw = nullptr;
+    packet.Data = nullptr;
+    RawBuffer = nullptr;
+}
@@ -1,10 +1,23 @@
 #pragma once
 #include <cstring>
+#include "Checksum.h"
+#include "NetMetrics.h"
+#include "WireFormat.h"
+
+// How a packet body is encoded, stored in the header's top two flag bits.
+// BODY_RAW must stay 0 so packets from legacy peers read as plain bodies.
+// Only TelemetryCodec produces the other two; see TelemetryCodec.h.
+enum BodyCodec {
+    BODY_RAW = 0,       // The body as is.
+    BODY_KEYFRAME = 1,  // A full sample the receiver keeps as a delta reference.
+    BODY_DELTA = 2      // Changes against an earlier keyframe or delta.
+};
 
 class PktDef {
 public:
-    // Enumeration for command types.
-    enum CmdType { DRIVE, SLEEP, RESPONSE };
+    // Enumeration for command types. EXTENDED packets set none of the legacy
+    // flags and carry a command code in the first body byte (see Commands.h).
+    enum CmdType { DRIVE, SLEEP, RESPONSE, EXTENDED };
 
     // Constant integer definitions for drive directions.
     static const int FORWARD = 1;
@@ -13,8 +26,13 @@ public:
     static const int RIGHT = 4;
     // HEADERSIZE is manually calculated as 3 bytes (2 bytes for PktCount + 1 byte for flags).
     static const int HEADERSIZE = 3;
+    // Bodies up to this size are stored inside the PktDef object itself, so
+    // DRIVE commands and short responses never touch the heap.
+    static const int INLINE_BODY_SIZE = 32;
 
     // Header structure: holds a 2-byte packet count and a 1-byte field for command flags.
+    // It is never copied to the wire as-is; EncodeHeader/DecodeHeader use the
+    // explicit layout in WireFormat.h, since bitfield order is compiler-defined.
     struct Header {
         unsigned short PktCount;  // 2 bytes.
         // Bit-fields for command flags.
@@ -22,7 +40,8 @@ public:
         unsigned char Status : 1;
         unsigned char Sleep : 1;
         unsigned char Ack : 1;
-        unsigned char padding : 4;  // 4 bits of padding to complete 1 byte.
+        unsigned char CrcType : 2;  // CrcAlgorithm of the trailer; 0 (XOR) for legacy peers.
+        unsigned char Codec : 2;    // BodyCodec; 0 (raw) for legacy peers.
     };
 
     // Structure for drive command parameters.
@@ -35,11 +54,29 @@ public:
     // Constructors
     PktDef();
     PktDef(char* rawBuffer);
+    // Parse a complete packet of known size (header + body + CRC), e.g. one
+    // delivered by PktFramer.
+    PktDef(char* rawBuffer, int size);
+    PktDef(const PktDef& other);
+    PktDef& operator=(const PktDef& other);
+
+    // Re-parse a complete packet into this object, reusing its body storage.
+    void Parse(char* rawBuffer, int size);
 
     // Setters
     void SetCmd(CmdType cmd);
     void SetBodyData(char* data, int size);
     void SetPktCount(int count);
+    void SetAck(bool ack);
+    // Provide caller-owned storage for bodies larger than INLINE_BODY_SIZE.
+    // The arena must outlive the packet; pass nullptr to go back to the heap.
+    void SetBodyArena(char* arena, int capacity);
+    // Select the trailer checksum. Call before CalcCRC(); GetLength() grows to
+    // fit the wider CRCs. Only use something other than CRC_XOR with a peer
+    // known to support it, e.g. by mirroring GetCrcType() of its packets.
+    void SetCrcType(CrcAlgorithm alg);
+    // Mark how the body is encoded. Set by TelemetryEncoder.
+    void SetBodyCodec(BodyCodec codec);
 
     // Getters
     CmdType GetCmd();
@@ -47,11 +84,25 @@ public:
     int GetLength();
     char* GetBodyData();
     int GetPktCount();
+    CrcAlgorithm GetCrcType();
+    BodyCodec GetBodyCodec();
+    // Timestamps of this packet's trip through the stack. Filled in only
+    // while SetPacketTracing(true) is in effect.
+    PacketTrace& GetTrace();
 
     // CRC functions
+    // Verifies a serialized packet using the algorithm named in its own header.
     bool CheckCRC(char* buffer, int size);
     void CalcCRC();
     char* GenPacket();
+    // Serialize the packet into dest. Returns the number of bytes written,
+    // or 0 if capacity is smaller than GetLength().
+    int GenPacket(char* dest, int capacity);
+    // Header-only forms for PktStream, which moves the body itself. GenHeader
+    // writes HEADERSIZE bytes; ParseHeader takes the fields and leaves the
+    // body empty, so GetCmd() cannot report EXTENDED.
+    void GenHeader(char* dest);
+    void ParseHeader(const char* src);
 
     // Destructor
     ~PktDef();
@@ -61,10 +112,29 @@ private:
     struct CmdPacket {
         Header header;
         char* Data;
-        unsigned char CRC; // Using unsigned char for consistency.
+        unsigned int CRC;  // Wide enough for every CrcAlgorithm.
     };
 
+    // Return storage able to hold a body of the given size, preferring the
+    // inline buffer, then the arena, then a reused heap buffer.
+    char* ReserveBody(int size);
+    // Copy body, header and CRC from another packet.
+    void CopyFrom(const PktDef& other);
+    // Header <-> 3-byte little-endian wire form.
+    static void EncodeHeader(const Header& header, char* dest);
+    static void DecodeHeader(const char* src, Header& header);
+
     CmdPacket packet;    // The complete command packet.
     char* RawBuffer;     // Serialized form of the packet.
     int dataLength;      // Number of bytes in the packet body. 
+
+    char InlineBody[INLINE_BODY_SIZE];              // Storage for small bodies.
+    char InlineRaw[HEADERSIZE + INLINE_BODY_SIZE + Checksum::MAX_SIZE]; // Serialized form of small packets.
+    char* Arena;         // Optional caller-owned body storage.
+    int arenaCapacity;   // Size of Arena in bytes.
+    char* HeapBody;      // Heap body buffer, kept for reuse across SetBodyData calls.
+    int heapBodyCapacity;
+    char* HeapRaw;       // Heap serialization buffer, kept for reuse across GenPacket calls.
+    int heapRawCapacity;
+    PacketTrace Trace;   // Enqueue/send/receive/decode stamps.
 };
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "PktFramer.h"
+#include <stdexcept>
+#include <cstring>
+using namespace std;
+
+PktFramer::PktFramer(int ringSize, int maxFrame)
+    : Ring(nullptr), RingSize(ringSize), MaxFrame(maxFrame), Head(0), Count(0),
+    SkipRemaining(0), Oversized(0)
+{
+    if (RingSize < PREFIXSIZE + 1)
+        throw runtime_error("Framer ring is too small");
+    if (MaxFrame <= 0 || MaxFrame > MAX_FRAME)
+        MaxFrame = MAX_FRAME;
+    // A packet must fit in the ring together with its prefix to be reassembled.
+    if (MaxFrame > RingSize - PREFIXSIZE)
+        MaxFrame = RingSize - PREFIXSIZE;
+    Ring = new char[RingSize];
+}
+
+PktFramer::~PktFramer() {
+    if (Ring) {
+        delete[] Ring;
+        Ring = nullptr;
+    }
+}
+
+int PktFramer::Frame(const char* packet, int length, char* dest, int capacity) {
+    if (length < 0 || length > MAX_FRAME || capacity < length + PREFIXSIZE)
+        return 0;
+    dest[0] = static_cast<char>(length & 0xFF);
+    dest[1] = static_cast<char>((length >> 8) & 0xFF);
+    memcpy(dest + PREFIXSIZE, packet, length);
+    return length + PREFIXSIZE;
+}
+
+int PktFramer::Feed(const char* chunk, int length) {
+    int accepted = 0;
+    while (accepted < length) {
+        int contiguous = 0;
+        char* dest = WritePtr(contiguous);
+        if (contiguous == 0)
+            break;
+        int n = (length - accepted < contiguous) ? length - accepted : contiguous;
+        memcpy(dest, chunk + accepted, n);
+        Commit(n);
+        accepted += n;
+    }
+    return accepted;
+}
+
+char* PktFramer::WritePtr(int& contiguousFree) {
+    int tail = (Head + Count) % RingSize;
+    int free = RingSize - Count;
+    // The free region either runs to the end of the ring or up to Head.
+    contiguousFree = (tail >= Head) ? RingSize - tail : Head - tail;
+    if (contiguousFree > free)
+        contiguousFree = free;
+    return Ring + tail;
+}
+
+void PktFramer::Commit(int length) {
+    if (length < 0 || length > RingSize - Count)
+        throw runtime_error("Commit exceeds free space in framer ring");
+    Count += length;
+
+    // Drop bytes belonging to an oversized packet as soon as they arrive.
+    int skip = (SkipRemaining < Count) ? SkipRemaining : Count;
+    Head = (Head + skip) % RingSize;
+    Count -= skip;
+    SkipRemaining -= skip;
+}
+
+void PktFramer::PeekBytes(int offset, char* dest, int length) {
+    int start = (Head + offset) % RingSize;
+    int first = (RingSize - start < length) ? RingSize - start : length;
+    memcpy(dest, Ring + start, first);
+    if (first < length)
+        memcpy(dest + first, Ring, length - first);
+}
+
+int PktFramer::NextFrame(char* dest, int capacity) {
+    while (Count >= PREFIXSIZE) {
+        unsigned char prefix[PREFIXSIZE];
+        PeekBytes(0, reinterpret_cast<char*>(prefix), PREFIXSIZE);
+        int length = prefix[0] | (prefix[1] << 8);
+
+        if (length > MaxFrame) {
+            // Consume the prefix and whatever part of the body is already here;
+            // the rest is discarded by Commit() as it arrives.
+            ++Oversized;
+            int available = Count - PREFIXSIZE;
+            int skip = (length < available) ? length : available;
+            Head = (Head + PREFIXSIZE + skip) % RingSize;
+            Count -= PREFIXSIZE + skip;
+            SkipRemaining = length - skip;
+            continue;
+        }
+
+        if (Count < PREFIXSIZE + length)
+            return 0;
+        if (length == 0) {
+            // Empty frames carry nothing; consume the prefix and keep going.
+            Head = (Head + PREFIXSIZE) % RingSize;
+            Count -= PREFIXSIZE;
+            continue;
+        }
+        if (capacity < length)
+            throw runtime_error("Destination buffer too small for framed packet");
+
+        PeekBytes(PREFIXSIZE, dest, length);
+        Head = (Head + PREFIXSIZE + length) % RingSize;
+        Count -= PREFIXSIZE + length;
+        return length;
+    }
+    return 0;
+}
+
+void PktFramer::Reset() {
+    Head = 0;
+    Count = 0;
+    SkipRemaining = 0;
+}
+
+int PktFramer::GetBuffered() {
+    return Count;
+}
+
+int PktFramer::GetOversizedFrames() {
+    return Oversized;
+}
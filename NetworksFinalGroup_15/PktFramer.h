@@ -0,0 +1,62 @@
+#pragma once
+#include <cstring>
+
+// Length-prefixed framing for PktDef packets carried over a TCP byte stream.
+//
+// On the wire every packet is preceded by a 2-byte little-endian length:
+//   [len lo][len hi][PktDef bytes (header + body + CRC)]
+// The receive side feeds arbitrary recv() chunks into a fixed-size ring buffer
+// and pulls out complete packets, so partial headers and several packets
+// coalesced into one recv() are both handled without per-packet allocation.
+class PktFramer {
+public:
+    // Size of the length prefix placed in front of every packet.
+    static const int PREFIXSIZE = 2;
+    // Largest packet the 2-byte prefix can describe.
+    static const int MAX_FRAME = 0xFFFF;
+
+    // Constructor: allocates a ring of ringSize bytes once. Packets longer than
+    // maxFrame are skipped (and counted) instead of being delivered.
+    PktFramer(int ringSize, int maxFrame);
+
+    // Destructor: releases the ring buffer.
+    ~PktFramer();
+
+    // Write the length prefix followed by the packet into dest.
+    // Returns the number of bytes written, or 0 if dest is too small.
+    static int Frame(const char* packet, int length, char* dest, int capacity);
+
+    // Copy a received chunk into the ring. Returns the number of bytes accepted,
+    // which is less than length only if the ring is full.
+    int Feed(const char* chunk, int length);
+
+    // Zero-copy alternative to Feed(): returns the largest contiguous free region
+    // of the ring so the caller can recv() straight into it, then Commit() the
+    // number of bytes actually received.
+    char* WritePtr(int& contiguousFree);
+    void Commit(int length);
+
+    // Copy the next complete packet (without its prefix) into dest.
+    // Returns its length, or 0 if no complete packet is buffered yet.
+    // Throws if dest is smaller than the pending packet.
+    int NextFrame(char* dest, int capacity);
+
+    // Discard everything buffered, e.g. before reusing the framer for a new connection.
+    void Reset();
+
+    // Getters
+    int GetBuffered();          // Bytes currently held in the ring.
+    int GetOversizedFrames();   // Number of packets dropped for exceeding maxFrame.
+
+private:
+    // Copy length bytes starting at logical offset 'offset' from the read position.
+    void PeekBytes(int offset, char* dest, int length);
+
+    char* Ring;         // Ring storage.
+    int RingSize;       // Capacity of the ring in bytes.
+    int MaxFrame;       // Largest packet delivered to the caller.
+    int Head;           // Read index.
+    int Count;          // Number of buffered bytes.
+    int SkipRemaining;  // Bytes still to discard from an oversized packet.
+    int Oversized;      // Number of oversized packets skipped.
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include "WireFormat.h"
+#include "PktDef.h"
+#include "Checksum.h"
+#include <type_traits>
+
+// Compile-time packet body schemas.
+//
+// A body is a plain struct plus a Schema typedef listing its fields in wire
+// order. The encoder and decoder are unrolled at compile time: each field
+// becomes one fixed-offset little-endian store or load, with no loops,
+// branches or per-field dispatch, and the wire size is a constant.
+//
+//   struct ArmCommand {
+//       unsigned char Joint;
+//       short Angle;
+//       typedef PktSchema<ArmCommand,
+//           SCHEMA_FIELD(ArmCommand, Joint),
+//           SCHEMA_FIELD(ArmCommand, Angle)> Schema;
+//   };
+//
+// The wire layout is packed (no padding), so it does not depend on how the
+// compiler lays out the struct.
+
+// One field: its C++ type and the member it lives in.
+template <typename Body, typename T, T Body::* Member>
+struct SchemaField {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+        "Schema fields must be integer, floating-point or enum types");
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8,
+        "Schema fields must be 1, 2, 4 or 8 bytes wide");
+
+    typedef T Type;
+    static const int Size = sizeof(T);
+
+    static void Store(const Body& body, char* dest) {
+        WireFormat::LittleEndian<T>::Store(dest, body.*Member);
+    }
+    static void Load(const char* src, Body& body) {
+        body.*Member = WireFormat::LittleEndian<T>::Load(src);
+    }
+};
+
+#define SCHEMA_FIELD(Body, member) SchemaField<Body, decltype(Body::member), &Body::member>
+
+// Recursive unrolling of a field list; Offset is each field's wire position.
+template <typename Body, int Offset, typename... Fields>
+struct SchemaCodec {
+    static const int Size = 0;
+    static void Encode(const Body&, char*) {}
+    static void Decode(const char*, Body&) {}
+};
+
+template <typename Body, int Offset, typename First, typename... Rest>
+struct SchemaCodec<Body, Offset, First, Rest...> {
+    typedef SchemaCodec<Body, Offset + First::Size, Rest...> Next;
+    static const int Size = First::Size + Next::Size;
+
+    static void Encode(const Body& body, char* dest) {
+        First::Store(body, dest + Offset);
+        Next::Encode(body, dest);
+    }
+    static void Decode(const char* src, Body& body) {
+        First::Load(src + Offset, body);
+        Next::Decode(src, body);
+    }
+};
+
+// The schema of one body type.
+template <typename Body, typename... Fields>
+struct PktSchema {
+    typedef SchemaCodec<Body, 0, Fields...> Codec;
+    // Bytes the body occupies on the wire.
+    static const int Size = Codec::Size;
+
+    static void Encode(const Body& body, char* dest) { Codec::Encode(body, dest); }
+    static void Decode(const char* src, Body& body) { Codec::Decode(src, body); }
+};
+
+// Encoding of whole commands sent as PktDef::EXTENDED packets:
+//   [header][command code][body fields][CRC]
+// Cmd needs a Schema typedef and a static const unsigned char Code.
+template <typename Cmd>
+struct CommandCodec {
+    typedef typename Cmd::Schema Schema;
+    static_assert(Schema::Size + 1 <= 0xFFFF, "Command body too large for a frame");
+
+    // Body bytes, including the code byte.
+    static const int BodySize = 1 + Schema::Size;
+    // Full packet size for a given trailer checksum.
+    static int PacketSize(CrcAlgorithm alg) {
+        return WireFormat::HEADER_SIZE + BodySize + Checksum::Size(alg);
+    }
+
+    // Serialize a complete packet into dest. Returns the bytes written, or 0
+    // if capacity is too small.
+    static int Encode(const Cmd& cmd, unsigned short count, char* dest, int capacity, CrcAlgorithm alg = CRC_XOR) {
+        int total = PacketSize(alg);
+        if (capacity < total)
+            return 0;
+        WireFormat::Store16(dest, count);
+        dest[2] = static_cast<char>(static_cast<unsigned char>(alg) << WireFormat::CRC_TYPE_SHIFT);
+        dest[WireFormat::HEADER_SIZE] = static_cast<char>(Cmd::Code);
+        Schema::Encode(cmd, dest + WireFormat::HEADER_SIZE + 1);
+        int crcOffset = WireFormat::HEADER_SIZE + BodySize;
+        Checksum::Store(alg, Checksum::Compute(alg, dest, crcOffset), dest + crcOffset);
+        return total;
+    }
+
+    // Decode a complete packet. Returns false if it is not a valid Cmd packet
+    // (wrong size, code or CRC); out is untouched in that case.
+    static bool Decode(const char* src, int size, Cmd& out) {
+        if (size < WireFormat::HEADER_SIZE + 1)
+            return false;
+        CrcAlgorithm alg = static_cast<CrcAlgorithm>(
+            (static_cast<unsigned char>(src[2]) & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT);
+        if (size != PacketSize(alg) || static_cast<unsigned char>(src[WireFormat::HEADER_SIZE]) != Cmd::Code)
+            return false;
+        int crcOffset = WireFormat::HEADER_SIZE + BodySize;
+        if (Checksum::Compute(alg, src, crcOffset) != Checksum::Load(alg, src + crcOffset))
+            return false;
+        Schema::Decode(src + WireFormat::HEADER_SIZE + 1, out);
+        return true;
+    }
+
+    // Put cmd into a PktDef as an EXTENDED body (call CalcCRC() afterwards).
+    static void ToPacket(const Cmd& cmd, PktDef& pkt) {
+        char body[BodySize];
+        body[0] = static_cast<char>(Cmd::Code);
+        Schema::Encode(cmd, body + 1);
+        pkt.SetCmd(PktDef::EXTENDED);
+        pkt.SetBodyData(body, BodySize);
+    }
+
+    // Read cmd back out of a parsed PktDef. Returns false if it carries another command.
+    static bool FromPacket(PktDef& pkt, Cmd& out) {
+        if (pkt.GetCmd() != PktDef::EXTENDED || pkt.GetLength() - WireFormat::HEADER_SIZE
+            - Checksum::Size(pkt.GetCrcType()) != BodySize)
+            return false;
+        const char* body = pkt.GetBodyData();
+        if (static_cast<unsigned char>(body[0]) != Cmd::Code)
+            return false;
+        Schema::Decode(body + 1, out);
+        return true;
+    }
+};
+
+// Command code of an EXTENDED packet, for dispatch before choosing a codec.
+// Returns -1 for legacy (DRIVE/SLEEP/RESPONSE) or empty packets.
+inline int ExtendedCommandCode(const char* packet, int size) {
+    unsigned char flags = static_cast<unsigned char>(packet[2]);
+    const unsigned char legacy = WireFormat::FLAG_DRIVE | WireFormat::FLAG_STATUS | WireFormat::FLAG_SLEEP;
+    if (size <= WireFormat::HEADER_SIZE + 1 || (flags & legacy) != 0)
+        return -1;
+    return static_cast<unsigned char>(packet[WireFormat::HEADER_SIZE]);
+}
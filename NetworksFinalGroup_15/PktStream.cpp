@@ -0,0 +1,230 @@
+#include "PktStream.h"
+#include "BufferPool.h"
+#include "WireFormat.h"
+#include <stdexcept>
+using namespace std;
+
+// Largest len a 4-byte prefix can carry.
+static const long long STREAM_MAX_PACKET = 0xFFFFFFFFLL;
+
+PktStreamWriter::PktStreamWriter(MySocket& sock, int chunkSize)
+    : Sock(sock), ChunkSize(chunkSize), Chunk(nullptr), Alg(CRC_XOR), State(0),
+    Remaining(0), Open(false), LeadLength(0)
+{
+    if (chunkSize <= 0)
+        throw runtime_error("PktStreamWriter chunk size must be positive");
+}
+
+PktStreamWriter::~PktStreamWriter() {
+    BufferPool::Free(Chunk);
+}
+
+void PktStreamWriter::Begin(PktDef& header, long long bodyLength) {
+    if (Open)
+        throw runtime_error("The previous streamed packet was not ended");
+    Alg = header.GetCrcType();
+    long long total = PktDef::HEADERSIZE + bodyLength + Checksum::Size(Alg);
+    if (bodyLength < 0 || total > STREAM_MAX_PACKET)
+        throw runtime_error("Streamed body length out of range");
+    WireFormat::Store32(Lead, static_cast<uint32_t>(total));
+    header.GenHeader(Lead + PREFIXSIZE);
+    // The CRC covers the header in its wire form, as CalcCRC() does.
+    State = Checksum::Update(Alg, Checksum::Init(Alg), Lead + PREFIXSIZE, PktDef::HEADERSIZE);
+    Remaining = bodyLength;
+    LeadLength = sizeof(Lead);
+    Open = true;
+}
+
+void PktStreamWriter::Write(const char* data, int length) {
+    IoSlice slice = { data, length };
+    Write(&slice, 1);
+}
+
+void PktStreamWriter::Write(const IoSlice* slices, int count) {
+    if (!Open)
+        throw runtime_error("Write called outside Begin/End");
+    long long total = 0;
+    for (int i = 0; i < count; ++i) {
+        if (slices[i].Length < 0)
+            throw runtime_error("Negative slice length");
+        total += slices[i].Length;
+    }
+    if (total > Remaining)
+        throw runtime_error("Streamed body is longer than announced");
+
+    IoSlice gather[MAX_BATCH];
+    int next = 0;
+    while (next < count) {
+        int n = 0;
+        // The prefix and header ride along with the first body bytes.
+        if (LeadLength > 0) {
+            gather[n].Data = Lead + sizeof(Lead) - LeadLength;
+            gather[n++].Length = LeadLength;
+        }
+        while (n < MAX_BATCH && next < count) {
+            State = Checksum::Update(Alg, State, slices[next].Data, slices[next].Length);
+            gather[n++] = slices[next++];
+        }
+        SendAll(gather, n);
+        LeadLength = 0;
+    }
+    Remaining -= total;
+}
+
+void PktStreamWriter::WriteFile(FILE* file, long long length) {
+    if (length > Remaining)
+        throw runtime_error("Streamed body is longer than announced");
+    if (!Chunk)
+        Chunk = BufferPool::Allocate(ChunkSize);
+    while (length > 0) {
+        int step = length < ChunkSize ? static_cast<int>(length) : ChunkSize;
+        size_t got = fread(Chunk, 1, step, file);
+        if (got == 0)
+            throw runtime_error("File ended before the streamed body");
+        Write(Chunk, static_cast<int>(got));
+        length -= got;
+    }
+}
+
+void PktStreamWriter::End() {
+    if (!Open)
+        throw runtime_error("End called without Begin");
+    if (Remaining != 0)
+        throw runtime_error("Streamed body is shorter than announced");
+    char trailer[Checksum::MAX_SIZE];
+    Checksum::Store(Alg, Checksum::Final(Alg, State), trailer);
+    IoSlice gather[2];
+    int n = 0;
+    // An empty body leaves the header to go out with the trailer.
+    if (LeadLength > 0) {
+        gather[n].Data = Lead + sizeof(Lead) - LeadLength;
+        gather[n++].Length = LeadLength;
+    }
+    gather[n].Data = trailer;
+    gather[n++].Length = Checksum::Size(Alg);
+    Open = false;
+    LeadLength = 0;
+    SendAll(gather, n);
+}
+
+long long PktStreamWriter::GetRemaining() {
+    return Remaining;
+}
+
+void PktStreamWriter::SendAll(IoSlice* slices, int count) {
+    int first = 0;
+    for (;;) {
+        while (first < count && slices[first].Length == 0)
+            ++first;
+        if (first == count)
+            return;
+        int sent = Sock.SendGather(slices + first, count - first, false);
+        if (sent <= 0)
+            throw runtime_error("Stream send failed");
+        // Step past what the socket took and resume inside a partial slice.
+        while (first < count && sent >= slices[first].Length) {
+            sent -= slices[first].Length;
+            ++first;
+        }
+        if (first < count) {
+            slices[first].Data += sent;
+            slices[first].Length -= sent;
+        }
+    }
+}
+
+PktStreamReader::PktStreamReader(MySocket& sock, int chunkSize)
+    : Sock(sock), ChunkSize(chunkSize), Chunk(nullptr), Alg(CRC_XOR), State(0),
+    BodyLength(0), Remaining(0), Open(false)
+{
+    if (chunkSize <= 0)
+        throw runtime_error("PktStreamReader chunk size must be positive");
+}
+
+PktStreamReader::~PktStreamReader() {
+    BufferPool::Free(Chunk);
+}
+
+bool PktStreamReader::Begin() {
+    if (Open)
+        throw runtime_error("The previous streamed packet was not ended");
+    char lead[PktStreamWriter::PREFIXSIZE + PktDef::HEADERSIZE];
+    if (!ReceiveAll(lead, sizeof(lead), true))
+        return false;
+    long long total = WireFormat::Load32(lead);
+    Header.ParseHeader(lead + PktStreamWriter::PREFIXSIZE);
+    Alg = Header.GetCrcType();
+    long long body = total - PktDef::HEADERSIZE - Checksum::Size(Alg);
+    if (body < 0)
+        throw runtime_error("Streamed packet is shorter than header and CRC");
+    State = Checksum::Update(Alg, Checksum::Init(Alg), lead + PktStreamWriter::PREFIXSIZE, PktDef::HEADERSIZE);
+    BodyLength = body;
+    Remaining = body;
+    Open = true;
+    return true;
+}
+
+PktDef& PktStreamReader::GetHeader() {
+    return Header;
+}
+
+long long PktStreamReader::GetBodyLength() {
+    return BodyLength;
+}
+
+long long PktStreamReader::GetRemaining() {
+    return Remaining;
+}
+
+int PktStreamReader::Read(char* dest, int capacity) {
+    if (!Open)
+        throw runtime_error("Read called outside Begin/End");
+    if (Remaining == 0)
+        return 0;
+    // Never read past the body, so the trailer and the next packet stay queued.
+    int want = capacity < Remaining ? capacity : static_cast<int>(Remaining);
+    int n = Sock.GetData(dest, want);
+    if (n == 0)
+        throw runtime_error("Stream ended inside a packet body");
+    State = Checksum::Update(Alg, State, dest, n);
+    Remaining -= n;
+    return n;
+}
+
+long long PktStreamReader::ReadFile(FILE* file) {
+    if (!Chunk)
+        Chunk = BufferPool::Allocate(ChunkSize);
+    long long written = 0;
+    int n;
+    while ((n = Read(Chunk, ChunkSize)) > 0) {
+        if (fwrite(Chunk, 1, n, file) != static_cast<size_t>(n))
+            throw runtime_error("Writing the streamed body failed");
+        written += n;
+    }
+    return written;
+}
+
+bool PktStreamReader::End() {
+    if (!Open)
+        throw runtime_error("End called without Begin");
+    if (Remaining != 0)
+        throw runtime_error("Streamed body was not read in full");
+    char trailer[Checksum::MAX_SIZE];
+    ReceiveAll(trailer, Checksum::Size(Alg), false);
+    Open = false;
+    return Checksum::Final(Alg, State) == Checksum::Load(Alg, trailer);
+}
+
+bool PktStreamReader::ReceiveAll(char* dest, int length, bool endOk) {
+    int got = 0;
+    while (got < length) {
+        int n = Sock.GetData(dest + got, length - got);
+        if (n == 0) {
+            if (got == 0 && endOk)
+                return false;
+            throw runtime_error("Stream ended inside a packet");
+        }
+        got += n;
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "MySocket.h"
+#include "PktDef.h"
+#include <cstdio>
+using namespace std;
+
+// Bytes WriteFile()/ReadFile() move per step; the only buffer either side owns.
+static const int STREAM_CHUNK_SIZE = 65536;
+
+// Streaming send and receive of PktDef packets whose bodies are too large to
+// hold in memory twice (map uploads, firmware images, log dumps), over a
+// connected TCP MySocket.
+//
+// SetBodyData() copies a body into the packet and GenPacket() copies it again
+// into the wire buffer. PktStreamWriter never holds the body: it sends the
+// header, then each body segment straight from the caller's memory with
+// SendGather() while the CRC is updated with Checksum::Update(), and finally
+// the trailer. PktStreamReader receives the body into the caller's buffers
+// in the same way and checks the trailer at the end. Either side's memory
+// use is independent of the body size.
+//
+// On the stream a packet is
+//   [len: 4 bytes little-endian][header][body][CRC]
+// where len counts the header, body and CRC. The bytes after the prefix are
+// an ordinary PktDef packet, but the 4-byte prefix is not PktFramer's, so a
+// connection carries either streamed packets or framed ones, not both.
+class PktStreamWriter {
+public:
+    // Size of the length prefix.
+    static const int PREFIXSIZE = 4;
+
+    // sock must be a connected TCP socket.
+    PktStreamWriter(MySocket& sock, int chunkSize = STREAM_CHUNK_SIZE);
+    ~PktStreamWriter();
+
+    // Start a packet with header's command, count, ack, CRC type and codec
+    // (its body is ignored) and a body of exactly bodyLength bytes. The
+    // prefix and header go out with the first body bytes.
+    void Begin(PktDef& header, long long bodyLength);
+    // Send the next body bytes from caller memory. The data is on its way
+    // when the call returns. Throws if the body grows past bodyLength.
+    void Write(const char* data, int length);
+    // As Write(), with up to MAX_BATCH slices per sendmsg.
+    void Write(const IoSlice* slices, int count);
+    // Read length body bytes from file in chunkSize steps and send them.
+    // Throws if the file ends first.
+    void WriteFile(FILE* file, long long length);
+    // Send the CRC trailer. Throws if fewer bytes were written than promised.
+    void End();
+
+    long long GetRemaining();   // Body bytes still to be written.
+
+private:
+    PktStreamWriter(const PktStreamWriter&);
+    PktStreamWriter& operator=(const PktStreamWriter&);
+
+    // Send every byte of the slices, resuming after partial sends.
+    void SendAll(IoSlice* slices, int count);
+
+    MySocket& Sock;
+    int ChunkSize;
+    char* Chunk;            // WriteFile() buffer, allocated on first use.
+    CrcAlgorithm Alg;
+    unsigned int State;     // Running checksum over header and body.
+    long long Remaining;
+    bool Open;
+    char Lead[PREFIXSIZE + PktDef::HEADERSIZE];    // Prefix and header.
+    int LeadLength;         // Lead bytes still to be sent.
+};
+
+// Receiving side of PktStreamWriter: reads the stream one packet at a time
+// into caller buffers, checking the CRC as the bytes go past.
+class PktStreamReader {
+public:
+    // sock must be a connected TCP socket. Receive calls use its timeouts.
+    PktStreamReader(MySocket& sock, int chunkSize = STREAM_CHUNK_SIZE);
+    ~PktStreamReader();
+
+    // Read the next packet's prefix and header. Returns false if the peer
+    // closed the stream cleanly before another packet; throws if the prefix
+    // cannot describe a packet, or if the previous one was not finished.
+    bool Begin();
+    // Header fields of the current packet; the body stays empty.
+    PktDef& GetHeader();
+    long long GetBodyLength();
+    long long GetRemaining();   // Body bytes not read yet.
+
+    // Receive up to capacity body bytes into dest. Returns the number read,
+    // or 0 once the whole body has been read. Throws if the stream ends
+    // mid-packet.
+    int Read(char* dest, int capacity);
+    // Write the rest of the body to file in chunkSize steps. Returns the bytes written.
+    long long ReadFile(FILE* file);
+    // Receive the trailer and compare it with the running CRC. Returns true
+    // if the packet arrived intact. The body must have been read in full.
+    bool End();
+
+private:
+    PktStreamReader(const PktStreamReader&);
+    PktStreamReader& operator=(const PktStreamReader&);
+
+    // Fill dest completely. Returns false only if the stream ended before
+    // the first byte and endOk is set.
+    bool ReceiveAll(char* dest, int length, bool endOk);
+
+    MySocket& Sock;
+    int ChunkSize;
+    char* Chunk;            // ReadFile() buffer, allocated on first use.
+    PktDef Header;
+    CrcAlgorithm Alg;
+    unsigned int State;
+    long long BodyLength;
+    long long Remaining;
+    bool Open;
+};
@@ -0,0 +1,355 @@
+#include "PrioritySender.h"
+#include "Commands.h"
+#include "PktFramer.h"
+#include "WireFormat.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+// Stride scheduling: a lane's Pass advances by bytes * STRIDE / weight.
+static const unsigned long long LANE_STRIDE = 1 << 16;
+// How often the writer re-reads the kernel backlog while it is over the limit.
+static const int BACKLOG_POLL_US = 100;
+// Chunked packets a ChunkAssembler keeps in progress at once.
+static const size_t MAX_PARTIALS = 16;
+
+static const char* const LaneNames[LANE_COUNT] = { "control", "telemetry", "bulk" };
+
+static int ChunkPayloadSize(PktDef& pkt) {
+    return pkt.GetLength() - PktDef::HEADERSIZE - Checksum::Size(pkt.GetCrcType());
+}
+
+PrioritySender::PrioritySender(MySocket& socket, LanePolicy policy, int chunkSize, int backlogBytes)
+    : Socket(socket), Policy(policy), ChunkSize(chunkSize), BacklogBytes(backlogBytes),
+    GlobalPass(0), NextStream(0), Chunks(0), Failed(false), Running(false), Writing(false)
+{
+    if (chunkSize <= 0 || chunkSize + CHUNK_HEADER + PktDef::HEADERSIZE + 4 > PktFramer::MAX_FRAME)
+        throw runtime_error("PrioritySender chunk size out of range");
+    // Every frame is a whole packet; Nagle would only hold control packets back.
+    Socket.SetNoDelay(true);
+    for (int i = 0; i < LANE_COUNT; ++i) {
+        Lanes[i].Bytes = 0;
+        Lanes[i].Limit = 4 << 20;
+        Lanes[i].Sent = 0;
+        Lanes[i].Weight = 1;
+        Lanes[i].Pass = 0;
+        METRIC_ONLY(MetricsRegistry::Instance().Add(string("lane_latency/") + LaneNames[i] + "/" + Socket.GetMetricsLabel(), &Lanes[i].Latency));
+    }
+    ChunkBody.resize(CHUNK_HEADER + ChunkSize);
+    ChunkPkt.SetCmd(PktDef::EXTENDED);
+}
+
+PrioritySender::~PrioritySender() {
+    Stop();
+    METRIC_ONLY(for (int i = 0; i < LANE_COUNT; ++i) MetricsRegistry::Instance().Remove(&Lanes[i].Latency));
+}
+
+bool PrioritySender::Enqueue(PktDef& pkt, SendLane lane) {
+    if (lane < 0 || lane >= LANE_COUNT)
+        throw runtime_error("Unknown send lane");
+
+    // Copy the packet outside the lock; only the queue insert is shared.
+    int length = pkt.GetLength();
+    Item item;
+    item.Chunked = lane != LANE_CONTROL && length > ChunkSize;
+    item.Offset = 0;
+    item.Stream = 0;
+    if (item.Chunked) {
+        char* raw = pkt.GenPacket();
+        item.Bytes.assign(raw, raw + length);
+    }
+    else {
+        if (length > PktFramer::MAX_FRAME)
+            throw runtime_error("PrioritySender packet too large to frame");
+        item.Bytes.resize(PktFramer::PREFIXSIZE + length);
+        PktFramer::Frame(pkt.GenPacket(), length, item.Bytes.data(), static_cast<int>(item.Bytes.size()));
+    }
+    item.EnqueueNs = MetricsNowNs();
+
+    lock_guard<mutex> guard(Lock);
+    Lane& target = Lanes[lane];
+    long long size = static_cast<long long>(item.Bytes.size());
+    // An empty lane always takes one packet, however large.
+    if (lane != LANE_CONTROL && !target.Queue.empty() && target.Bytes + size > target.Limit)
+        return false;
+    if (item.Chunked)
+        item.Stream = NextStream++;
+    // A lane that was idle rejoins at the current position instead of
+    // claiming the share it did not use.
+    if (target.Queue.empty())
+        target.Pass = max(target.Pass, GlobalPass);
+    target.Bytes += size;
+    target.Queue.push_back(move(item));
+    Wake.notify_all();
+    return true;
+}
+
+void PrioritySender::SetWeight(SendLane lane, int weight) {
+    if (lane < 0 || lane >= LANE_COUNT || weight <= 0)
+        throw runtime_error("PrioritySender weight out of range");
+    lock_guard<mutex> guard(Lock);
+    Lanes[lane].Weight = weight;
+}
+
+void PrioritySender::SetLaneLimit(SendLane lane, long long bytes) {
+    if (lane < 0 || lane >= LANE_COUNT)
+        throw runtime_error("Unknown send lane");
+    lock_guard<mutex> guard(Lock);
+    Lanes[lane].Limit = bytes;
+}
+
+void PrioritySender::Start() {
+    lock_guard<mutex> guard(Lock);
+    if (Running || Writer.joinable())
+        return;
+    Running = true;
+    Failed = false;
+    Writer = thread(&PrioritySender::Run, this);
+}
+
+void PrioritySender::Stop() {
+    {
+        lock_guard<mutex> guard(Lock);
+        Running = false;
+        Wake.notify_all();
+    }
+    if (Writer.joinable())
+        Writer.join();
+}
+
+bool PrioritySender::Flush(int timeoutMs) {
+    unique_lock<mutex> guard(Lock);
+    auto idle = [this]() {
+        if (Failed)
+            return true;
+        for (int i = 0; i < LANE_COUNT; ++i)
+            if (!Lanes[i].Queue.empty())
+                return false;
+        return !Writing;
+    };
+    if (!Wake.wait_for(guard, chrono::milliseconds(timeoutMs), idle))
+        return false;
+    return !Failed;
+}
+
+int PrioritySender::PickLane(bool& backlogged) {
+    backlogged = false;
+    if (!Lanes[LANE_CONTROL].Queue.empty())
+        return LANE_CONTROL;
+    bool telemetry = !Lanes[LANE_TELEMETRY].Queue.empty();
+    bool bulk = !Lanes[LANE_BULK].Queue.empty();
+    if (!telemetry && !bulk)
+        return -1;
+
+    // Keep the kernel queue short so the next control packet is not stuck
+    // behind it. -1 means the platform cannot tell; SO_SNDBUF is the bound.
+    int unsent = Socket.GetUnsentBytes();
+    if (unsent >= BacklogBytes) {
+        backlogged = true;
+        return -1;
+    }
+
+    if (!telemetry)
+        return LANE_BULK;
+    if (!bulk || Policy == POLICY_STRICT)
+        return LANE_TELEMETRY;
+    return Lanes[LANE_BULK].Pass < Lanes[LANE_TELEMETRY].Pass ? LANE_BULK : LANE_TELEMETRY;
+}
+
+bool PrioritySender::NextFrame(Lane& lane) {
+    Item& item = lane.Queue.front();
+    if (!item.Chunked) {
+        Frame.swap(item.Bytes);
+        return true;
+    }
+
+    // [CMD_CHUNK][stream u16][offset u32][total u32][slice of the raw packet]
+    int total = static_cast<int>(item.Bytes.size());
+    int slice = min(ChunkSize, total - item.Offset);
+    char* body = ChunkBody.data();
+    body[0] = static_cast<char>(CMD_CHUNK);
+    WireFormat::Store16(body + 1, item.Stream);
+    WireFormat::Store32(body + 3, static_cast<uint32_t>(item.Offset));
+    WireFormat::Store32(body + 7, static_cast<uint32_t>(total));
+    memcpy(body + CHUNK_HEADER, item.Bytes.data() + item.Offset, slice);
+
+    // Reuse the carried packet's CRC algorithm, which the peer evidently accepts.
+    unsigned char flags = static_cast<unsigned char>(item.Bytes[2]);
+    ChunkPkt.SetCrcType(static_cast<CrcAlgorithm>((flags & WireFormat::CRC_TYPE_MASK) >> WireFormat::CRC_TYPE_SHIFT));
+    ChunkPkt.SetPktCount(item.Stream);
+    ChunkPkt.SetBodyData(body, CHUNK_HEADER + slice);
+    ChunkPkt.CalcCRC();
+    int length = ChunkPkt.GetLength();
+    Frame.resize(PktFramer::PREFIXSIZE + length);
+    PktFramer::Frame(ChunkPkt.GenPacket(), length, Frame.data(), static_cast<int>(Frame.size()));
+
+    item.Offset += slice;
+    ++Chunks;
+    return item.Offset >= total;
+}
+
+void PrioritySender::Run() {
+    unique_lock<mutex> guard(Lock);
+    while (Running) {
+        bool backlogged = false;
+        int index = PickLane(backlogged);
+        if (index < 0) {
+            if (backlogged)
+                Wake.wait_for(guard, chrono::microseconds(BACKLOG_POLL_US));
+            else
+                Wake.wait(guard);
+            continue;
+        }
+
+        Lane& lane = Lanes[index];
+        long long enqueueNs = lane.Queue.front().EnqueueNs;
+        bool finished = NextFrame(lane);
+        if (finished) {
+            Item& done = lane.Queue.front();
+            lane.Bytes -= done.Chunked ? static_cast<long long>(done.Bytes.size()) : static_cast<long long>(Frame.size());
+            lane.Queue.pop_front();
+        }
+        if (index != LANE_CONTROL) {
+            lane.Pass += Frame.size() * LANE_STRIDE / lane.Weight;
+            GlobalPass = lane.Pass;
+        }
+        Writing = true;
+
+        // Producers keep queuing while the frame is written.
+        guard.unlock();
+        bool ok = true;
+        try {
+            Socket.SendData(Frame.data(), static_cast<int>(Frame.size()));
+        }
+        catch (const runtime_error&) {
+            ok = false;
+        }
+        guard.lock();
+
+        Writing = false;
+        if (!ok) {
+            Failed = true;
+            Running = false;
+        }
+        else if (finished) {
+            ++lane.Sent;
+            lane.Latency.Record(MetricsNowNs() - enqueueNs);
+        }
+        // Flush() waiters check whether this emptied the queues.
+        Wake.notify_all();
+    }
+}
+
+int PrioritySender::GetQueuedPackets(SendLane lane) {
+    lock_guard<mutex> guard(Lock);
+    return static_cast<int>(Lanes[lane].Queue.size());
+}
+
+long long PrioritySender::GetQueuedBytes(SendLane lane) {
+    lock_guard<mutex> guard(Lock);
+    return Lanes[lane].Bytes;
+}
+
+long long PrioritySender::GetSentPackets(SendLane lane) {
+    lock_guard<mutex> guard(Lock);
+    return Lanes[lane].Sent;
+}
+
+long long PrioritySender::GetChunks() {
+    lock_guard<mutex> guard(Lock);
+    return Chunks;
+}
+
+bool PrioritySender::HasFailed() {
+    lock_guard<mutex> guard(Lock);
+    return Failed;
+}
+
+LatencyHistogram& PrioritySender::GetLatencyHistogram(SendLane lane) {
+    return Lanes[lane].Latency;
+}
+
+ChunkAssembler::ChunkAssembler(int maxPacket) : MaxPacket(maxPacket), Reassembled(0), Dropped(0) {}
+
+bool ChunkAssembler::Receive(PktDef& pkt) {
+    if (pkt.GetCmd() != PktDef::EXTENDED)
+        return true;
+    int bodySize = ChunkPayloadSize(pkt);
+    const char* body = pkt.GetBodyData();
+    if (bodySize < 1 || static_cast<unsigned char>(body[0]) != CMD_CHUNK)
+        return true;
+    if (bodySize < PrioritySender::CHUNK_HEADER) {
+        ++Dropped;
+        return false;
+    }
+
+    unsigned short stream = WireFormat::Load16(body + 1);
+    long long offset = WireFormat::Load32(body + 3);
+    long long total = WireFormat::Load32(body + 7);
+    int slice = bodySize - PrioritySender::CHUNK_HEADER;
+
+    size_t index = 0;
+    while (index < Partials.size() && Partials[index].Stream != stream)
+        ++index;
+    auto drop = [&]() {
+        if (index < Partials.size()) {
+            Partials[index] = move(Partials.back());
+            Partials.pop_back();
+        }
+        ++Dropped;
+        return false;
+    };
+
+    if (offset == 0) {
+        // The first chunk (re)starts the stream.
+        if (total > MaxPacket || total <= PktDef::HEADERSIZE)
+            return drop();
+        if (index == Partials.size()) {
+            if (Partials.size() >= MAX_PARTIALS)
+                return drop();
+            Partials.push_back(Partial());
+        }
+        Partial& fresh = Partials[index];
+        fresh.Stream = stream;
+        fresh.Total = static_cast<int>(total);
+        fresh.Received = 0;
+        fresh.Data.resize(fresh.Total);
+    }
+    else if (index == Partials.size()) {
+        return drop();
+    }
+
+    // TCP delivers chunks in order; anything else means one went missing.
+    Partial& partial = Partials[index];
+    if (partial.Total != total || partial.Received != offset || offset + slice > total)
+        return drop();
+    memcpy(partial.Data.data() + partial.Received, body + PrioritySender::CHUNK_HEADER, slice);
+    partial.Received += slice;
+    if (partial.Received < partial.Total)
+        return false;
+
+    bool valid = true;
+    try {
+        pkt.Parse(partial.Data.data(), partial.Total);
+        valid = pkt.CheckCRC(partial.Data.data(), partial.Total);
+    }
+    catch (const runtime_error&) {
+        valid = false;
+    }
+    if (!valid)
+        return drop();
+    Partials[index] = move(Partials.back());
+    Partials.pop_back();
+    ++Reassembled;
+    return true;
+}
+
+long long ChunkAssembler::GetReassembled() {
+    return Reassembled;
+}
+
+long long ChunkAssembler::GetDropped() {
+    return Dropped;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "MySocket.h"
+#include "NetMetrics.h"
+#include "PktDef.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Traffic classes of a PrioritySender, most urgent first.
+enum SendLane { LANE_CONTROL, LANE_TELEMETRY, LANE_BULK, LANE_COUNT };
+
+// How the lanes share a connection.
+enum LanePolicy {
+    POLICY_STRICT,      // Always the most urgent non-empty lane.
+    POLICY_WEIGHTED     // CONTROL first; TELEMETRY and BULK split the rest by weight.
+};
+
+// Multi-priority send scheduling for one connected TCP MySocket.
+//
+// Each lane has its own queue, and one writer thread decides what goes on the
+// wire next, so a SLEEP or stop queued behind megabytes of bulk data still
+// leaves next. TELEMETRY and BULK packets larger than the chunk size are cut
+// into CMD_CHUNK packets ([code][stream u16][offset u32][total u32][bytes],
+// carrying the original packet's wire bytes), and the scheduler picks again
+// after every chunk. Packets are framed with PktFramer like AsyncSender.
+//
+// A control packet therefore waits for at most one chunk, plus whatever bulk
+// is already in the kernel's send buffer. On Linux the writer keeps that
+// backlog under backlogBytes (SIOCOUTQ) before writing more TELEMETRY or BULK;
+// elsewhere it is bounded only by SO_SNDBUF. Worst-case CONTROL latency is
+// then about (backlogBytes + chunkSize) / link rate, whatever the size of
+// the transfer in flight. GetLatencyHistogram() records it per lane.
+//
+// The receiver must pass every packet through a ChunkAssembler.
+class PrioritySender {
+public:
+    // Overhead of a chunk packet on top of its slice of the original packet.
+    static const int CHUNK_HEADER = 11;
+
+    // The socket must be a connected TCP socket. Turns Nagle off.
+    PrioritySender(MySocket& socket, LanePolicy policy = POLICY_STRICT, int chunkSize = 1024, int backlogBytes = 16384);
+    // Stops the writer; anything still queued is discarded.
+    ~PrioritySender();
+
+    // Queue a copy of pkt (CalcCRC() must already have been called). Returns
+    // false, queuing nothing, if the lane already holds its limit of bytes.
+    // CONTROL packets are never chunked and never refused.
+    bool Enqueue(PktDef& pkt, SendLane lane);
+
+    // POLICY_WEIGHTED share of TELEMETRY and BULK (default 1 : 1).
+    void SetWeight(SendLane lane, int weight);
+    // Bytes a lane may hold before Enqueue() refuses (default 4 MB).
+    void SetLaneLimit(SendLane lane, long long bytes);
+
+    void Start();
+    // Stop after the frame being written; queued packets stay queued.
+    void Stop();
+    // Wait until every lane is empty. Returns false on timeout or a send error.
+    bool Flush(int timeoutMs);
+
+    // Getters
+    int GetQueuedPackets(SendLane lane);
+    long long GetQueuedBytes(SendLane lane);
+    long long GetSentPackets(SendLane lane);
+    long long GetChunks();
+    bool HasFailed();               // A send threw; the writer has stopped.
+    // Enqueue until the packet's last byte was handed to the socket, in ns.
+    LatencyHistogram& GetLatencyHistogram(SendLane lane);
+
+private:
+    struct Item {
+        vector<char> Bytes;         // Framed packet, or the raw packet when Chunked.
+        bool Chunked;
+        int Offset;                 // Raw bytes already sent as chunks.
+        unsigned short Stream;
+        long long EnqueueNs;
+    };
+    struct Lane {
+        deque<Item> Queue;
+        long long Bytes;
+        long long Limit;
+        long long Sent;
+        int Weight;
+        unsigned long long Pass;    // Stride-scheduling position (POLICY_WEIGHTED).
+        LatencyHistogram Latency;
+    };
+
+    PrioritySender(const PrioritySender&);
+    PrioritySender& operator=(const PrioritySender&);
+
+    void Run();
+    // Next lane to serve, or -1 if nothing may be sent right now. Sets
+    // backlogged when a lane was held back by the kernel backlog.
+    int PickLane(bool& backlogged);
+    // Build the next wire frame of lane's head item into Frame. Returns true
+    // if that finishes the item.
+    bool NextFrame(Lane& lane);
+
+    MySocket& Socket;
+    LanePolicy Policy;
+    int ChunkSize;
+    int BacklogBytes;
+
+    mutex Lock;
+    condition_variable Wake;        // Work queued, Stop(), or a lane emptied.
+    Lane Lanes[LANE_COUNT];
+    unsigned long long GlobalPass;  // Pass of the lane served last.
+    unsigned short NextStream;
+    long long Chunks;
+    bool Failed;
+    bool Running;
+    bool Writing;                   // A frame is on its way to the socket.
+    thread Writer;
+
+    // Writer thread only.
+    vector<char> Frame;
+    vector<char> ChunkBody;
+    PktDef ChunkPkt;
+};
+
+// Receive side of PrioritySender's chunking: collects CMD_CHUNK packets until
+// the packet they carry is whole again.
+class ChunkAssembler {
+public:
+    // Chunked packets that would exceed maxPacket bytes are dropped.
+    explicit ChunkAssembler(int maxPacket = 1 << 20);
+
+    // Returns true if pkt is ready for the application: it was not a chunk,
+    // or it completed a chunked packet, which now replaces it. Returns false
+    // while a chunked packet is incomplete, or if it was dropped.
+    bool Receive(PktDef& pkt);
+
+    // Getters
+    long long GetReassembled();
+    long long GetDropped();         // Out-of-order, oversized or corrupt.
+
+private:
+    struct Partial {
+        unsigned short Stream;
+        int Total;
+        int Received;
+        vector<char> Data;
+    };
+
+    int MaxPacket;
+    vector<Partial> Partials;       // Streams in progress; a handful at most.
+    long long Reassembled;
+    long long Dropped;
+};
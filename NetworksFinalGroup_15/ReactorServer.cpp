@@ -0,0 +1,393 @@
+#include "ReactorServer.h"
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+using namespace std;
+
+// Reassembly ring per TCP session; also bounds the largest packet accepted.
+static const int SESSION_RING_SIZE = 8192;
+// Receive buffer per worker, large enough for any UDP datagram.
+static const int WORKER_SCRATCH_SIZE = 65536;
+// How long a worker blocks in the poller before re-checking Running.
+static const int POLL_TIMEOUT_MS = 50;
+static const int MAX_EVENTS = 64;
+// Reads (TCP) or datagrams (UDP) taken per readiness event. The poller is
+// level-triggered, so a busy socket is picked up again on the next Wait()
+// after the other sockets in the batch have had their turn.
+static const int READ_BUDGET = 16;
+// Default UDP session limits; see SetUdpLimits().
+static const int UDP_IDLE_TIMEOUT_MS = 60000;
+static const int MAX_UDP_SESSIONS = 4096;
+
+ReactorSession::ReactorSession(ReactorServer* owner, int worker, SOCKET sock, const sockaddr_in& peer, int ringSize)
+    : UserData(nullptr), Owner(owner), Worker(worker), Id(0), Sock(sock), Peer(peer),
+    Framer(ringSize, ringSize - PktFramer::PREFIXSIZE), WantWrite(false), Closing(false), Doomed(false), LastActiveMs(0)
+{
+}
+
+void ReactorSession::Send(PktDef& pkt) {
+    if (Closing || Doomed)
+        return;
+    int length = pkt.GetLength();
+    char* raw = pkt.GenPacket();
+
+    if (Owner->connectionType == UDP) {
+        // Datagrams are never queued; a full socket buffer drops the packet like the network would.
+        sendto(Sock, raw, length, 0, (struct sockaddr*)&Peer, sizeof(Peer));
+        return;
+    }
+
+    size_t offset = Pending.size();
+    Pending.resize(offset + length + PktFramer::PREFIXSIZE);
+    PktFramer::Frame(raw, length, &Pending[offset], length + PktFramer::PREFIXSIZE);
+    Owner->FlushPending(*this);
+}
+
+void ReactorSession::Close() {
+    if (Closing)
+        return;
+    Closing = true;
+    if (Pending.empty())
+        Owner->RequestClose(*this);
+}
+
+int ReactorSession::GetId() {
+    return Id;
+}
+
+string ReactorSession::GetPeerIP() {
+    char text[INET_ADDRSTRLEN] = { 0 };
+    inet_ntop(AF_INET, &Peer.sin_addr, text, sizeof(text));
+    return string(text);
+}
+
+int ReactorSession::GetPeerPort() {
+    return ntohs(Peer.sin_port);
+}
+
+ReactorServer::ReactorServer(string ip, unsigned int port, ConnectionType connType, int numThreads)
+    : connectionType(connType), ListenSocket(INVALID_SOCKET), Port(static_cast<int>(port)),
+    Running(false), SessionCount(0), NextSessionId(1), CrcErrors(0), RejectedPeers(0),
+    UdpIdleTimeoutMs(UDP_IDLE_TIMEOUT_MS), MaxUdpSessions(MAX_UDP_SESSIONS)
+{
+    NetworkStartup();
+    if (numThreads < 1)
+        numThreads = 1;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(Port);
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+
+    if (connectionType == TCP)
+        ListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    else
+        ListenSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (ListenSocket == INVALID_SOCKET)
+        throw runtime_error("Failed to create reactor socket");
+
+    int reuse = 1;
+    setsockopt(ListenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+    if (bind(ListenSocket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        CloseSocket(ListenSocket);
+        throw runtime_error("Reactor bind failed");
+    }
+    if (connectionType == TCP && listen(ListenSocket, SOMAXCONN) == SOCKET_ERROR) {
+        CloseSocket(ListenSocket);
+        throw runtime_error("Reactor listen failed");
+    }
+    SetNonBlocking(ListenSocket, true);
+
+    // Report the port actually bound (matters when port 0 was requested).
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(ListenSocket, (struct sockaddr*)&addr, &addrLen) == 0)
+        Port = ntohs(addr.sin_port);
+    METRIC_ONLY(MetricsRegistry::Instance().Add("reactor/" + ip + ":" + to_string(Port), &Counters));
+
+    for (int i = 0; i < numThreads; ++i) {
+        unique_ptr<Worker> w(new Worker());
+        w->Scratch.resize(WORKER_SCRATCH_SIZE);
+        w->LastSweepMs = 0;
+        Workers.push_back(move(w));
+    }
+}
+
+ReactorServer::~ReactorServer() {
+    Stop();
+    METRIC_ONLY(MetricsRegistry::Instance().Remove(&Counters));
+    if (ListenSocket != INVALID_SOCKET) {
+        CloseSocket(ListenSocket);
+        ListenSocket = INVALID_SOCKET;
+    }
+}
+
+void ReactorServer::OnConnect(SessionHandler handler) {
+    ConnectHandler = handler;
+}
+
+void ReactorServer::OnPacket(PacketHandler handler) {
+    PacketCallback = handler;
+}
+
+void ReactorServer::OnDisconnect(SessionHandler handler) {
+    DisconnectHandler = handler;
+}
+
+void ReactorServer::SetUdpLimits(int idleTimeoutMs, int maxSessions) {
+    UdpIdleTimeoutMs = idleTimeoutMs;
+    MaxUdpSessions = maxSessions > 0 ? maxSessions : 1;
+}
+
+void ReactorServer::Start() {
+    if (Running.exchange(true))
+        return;
+    for (size_t i = 0; i < Workers.size(); ++i) {
+        // Every TCP worker accepts, but a connection wakes only one of them;
+        // a UDP socket has exactly one reader.
+        if (connectionType == TCP)
+            Workers[i]->Poller.Add(ListenSocket, EVENT_READ | EVENT_EXCLUSIVE, this);
+        else if (i == 0)
+            Workers[i]->Poller.Add(ListenSocket, EVENT_READ, this);
+        Workers[i]->Thread = thread(&ReactorServer::Run, this, static_cast<int>(i));
+    }
+}
+
+void ReactorServer::Stop() {
+    if (!Running.exchange(false))
+        return;
+    for (size_t i = 0; i < Workers.size(); ++i) {
+        if (Workers[i]->Thread.joinable())
+            Workers[i]->Thread.join();
+        if (connectionType == TCP || i == 0)
+            Workers[i]->Poller.Remove(ListenSocket);
+    }
+}
+
+int ReactorServer::GetPort() {
+    return Port;
+}
+
+int ReactorServer::GetSessionCount() {
+    return SessionCount.load();
+}
+
+long long ReactorServer::GetCrcErrors() {
+    return CrcErrors.load();
+}
+
+SocketCounters& ReactorServer::GetCounters() {
+    return Counters;
+}
+
+long long ReactorServer::GetRejectedPeers() {
+    return RejectedPeers.load();
+}
+
+long long ReactorServer::NowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ReactorServer::Run(int index) {
+    Worker& w = *Workers[index];
+    PollEvent events[MAX_EVENTS];
+
+    while (Running.load(memory_order_relaxed)) {
+        int n = w.Poller.Wait(events, MAX_EVENTS, POLL_TIMEOUT_MS);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].Context == this) {
+                if (connectionType == TCP)
+                    AcceptAll(w, index);
+                else
+                    ReadUdp(w, index);
+                continue;
+            }
+            ReactorSession* s = static_cast<ReactorSession*>(events[i].Context);
+            if (s->Doomed)
+                continue;
+            if (events[i].Events & EVENT_WRITE)
+                FlushPending(*s);
+            if (!s->Doomed && (events[i].Events & (EVENT_READ | EVENT_CLOSED)))
+                ReadTcp(w, *s);
+        }
+
+        if (connectionType == UDP && index == 0) {
+            long long now = NowMs();
+            if (now - w.LastSweepMs >= POLL_TIMEOUT_MS)
+                SweepIdleUdp(w, now);
+        }
+
+        // Sessions are only freed here, so no event in the batch can see a dangling pointer.
+        for (ReactorSession* s : w.Closing)
+            Release(w, s);
+        w.Closing.clear();
+    }
+
+    // Shutting down: release every session this worker still owns.
+    vector<ReactorSession*> remaining;
+    for (auto& entry : w.TcpSessions)
+        remaining.push_back(entry.second.get());
+    for (auto& entry : w.UdpSessions)
+        remaining.push_back(entry.second.get());
+    for (ReactorSession* s : remaining)
+        Release(w, s);
+    w.Closing.clear();
+}
+
+void ReactorServer::AcceptAll(Worker& w, int index) {
+    for (;;) {
+        sockaddr_in peer;
+        socklen_t peerLen = sizeof(peer);
+        SOCKET sock = accept(ListenSocket, (struct sockaddr*)&peer, &peerLen);
+        if (sock == INVALID_SOCKET)
+            return;     // Drained, or another worker took the connection.
+
+        SetNonBlocking(sock, true);
+        int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+        ReactorSession* s = new ReactorSession(this, index, sock, peer, SESSION_RING_SIZE);
+        s->Id = NextSessionId++;
+        w.TcpSessions[sock].reset(s);
+        w.Poller.Add(sock, EVENT_READ, s);
+        ++SessionCount;
+        if (ConnectHandler)
+            ConnectHandler(*s);
+    }
+}
+
+void ReactorServer::ReadTcp(Worker& w, ReactorSession& s) {
+    for (int reads = 0; reads < READ_BUDGET; ++reads) {
+        int space = 0;
+        char* dest = s.Framer.WritePtr(space);
+        if (space == 0)
+            return;
+        int n = recv(s.Sock, dest, space, 0);
+        if (n > 0) {
+            s.Framer.Commit(n);
+            int length;
+            while (!s.Doomed && (length = s.Framer.NextFrame(w.Scratch.data(), static_cast<int>(w.Scratch.size()))) > 0)
+                Deliver(w, s, w.Scratch.data(), length);
+            if (s.Doomed)
+                return;
+            continue;
+        }
+        if (n == SOCKET_ERROR && WouldBlock(LastSocketError()))
+            return;
+        // Orderly shutdown by the robot, or a hard error.
+        RequestClose(s);
+        return;
+    }
+}
+
+void ReactorServer::ReadUdp(Worker& w, int index) {
+    for (int reads = 0; reads < READ_BUDGET; ++reads) {
+        sockaddr_in peer;
+        socklen_t peerLen = sizeof(peer);
+        int n = recvfrom(ListenSocket, w.Scratch.data(), static_cast<int>(w.Scratch.size()), 0, (struct sockaddr*)&peer, &peerLen);
+        if (n == SOCKET_ERROR)
+            return;
+
+        unsigned long long key = (static_cast<unsigned long long>(peer.sin_addr.s_addr) << 16) | peer.sin_port;
+        long long now = NowMs();
+        auto found = w.UdpSessions.find(key);
+        if (found == w.UdpSessions.end() && static_cast<int>(w.UdpSessions.size()) >= MaxUdpSessions) {
+            // Make room from idle peers first; the released ones leave at the end of the batch.
+            SweepIdleUdp(w, now);
+            if (static_cast<int>(w.UdpSessions.size() - w.Closing.size()) >= MaxUdpSessions) {
+                ++RejectedPeers;
+                continue;
+            }
+            for (ReactorSession* s : w.Closing)
+                Release(w, s);
+            w.Closing.clear();
+        }
+        unique_ptr<ReactorSession>& slot = w.UdpSessions[key];
+        if (!slot) {
+            // The framer is unused for datagrams, so give it the minimum ring.
+            slot.reset(new ReactorSession(this, index, ListenSocket, peer, PktFramer::PREFIXSIZE + 1));
+            slot->Id = NextSessionId++;
+            ++SessionCount;
+            if (ConnectHandler)
+                ConnectHandler(*slot);
+        }
+        slot->LastActiveMs = now;
+        if (!slot->Doomed)
+            Deliver(w, *slot, w.Scratch.data(), n);
+    }
+}
+
+void ReactorServer::SweepIdleUdp(Worker& w, long long nowMs) {
+    w.LastSweepMs = nowMs;
+    for (auto& entry : w.UdpSessions) {
+        if (nowMs - entry.second->LastActiveMs >= UdpIdleTimeoutMs)
+            RequestClose(*entry.second);
+    }
+}
+
+void ReactorServer::FlushPending(ReactorSession& s) {
+    size_t sent = 0;
+    while (sent < s.Pending.size()) {
+        int n = send(s.Sock, &s.Pending[sent], static_cast<int>(s.Pending.size() - sent), 0);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n == SOCKET_ERROR && WouldBlock(LastSocketError()))
+            break;
+        s.Pending.clear();
+        RequestClose(s);
+        return;
+    }
+    s.Pending.erase(s.Pending.begin(), s.Pending.begin() + sent);
+
+    bool wantWrite = !s.Pending.empty();
+    if (wantWrite != s.WantWrite) {
+        Workers[s.Worker]->Poller.Modify(s.Sock, wantWrite ? (EVENT_READ | EVENT_WRITE) : EVENT_READ, &s);
+        s.WantWrite = wantWrite;
+    }
+    if (!wantWrite && s.Closing)
+        RequestClose(s);
+}
+
+void ReactorServer::Deliver(Worker& w, ReactorSession& s, char* data, int length) {
+    try {
+        w.Packet.Parse(data, length);
+    }
+    catch (const runtime_error&) {
+        ++CrcErrors;
+        METRIC_ADD(Counters.CrcFailures, 1);
+        return;
+    }
+    if (!w.Packet.CheckCRC(data, length)) {
+        ++CrcErrors;
+        METRIC_ADD(Counters.CrcFailures, 1);
+        return;
+    }
+    METRIC_ADD(Counters.PacketsIn, 1);
+    if (PacketCallback)
+        PacketCallback(s, w.Packet);
+}
+
+void ReactorServer::RequestClose(ReactorSession& s) {
+    if (s.Doomed)
+        return;
+    s.Doomed = true;
+    Workers[s.Worker]->Closing.push_back(&s);
+}
+
+void ReactorServer::Release(Worker& w, ReactorSession* s) {
+    if (DisconnectHandler)
+        DisconnectHandler(*s);
+    --SessionCount;
+    if (connectionType == TCP) {
+        SOCKET sock = s->Sock;
+        w.Poller.Remove(sock);
+        CloseSocket(sock);
+        w.TcpSessions.erase(sock);
+    }
+    else {
+        unsigned long long key = (static_cast<unsigned long long>(s->Peer.sin_addr.s_addr) << 16) | s->Peer.sin_port;
+        w.UdpSessions.erase(key);
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include "NetPlatform.h"
+#include "MySocket.h"
+#include "EventPoller.h"
+#include "PktDef.h"
+#include "PktFramer.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class ReactorServer;
+
+// One robot served by a ReactorServer: a TCP connection, or a UDP peer address.
+// Sessions belong to a single worker thread; only use them from handler callbacks.
+class ReactorSession {
+public:
+    // Send a packet to this robot. TCP packets are length-prefixed with
+    // PktFramer; whatever the socket cannot take immediately is queued and
+    // flushed when it becomes writable.
+    void Send(PktDef& pkt);
+    // Close the session once queued output has been flushed (TCP) or
+    // immediately (UDP). OnDisconnect is called when it is released.
+    void Close();
+
+    // Getters
+    int GetId();
+    string GetPeerIP();
+    int GetPeerPort();
+
+    void* UserData;     // Free for the application; never touched by the server.
+
+private:
+    friend class ReactorServer;
+    ReactorSession(ReactorServer* owner, int worker, SOCKET sock, const sockaddr_in& peer, int ringSize);
+    ReactorSession(const ReactorSession&);
+    ReactorSession& operator=(const ReactorSession&);
+
+    ReactorServer* Owner;   // Server that owns the session.
+    int Worker;             // Index of the worker thread serving the session.
+    int Id;                 // Unique session number.
+    SOCKET Sock;            // TCP connection, or the shared UDP socket.
+    sockaddr_in Peer;       // Remote address.
+    PktFramer Framer;       // TCP reassembly ring (unused for UDP).
+    vector<char> Pending;   // Output the socket has not accepted yet.
+    bool WantWrite;         // Write readiness is registered with the poller.
+    bool Closing;           // Close() was requested; release once Pending is empty.
+    bool Doomed;            // Queued for release at the end of the current batch.
+    long long LastActiveMs; // Latest datagram from a UDP peer (steady clock).
+};
+
+// Event-driven server that serves many TCP or UDP robot sessions from a small
+// pool of worker threads. Each worker owns an EventPoller (epoll on Linux) and
+// a set of non-blocking sockets. Every TCP worker accepts from the shared
+// listening socket (registered exclusively, so a connection wakes one worker);
+// a UDP server is served by worker 0 and demultiplexes datagrams by peer
+// address. A worker reads a bounded number of times per ready socket before
+// going back to the poller, so one busy robot cannot starve the others.
+//
+// Received bytes are reassembled (TCP), decoded into a PktDef and handed to
+// the OnPacket callback if their CRC checks out.
+//
+// UDP peers have no connection to close, so a UDP session is released once
+// it has been silent for the idle timeout. The number of sessions is capped,
+// and datagrams from new peers are dropped while the table is full of active
+// ones, so spoofed source addresses cannot grow it without bound.
+class ReactorServer {
+public:
+    typedef function<void(ReactorSession&)> SessionHandler;
+    typedef function<void(ReactorSession&, PktDef&)> PacketHandler;
+
+    // Constructor: binds (and for TCP, listens on) ip:port. Port 0 picks an
+    // ephemeral port, see GetPort(). numThreads < 1 is treated as 1.
+    ReactorServer(string ip, unsigned int port, ConnectionType connType, int numThreads);
+
+    // Destructor: stops the workers and closes every session.
+    ~ReactorServer();
+
+    // Callbacks; set them before Start(). They run on worker threads.
+    void OnConnect(SessionHandler handler);
+    void OnPacket(PacketHandler handler);
+    void OnDisconnect(SessionHandler handler);
+
+    // UDP session limits; set them before Start(). Defaults: 60 s, 4096.
+    void SetUdpLimits(int idleTimeoutMs, int maxSessions);
+
+    // Start / stop the worker threads.
+    void Start();
+    void Stop();
+
+    // Getters
+    int GetPort();              // Port actually bound.
+    int GetSessionCount();      // Sessions currently open.
+    long long GetCrcErrors();   // Packets dropped for a bad CRC or length.
+    long long GetRejectedPeers();   // UDP datagrams dropped because the session table was full.
+    // Exported as "reactor/<ip>:<port>": packets delivered to the handler
+    // (PacketsIn) and packets dropped for a bad CRC or length (CrcFailures).
+    SocketCounters& GetCounters();
+
+private:
+    friend class ReactorSession;
+
+    // Per-thread state.
+    struct Worker {
+        EventPoller Poller;
+        thread Thread;
+        unordered_map<SOCKET, unique_ptr<ReactorSession>> TcpSessions;
+        unordered_map<unsigned long long, unique_ptr<ReactorSession>> UdpSessions;
+        vector<ReactorSession*> Closing;    // Sessions to release after the current batch.
+        vector<char> Scratch;               // Receive / reassembly buffer.
+        PktDef Packet;                      // Reused decode target.
+        long long LastSweepMs;              // Last idle UDP session sweep.
+    };
+
+    void Run(int index);
+    void AcceptAll(Worker& w, int index);
+    void ReadTcp(Worker& w, ReactorSession& s);
+    void ReadUdp(Worker& w, int index);
+    void FlushPending(ReactorSession& s);
+    void Deliver(Worker& w, ReactorSession& s, char* data, int length);
+    void RequestClose(ReactorSession& s);
+    void Release(Worker& w, ReactorSession* s);
+    void SweepIdleUdp(Worker& w, long long nowMs);
+    static long long NowMs();
+
+    ConnectionType connectionType;
+    SOCKET ListenSocket;            // TCP listener or the UDP socket.
+    int Port;
+    vector<unique_ptr<Worker>> Workers;
+    atomic<bool> Running;
+    atomic<int> SessionCount;
+    atomic<int> NextSessionId;
+    atomic<long long> CrcErrors;
+    atomic<long long> RejectedPeers;
+    SocketCounters Counters;
+    int UdpIdleTimeoutMs;
+    int MaxUdpSessions;
+    SessionHandler ConnectHandler;
+    PacketHandler PacketCallback;
+    SessionHandler DisconnectHandler;
+};
@@ -0,0 +1,317 @@
+#include "ReliableChannel.h"
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+using namespace std;
+
+// Initial RTO before any RTT sample, per RFC 6298 scaled for a LAN/Wi-Fi link.
+static const long long INITIAL_RTO_US = 200000;
+static const int RELIABLE_BUFFER_SIZE = 65536;
+
+ReliableChannel::ReliableChannel(MySocket& socket, int windowSize, int initialSeq)
+    : Socket(socket), WindowSize(windowSize), SendBase(static_cast<unsigned short>(initialSeq)),
+    NextSeq(static_cast<unsigned short>(initialSeq)), RecvBase(static_cast<unsigned short>(initialSeq)),
+    RecvMarks(RECV_WINDOW, 0), SrttUs(0), RttVarUs(0), RtoUs(INITIAL_RTO_US),
+    MinRtoUs(5000), MaxRtoUs(2000000), MaxRetries(10),
+    Retransmits(0), Duplicates(0), Failures(0), RecvBuffer(RELIABLE_BUFFER_SIZE)
+{
+    if (WindowSize < 1)
+        WindowSize = 1;
+    if (WindowSize > RECV_WINDOW)
+        WindowSize = RECV_WINDOW;
+    // Slot count is a power of two so seq & SlotMask stays contiguous across the 16-bit wrap.
+    int slotCount = 1;
+    while (slotCount < WindowSize)
+        slotCount <<= 1;
+    SlotMask = slotCount - 1;
+    Slots.resize(slotCount);
+    for (Slot& s : Slots) {
+        s.SentAtUs = 0;
+        s.Retries = 0;
+        s.InUse = false;
+        s.Acked = false;
+    }
+    AckPacket.SetAck(true);
+    AckPacket.SetCmd(PktDef::RESPONSE);
+    METRIC_ONLY(MetricsRegistry::Instance().Add("rtt/" + Socket.GetMetricsLabel(), &RttHistogram));
+}
+
+ReliableChannel::~ReliableChannel() {
+    METRIC_ONLY(MetricsRegistry::Instance().Remove(&RttHistogram));
+}
+
+long long ReliableChannel::NowUs() {
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+short ReliableChannel::SeqDiff(unsigned short a, unsigned short b) {
+    // Signed distance from b to a, correct across 16-bit wraparound.
+    return static_cast<short>(static_cast<unsigned short>(a - b));
+}
+
+bool ReliableChannel::Send(PktDef& pkt) {
+    if (SeqDiff(NextSeq, SendBase) >= WindowSize)
+        return false;
+
+    unsigned short seq = NextSeq++;
+    pkt.SetPktCount(seq);
+    pkt.SetAck(false);
+    pkt.CalcCRC();
+
+    Slot& slot = Slots[seq & SlotMask];
+    int length = pkt.GetLength();
+    slot.Raw.resize(length);
+    pkt.GenPacket(slot.Raw.data(), length);
+    slot.Retries = 0;
+    slot.InUse = true;
+    slot.Acked = false;
+    slot.SentAtUs = NowUs();
+    Socket.SendData(slot.Raw.data(), length);
+    METRIC_STAMP(pkt.GetTrace().SendNs);
+    return true;
+}
+
+bool ReliableChannel::Receive(PktDef& out, int timeoutMs) {
+    // Packets that arrived during Flush() were already acknowledged.
+    if (!Held.empty()) {
+        out = Held.front();
+        Held.pop_front();
+        return true;
+    }
+    return Poll(out, timeoutMs);
+}
+
+bool ReliableChannel::Poll(PktDef& out, int timeoutMs) {
+    long long deadline = NowUs() + static_cast<long long>(timeoutMs) * 1000;
+    for (;;) {
+        Service();
+        long long now = NowUs();
+
+        // Sleep until data arrives, the deadline passes or a retransmit is due.
+        long long waitUs = deadline - now;
+        long long retransmitUs = NextTimeoutUs() - now;
+        if (retransmitUs < waitUs)
+            waitUs = retransmitUs;
+        int waitMs = (waitUs <= 0) ? 0 : static_cast<int>((waitUs + 999) / 1000);
+        if (!Socket.WaitForData(waitMs)) {
+            if (NowUs() >= deadline)
+                return false;
+            continue;
+        }
+
+        int n = Socket.GetData(RecvBuffer.data(), static_cast<int>(RecvBuffer.size()));
+        METRIC_STAMP(Incoming.GetTrace().ReceiveNs);
+        try {
+            Incoming.Parse(RecvBuffer.data(), n);
+        }
+        catch (const runtime_error&) {
+            METRIC_ADD(Socket.GetCounters().CrcFailures, 1);
+            continue;
+        }
+        if (!Incoming.CheckCRC(RecvBuffer.data(), n)) {
+            METRIC_ADD(Socket.GetCounters().CrcFailures, 1);
+            continue;
+        }
+
+        if (Incoming.GetAck()) {
+            HandleAck(Incoming);
+            continue;
+        }
+
+        unsigned short seq = static_cast<unsigned short>(Incoming.GetPktCount());
+        // The sender's window is at most RECV_WINDOW, so a packet this far
+        // ahead means it has stopped waiting for everything older: those
+        // were acknowledged or given up after MaxRetries. Slide past them,
+        // or a single abandoned gap would block the channel for good.
+        while (SeqDiff(seq, RecvBase) >= RECV_WINDOW) {
+            RecvMarks[RecvBase % RECV_WINDOW] = 0;
+            ++RecvBase;
+        }
+        short ahead = SeqDiff(seq, RecvBase);
+        if (ahead < 0 || RecvMarks[seq % RECV_WINDOW]) {
+            // Already delivered: the ACK was lost, so repeat it.
+            ++Duplicates;
+            SendAck(seq);
+            continue;
+        }
+
+        RecvMarks[seq % RECV_WINDOW] = 1;
+        while (RecvMarks[RecvBase % RECV_WINDOW]) {
+            RecvMarks[RecvBase % RECV_WINDOW] = 0;
+            ++RecvBase;
+        }
+        SendAck(seq);
+        out.Parse(RecvBuffer.data(), n);
+        return true;
+    }
+}
+
+bool ReliableChannel::Flush(int timeoutMs) {
+    long long deadline = NowUs() + static_cast<long long>(timeoutMs) * 1000;
+    while (GetInFlight() > 0 && NowUs() < deadline) {
+        int remainingMs = static_cast<int>((deadline - NowUs()) / 1000);
+        // Data packets arriving while flushing are kept for Receive().
+        if (Poll(Incoming, remainingMs < 1 ? 1 : remainingMs))
+            Held.push_back(Incoming);
+    }
+    return GetInFlight() == 0;
+}
+
+void ReliableChannel::Service() {
+    long long now = NowUs();
+    for (unsigned short seq = SendBase; seq != NextSeq; ++seq) {
+        Slot& slot = Slots[seq & SlotMask];
+        if (!slot.InUse || slot.Acked)
+            continue;
+        // Exponential backoff per retransmission of the same packet.
+        long long timeout = RtoUs << (slot.Retries < 6 ? slot.Retries : 6);
+        if (timeout > MaxRtoUs)
+            timeout = MaxRtoUs;
+        if (now - slot.SentAtUs < timeout)
+            continue;
+        if (slot.Retries >= MaxRetries) {
+            ++Failures;
+            slot.Acked = true;  // Give up; frees the slot.
+            continue;
+        }
+        ++slot.Retries;
+        ++Retransmits;
+        slot.SentAtUs = now;
+        Socket.SendData(slot.Raw.data(), static_cast<int>(slot.Raw.size()));
+    }
+    AdvanceSendBase();
+}
+
+void ReliableChannel::HandleAck(PktDef& ack) {
+    unsigned short seq = static_cast<unsigned short>(ack.GetPktCount());
+    AckSlot(seq, true);
+
+    int bodyLength = ack.GetLength() - PktDef::HEADERSIZE - Checksum::Size(ack.GetCrcType());
+    if (bodyLength >= ACK_BODY_SIZE) {
+        const unsigned char* body = reinterpret_cast<const unsigned char*>(ack.GetBodyData());
+        unsigned short next = static_cast<unsigned short>(body[0] | (body[1] << 8));
+        unsigned int bitmap = body[2] | (body[3] << 8) | (body[4] << 16) | (static_cast<unsigned int>(body[5]) << 24);
+
+        // Everything before 'next' has arrived.
+        for (unsigned short s = SendBase; SeqDiff(s, next) < 0 && s != NextSeq; ++s)
+            AckSlot(s, false);
+        for (int i = 0; i < 32; ++i) {
+            if (bitmap & (1u << i))
+                AckSlot(static_cast<unsigned short>(next + 1 + i), false);
+        }
+    }
+    AdvanceSendBase();
+}
+
+void ReliableChannel::AckSlot(unsigned short seq, bool sampleRtt) {
+    // Ignore ACKs outside [SendBase, NextSeq).
+    if (SeqDiff(seq, SendBase) < 0 || SeqDiff(seq, NextSeq) >= 0)
+        return;
+    Slot& slot = Slots[seq & SlotMask];
+    if (!slot.InUse || slot.Acked)
+        return;
+    slot.Acked = true;
+    // Karn's rule: a retransmitted packet gives an ambiguous RTT sample.
+    if (sampleRtt && slot.Retries == 0)
+        UpdateRto(NowUs() - slot.SentAtUs);
+}
+
+void ReliableChannel::SendAck(unsigned short seq) {
+    unsigned int bitmap = 0;
+    for (int i = 0; i < 32; ++i) {
+        unsigned short s = static_cast<unsigned short>(RecvBase + 1 + i);
+        if (RecvMarks[s % RECV_WINDOW])
+            bitmap |= 1u << i;
+    }
+    char body[ACK_BODY_SIZE];
+    body[0] = static_cast<char>(RecvBase & 0xFF);
+    body[1] = static_cast<char>(RecvBase >> 8);
+    for (int i = 0; i < 4; ++i)
+        body[2 + i] = static_cast<char>((bitmap >> (8 * i)) & 0xFF);
+
+    AckPacket.SetPktCount(seq);
+    AckPacket.SetBodyData(body, ACK_BODY_SIZE);
+    AckPacket.CalcCRC();
+    Socket.SendData(AckPacket.GenPacket(), AckPacket.GetLength());
+}
+
+void ReliableChannel::AdvanceSendBase() {
+    while (SendBase != NextSeq) {
+        Slot& slot = Slots[SendBase & SlotMask];
+        if (slot.InUse && !slot.Acked)
+            break;
+        slot.InUse = false;
+        ++SendBase;
+    }
+}
+
+void ReliableChannel::UpdateRto(long long sampleUs) {
+    METRIC_ONLY(RttHistogram.Record(sampleUs * 1000));
+    if (SrttUs == 0) {
+        SrttUs = sampleUs;
+        RttVarUs = sampleUs / 2;
+    }
+    else {
+        long long err = sampleUs - SrttUs;
+        RttVarUs += ((err < 0 ? -err : err) - RttVarUs) / 4;
+        SrttUs += err / 8;
+    }
+    RtoUs = SrttUs + 4 * RttVarUs;
+    if (RtoUs < MinRtoUs)
+        RtoUs = MinRtoUs;
+    if (RtoUs > MaxRtoUs)
+        RtoUs = MaxRtoUs;
+}
+
+long long ReliableChannel::NextTimeoutUs() {
+    long long earliest = NowUs() + MaxRtoUs;
+    for (unsigned short seq = SendBase; seq != NextSeq; ++seq) {
+        Slot& slot = Slots[seq & SlotMask];
+        if (!slot.InUse || slot.Acked)
+            continue;
+        long long timeout = RtoUs << (slot.Retries < 6 ? slot.Retries : 6);
+        if (timeout > MaxRtoUs)
+            timeout = MaxRtoUs;
+        if (slot.SentAtUs + timeout < earliest)
+            earliest = slot.SentAtUs + timeout;
+    }
+    return earliest;
+}
+
+void ReliableChannel::SetRtoLimits(int minRtoMs, int maxRtoMs) {
+    MinRtoUs = static_cast<long long>(minRtoMs) * 1000;
+    MaxRtoUs = static_cast<long long>(maxRtoMs) * 1000;
+    if (RtoUs < MinRtoUs)
+        RtoUs = MinRtoUs;
+    if (RtoUs > MaxRtoUs)
+        RtoUs = MaxRtoUs;
+}
+
+void ReliableChannel::SetMaxRetries(int retries) {
+    MaxRetries = retries;
+}
+
+int ReliableChannel::GetInFlight() {
+    return SeqDiff(NextSeq, SendBase);
+}
+
+int ReliableChannel::GetRtoMs() {
+    return static_cast<int>(RtoUs / 1000);
+}
+
+long long ReliableChannel::GetRetransmits() {
+    return Retransmits;
+}
+
+LatencyHistogram& ReliableChannel::GetRttHistogram() {
+    return RttHistogram;
+}
+
+long long ReliableChannel::GetDuplicates() {
+    return Duplicates;
+}
+
+long long ReliableChannel::GetFailures() {
+    return Failures;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "MySocket.h"
+#include "PktDef.h"
+#include <deque>
+#include <vector>
+using namespace std;
+
+// Reliable, unordered delivery of PktDef commands over a UDP MySocket.
+//
+// The sender numbers every packet with PktCount (16-bit, wrapping) and keeps up
+// to windowSize packets in flight. The receiver answers each packet with an ACK
+// packet (Ack bit set, PktCount = the packet being acknowledged) whose 6-byte body
+// carries the next sequence number it expects and a bitmap of the 32 numbers
+// after that which it already holds:
+//   [next lo][next hi][bitmap bits 0-31, little-endian]
+// Unacknowledged packets are retransmitted when the adaptive RTO (RFC 6298,
+// Karn's rule) expires. Packets are handed to the application as soon as they
+// arrive, so one lost DRIVE does not hold up the ones behind it; duplicates
+// created by retransmission are suppressed. A packet given up on after
+// MaxRetries leaves a gap the receiver skips once the sender has moved a full
+// RECV_WINDOW past it.
+//
+// Both ends must use a ReliableChannel with the same initial sequence number.
+// A SERVER socket replies to whichever peer it heard from last, so one channel
+// serves one robot.
+class ReliableChannel {
+public:
+    // Size of the ACK body: 2-byte next-expected number + 4-byte bitmap.
+    static const int ACK_BODY_SIZE = 6;
+    // Duplicate-detection window on the receive side.
+    static const int RECV_WINDOW = 1024;
+
+    // Constructor: windowSize is clamped to [1, RECV_WINDOW].
+    ReliableChannel(MySocket& socket, int windowSize, int initialSeq = 0);
+    ~ReliableChannel();
+
+    // Assign the next sequence number, compute the CRC and transmit.
+    // Returns false (and sends nothing) if the window is full.
+    bool Send(PktDef& pkt);
+
+    // Wait up to timeoutMs for the next new data packet, processing ACKs and
+    // retransmissions meanwhile. Returns true and fills out if one arrived.
+    bool Receive(PktDef& out, int timeoutMs);
+
+    // Keep servicing ACKs and retransmissions until everything sent has been
+    // acknowledged or timeoutMs passes. Returns true if nothing is in flight.
+    // Data packets that arrive meanwhile are held for the next Receive() calls.
+    bool Flush(int timeoutMs);
+
+    // Retransmit every packet whose timer has expired.
+    void Service();
+
+    // Retransmission limits.
+    void SetRtoLimits(int minRtoMs, int maxRtoMs);
+    void SetMaxRetries(int retries);
+
+    // Getters
+    int GetInFlight();
+    int GetRtoMs();
+    long long GetRetransmits();
+    long long GetDuplicates();
+    long long GetFailures();       // Packets given up on after MaxRetries.
+    LatencyHistogram& GetRttHistogram();  // Every RTT sample, in nanoseconds.
+
+private:
+    // One packet waiting for its ACK.
+    struct Slot {
+        vector<char> Raw;       // Serialized packet, kept for retransmission.
+        long long SentAtUs;     // Time of the latest transmission.
+        int Retries;            // Retransmissions so far.
+        bool InUse;
+        bool Acked;
+    };
+
+    static long long NowUs();
+    static short SeqDiff(unsigned short a, unsigned short b);
+
+    // Receive() without the held packets.
+    bool Poll(PktDef& out, int timeoutMs);
+    void HandleAck(PktDef& ack);
+    void AckSlot(unsigned short seq, bool sampleRtt);
+    void SendAck(unsigned short seq);
+    void AdvanceSendBase();
+    void UpdateRto(long long sampleUs);
+    long long NextTimeoutUs();
+
+    MySocket& Socket;
+    int WindowSize;
+    vector<Slot> Slots;             // Indexed by seq & SlotMask.
+    int SlotMask;
+    unsigned short SendBase;        // Oldest unacknowledged sequence number.
+    unsigned short NextSeq;         // Number given to the next Send().
+    unsigned short RecvBase;        // Next sequence number expected from the peer.
+    vector<char> RecvMarks;         // Packets held beyond RecvBase, indexed by seq % RECV_WINDOW.
+
+    long long SrttUs;               // Smoothed RTT (0 until the first sample).
+    long long RttVarUs;             // RTT variation.
+    long long RtoUs;                // Current retransmission timeout.
+    long long MinRtoUs;
+    long long MaxRtoUs;
+    int MaxRetries;
+
+    long long Retransmits;
+    long long Duplicates;
+    long long Failures;
+    LatencyHistogram RttHistogram;  // Exported as "rtt/<socket label>".
+
+    vector<char> RecvBuffer;        // Datagram receive buffer.
+    PktDef Incoming;                // Reused decode target.
+    PktDef AckPacket;               // Reused ACK packet.
+    deque<PktDef> Held;             // Acknowledged during Flush(), not yet returned.
+};
@@ -0,0 +1,458 @@
+#include "ShmTransport.h"
+#include "MySocket.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+using namespace std;
+
+// The segment is shared between processes, so its atomics must not hide a lock.
+static_assert(atomic<uint32_t>::is_always_lock_free, "Shared-memory rings need lock-free 32-bit atomics");
+
+static const uint32_t SHM_MAGIC = 0x534E4252;   // "RBNS"
+static const uint32_t SHM_VERSION = 1;
+// Iterations a receiver polls before sleeping on the futex (multi-core only).
+static const int SHM_SPIN_ITERATIONS = 20000;
+
+// One message. The sequence number follows Vyukov's bounded queue: a slot at
+// ring position pos is free while Seq == pos and full once Seq == pos + 1.
+struct ShmSlot {
+    atomic<uint32_t> Seq;
+    uint32_t Length;
+    uint32_t Session;   // Sender's session; stale messages are dropped.
+    uint32_t Reserved;
+    // Message bytes follow.
+};
+
+// Producer, consumer and wakeup words on separate cache lines.
+struct ShmRingHeader {
+    alignas(64) atomic<uint32_t> Tail;  // Next position to claim (senders).
+    alignas(64) atomic<uint32_t> Head;  // Next position to read (the receiver).
+    alignas(64) atomic<uint32_t> DataSignal;    // Futex word, bumped when a message is queued.
+    atomic<uint32_t> DataWaiters;               // Receivers asleep on DataSignal.
+    atomic<uint32_t> SpaceSignal;               // Futex word, bumped when a slot is freed.
+    atomic<uint32_t> SpaceWaiters;              // Senders asleep on SpaceSignal.
+    uint32_t SlotStride;
+    uint32_t SlotMask;
+    // SHM_RING_SLOTS slots follow.
+};
+
+// Start of the segment. The client-to-server ring and then the
+// server-to-client ring follow, RingBytes each.
+struct ShmSegment {
+    atomic<uint32_t> Magic;             // Written last by the server.
+    uint32_t Version;
+    uint32_t MaxSize;
+    uint32_t RingBytes;
+    alignas(64) atomic<uint32_t> Sessions;  // Futex word for Accept(); bumped on each Connect().
+    atomic<uint32_t> AcceptWaiters;
+    atomic<uint32_t> NextSession;
+    atomic<uint32_t> ClientSession;     // Session of the attached client, 0 if none.
+    atomic<int> ClientPid;
+    atomic<uint32_t> ServerClosed;      // Last session the server ended.
+    atomic<uint32_t> ServerGone;        // The server has been destroyed.
+};
+
+static long long NowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void CpuRelax() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#endif
+}
+
+// Sleep while signal still holds expected, for at most timeoutMs (-1 = no limit).
+// The words live in a MAP_SHARED mapping, so these are the process-shared
+// futex operations, not the _PRIVATE ones.
+static void FutexWait(atomic<uint32_t>& signal, uint32_t expected, long long timeoutMs) {
+#ifdef __linux__
+    timespec ts;
+    timespec* timeout = nullptr;
+    if (timeoutMs >= 0) {
+        ts.tv_sec = static_cast<time_t>(timeoutMs / 1000);
+        ts.tv_nsec = static_cast<long>(timeoutMs % 1000) * 1000000;
+        timeout = &ts;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&signal), FUTEX_WAIT, expected, timeout, nullptr, 0);
+#else
+    (void)signal;
+    (void)expected;
+    (void)timeoutMs;
+    this_thread::yield();
+#endif
+}
+
+static void FutexWake(atomic<uint32_t>& signal) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&signal), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)signal;
+#endif
+}
+
+// Wait until ready() holds or the deadline passes (returns false). Spins
+// first when there is another core to make progress, then parks on the futex
+// after announcing itself in waiters so Wake() knows to make the syscall.
+template <typename Ready>
+static bool WaitFor(atomic<uint32_t>& signal, atomic<uint32_t>& waiters, long long deadlineMs, Ready ready) {
+    if (ready())
+        return true;
+    static const bool spin = thread::hardware_concurrency() > 1;
+    if (spin && deadlineMs != 0) {
+        for (int i = 0; i < SHM_SPIN_ITERATIONS; ++i) {
+            CpuRelax();
+            if (ready())
+                return true;
+        }
+    }
+    for (;;) {
+        uint32_t seen = signal.load(memory_order_acquire);
+        waiters.fetch_add(1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        bool done = ready();
+        long long remaining = -1;
+        if (!done && deadlineMs >= 0)
+            remaining = deadlineMs - NowMs();
+        if (!done && (deadlineMs < 0 || remaining > 0))
+            FutexWait(signal, seen, remaining);
+        waiters.fetch_sub(1, memory_order_relaxed);
+        if (done || ready())
+            return true;
+        if (deadlineMs >= 0 && NowMs() >= deadlineMs)
+            return false;
+    }
+}
+
+// Pairs with WaitFor(): the fence orders the caller's publish before the
+// waiters check, so either the waiter sees the change or we see the waiter.
+static void Wake(atomic<uint32_t>& signal, atomic<uint32_t>& waiters) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (waiters.load(memory_order_relaxed) == 0)
+        return;
+    signal.fetch_add(1, memory_order_release);
+    FutexWake(signal);
+}
+
+static ShmSlot* SlotAt(ShmRingHeader* ring, uint32_t pos) {
+    return reinterpret_cast<ShmSlot*>(reinterpret_cast<char*>(ring) + sizeof(ShmRingHeader)
+        + static_cast<size_t>(pos & ring->SlotMask) * ring->SlotStride);
+}
+
+// Claim the slot at the tail for writing. Returns nullptr if the ring is full.
+static ShmSlot* Claim(ShmRingHeader* ring, uint32_t& pos) {
+    pos = ring->Tail.load(memory_order_relaxed);
+    for (;;) {
+        ShmSlot* slot = SlotAt(ring, pos);
+        int diff = static_cast<int>(slot->Seq.load(memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (ring->Tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                return slot;
+        }
+        else if (diff < 0) {
+            return nullptr;
+        }
+        else {
+            pos = ring->Tail.load(memory_order_relaxed);
+        }
+    }
+}
+
+static bool HasMessage(ShmRingHeader* ring) {
+    uint32_t pos = ring->Head.load(memory_order_relaxed);
+    return SlotAt(ring, pos)->Seq.load(memory_order_acquire) == pos + 1;
+}
+
+static bool HasSpace(ShmRingHeader* ring) {
+    uint32_t pos = ring->Tail.load(memory_order_relaxed);
+    return static_cast<int>(SlotAt(ring, pos)->Seq.load(memory_order_acquire) - pos) >= 0;
+}
+
+// Publish every slot between head and tail that was claimed but never filled,
+// as an empty message from session 0, which no receiver accepts. Only safe
+// while no live sender is using the ring.
+static void ReleaseAbandonedClaims(ShmRingHeader* ring) {
+    uint32_t tail = ring->Tail.load(memory_order_acquire);
+    for (uint32_t pos = ring->Head.load(memory_order_acquire); pos != tail; ++pos) {
+        ShmSlot* slot = SlotAt(ring, pos);
+        if (slot->Seq.load(memory_order_acquire) != pos)
+            continue;
+        slot->Length = 0;
+        slot->Session = 0;
+        slot->Seq.store(pos + 1, memory_order_release);
+    }
+}
+
+static size_t SlotStrideFor(int maxSize) {
+    return (sizeof(ShmSlot) + maxSize + 63) & ~static_cast<size_t>(63);
+}
+
+ShmTransport::ShmTransport(string ip, int port, int maxSize, bool server)
+    : Name("/robotnet-" + ip + "-" + to_string(port)), MaxSize(maxSize), Server(server), Fd(-1),
+    Segment(nullptr), MappedBytes(0), Outbox(nullptr), Inbox(nullptr), Session(0), LastSession(0)
+{
+    if (Server)
+        Map(true);
+}
+
+ShmTransport::~ShmTransport() {
+    if (Session)
+        Disconnect();
+    if (Segment && Server) {
+        Segment->ServerGone.store(1, memory_order_release);
+        Wake(Outbox->DataSignal, Outbox->DataWaiters);
+        Wake(Inbox->SpaceSignal, Inbox->SpaceWaiters);
+    }
+    Unmap();
+#ifdef __linux__
+    if (Server)
+        shm_unlink(Name.c_str());
+#endif
+}
+
+void ShmTransport::Map(bool create) {
+#ifdef __linux__
+    size_t ringBytes = sizeof(ShmRingHeader) + SlotStrideFor(MaxSize) * SHM_RING_SLOTS;
+    if (create) {
+        // Start from a fresh segment; clients of a previous server keep the old one.
+        shm_unlink(Name.c_str());
+        Fd = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (Fd < 0)
+            throw runtime_error("Failed to create shared-memory segment");
+        MappedBytes = sizeof(ShmSegment) + 2 * ringBytes;
+        if (ftruncate(Fd, static_cast<off_t>(MappedBytes)) != 0) {
+            close(Fd);
+            Fd = -1;
+            shm_unlink(Name.c_str());
+            throw runtime_error("Failed to size shared-memory segment");
+        }
+    }
+    else {
+        Fd = shm_open(Name.c_str(), O_RDWR, 0);
+        struct stat st;
+        if (Fd >= 0 && (fstat(Fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ShmSegment)))) {
+            close(Fd);
+            Fd = -1;
+        }
+        if (Fd < 0)
+            throw runtime_error("SHM Connect failed");
+        MappedBytes = static_cast<size_t>(st.st_size);
+    }
+    void* base = mmap(nullptr, MappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+    if (base == MAP_FAILED) {
+        close(Fd);
+        Fd = -1;
+        throw runtime_error("Failed to map shared-memory segment");
+    }
+    Segment = static_cast<ShmSegment*>(base);
+
+    if (create) {
+        // ftruncate() zero-filled everything; only the slot sequences need setting.
+        Segment->Version = SHM_VERSION;
+        Segment->MaxSize = static_cast<uint32_t>(MaxSize);
+        Segment->RingBytes = static_cast<uint32_t>(ringBytes);
+        for (int r = 0; r < 2; ++r) {
+            ShmRingHeader* ring = reinterpret_cast<ShmRingHeader*>(reinterpret_cast<char*>(base) + sizeof(ShmSegment) + r * ringBytes);
+            ring->SlotStride = static_cast<uint32_t>(SlotStrideFor(MaxSize));
+            ring->SlotMask = SHM_RING_SLOTS - 1;
+            for (uint32_t i = 0; i < static_cast<uint32_t>(SHM_RING_SLOTS); ++i)
+                SlotAt(ring, i)->Seq.store(i, memory_order_relaxed);
+        }
+        Segment->Magic.store(SHM_MAGIC, memory_order_release);
+    }
+    else if (Segment->Magic.load(memory_order_acquire) != SHM_MAGIC || Segment->Version != SHM_VERSION
+        || MappedBytes < sizeof(ShmSegment) + 2 * static_cast<size_t>(Segment->RingBytes)) {
+        Unmap();
+        throw runtime_error("SHM Connect failed: segment is not a RobotNet ring");
+    }
+    else {
+        // Messages must fit the server's slots.
+        MaxSize = static_cast<int>(Segment->MaxSize);
+    }
+
+    char* rings = reinterpret_cast<char*>(base) + sizeof(ShmSegment);
+    ShmRingHeader* toServer = reinterpret_cast<ShmRingHeader*>(rings);
+    ShmRingHeader* toClient = reinterpret_cast<ShmRingHeader*>(rings + Segment->RingBytes);
+    Inbox = Server ? toServer : toClient;
+    Outbox = Server ? toClient : toServer;
+#else
+    (void)create;
+    throw runtime_error("The shared-memory transport needs Linux");
+#endif
+}
+
+void ShmTransport::Unmap() {
+#ifdef __linux__
+    if (Segment)
+        munmap(Segment, MappedBytes);
+    if (Fd >= 0)
+        close(Fd);
+#endif
+    Segment = nullptr;
+    Fd = -1;
+    Inbox = nullptr;
+    Outbox = nullptr;
+}
+
+void ShmTransport::Connect() {
+    if (Server)
+        throw runtime_error("Connect called on the server side of a shared-memory link");
+    if (Session)
+        throw runtime_error("ConnectTCP called on a connected socket");
+    if (!Segment)
+        Map(false);
+    if (Segment->ServerGone.load(memory_order_acquire)) {
+        Unmap();
+        throw runtime_error("SHM Connect failed");
+    }
+
+    uint32_t session = Segment->NextSession.fetch_add(1, memory_order_relaxed) + 1;
+    if (session == 0)
+        session = Segment->NextSession.fetch_add(1, memory_order_relaxed) + 1;
+    uint32_t current = 0;
+    if (!Segment->ClientSession.compare_exchange_strong(current, session)) {
+#ifdef __linux__
+        // Take over from a client process that died without disconnecting.
+        int pid = Segment->ClientPid.load(memory_order_relaxed);
+        bool dead = pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+        if (!dead || !Segment->ClientSession.compare_exchange_strong(current, session))
+#endif
+            throw runtime_error("SHM Connect failed: the server already has a client");
+#ifdef __linux__
+        // The dead client may have been killed between claiming a slot and
+        // publishing it, which would stall the server's ring for good.
+        ReleaseAbandonedClaims(Outbox);
+        Wake(Outbox->DataSignal, Outbox->DataWaiters);
+#endif
+    }
+#ifdef __linux__
+    Segment->ClientPid.store(static_cast<int>(getpid()), memory_order_relaxed);
+#endif
+    Session = session;
+    Wake(Segment->Sessions, Segment->AcceptWaiters);
+}
+
+bool ShmTransport::Accept(long long deadlineMs) {
+    if (!Server)
+        throw runtime_error("Accept called on the client side of a shared-memory link");
+    if (Session)
+        LastSession = Session;  // Replaced, as accept() replaces a TCP connection.
+    Session = 0;
+    ShmSegment* segment = Segment;
+    uint32_t last = LastSession;
+    uint32_t session = 0;
+    bool accepted = WaitFor(segment->Sessions, segment->AcceptWaiters, deadlineMs, [segment, last, &session]() {
+        session = segment->ClientSession.load(memory_order_acquire);
+        return session != 0 && session != last;
+    });
+    if (!accepted)
+        return false;
+    Session = session;
+    return true;
+}
+
+void ShmTransport::Disconnect() {
+    if (!Session)
+        return;
+    if (Server) {
+        Segment->ServerClosed.store(Session, memory_order_release);
+        LastSession = Session;
+    }
+    else {
+        uint32_t expected = Session;
+        Segment->ClientSession.compare_exchange_strong(expected, 0);
+    }
+    Session = 0;
+    // Wake a peer blocked receiving from us or sending to us so it sees the close.
+    Wake(Outbox->DataSignal, Outbox->DataWaiters);
+    Wake(Inbox->SpaceSignal, Inbox->SpaceWaiters);
+}
+
+bool ShmTransport::PeerClosed() {
+    if (!Session)
+        return true;
+    if (Server)
+        return Segment->ClientSession.load(memory_order_acquire) != Session;
+    return Segment->ServerGone.load(memory_order_acquire) != 0 || Segment->ServerClosed.load(memory_order_acquire) == Session;
+}
+
+int ShmTransport::Send(const IoSlice* slices, int count, long long deadlineMs) {
+    if (!Session)
+        throw runtime_error("SHM Send on an unconnected socket");
+    int total = 0;
+    for (int i = 0; i < count; ++i)
+        total += slices[i].Length;
+    if (total > MaxSize)
+        throw runtime_error("Message is larger than the shared-memory slots");
+
+    uint32_t pos;
+    ShmSlot* slot;
+    while ((slot = Claim(Outbox, pos)) == nullptr) {
+        if (PeerClosed())
+            throw runtime_error("SHM Send failed");
+        ShmRingHeader* ring = Outbox;
+        if (!WaitFor(ring->SpaceSignal, ring->SpaceWaiters, deadlineMs, [this, ring]() { return HasSpace(ring) || PeerClosed(); }))
+            return -1;
+    }
+    char* dest = reinterpret_cast<char*>(slot + 1);
+    for (int i = 0; i < count; ++i) {
+        memcpy(dest, slices[i].Data, slices[i].Length);
+        dest += slices[i].Length;
+    }
+    slot->Length = static_cast<uint32_t>(total);
+    slot->Session = Session;
+    slot->Seq.store(pos + 1, memory_order_release);
+    Wake(Outbox->DataSignal, Outbox->DataWaiters);
+    return total;
+}
+
+int ShmTransport::Receive(char* dest, int capacity, long long deadlineMs) {
+    if (!Session)
+        throw runtime_error("SHM Receive on an unconnected socket");
+    for (;;) {
+        uint32_t pos = Inbox->Head.load(memory_order_relaxed);
+        ShmSlot* slot = SlotAt(Inbox, pos);
+        if (slot->Seq.load(memory_order_acquire) == pos + 1) {
+            // Sessions count up. A message from a later one means a new client
+            // has replaced ours; leave it for the next Accept().
+            if (static_cast<int>(slot->Session - Session) > 0)
+                return 0;
+            bool current = slot->Session == Session;
+            int length = static_cast<int>(slot->Length);
+            if (length > capacity)
+                length = capacity;
+            if (current)
+                memcpy(dest, slot + 1, length);
+            slot->Seq.store(pos + Inbox->SlotMask + 1, memory_order_release);
+            Inbox->Head.store(pos + 1, memory_order_relaxed);
+            Wake(Inbox->SpaceSignal, Inbox->SpaceWaiters);
+            if (current)
+                return length;
+            continue;   // Left over from an earlier session.
+        }
+        if (PeerClosed())
+            return 0;
+        if (!WaitForData(deadlineMs))
+            return -1;
+    }
+}
+
+bool ShmTransport::WaitForData(long long deadlineMs) {
+    ShmRingHeader* ring = Inbox;
+    if (!ring)
+        return false;
+    return WaitFor(ring->DataSignal, ring->DataWaiters, deadlineMs, [this, ring]() { return HasMessage(ring) || PeerClosed(); });
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <cstdint>
+using namespace std;
+
+struct IoSlice;
+struct ShmSegment;
+struct ShmRingHeader;
+
+// Messages per direction in a shared-memory segment (a power of two).
+static const int SHM_RING_SLOTS = 256;
+
+// Shared-memory link between two processes on the same host, used by
+// MySocket for the SHM ConnectionType.
+//
+// The SERVER creates a POSIX shared-memory segment named after ip:port (Linux
+// only); the CLIENT maps it in ConnectTCP(). The segment holds one ring per
+// direction of SHM_RING_SLOTS fixed-size slots, each holding one message of up
+// to maxSize bytes, so messages keep their boundaries like UDP datagrams. A
+// message is copied once into the ring and once out of it; nothing goes
+// through the kernel. Each ring is multi-producer, single-consumer: several
+// threads may send on one socket at once, but only one may receive.
+//
+// Every message is tagged with its session, and a receiver drops messages
+// from earlier sessions, so nothing queued before a reconnect reaches the
+// new peer. A client process that died without disconnecting is replaced by
+// the next Connect(), which also releases any slot it left half written.
+//
+// A receiver spins briefly and then sleeps on a futex; senders make the wake
+// syscall only when a receiver is actually asleep. A full ring makes senders
+// wait the same way.
+class ShmTransport {
+public:
+    // server: create (or recreate) the segment; otherwise attach in Connect().
+    ShmTransport(string ip, int port, int maxSize, bool server);
+    // The server also unlinks the segment.
+    ~ShmTransport();
+
+    // Client: map the segment and start a session. Throws if there is no
+    // server or it already has a client.
+    void Connect();
+    // Server: wait for a client to start a session. Returns false if the
+    // deadline passes first. Deadlines here are steady_clock milliseconds,
+    // as MySocket computes them; -1 means none.
+    bool Accept(long long deadlineMs);
+    // End the session; the peer's receives then return 0.
+    void Disconnect();
+
+    // Queue the slices as one message. Returns the bytes queued, or -1 if the
+    // ring stayed full until deadlineMs (0 = do not wait). Throws if the
+    // message is too large or the peer has gone.
+    int Send(const IoSlice* slices, int count, long long deadlineMs);
+    // Take the next message, truncated to capacity. Returns its length, 0 once
+    // the peer has closed and the ring holds nothing more from this session,
+    // or -1 on timeout.
+    int Receive(char* dest, int capacity, long long deadlineMs);
+    // Wait for a message or the peer closing. Returns false on timeout.
+    bool WaitForData(long long deadlineMs);
+    // The peer ended the session, or the server went away.
+    bool PeerClosed();
+
+private:
+    ShmTransport(const ShmTransport&);
+    ShmTransport& operator=(const ShmTransport&);
+
+    void Map(bool create);
+    void Unmap();
+
+    string Name;            // shm_open() name.
+    int MaxSize;
+    bool Server;
+    int Fd;
+    ShmSegment* Segment;    // Mapped segment, or nullptr.
+    size_t MappedBytes;
+    ShmRingHeader* Outbox;  // Ring this side sends on.
+    ShmRingHeader* Inbox;   // Ring this side receives from.
+    uint32_t Session;       // Session this side is in; 0 when not connected.
+    uint32_t LastSession;   // Server: the session it ended last, never accepted again.
+};
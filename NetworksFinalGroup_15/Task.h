@@ -0,0 +1,129 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+using namespace std;
+
+// Coroutine return type for the IoLoop socket API (AsyncSocket, IoLoop::Sleep).
+//
+// A Task is lazy: its body does not start until the Task is co_awaited or
+// handed to IoLoop::Spawn(). When it finishes, the awaiting coroutine is
+// resumed directly (symmetric transfer, so long chains of tasks that complete
+// without blocking do not grow the stack), and an exception thrown inside the
+// task is rethrown at the co_await. The Task owns its coroutine frame and
+// destroys it when it goes out of scope.
+template <typename T> class Task;
+
+class TaskPromiseBase {
+public:
+    // Called when a task that nobody awaits (a spawned one) finishes.
+    typedef void (*DoneCallback)(void* context, coroutine_handle<> handle);
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> handle) noexcept {
+            TaskPromiseBase& promise = handle.promise();
+            if (promise.Continuation)
+                return promise.Continuation;
+            if (promise.OnDone)
+                promise.OnDone(promise.DoneContext, handle);
+            return noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    TaskPromiseBase() : OnDone(nullptr), DoneContext(nullptr) {}
+
+    suspend_always initial_suspend() noexcept { return suspend_always(); }
+    FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+    void unhandled_exception() { Error = current_exception(); }
+
+    coroutine_handle<> Continuation;    // Coroutine awaiting this task, if any.
+    exception_ptr Error;
+    DoneCallback OnDone;
+    void* DoneContext;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& value) { Value.emplace(forward<U>(value)); }
+    T TakeResult() {
+        if (Error)
+            rethrow_exception(Error);
+        return move(*Value);
+    }
+
+private:
+    optional<T> Value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object();
+    void return_void() {}
+    void TakeResult() {
+        if (Error)
+            rethrow_exception(Error);
+    }
+};
+
+template <typename T>
+class Task {
+public:
+    typedef TaskPromise<T> promise_type;
+    typedef coroutine_handle<promise_type> Handle;
+
+    Task() : Frame(nullptr) {}
+    explicit Task(Handle frame) : Frame(frame) {}
+    Task(Task&& other) noexcept : Frame(other.Frame) { other.Frame = nullptr; }
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (Frame)
+                Frame.destroy();
+            Frame = other.Frame;
+            other.Frame = nullptr;
+        }
+        return *this;
+    }
+    ~Task() {
+        if (Frame)
+            Frame.destroy();
+    }
+
+    // Awaiting starts the task and resumes the caller with its result.
+    bool await_ready() const noexcept { return Frame.done(); }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        Frame.promise().Continuation = awaiting;
+        return Frame;
+    }
+    T await_resume() { return Frame.promise().TakeResult(); }
+
+    bool IsDone() const { return !Frame || Frame.done(); }
+    // Give up ownership of the frame (IoLoop::Spawn).
+    Handle Release() {
+        Handle frame = Frame;
+        Frame = nullptr;
+        return frame;
+    }
+
+private:
+    Task(const Task&);
+    Task& operator=(const Task&);
+
+    Handle Frame;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(Task<void>::Handle::from_promise(*this));
+}
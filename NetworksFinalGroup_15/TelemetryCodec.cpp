@@ -0,0 +1,251 @@
+#include "TelemetryCodec.h"
+#include <stdexcept>
+#include <cstring>
+using namespace std;
+
+// Delta body prefix: PktCount of the reference sample.
+static const int DELTA_PREFIX = 2;
+
+// How far a is ahead of b, allowing for PktCount wrapping at 16 bits.
+static int CountsAhead(unsigned short a, unsigned short b) {
+    return static_cast<short>(static_cast<unsigned short>(a - b));
+}
+
+// LEB128: 7 bits per byte, high bit set on all but the last.
+static char* PutVarint(char* dest, unsigned int value) {
+    while (value >= 0x80) {
+        *dest++ = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    *dest++ = static_cast<char>(value);
+    return dest;
+}
+
+// Returns false if the varint runs past end or does not fit in 32 bits.
+static bool GetVarint(const char*& src, const char* end, unsigned int& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && src < end; shift += 7) {
+        unsigned char b = static_cast<unsigned char>(*src++);
+        value |= static_cast<unsigned int>(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static int BodySize(PktDef& pkt) {
+    return pkt.GetLength() - PktDef::HEADERSIZE - Checksum::Size(pkt.GetCrcType());
+}
+
+TelemetryEncoder::TelemetryEncoder(int maxBody, int keyframeInterval)
+    : MaxBody(maxBody), KeyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1), SinceKeyframe(0),
+    HistoryCount(0), NextSlot(0), HasReference(false), Keyframes(0), Deltas(0), RawBytes(0), EncodedBytes(0)
+{
+    if (maxBody <= 0)
+        throw runtime_error("TelemetryEncoder needs a positive maxBody");
+    // Allocate up front so encoding never allocates.
+    for (int i = 0; i < TELEMETRY_HISTORY; ++i) {
+        History[i].Data.resize(MaxBody);
+        History[i].Count = 0;
+        History[i].Size = 0;
+    }
+    Reference.Data.resize(MaxBody);
+    Reference.Count = 0;
+    Reference.Size = 0;
+    // Runs stop being written once the delta reaches the sample size, so it
+    // never gets much past MaxBody.
+    Scratch.resize(DELTA_PREFIX + MaxBody + 16);
+}
+
+int TelemetryEncoder::BuildDelta(const char* sample, int size) {
+    const char* ref = Reference.Data.data();
+    char* start = Scratch.data();
+    char* out = start;
+    WireFormat::Store16(out, Reference.Count);
+    out += DELTA_PREFIX;
+
+    int i = 0;
+    while (i < size) {
+        int zeros = i;
+        while (i < size && sample[i] == ref[i])
+            ++i;
+        if (i == size)
+            break;      // Trailing unchanged bytes are left out.
+        zeros = i - zeros;
+
+        // Absorb single unchanged bytes between changes; a new run would cost more.
+        int first = i;
+        while (i < size && (sample[i] != ref[i] || (i + 1 < size && sample[i + 1] != ref[i + 1])))
+            ++i;
+        int n = i - first;
+
+        out = PutVarint(out, zeros);
+        out = PutVarint(out, n);
+        if (out - start + n >= size)
+            return -1;
+        for (int k = first; k < i; ++k)
+            *out++ = static_cast<char>(sample[k] ^ ref[k]);
+    }
+    int length = static_cast<int>(out - start);
+    return length < size ? length : -1;
+}
+
+void TelemetryEncoder::Encode(PktDef& pkt, const char* sample, int size) {
+    if (pkt.GetCmd() != PktDef::RESPONSE)
+        throw runtime_error("TelemetryEncoder only encodes RESPONSE packets");
+    if (size < 0 || size > MaxBody)
+        throw runtime_error("Telemetry sample is larger than maxBody");
+
+    unsigned short count = static_cast<unsigned short>(pkt.GetPktCount());
+    int deltaSize = -1;
+    if (HasReference && Reference.Size == size && SinceKeyframe < KeyframeInterval
+        && CountsAhead(count, Reference.Count) > 0 && CountsAhead(count, Reference.Count) < TELEMETRY_HISTORY)
+        deltaSize = BuildDelta(sample, size);
+
+    if (deltaSize >= 0) {
+        pkt.SetBodyData(Scratch.data(), deltaSize);
+        pkt.SetBodyCodec(BODY_DELTA);
+        ++SinceKeyframe;
+        ++Deltas;
+        EncodedBytes += deltaSize;
+    }
+    else {
+        pkt.SetBodyData(const_cast<char*>(sample), size);
+        pkt.SetBodyCodec(BODY_KEYFRAME);
+        SinceKeyframe = 0;
+        ++Keyframes;
+        EncodedBytes += size;
+    }
+    RawBytes += size;
+
+    // Remember what was sent so an ack for it can make it the reference.
+    Sample& slot = History[NextSlot];
+    slot.Count = count;
+    slot.Size = size;
+    memcpy(slot.Data.data(), sample, size);
+    NextSlot = (NextSlot + 1) % TELEMETRY_HISTORY;
+    if (HistoryCount < TELEMETRY_HISTORY)
+        ++HistoryCount;
+}
+
+void TelemetryEncoder::OnAck(int pktCount) {
+    unsigned short count = static_cast<unsigned short>(pktCount);
+    if (HasReference && CountsAhead(count, Reference.Count) <= 0)
+        return;     // Stale or duplicate ack.
+    for (int i = 0; i < HistoryCount; ++i) {
+        Sample& sent = History[i];
+        if (sent.Count != count)
+            continue;
+        Reference.Count = sent.Count;
+        Reference.Size = sent.Size;
+        memcpy(Reference.Data.data(), sent.Data.data(), sent.Size);
+        HasReference = true;
+        return;
+    }
+}
+
+void TelemetryEncoder::ForceKeyframe() {
+    // The receiver may have lost its history too, so start over.
+    HasReference = false;
+    HistoryCount = 0;
+    NextSlot = 0;
+}
+
+long long TelemetryEncoder::GetKeyframes() {
+    return Keyframes;
+}
+
+long long TelemetryEncoder::GetDeltas() {
+    return Deltas;
+}
+
+long long TelemetryEncoder::GetRawBytes() {
+    return RawBytes;
+}
+
+long long TelemetryEncoder::GetEncodedBytes() {
+    return EncodedBytes;
+}
+
+TelemetryDecoder::TelemetryDecoder(int maxBody)
+    : MaxBody(maxBody), HistoryCount(0), NextSlot(0), MissingReferences(0)
+{
+    if (maxBody <= 0)
+        throw runtime_error("TelemetryDecoder needs a positive maxBody");
+    for (int i = 0; i < TELEMETRY_HISTORY; ++i) {
+        History[i].Data.resize(MaxBody);
+        History[i].Count = 0;
+        History[i].Size = 0;
+    }
+}
+
+void TelemetryDecoder::Remember(unsigned short count, const char* data, int size) {
+    Sample& slot = History[NextSlot];
+    slot.Count = count;
+    slot.Size = size;
+    memcpy(slot.Data.data(), data, size);
+    NextSlot = (NextSlot + 1) % TELEMETRY_HISTORY;
+    if (HistoryCount < TELEMETRY_HISTORY)
+        ++HistoryCount;
+}
+
+int TelemetryDecoder::Decode(PktDef& pkt, char* dest, int capacity) {
+    const char* body = pkt.GetBodyData();
+    int bodySize = BodySize(pkt);
+    BodyCodec codec = pkt.GetBodyCodec();
+    unsigned short count = static_cast<unsigned short>(pkt.GetPktCount());
+
+    if (codec != BODY_DELTA) {
+        if (bodySize > capacity)
+            throw runtime_error("Telemetry sample does not fit the destination buffer");
+        if (bodySize > 0)
+            memcpy(dest, body, bodySize);
+        if (codec == BODY_KEYFRAME) {
+            if (bodySize > MaxBody)
+                throw runtime_error("Telemetry keyframe is larger than maxBody");
+            Remember(count, dest, bodySize);
+        }
+        return bodySize;
+    }
+
+    if (bodySize < DELTA_PREFIX)
+        throw runtime_error("Malformed telemetry delta");
+    unsigned short refCount = WireFormat::Load16(body);
+    const Sample* ref = nullptr;
+    for (int i = 0; i < HistoryCount; ++i) {
+        if (History[i].Count == refCount) {
+            ref = &History[i];
+            break;
+        }
+    }
+    if (!ref) {
+        ++MissingReferences;
+        return -1;
+    }
+    int size = ref->Size;
+    if (size > capacity)
+        throw runtime_error("Telemetry sample does not fit the destination buffer");
+
+    // Start from the reference and flip the changed bytes.
+    memcpy(dest, ref->Data.data(), size);
+    const char* in = body + DELTA_PREFIX;
+    const char* end = body + bodySize;
+    int pos = 0;
+    while (in < end) {
+        unsigned int zeros;
+        unsigned int n;
+        if (!GetVarint(in, end, zeros) || !GetVarint(in, end, n)
+            || zeros > static_cast<unsigned int>(size - pos) || n > static_cast<unsigned int>(size - pos) - zeros
+            || n > static_cast<unsigned int>(end - in))
+            throw runtime_error("Malformed telemetry delta");
+        pos += zeros;
+        for (unsigned int k = 0; k < n; ++k)
+            dest[pos++] ^= *in++;
+    }
+    Remember(count, dest, size);
+    return size;
+}
+
+long long TelemetryDecoder::GetMissingReferences() {
+    return MissingReferences;
+}
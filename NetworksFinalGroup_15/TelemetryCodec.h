@@ -0,0 +1,103 @@
+#pragma once
+#include "PktDef.h"
+#include <vector>
+using namespace std;
+
+// Samples each side remembers. A delta never refers further back than this,
+// so a decoder that has seen every packet always holds its reference.
+static const int TELEMETRY_HISTORY = 16;
+
+// Delta compression for periodic RESPONSE (telemetry) bodies.
+//
+// Consecutive telemetry samples differ in a few bytes, so instead of the whole
+// body the encoder sends the XOR of the new sample against a reference the
+// receiver is known to hold: the newest sample it has acknowledged. The XOR is
+// mostly zeros and goes on the wire as runs,
+//
+//   [reference PktCount u16] { [varint zeros][varint n][n XOR bytes] }...
+//
+// with the final run of zeros left out. A keyframe (the whole sample) is sent
+// instead while nothing has been acknowledged, when the size changes, when
+// the reference is more than TELEMETRY_HISTORY samples old, when the delta
+// would not be smaller, and every keyframeInterval packets.
+//
+// The choice is carried in the header's BodyCodec bits, so only enable this
+// with peers that understand them. Each sample needs its own PktCount.
+// Use one encoder per receiver.
+class TelemetryEncoder {
+public:
+    // maxBody is the largest sample; keyframeInterval forces a keyframe after
+    // that many deltas in a row.
+    TelemetryEncoder(int maxBody, int keyframeInterval = 64);
+
+    // Set pkt's body to sample, as a keyframe or a delta. pkt must be a
+    // RESPONSE with its PktCount already set; call CalcCRC() afterwards.
+    void Encode(PktDef& pkt, const char* sample, int size);
+    // The receiver acknowledged the packet with this PktCount. Its sample
+    // becomes the reference for later deltas if it is newer than the current one.
+    void OnAck(int pktCount);
+    // Send a keyframe next, e.g. after the receiver restarted.
+    void ForceKeyframe();
+
+    // Getters
+    long long GetKeyframes();
+    long long GetDeltas();
+    long long GetRawBytes();        // Sample bytes passed to Encode().
+    long long GetEncodedBytes();    // Body bytes actually sent.
+
+private:
+    struct Sample {
+        unsigned short Count;
+        int Size;
+        vector<char> Data;
+    };
+
+    // Write the delta of sample against Reference into Scratch. Returns its
+    // size, or -1 if it would not be smaller than the sample.
+    int BuildDelta(const char* sample, int size);
+
+    int MaxBody;
+    int KeyframeInterval;
+    int SinceKeyframe;
+    Sample History[TELEMETRY_HISTORY];  // Recently sent samples, for OnAck().
+    int HistoryCount;
+    int NextSlot;
+    Sample Reference;                   // Newest acknowledged sample.
+    bool HasReference;
+    vector<char> Scratch;
+
+    long long Keyframes;
+    long long Deltas;
+    long long RawBytes;
+    long long EncodedBytes;
+};
+
+// Receiving side of TelemetryEncoder. Use one decoder per sender.
+class TelemetryDecoder {
+public:
+    explicit TelemetryDecoder(int maxBody);
+
+    // Decode pkt's body into dest, which must hold capacity bytes, and return
+    // the sample size. Raw bodies are copied unchanged. Returns -1 if a delta
+    // refers to a sample this decoder does not hold (it missed the keyframe);
+    // do not acknowledge that packet. Throws on a malformed delta.
+    int Decode(PktDef& pkt, char* dest, int capacity);
+
+    // Getters
+    long long GetMissingReferences();
+
+private:
+    struct Sample {
+        unsigned short Count;
+        int Size;
+        vector<char> Data;
+    };
+
+    void Remember(unsigned short count, const char* data, int size);
+
+    int MaxBody;
+    Sample History[TELEMETRY_HISTORY];
+    int HistoryCount;
+    int NextSlot;
+    long long MissingReferences;
+};
@@ -0,0 +1,191 @@
+#include "UdpIngest.h"
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+using namespace std;
+
+// Default peer table limits; see SetPeerLimits().
+static const int PEER_IDLE_TIMEOUT_MS = 60000;
+static const int MAX_PEERS = 4096;
+
+// Peer table key: IPv4 address and port of the sender.
+static unsigned long long PeerKey(const sockaddr_in& addr) {
+    return (static_cast<unsigned long long>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+
+// Keep a shard's thread on one core so its socket's data stays in that
+// core's cache. Best effort; a restricted cpuset just leaves it floating.
+// Called by the shard's own thread, which must not look at its std::thread:
+// Start() may still be assigning it.
+static void PinCurrentThread(int index) {
+#ifdef __linux__
+    int cores = static_cast<int>(thread::hardware_concurrency());
+    if (cores <= 1)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cores, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)index;
+#endif
+}
+
+UdpIngest::UdpIngest(string ip, int port, int shards, Handler handler, int maxDatagram)
+    : PacketHandler(handler), MaxDatagram(maxDatagram > 0 ? maxDatagram : DEFAULT_SIZE), Running(false),
+    RejectedPeers(0), PeerIdleTimeoutNs(PEER_IDLE_TIMEOUT_MS * 1000000LL), MaxPeers(MAX_PEERS)
+{
+    if (shards < 1)
+        shards = static_cast<int>(thread::hardware_concurrency());
+    if (shards < 1)
+        shards = 1;
+    // The sockets join the port's group in this order, which is the order
+    // SteerByPayloadByte() indexes.
+    for (int i = 0; i < shards; ++i) {
+        unique_ptr<Shard> shard(new Shard);
+        shard->Socket.reset(new MySocket(SERVER, ip, static_cast<unsigned int>(port), UDP,
+            static_cast<unsigned int>(MaxDatagram), shards > 1));
+        shard->Received.store(0);
+        shard->LastSweepNs = 0;
+        Shards.push_back(move(shard));
+    }
+}
+
+UdpIngest::~UdpIngest() {
+    Stop();
+}
+
+void UdpIngest::SteerByPayloadByte(int offset) {
+    Shards[0]->Socket->SteerReusePort(offset, static_cast<int>(Shards.size()));
+}
+
+void UdpIngest::SetPeerLimits(int idleTimeoutMs, int maxPeers) {
+    PeerIdleTimeoutNs = idleTimeoutMs * 1000000LL;
+    MaxPeers = maxPeers > 0 ? maxPeers : 1;
+}
+
+void UdpIngest::Start(bool pinThreads) {
+    if (Running.exchange(true))
+        return;
+    for (size_t i = 0; i < Shards.size(); ++i)
+        Shards[i]->Reader = thread(&UdpIngest::Run, this, static_cast<int>(i), pinThreads);
+}
+
+void UdpIngest::Stop() {
+    if (!Running.exchange(false))
+        return;
+    for (unique_ptr<Shard>& shard : Shards) {
+        if (shard->Reader.joinable())
+            shard->Reader.join();
+    }
+}
+
+void UdpIngest::Run(int index, bool pin) {
+    Shard& shard = *Shards[index];
+    if (pin)
+        PinCurrentThread(index);
+
+    vector<char> storage(static_cast<size_t>(MaxDatagram) * MAX_BATCH);
+    UdpDatagram batch[MAX_BATCH];
+    for (int i = 0; i < MAX_BATCH; ++i) {
+        batch[i].Data = storage.data() + static_cast<size_t>(MaxDatagram) * i;
+        batch[i].Capacity = MaxDatagram;
+    }
+
+    while (Running.load(memory_order_relaxed)) {
+        long long now = MetricsNowNs();
+        if (now - shard.LastSweepNs >= STOP_POLL_MS * 1000000LL) {
+            lock_guard<mutex> guard(shard.PeerLock);
+            SweepIdlePeers(shard, now);
+        }
+        // One poll per batch of up to MAX_BATCH datagrams keeps Stop() prompt.
+        if (!shard.Socket->WaitForData(STOP_POLL_MS))
+            continue;
+        int received;
+        try {
+            received = shard.Socket->GetDataBatch(batch, MAX_BATCH);
+        }
+        catch (const runtime_error&) {
+            continue;
+        }
+
+        now = MetricsNowNs();
+        {
+            lock_guard<mutex> guard(shard.PeerLock);
+            for (int i = 0; i < received; ++i) {
+                unsigned long long key = PeerKey(batch[i].Addr);
+                auto found = shard.Peers.find(key);
+                if (found == shard.Peers.end() && static_cast<int>(shard.Peers.size()) >= MaxPeers) {
+                    // Make room from idle peers first.
+                    SweepIdlePeers(shard, now);
+                    if (static_cast<int>(shard.Peers.size()) >= MaxPeers) {
+                        RejectedPeers.fetch_add(1, memory_order_relaxed);
+                        continue;
+                    }
+                }
+                IngestPeer& peer = (found != shard.Peers.end()) ? found->second : shard.Peers[key];
+                if (peer.Packets == 0)
+                    peer.Addr = batch[i].Addr;
+                ++peer.Packets;
+                peer.Bytes += batch[i].Length;
+                peer.LastSeenNs = now;
+            }
+        }
+        shard.Received.fetch_add(received, memory_order_relaxed);
+
+        if (PacketHandler) {
+            for (int i = 0; i < received; ++i)
+                PacketHandler(index, batch[i].Data, batch[i].Length, batch[i].Addr);
+        }
+    }
+}
+
+void UdpIngest::SweepIdlePeers(Shard& shard, long long nowNs) {
+    shard.LastSweepNs = nowNs;
+    for (auto it = shard.Peers.begin(); it != shard.Peers.end();) {
+        if (nowNs - it->second.LastSeenNs >= PeerIdleTimeoutNs)
+            it = shard.Peers.erase(it);
+        else
+            ++it;
+    }
+}
+
+void UdpIngest::Reply(int shard, const sockaddr_in& to, const char* data, int length) {
+    UdpDatagram datagram;
+    datagram.Data = const_cast<char*>(data);
+    datagram.Length = length;
+    datagram.Capacity = length;
+    datagram.Addr = to;
+    Shards.at(shard)->Socket->SendBatch(&datagram, 1);
+}
+
+int UdpIngest::GetShardCount() {
+    return static_cast<int>(Shards.size());
+}
+
+long long UdpIngest::GetReceived(int shard) {
+    return Shards.at(shard)->Received.load(memory_order_relaxed);
+}
+
+long long UdpIngest::GetReceived() {
+    long long total = 0;
+    for (unique_ptr<Shard>& shard : Shards)
+        total += shard->Received.load(memory_order_relaxed);
+    return total;
+}
+
+long long UdpIngest::GetRejectedPeers() {
+    return RejectedPeers.load(memory_order_relaxed);
+}
+
+vector<IngestPeer> UdpIngest::GetPeers(int shard) {
+    Shard& s = *Shards.at(shard);
+    lock_guard<mutex> guard(s.PeerLock);
+    vector<IngestPeer> peers;
+    peers.reserve(s.Peers.size());
+    for (auto& entry : s.Peers)
+        peers.push_back(entry.second);
+    return peers;
+}
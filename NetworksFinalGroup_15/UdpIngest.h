@@ -0,0 +1,101 @@
+#pragma once
+#include "MySocket.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// What one shard knows about one sender.
+struct IngestPeer {
+    sockaddr_in Addr;
+    long long Packets;
+    long long Bytes;
+    long long LastSeenNs;   // MetricsNowNs() of its latest datagram.
+};
+
+// Multi-core UDP telemetry ingest on one port.
+//
+// A plain UDP server MySocket is one socket read by one thread, and GetData()
+// overwrites the socket's peer address with every sender, so two readers race
+// on it. UdpIngest opens one SO_REUSEPORT socket per shard on the same port
+// instead. The kernel spreads senders over them by a hash of the source
+// address, or by a payload byte (e.g. a robot id) after SteerByPayloadByte().
+// Each shard has its own receive thread, pinned to a core on Linux, reading
+// with GetDataBatch(), which reports every datagram's source without touching
+// the shared address, and its own peer table. Nothing is shared between
+// shards on the receive path, so throughput can grow with the number of cores.
+//
+// A peer is forgotten once it has been silent for the idle timeout, and each
+// shard tracks a limited number of peers, so spoofed source addresses cannot
+// grow the tables without bound. Datagrams from a sender that finds its
+// shard's table full of active peers still reach the handler; they are only
+// left out of the table and counted by GetRejectedPeers().
+//
+// Without SO_REUSEPORT (Windows) only one shard can be opened.
+class UdpIngest {
+public:
+    // Called on the shard's receive thread for every datagram.
+    typedef function<void(int shard, const char* data, int length, const sockaddr_in& from)> Handler;
+
+    // Shard receive threads wake at least this often to notice Stop().
+    static const int STOP_POLL_MS = 50;
+
+    // Binds shards sockets to ip:port right away; shards < 1 uses one per
+    // hardware thread. Datagrams larger than maxDatagram are truncated.
+    UdpIngest(string ip, int port, int shards, Handler handler, int maxDatagram = DEFAULT_SIZE);
+    // Stops the receive threads and closes the sockets.
+    ~UdpIngest();
+
+    // Steer by payload[offset] % shards instead of the sender's address, so
+    // each robot lands on the same shard whatever port it sends from. Linux
+    // only; throws elsewhere.
+    void SteerByPayloadByte(int offset);
+
+    // Peer table limits per shard; set them before Start(). Defaults: 60 s, 4096.
+    void SetPeerLimits(int idleTimeoutMs, int maxPeers);
+
+    // Start / stop the receive threads. Datagrams arriving before Start() wait
+    // in the socket buffers.
+    void Start(bool pinThreads = true);
+    void Stop();
+
+    // Send a reply to a peer through the shard socket that heard from it.
+    void Reply(int shard, const sockaddr_in& to, const char* data, int length);
+
+    // Getters
+    int GetShardCount();
+    long long GetReceived(int shard);
+    long long GetReceived();        // All shards.
+    long long GetRejectedPeers();   // Datagrams not tracked because a peer table was full.
+    // Snapshot of one shard's peer table.
+    vector<IngestPeer> GetPeers(int shard);
+
+private:
+    struct Shard {
+        unique_ptr<MySocket> Socket;
+        thread Reader;
+        atomic<long long> Received;
+        mutex PeerLock;
+        unordered_map<unsigned long long, IngestPeer> Peers;
+        long long LastSweepNs;
+    };
+
+    UdpIngest(const UdpIngest&);
+    UdpIngest& operator=(const UdpIngest&);
+
+    void Run(int index, bool pin);
+    // Forget the shard's idle peers; needs PeerLock held.
+    void SweepIdlePeers(Shard& shard, long long nowNs);
+
+    Handler PacketHandler;
+    int MaxDatagram;
+    vector<unique_ptr<Shard>> Shards;
+    atomic<bool> Running;
+    atomic<long long> RejectedPeers;
+    long long PeerIdleTimeoutNs;
+    int MaxPeers;
+};
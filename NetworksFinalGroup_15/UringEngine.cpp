@@ -0,0 +1,724 @@
+#include "UringEngine.h"
+#include "MySocket.h"
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+// Multishot receive is the newest feature used (Linux 6.0 headers).
+#if defined(__linux__) && defined(IORING_RECV_MULTISHOT)
+#define ROBOTNET_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+using namespace std;
+
+#ifndef ROBOTNET_URING
+
+bool UringEngine::IsSupported() {
+    return false;
+}
+
+UringEngine::UringEngine(SOCKET sock, bool stream, int maxSize, SocketCounters& counters)
+    : Sock(sock), Stream(stream), Counters(counters), SendRing(nullptr), Slots(nullptr), Gather(nullptr),
+    Staging(nullptr), SlotSize(maxSize), StagedInFlight(0), DirectPending(0), SendError(0),
+    RecvRing(nullptr), RecvBuffers(nullptr), RecvBufferSize(0), BufferRing(nullptr), BufferTail(0), Armed(false)
+{
+    throw runtime_error("io_uring is not supported on this platform");
+}
+
+UringEngine::~UringEngine() {}
+bool UringEngine::Send(const char*, int, const sockaddr_in*, long long) { return false; }
+int UringEngine::SendGather(const IoSlice*, int, const sockaddr_in*, bool) { return 0; }
+int UringEngine::SendBatch(UdpDatagram*, int) { return 0; }
+bool UringEngine::WaitForData(long long) { return false; }
+bool UringEngine::HasData() { return false; }
+int UringEngine::Receive(char*, int, sockaddr_in*, long long) { return -1; }
+int UringEngine::ReceiveBatch(UdpDatagram*, int, long long) { return -1; }
+
+#else
+
+// user_data of each request: a tag in the high word, a slot index in the low word.
+static const unsigned long long URING_TAG_STAGED = 1ULL << 32;
+static const unsigned long long URING_TAG_DIRECT = 2ULL << 32;
+static const unsigned long long URING_TAG_RECV = 3ULL << 32;
+static const unsigned long long URING_TAG_CANCEL = 4ULL << 32;
+static const unsigned long long URING_INDEX_MASK = 0xFFFFFFFFULL;
+
+// Direct slot of SendGather() and large sends; 0..MAX_BATCH-1 belong to SendBatch().
+static const int URING_GATHER = MAX_BATCH;
+// Slots entry holding the receive's msghdr.
+static const int URING_RECV_SLOT = URING_SEND_SLOTS + MAX_BATCH;
+// DirectResults value of a request still in flight.
+static const int URING_PENDING = INT_MIN;
+// Ring sizes. Every send is submitted straight away, so the send SQ never
+// holds more than a batch plus the staged slots.
+static const unsigned URING_SEND_ENTRIES = 256;
+static const unsigned URING_RECV_ENTRIES = 8;
+static const unsigned URING_RECV_CQ_ENTRIES = 4 * URING_RECV_BUFFERS;
+// How long the destructor lets staged sends and the receive wind down.
+static const int URING_DRAIN_MS = 200;
+
+// One mapped io_uring instance.
+struct UringRing {
+    int Fd;
+    int Sock;               // Target of every request.
+    void* RingMap;
+    size_t RingBytes;
+    io_uring_sqe* Sqes;
+    size_t SqeBytes;
+    unsigned* SqHead;
+    unsigned* SqTail;
+    unsigned* SqArray;
+    unsigned SqMask;
+    unsigned SqEntries;
+    unsigned* CqHead;
+    unsigned* CqTail;
+    unsigned CqMask;
+    io_uring_cqe* Cqes;
+    unsigned LocalTail;     // Next SQE to fill; published to the kernel on enter.
+};
+
+// Kernel-visible state of one sendmsg/recvmsg request.
+struct UringSlot {
+    msghdr Msg;
+    iovec Iov;
+    sockaddr_in Addr;
+    int Length;
+};
+
+struct UringGather {
+    msghdr Msg;
+    iovec Iov[MAX_BATCH];
+    sockaddr_in Addr;
+};
+
+static long long UringNowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int UringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int UringEnter(int fd, unsigned submit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, minComplete, flags, arg, argSize));
+}
+
+static int UringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static void CloseRing(UringRing* ring) {
+    if (!ring)
+        return;
+    if (ring->Sqes)
+        munmap(ring->Sqes, ring->SqeBytes);
+    if (ring->RingMap)
+        munmap(ring->RingMap, ring->RingBytes);
+    if (ring->Fd >= 0)
+        close(ring->Fd);
+    delete ring;
+}
+
+// Set up a ring whose requests go to sock.
+static UringRing* OpenRing(unsigned entries, unsigned cqEntries, SOCKET sock) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cqEntries;
+    int fd = UringSetup(entries, &params);
+    if (fd < 0)
+        throw runtime_error("io_uring_setup failed");
+    UringRing* ring = new UringRing();
+    ring->Fd = fd;
+    ring->Sock = sock;
+    // Timed waits pass their timeout through IORING_ENTER_EXT_ARG (Linux 5.11).
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        CloseRing(ring);
+        throw runtime_error("io_uring is too old");
+    }
+
+    size_t sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->RingBytes = sqBytes > cqBytes ? sqBytes : cqBytes;
+    void* map = mmap(nullptr, ring->RingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        CloseRing(ring);
+        throw runtime_error("io_uring ring mmap failed");
+    }
+    ring->RingMap = map;
+    ring->SqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+    map = mmap(nullptr, ring->SqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (map == MAP_FAILED) {
+        CloseRing(ring);
+        throw runtime_error("io_uring SQE mmap failed");
+    }
+    ring->Sqes = static_cast<io_uring_sqe*>(map);
+
+    char* base = static_cast<char*>(ring->RingMap);
+    ring->SqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    ring->SqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    ring->SqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    ring->SqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    ring->SqEntries = params.sq_entries;
+    ring->CqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    ring->CqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    ring->CqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    ring->Cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    ring->LocalTail = *ring->SqTail;
+    return ring;
+}
+
+// Claim the next SQE, zeroed and aimed at the socket.
+static io_uring_sqe* NextSqe(UringRing& ring) {
+    unsigned head = __atomic_load_n(ring.SqHead, __ATOMIC_ACQUIRE);
+    if (ring.LocalTail - head >= ring.SqEntries)
+        throw runtime_error("io_uring submission queue full");
+    unsigned index = ring.LocalTail & ring.SqMask;
+    io_uring_sqe* sqe = &ring.Sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = ring.Sock;
+    ring.SqArray[index] = index;
+    ++ring.LocalTail;
+    return sqe;
+}
+
+// Submit every claimed SQE and, with wait, block until a completion is
+// posted or deadlineMs passes. One syscall either way; callers look at the
+// completion queue and the clock afterwards to see which it was.
+static void RingEnter(UringRing& ring, bool wait, long long deadlineMs, SocketCounters& counters) {
+    __atomic_store_n(ring.SqTail, ring.LocalTail, __ATOMIC_RELEASE);
+    unsigned submit = ring.LocalTail - __atomic_load_n(ring.SqHead, __ATOMIC_ACQUIRE);
+    if (submit == 0 && !wait)
+        return;
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    io_uring_getevents_arg arg;
+    timespec ts;
+    void* argp = nullptr;
+    size_t argSize = 0;
+    if (wait && deadlineMs >= 0) {
+        long long remaining = deadlineMs - UringNowMs();
+        if (remaining < 0)
+            remaining = 0;
+        ts.tv_sec = static_cast<time_t>(remaining / 1000);
+        ts.tv_nsec = static_cast<long>((remaining % 1000) * 1000000);
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<unsigned long long>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argSize = sizeof(arg);
+    }
+    int rc = UringEnter(ring.Fd, submit, wait ? 1 : 0, flags, argp, argSize);
+    METRIC_ADD(counters.Syscalls, 1);
+    // ETIME: the wait timed out. EINTR: a signal. EAGAIN / EBUSY: the kernel is
+    // short of memory or completions must be reaped first. The caller loops.
+    if (rc < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        METRIC_ADD(counters.Errors, 1);
+        throw runtime_error("io_uring_enter failed");
+    }
+}
+
+// Hand every posted completion to handle, then release the CQ entries.
+template <typename Handler>
+static void DrainCompletions(UringRing& ring, Handler handle) {
+    unsigned head = *ring.CqHead;
+    unsigned tail = __atomic_load_n(ring.CqTail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return;
+    for (; head != tail; ++head)
+        handle(ring.Cqes[head & ring.CqMask]);
+    __atomic_store_n(ring.CqHead, head, __ATOMIC_RELEASE);
+}
+
+static void QueueCancel(UringRing& ring, unsigned long long userData, bool any) {
+    io_uring_sqe* sqe = NextSqe(ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->flags = 0;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->cancel_flags = any ? IORING_ASYNC_CANCEL_ANY : 0;
+    sqe->user_data = URING_TAG_CANCEL;
+}
+
+// Functional probe: a multishot recvmsg must deliver a datagram on a socketpair.
+static bool ProbeUring() {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) != 0)
+        return false;
+    bool works = false;
+    try {
+        SocketCounters counters;
+        UringEngine engine(pair[0], false, 64, counters);
+        char probe = 1;
+        char got[4];
+        if (send(pair[1], &probe, 1, 0) == 1)
+            works = engine.Receive(got, sizeof(got), nullptr, UringNowMs() + 1000) == 1;
+    }
+    catch (const runtime_error&) {
+        works = false;
+    }
+    close(pair[0]);
+    close(pair[1]);
+    return works;
+}
+
+bool UringEngine::IsSupported() {
+    static bool supported = ProbeUring();
+    return supported;
+}
+
+UringEngine::UringEngine(SOCKET sock, bool stream, int maxSize, SocketCounters& counters)
+    : Sock(sock), Stream(stream), Counters(counters), SendRing(nullptr), Slots(nullptr), Gather(nullptr),
+    Staging(nullptr), SlotSize(maxSize > 0 ? maxSize : DEFAULT_SIZE), StagedInFlight(0), DirectPending(0),
+    DirectResults(MAX_BATCH + 1, 0), SendError(0),
+    RecvRing(nullptr), RecvBuffers(nullptr), RecvBufferSize(0), BufferRing(nullptr), BufferTail(0), Armed(false)
+{
+    try {
+        SendRing = OpenRing(URING_SEND_ENTRIES, 2 * URING_SEND_ENTRIES, sock);
+        RecvRing = OpenRing(URING_RECV_ENTRIES, URING_RECV_CQ_ENTRIES, sock);
+        Slots = new UringSlot[URING_RECV_SLOT + 1]();
+        Gather = new UringGather();
+        Staging = new char[static_cast<size_t>(URING_SEND_SLOTS) * SlotSize];
+        for (int i = URING_SEND_SLOTS - 1; i >= 0; --i)
+            FreeSlots.push_back(i);
+
+        // A datagram lands behind the recvmsg header and the sender's address.
+        RecvBufferSize = SlotSize + static_cast<int>(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in));
+        RecvBuffers = new char[static_cast<size_t>(URING_RECV_BUFFERS) * RecvBufferSize];
+        // The buffer ring must be page aligned; the kernel pins it on registration.
+        void* ring = mmap(nullptr, URING_RECV_BUFFERS * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED)
+            throw runtime_error("io_uring buffer ring mmap failed");
+        BufferRing = ring;
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<unsigned long long>(BufferRing);
+        reg.ring_entries = URING_RECV_BUFFERS;
+        reg.bgid = 0;
+        if (UringRegister(RecvRing->Fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            throw runtime_error("io_uring buffer ring registration failed");
+        for (int i = 0; i < URING_RECV_BUFFERS; ++i)
+            RecycleBuffer(i);
+    }
+    catch (...) {
+        Close();
+        throw;
+    }
+}
+
+UringEngine::~UringEngine() {
+    Close();
+}
+
+void UringEngine::Close() {
+    if (SendRing) {
+        lock_guard<mutex> guard(SendLock);
+        try {
+            // Staged sends hold their own copy and may finish on their own;
+            // whatever is still stuck after that is cancelled, because the
+            // staging memory is about to go.
+            if (!WaitSends(NoneStaged, UringNowMs() + URING_DRAIN_MS)) {
+                QueueCancel(*SendRing, 0, true);
+                WaitSends(NoneStaged, UringNowMs() + URING_DRAIN_MS);
+            }
+        }
+        catch (const runtime_error&) {
+        }
+    }
+    if (RecvRing && Armed) {
+        try {
+            QueueCancel(*RecvRing, URING_TAG_RECV, false);
+            long long deadline = UringNowMs() + URING_DRAIN_MS;
+            while (Armed && UringNowMs() < deadline) {
+                RingEnter(*RecvRing, true, deadline, Counters);
+                ReapReceives();
+            }
+        }
+        catch (const runtime_error&) {
+        }
+    }
+    CloseRing(SendRing);
+    SendRing = nullptr;
+    CloseRing(RecvRing);
+    RecvRing = nullptr;
+    if (BufferRing)
+        munmap(BufferRing, URING_RECV_BUFFERS * sizeof(io_uring_buf));
+    BufferRing = nullptr;
+    delete[] RecvBuffers;
+    RecvBuffers = nullptr;
+    delete[] Staging;
+    Staging = nullptr;
+    delete[] Slots;
+    Slots = nullptr;
+    delete Gather;
+    Gather = nullptr;
+}
+
+bool UringEngine::NoneStaged(UringEngine& engine) {
+    return engine.StagedInFlight == 0;
+}
+
+bool UringEngine::SlotFree(UringEngine& engine) {
+    return !engine.FreeSlots.empty();
+}
+
+void UringEngine::ReapSends() {
+    DrainCompletions(*SendRing, [this](const io_uring_cqe& cqe) {
+        unsigned long long tag = cqe.user_data & ~URING_INDEX_MASK;
+        int index = static_cast<int>(cqe.user_data & URING_INDEX_MASK);
+        if (tag == URING_TAG_STAGED) {
+            FreeSlots.push_back(index);
+            --StagedInFlight;
+            // MSG_WAITALL makes a short stream send an error too.
+            if (SendError == 0 && (cqe.res < 0 || (Stream && cqe.res < Slots[index].Length)))
+                SendError = cqe.res < 0 ? -cqe.res : EPIPE;
+        }
+        else if (tag == URING_TAG_DIRECT) {
+            DirectResults[index] = cqe.res;
+            --DirectPending;
+        }
+    });
+}
+
+bool UringEngine::WaitSends(bool (*done)(UringEngine&), long long deadlineMs) {
+    for (;;) {
+        ReapSends();
+        if (done(*this))
+            return true;
+        if (deadlineMs >= 0 && UringNowMs() >= deadlineMs)
+            return false;
+        RingEnter(*SendRing, true, deadlineMs, Counters);
+    }
+}
+
+int UringEngine::WaitDirect(int index, long long deadlineMs) {
+    for (;;) {
+        ReapSends();
+        if (DirectResults[index] != URING_PENDING)
+            return DirectResults[index];
+        if (deadlineMs >= 0 && UringNowMs() >= deadlineMs) {
+            // The request reads the caller's memory, so it must be over
+            // before we return.
+            QueueCancel(*SendRing, URING_TAG_DIRECT | static_cast<unsigned>(index), false);
+            deadlineMs = -1;
+        }
+        RingEnter(*SendRing, true, deadlineMs, Counters);
+    }
+}
+
+void UringEngine::ThrowSendError() {
+    if (SendError == 0)
+        return;
+    SendError = 0;
+    METRIC_ADD(Counters.Errors, 1);
+    throw runtime_error("io_uring send failed");
+}
+
+void UringEngine::QueueGather(const IoSlice* slices, int count, const sockaddr_in* to, int flags) {
+    UringGather& gather = *Gather;
+    for (int i = 0; i < count; ++i) {
+        gather.Iov[i].iov_base = const_cast<char*>(slices[i].Data);
+        gather.Iov[i].iov_len = slices[i].Length;
+    }
+    memset(&gather.Msg, 0, sizeof(gather.Msg));
+    if (to) {
+        gather.Addr = *to;
+        gather.Msg.msg_name = &gather.Addr;
+        gather.Msg.msg_namelen = sizeof(gather.Addr);
+    }
+    gather.Msg.msg_iov = gather.Iov;
+    gather.Msg.msg_iovlen = count;
+
+    io_uring_sqe* sqe = NextSqe(*SendRing);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = reinterpret_cast<unsigned long long>(&gather.Msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | flags;
+    sqe->user_data = URING_TAG_DIRECT | URING_GATHER;
+    DirectResults[URING_GATHER] = URING_PENDING;
+    ++DirectPending;
+}
+
+bool UringEngine::Send(const char* data, int length, const sockaddr_in* to, long long deadlineMs) {
+    lock_guard<mutex> guard(SendLock);
+    ReapSends();
+    ThrowSendError();
+    // A stream keeps a single send in flight so its bytes stay in order.
+    if (Stream && !WaitSends(NoneStaged, deadlineMs))
+        return false;
+
+    if (length > SlotSize) {
+        IoSlice slice = { data, length };
+        QueueGather(&slice, 1, to, Stream ? MSG_WAITALL : 0);
+        int result = WaitDirect(URING_GATHER, deadlineMs);
+        if (result == -ECANCELED || (Stream && result >= 0 && result < length))
+            return false;
+        if (result < 0) {
+            METRIC_ADD(Counters.Errors, 1);
+            throw runtime_error("io_uring send failed");
+        }
+        return true;
+    }
+
+    if (!WaitSends(SlotFree, deadlineMs))
+        return false;
+    int index = FreeSlots.back();
+    FreeSlots.pop_back();
+    char* copy = Staging + static_cast<size_t>(index) * SlotSize;
+    memcpy(copy, data, length);
+    UringSlot& slot = Slots[index];
+    slot.Length = length;
+
+    io_uring_sqe* sqe = NextSqe(*SendRing);
+    if (Stream) {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = reinterpret_cast<unsigned long long>(copy);
+        sqe->len = static_cast<unsigned>(length);
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    }
+    else {
+        slot.Iov.iov_base = copy;
+        slot.Iov.iov_len = length;
+        memset(&slot.Msg, 0, sizeof(slot.Msg));
+        slot.Addr = *to;
+        slot.Msg.msg_name = &slot.Addr;
+        slot.Msg.msg_namelen = sizeof(slot.Addr);
+        slot.Msg.msg_iov = &slot.Iov;
+        slot.Msg.msg_iovlen = 1;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = reinterpret_cast<unsigned long long>(&slot.Msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+    sqe->user_data = URING_TAG_STAGED | static_cast<unsigned>(index);
+    ++StagedInFlight;
+    // Submit without waiting; on loopback the send usually completes inline.
+    RingEnter(*SendRing, false, -1, Counters);
+    return true;
+}
+
+int UringEngine::SendGather(const IoSlice* slices, int count, const sockaddr_in* to, bool dontWait) {
+    if (count > MAX_BATCH)
+        count = MAX_BATCH;
+    lock_guard<mutex> guard(SendLock);
+    ReapSends();
+    ThrowSendError();
+    if (Stream && !WaitSends(NoneStaged, dontWait ? UringNowMs() : -1))
+        return 0;
+    QueueGather(slices, count, to, dontWait ? MSG_DONTWAIT : 0);
+    int result = WaitDirect(URING_GATHER, -1);
+    if (result == -EAGAIN)
+        return 0;
+    if (result < 0) {
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("Gather send failed");
+    }
+    return result;
+}
+
+int UringEngine::SendBatch(UdpDatagram* datagrams, int count) {
+    lock_guard<mutex> guard(SendLock);
+    ReapSends();
+    ThrowSendError();
+    int sent = 0;
+    while (sent < count) {
+        int n = (count - sent < MAX_BATCH) ? count - sent : MAX_BATCH;
+        for (int i = 0; i < n; ++i) {
+            UdpDatagram& d = datagrams[sent + i];
+            UringSlot& slot = Slots[URING_SEND_SLOTS + i];
+            slot.Iov.iov_base = d.Data;
+            slot.Iov.iov_len = d.Length;
+            memset(&slot.Msg, 0, sizeof(slot.Msg));
+            slot.Msg.msg_name = &d.Addr;
+            slot.Msg.msg_namelen = sizeof(d.Addr);
+            slot.Msg.msg_iov = &slot.Iov;
+            slot.Msg.msg_iovlen = 1;
+            io_uring_sqe* sqe = NextSqe(*SendRing);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<unsigned long long>(&slot.Msg);
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = URING_TAG_DIRECT | static_cast<unsigned>(i);
+            DirectResults[i] = URING_PENDING;
+        }
+        DirectPending += n;
+        // The first wait submits the whole batch in one io_uring_enter; the
+        // rest normally find their completions already posted.
+        int ok = 0;
+        bool failed = false;
+        for (int i = 0; i < n; ++i) {
+            int result = WaitDirect(i, -1);
+            if (result < 0)
+                failed = true;
+            else if (!failed)
+                ++ok;
+        }
+        sent += ok;
+        if (failed)
+            break;
+    }
+    return sent;
+}
+
+void UringEngine::ArmReceive() {
+    io_uring_sqe* sqe = NextSqe(*RecvRing);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = URING_TAG_RECV;
+    if (Stream) {
+        sqe->opcode = IORING_OP_RECV;
+    }
+    else {
+        // Each buffer starts with io_uring_recvmsg_out and the sender's address.
+        msghdr& msg = Slots[URING_RECV_SLOT].Msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_namelen = sizeof(sockaddr_in);
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->addr = reinterpret_cast<unsigned long long>(&msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_TRUNC;
+    }
+    Armed = true;
+}
+
+void UringEngine::ReapReceives() {
+    DrainCompletions(*RecvRing, [this](const io_uring_cqe& cqe) {
+        if (cqe.user_data != URING_TAG_RECV)
+            return;
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+            Armed = false;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            int id = static_cast<int>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0) {
+                UringReceived received = { id, cqe.res, 0 };
+                Ready.push_back(received);
+                return;
+            }
+            RecycleBuffer(id);
+        }
+        // Out of buffers, or cancelled: the next wait arms the receive again.
+        if (cqe.res == -ENOBUFS || cqe.res == -ECANCELED)
+            return;
+        // End of stream (0) or a socket error.
+        UringReceived end = { -1, cqe.res, 0 };
+        Ready.push_back(end);
+    });
+}
+
+bool UringEngine::WaitReceive(long long deadlineMs) {
+    for (;;) {
+        ReapReceives();
+        if (!Ready.empty())
+            return true;
+        if (deadlineMs >= 0 && UringNowMs() >= deadlineMs)
+            return false;
+        if (!Armed)
+            ArmReceive();
+        RingEnter(*RecvRing, true, deadlineMs, Counters);
+    }
+}
+
+void UringEngine::RecycleBuffer(int id) {
+    // Index the entries by hand: in C++ the header's flexible array member
+    // does not start at offset 0. The ring tail overlays bufs[0].resv.
+    io_uring_buf* bufs = static_cast<io_uring_buf*>(BufferRing);
+    io_uring_buf& buf = bufs[BufferTail & (URING_RECV_BUFFERS - 1)];
+    buf.addr = reinterpret_cast<unsigned long long>(RecvBuffers + static_cast<size_t>(id) * RecvBufferSize);
+    buf.len = static_cast<unsigned>(RecvBufferSize);
+    buf.bid = static_cast<unsigned short>(id);
+    ++BufferTail;
+    __atomic_store_n(&bufs[0].resv, BufferTail, __ATOMIC_RELEASE);
+}
+
+bool UringEngine::WaitForData(long long deadlineMs) {
+    return WaitReceive(deadlineMs);
+}
+
+bool UringEngine::HasData() {
+    ReapReceives();
+    return !Ready.empty() && Ready.front().Buffer >= 0;
+}
+
+int UringEngine::TakeDatagram(char* dest, int capacity, sockaddr_in* from) {
+    UringReceived next = Ready.front();
+    Ready.pop_front();
+    char* buffer = RecvBuffers + static_cast<size_t>(next.Buffer) * RecvBufferSize;
+    const io_uring_recvmsg_out* out = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+    const int header = static_cast<int>(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in));
+    // payloadlen is the datagram's full size; only what fitted is in the buffer.
+    int length = next.Length - header;
+    if (length > static_cast<int>(out->payloadlen))
+        length = static_cast<int>(out->payloadlen);
+    if (length < 0)
+        length = 0;
+    int copied = (length < capacity) ? length : capacity;
+    memcpy(dest, buffer + header, copied);
+    if (from) {
+        memset(from, 0, sizeof(*from));
+        size_t nameBytes = (out->namelen < sizeof(sockaddr_in)) ? out->namelen : sizeof(sockaddr_in);
+        memcpy(from, buffer + sizeof(io_uring_recvmsg_out), nameBytes);
+    }
+    RecycleBuffer(next.Buffer);
+    return copied;
+}
+
+int UringEngine::Receive(char* dest, int capacity, sockaddr_in* from, long long deadlineMs) {
+    if (!WaitReceive(deadlineMs))
+        return -1;
+    if (Ready.front().Buffer < 0) {
+        // End of stream stays queued, so every later receive returns 0 too.
+        if (Ready.front().Length == 0)
+            return 0;
+        Ready.pop_front();
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("Receive failed");
+    }
+    if (!Stream)
+        return TakeDatagram(dest, capacity, from);
+
+    // Stream: copy from as many received buffers as fit, like one recv() would.
+    int copied = 0;
+    while (copied < capacity && !Ready.empty() && Ready.front().Buffer >= 0) {
+        UringReceived& next = Ready.front();
+        int n = next.Length - next.Offset;
+        if (n > capacity - copied)
+            n = capacity - copied;
+        memcpy(dest + copied, RecvBuffers + static_cast<size_t>(next.Buffer) * RecvBufferSize + next.Offset, n);
+        copied += n;
+        next.Offset += n;
+        if (next.Offset == next.Length) {
+            RecycleBuffer(next.Buffer);
+            Ready.pop_front();
+        }
+    }
+    return copied;
+}
+
+int UringEngine::ReceiveBatch(UdpDatagram* datagrams, int count, long long deadlineMs) {
+    if (!WaitReceive(deadlineMs))
+        return -1;
+    int taken = 0;
+    while (taken < count && !Ready.empty() && Ready.front().Buffer >= 0) {
+        UdpDatagram& d = datagrams[taken++];
+        d.Length = TakeDatagram(d.Data, d.Capacity, &d.Addr);
+    }
+    if (taken == 0) {
+        Ready.pop_front();
+        METRIC_ADD(Counters.Errors, 1);
+        throw runtime_error("Receive failed");
+    }
+    return taken;
+}
+
+#endif
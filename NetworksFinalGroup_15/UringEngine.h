@@ -0,0 +1,129 @@
+#pragma once
+#include "NetPlatform.h"
+#include "NetMetrics.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+struct IoSlice;
+struct UdpDatagram;
+struct UringRing;
+struct UringSlot;
+struct UringGather;
+
+// Kernel-selected receive buffers per socket (a power of two).
+static const int URING_RECV_BUFFERS = 64;
+// Messages that can be staged for sending at once.
+static const int URING_SEND_SLOTS = 64;
+
+// A receive completion not yet handed to the caller.
+struct UringReceived {
+    int Buffer;     // Provided buffer id, or -1 for end of stream / an error.
+    int Length;     // Bytes in the buffer, or 0 (end of stream) / -errno.
+    int Offset;     // Stream bytes already copied out of the buffer.
+};
+
+// io_uring I/O for one TCP connection or UDP socket, used by MySocket after
+// SetIoEngine(ENGINE_URING). Talks to the kernel through the raw
+// io_uring_setup/enter/register syscalls; there is no liburing dependency.
+//
+// Receiving arms one multishot recv (recvmsg for UDP) on a ring of
+// kernel-selected buffers registered with the ring. From then on the kernel
+// fills buffers and posts completions as data arrives, and a receive that
+// finds a completion already posted makes no syscall at all. Only an empty
+// completion queue costs an io_uring_enter to wait.
+//
+// Sends small enough for a staging slot are copied into it and submitted
+// without waiting, so the caller's buffer is free on return. A failed staged
+// send is reported by the next send. Batches put one submission entry per
+// datagram in a single io_uring_enter. Larger messages are sent straight from
+// the caller's memory and waited for. A stream never has two sends in flight,
+// so bytes cannot be reordered.
+//
+// Sending and receiving use separate rings, so one thread may send while
+// another receives. Only one thread may receive at a time. The kernel runs
+// receive completions on the thread that armed the receive; if that thread
+// exits, the receive is re-armed by the next one to call in.
+class UringEngine {
+public:
+    // True if io_uring is usable with multishot receive and provided buffer
+    // rings (Linux 6.0 or later), and not switched off by sysctl or seccomp.
+    // Probed once per process.
+    static bool IsSupported();
+
+    // Drive sock, which must stay open until the engine is destroyed. stream
+    // is true for a TCP connection. Messages of up to maxSize bytes are
+    // staged and received whole. Throws if the rings cannot be set up.
+    UringEngine(SOCKET sock, bool stream, int maxSize, SocketCounters& counters);
+    // Gives staged sends a moment to reach the socket, cancels the receive
+    // and closes the rings.
+    ~UringEngine();
+
+    // Send one message: to its destination for UDP, down the stream for
+    // TCP (to = nullptr). Returns false if deadlineMs passed first. Deadlines
+    // are steady_clock milliseconds, as MySocket computes them; -1 means
+    // none. Throws if this send or an earlier staged one failed.
+    bool Send(const char* data, int length, const sockaddr_in* to, long long deadlineMs);
+    // One sendmsg over the slices, waited for. With dontWait a full socket
+    // buffer returns 0 instead of waiting. Returns the bytes sent.
+    int SendGather(const IoSlice* slices, int count, const sockaddr_in* to, bool dontWait);
+    // Send up to MAX_BATCH datagrams per io_uring_enter. Returns the number sent.
+    int SendBatch(UdpDatagram* datagrams, int count);
+
+    // Wait for data or the end of the stream. Returns false on timeout.
+    bool WaitForData(long long deadlineMs);
+    // True if received bytes are waiting; never makes a syscall.
+    bool HasData();
+    // Copy out the next datagram (truncated to capacity) or up to capacity
+    // stream bytes; from, if given, gets a datagram's source. Returns the
+    // bytes, 0 at the end of the stream, or -1 on timeout.
+    int Receive(char* dest, int capacity, sockaddr_in* from, long long deadlineMs);
+    // Wait for the first datagram until deadlineMs, then take any others
+    // already received, up to count. Returns the number taken, or -1 on timeout.
+    int ReceiveBatch(UdpDatagram* datagrams, int count, long long deadlineMs);
+
+private:
+    UringEngine(const UringEngine&);
+    UringEngine& operator=(const UringEngine&);
+
+    void Close();
+    // Send side; SendLock must be held.
+    void ReapSends();
+    bool WaitSends(bool (*done)(UringEngine&), long long deadlineMs);
+    static bool NoneStaged(UringEngine& engine);
+    static bool SlotFree(UringEngine& engine);
+    void QueueGather(const IoSlice* slices, int count, const sockaddr_in* to, int flags);
+    int WaitDirect(int index, long long deadlineMs);
+    void ThrowSendError();
+    // Receive side.
+    void ArmReceive();
+    void ReapReceives();
+    bool WaitReceive(long long deadlineMs);
+    void RecycleBuffer(int id);
+    int TakeDatagram(char* dest, int capacity, sockaddr_in* from);
+
+    SOCKET Sock;
+    bool Stream;
+    SocketCounters& Counters;
+
+    mutex SendLock;
+    UringRing* SendRing;
+    UringSlot* Slots;           // Staged slots, then batch slots, then the receive's msghdr.
+    UringGather* Gather;        // sendmsg state for SendGather() and large sends.
+    char* Staging;              // URING_SEND_SLOTS slots of SlotSize bytes.
+    int SlotSize;
+    vector<int> FreeSlots;
+    int StagedInFlight;
+    int DirectPending;          // Direct sends submitted but not completed.
+    vector<int> DirectResults;  // Completion of each batch slot and the gather.
+    int SendError;              // errno of a failed staged send not reported yet.
+
+    UringRing* RecvRing;
+    char* RecvBuffers;          // URING_RECV_BUFFERS buffers of RecvBufferSize bytes.
+    int RecvBufferSize;
+    void* BufferRing;           // Shared with the kernel (io_uring_buf_ring).
+    unsigned short BufferTail;
+    bool Armed;                 // The multishot receive is live.
+    deque<UringReceived> Ready;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+// Explicit little-endian wire encoding.
+//
+// Every multi-byte value on the wire is little-endian regardless of the host,
+// so ARM and x86 controllers agree byte for byte. The shift-and-or forms below
+// have no branches and compile to a single load/store (plus bswap on a
+// big-endian host) with optimization on.
+namespace WireFormat {
+
+    inline void Store16(char* dest, uint16_t v) {
+        unsigned char* d = reinterpret_cast<unsigned char*>(dest);
+        d[0] = static_cast<unsigned char>(v);
+        d[1] = static_cast<unsigned char>(v >> 8);
+    }
+
+    inline void Store32(char* dest, uint32_t v) {
+        unsigned char* d = reinterpret_cast<unsigned char*>(dest);
+        d[0] = static_cast<unsigned char>(v);
+        d[1] = static_cast<unsigned char>(v >> 8);
+        d[2] = static_cast<unsigned char>(v >> 16);
+        d[3] = static_cast<unsigned char>(v >> 24);
+    }
+
+    inline void Store64(char* dest, uint64_t v) {
+        Store32(dest, static_cast<uint32_t>(v));
+        Store32(dest + 4, static_cast<uint32_t>(v >> 32));
+    }
+
+    inline uint16_t Load16(const char* src) {
+        const unsigned char* s = reinterpret_cast<const unsigned char*>(src);
+        return static_cast<uint16_t>(s[0] | (s[1] << 8));
+    }
+
+    inline uint32_t Load32(const char* src) {
+        const unsigned char* s = reinterpret_cast<const unsigned char*>(src);
+        return static_cast<uint32_t>(s[0]) | (static_cast<uint32_t>(s[1]) << 8)
+            | (static_cast<uint32_t>(s[2]) << 16) | (static_cast<uint32_t>(s[3]) << 24);
+    }
+
+    inline uint64_t Load64(const char* src) {
+        return static_cast<uint64_t>(Load32(src)) | (static_cast<uint64_t>(Load32(src + 4)) << 32);
+    }
+
+    // Typed access for the integer and floating-point types a schema may use.
+    // Signed values travel as two's complement; float/double as their IEEE-754 bits.
+    template <typename T, size_t Size = sizeof(T)>
+    struct LittleEndian;
+
+    template <typename T>
+    struct LittleEndian<T, 1> {
+        static void Store(char* dest, T v) { memcpy(dest, &v, 1); }
+        static T Load(const char* src) { T v; memcpy(&v, src, 1); return v; }
+    };
+
+    template <typename T>
+    struct LittleEndian<T, 2> {
+        static void Store(char* dest, T v) { uint16_t u; memcpy(&u, &v, 2); Store16(dest, u); }
+        static T Load(const char* src) { uint16_t u = Load16(src); T v; memcpy(&v, &u, 2); return v; }
+    };
+
+    template <typename T>
+    struct LittleEndian<T, 4> {
+        static void Store(char* dest, T v) { uint32_t u; memcpy(&u, &v, 4); Store32(dest, u); }
+        static T Load(const char* src) { uint32_t u = Load32(src); T v; memcpy(&v, &u, 4); return v; }
+    };
+
+    template <typename T>
+    struct LittleEndian<T, 8> {
+        static void Store(char* dest, T v) { uint64_t u; memcpy(&u, &v, 8); Store64(dest, u); }
+        static T Load(const char* src) { uint64_t u = Load64(src); T v; memcpy(&v, &u, 8); return v; }
+    };
+
+    // PktDef header: [PktCount lo][PktCount hi][flags], with the flag bits below.
+    const int HEADER_SIZE = 3;
+    const unsigned char FLAG_DRIVE = 0x01;
+    const unsigned char FLAG_STATUS = 0x02;
+    const unsigned char FLAG_SLEEP = 0x04;
+    const unsigned char FLAG_ACK = 0x08;
+    const int CRC_TYPE_SHIFT = 4;           // Bits 4-5: CrcAlgorithm of the trailer.
+    const unsigned char CRC_TYPE_MASK = 0x30;
+    const int BODY_CODEC_SHIFT = 6;         // Bits 6-7: BodyCodec of the body.
+    const unsigned char BODY_CODEC_MASK = 0xC0;
+}
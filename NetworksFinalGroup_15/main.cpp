@@ -0,0 +1,8 @@
+#include "MySocket.h"
+#include "PktDef.h"
+
+int main()
+{
+    
+    return 0;
+}
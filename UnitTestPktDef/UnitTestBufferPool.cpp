@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "BufferPool.cpp"
+#include "BufferPool.h"
+#include "PktDef.h"
+#include <cstdint>
+#include <thread>
+#include <vector>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    TEST_CLASS(UnitTestBufferPool)
+    {
+    public:
+        // Test that requests round up to their size class, stay 16-byte
+        // aligned, and that a freed block is the next one handed out.
+        TEST_METHOD(SizeClassTest)
+        {
+            char* small = BufferPool::Allocate(1);
+            Assert::AreEqual(BufferPool::MIN_CLASS_SIZE, BufferPool::Capacity(small));
+            char* medium = BufferPool::Allocate(65);
+            Assert::AreEqual(128, BufferPool::Capacity(medium));
+            char* largest = BufferPool::Allocate(BufferPool::MAX_CLASS_SIZE);
+            Assert::AreEqual(BufferPool::MAX_CLASS_SIZE, BufferPool::Capacity(largest));
+            Assert::AreEqual(0, static_cast<int>(reinterpret_cast<uintptr_t>(medium) % 16));
+
+            BufferPool::Free(medium);
+            Assert::IsTrue(BufferPool::Allocate(100) == medium, L"Same-thread frees are reused first");
+
+            long long large = BufferPool::GetStats().LargeBlocks;
+            char* oversized = BufferPool::Allocate(BufferPool::MAX_CLASS_SIZE + 1);
+            Assert::AreEqual(BufferPool::MAX_CLASS_SIZE + 1, BufferPool::Capacity(oversized));
+            Assert::AreEqual(large + 1, BufferPool::GetStats().LargeBlocks);
+
+            BufferPool::Free(small);
+            BufferPool::Free(medium);
+            BufferPool::Free(largest);
+            BufferPool::Free(oversized);
+            BufferPool::Free(nullptr);
+        }
+
+        // Test that blocks freed by another thread go back to the thread that
+        // allocated them and are reused without carving a new slab.
+        TEST_METHOD(CrossThreadFreeTest)
+        {
+            const int count = 8;
+            vector<char*> blocks;
+            for (int i = 0; i < count; ++i)
+                blocks.push_back(BufferPool::Allocate(BufferPool::MAX_CLASS_SIZE));
+            BufferPool::Stats before = BufferPool::GetStats();
+
+            thread consumer([&blocks]() {
+                for (char* block : blocks)
+                    BufferPool::Free(block);
+            });
+            consumer.join();
+
+            BufferPool::Stats after = BufferPool::GetStats();
+            Assert::AreEqual(before.RemoteFrees + count, after.RemoteFrees);
+            for (int i = 0; i < count; ++i)
+                blocks[i] = BufferPool::Allocate(BufferPool::MAX_CLASS_SIZE);
+            Assert::AreEqual(after.Slabs, BufferPool::GetStats().Slabs, L"Returned blocks are reused");
+            for (char* block : blocks)
+                BufferPool::Free(block);
+        }
+
+        // Test that a thread's cache outlives it: its blocks can still be freed
+        // and the next thread takes the cache over instead of creating one.
+        TEST_METHOD(ThreadExitTest)
+        {
+            char* leftover = nullptr;
+            thread first([&leftover]() { leftover = BufferPool::Allocate(200); });
+            first.join();
+            BufferPool::Stats before = BufferPool::GetStats();
+            BufferPool::Free(leftover);
+            Assert::AreEqual(before.RemoteFrees + 1, BufferPool::GetStats().RemoteFrees);
+
+            thread second([]() { BufferPool::Free(BufferPool::Allocate(200)); });
+            second.join();
+            Assert::AreEqual(before.Caches, BufferPool::GetStats().Caches, L"The orphaned cache was taken over");
+        }
+
+        // Test pooled objects, including a packet whose body lives in the pool,
+        // deleted on another thread, and the plain new[] path when disabled.
+        TEST_METHOD(PoolNewTest)
+        {
+            vector<char> body(512, 0x3C);
+            PktDef* pkt = PoolNew<PktDef>();
+            pkt->SetCmd(PktDef::RESPONSE);
+            pkt->SetBodyData(body.data(), static_cast<int>(body.size()));
+            pkt->CalcCRC();
+            Assert::IsTrue(pkt->CheckCRC(pkt->GenPacket(), pkt->GetLength()));
+            thread consumer([pkt]() { PoolDelete(pkt); });
+            consumer.join();
+
+            BufferPool::SetEnabled(false);
+            long long large = BufferPool::GetStats().LargeBlocks;
+            char* plain = BufferPool::Allocate(100);
+            BufferPool::SetEnabled(true);
+            Assert::AreEqual(large + 1, BufferPool::GetStats().LargeBlocks);
+            Assert::AreEqual(100, BufferPool::Capacity(plain));
+            BufferPool::Free(plain);
+        }
+    };
+}
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "BulkParser.cpp"
+#include "BulkParser.h"
+#include "PktFramer.h"
+#include "PktDef.h"
+#include <vector>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    // Append one framed packet to stream.
+    static void AppendFrame(vector<char>& stream, PktDef& pkt)
+    {
+        pkt.CalcCRC();
+        size_t offset = stream.size();
+        stream.resize(offset + PktFramer::PREFIXSIZE + pkt.GetLength());
+        PktFramer::Frame(pkt.GenPacket(), pkt.GetLength(), &stream[offset], pkt.GetLength() + PktFramer::PREFIXSIZE);
+    }
+
+    TEST_CLASS(UnitTestBulkParser)
+    {
+    public:
+        // Test column extraction for mixed commands and checksums, with zero-copy bodies.
+        TEST_METHOD(ColumnsTest)
+        {
+            vector<char> stream;
+            const CrcAlgorithm algs[] = { CRC_XOR, CRC_32C, CRC_16 };
+            for (int i = 0; i < 30; ++i) {
+                PktDef pkt;
+                pkt.SetPktCount(1000 + i);
+                pkt.SetCmd(i % 2 ? PktDef::SLEEP : PktDef::DRIVE);
+                pkt.SetAck(i % 3 == 0);
+                pkt.SetCrcType(algs[(i / 5) % 3]);
+                char body[40];
+                memset(body, i, sizeof(body));
+                pkt.SetBodyData(body, i);
+                AppendFrame(stream, pkt);
+            }
+
+            BulkParser parser(4);
+            Assert::AreEqual(30, parser.Parse(stream.data(), static_cast<int>(stream.size())));
+            Assert::AreEqual(static_cast<int>(stream.size()), parser.GetConsumed());
+            Assert::AreEqual(0, parser.GetInvalid());
+            const PacketColumns& cols = parser.GetColumns();
+            for (int i = 0; i < 30; ++i) {
+                Assert::AreEqual(1000 + i, static_cast<int>(cols.PktCount[i]));
+                Assert::AreEqual(i, static_cast<int>(cols.BodyLength[i]));
+                Assert::AreEqual(i % 3 == 0, parser.IsAck(i));
+                Assert::IsTrue(parser.GetCrcType(i) == algs[(i / 5) % 3]);
+                Assert::AreEqual(i % 2 ? 0x04 : 0x01, cols.Flags[i] & 0x07);
+                Assert::IsTrue(parser.GetBody(i) >= stream.data() && parser.GetBody(i) < stream.data() + stream.size());
+                if (i > 0)
+                    Assert::AreEqual(static_cast<char>(i), parser.GetBody(i)[i - 1]);
+            }
+        }
+
+        // Test that corrupt packets are flagged individually and a trailing partial frame is left over.
+        TEST_METHOD(CorruptAndPartialTest)
+        {
+            vector<char> stream;
+            for (int i = 0; i < 12; ++i) {
+                PktDef pkt;
+                pkt.SetPktCount(i);
+                pkt.SetCrcType(CRC_32C);
+                char body[16] = { 1, 2, 3 };
+                pkt.SetBodyData(body, sizeof(body));
+                AppendFrame(stream, pkt);
+            }
+            int frameSize = static_cast<int>(stream.size()) / 12;
+            stream[5 * frameSize + PktFramer::PREFIXSIZE + 4] ^= 0x40;
+            int complete = static_cast<int>(stream.size());
+            stream.push_back(20);
+            stream.push_back(0);
+            stream.push_back(7);
+
+            BulkParser parser;
+            Assert::AreEqual(12, parser.Parse(stream.data(), static_cast<int>(stream.size())));
+            Assert::AreEqual(complete, parser.GetConsumed());
+            Assert::AreEqual(1, parser.GetInvalid());
+            Assert::AreEqual(0, static_cast<int>(parser.GetColumns().Valid[5]));
+            Assert::AreEqual(1, static_cast<int>(parser.GetColumns().Valid[4]));
+        }
+
+        // Test that frames too short for a header are flagged without writing
+        // past the columns, which are sized from the buffer length.
+        TEST_METHOD(ShortMalformedFramesTest)
+        {
+            vector<char> stream;
+            for (int i = 0; i < 3000; ++i) {
+                const char frame[] = { 1, 0, 0x55 };
+                stream.insert(stream.end(), frame, frame + sizeof(frame));
+            }
+            const char three[] = { 3, 0, 0x01, 0x02, 0x03 };
+            stream.insert(stream.end(), three, three + sizeof(three));
+
+            BulkParser parser(1);
+            Assert::AreEqual(3001, parser.Parse(stream.data(), static_cast<int>(stream.size())));
+            Assert::AreEqual(3001, parser.GetInvalid());
+            Assert::AreEqual(static_cast<int>(stream.size()), parser.GetConsumed());
+            const PacketColumns& cols = parser.GetColumns();
+            Assert::IsTrue(cols.Valid.size() >= 3001);
+            Assert::AreEqual(0, static_cast<int>(cols.BodyLength[3000]));
+        }
+    };
+}
@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Checksum.cpp"
+#include "Checksum.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    TEST_CLASS(UnitTestChecksum)
+    {
+    public:
+        // Test each CRC against the standard check value for "123456789".
+        TEST_METHOD(CheckValuesTest)
+        {
+            const char input[] = "123456789";
+            Assert::AreEqual(0xD0u, Checksum::Compute(CRC_8, input, 9), L"CRC-8/ROHC check value");
+            Assert::AreEqual(0x906Eu, Checksum::Compute(CRC_16, input, 9), L"CRC-16/X-25 check value");
+            Assert::AreEqual(0xE3069283u, Checksum::Compute(CRC_32C, input, 9), L"CRC-32C check value");
+        }
+
+        // Test that feeding data in pieces gives the same result as one call,
+        // across lengths that exercise both the 8-byte and tail loops.
+        TEST_METHOD(IncrementalUpdateTest)
+        {
+            char data[300];
+            for (int i = 0; i < static_cast<int>(sizeof(data)); ++i)
+                data[i] = static_cast<char>(i * 31 + 7);
+
+            const CrcAlgorithm algs[] = { CRC_XOR, CRC_8, CRC_16, CRC_32C };
+            for (CrcAlgorithm alg : algs) {
+                unsigned int whole = Checksum::Compute(alg, data, sizeof(data));
+                unsigned int state = Checksum::Init(alg);
+                state = Checksum::Update(alg, state, data, 13);
+                state = Checksum::Update(alg, state, data + 13, 100);
+                state = Checksum::Update(alg, state, data + 113, sizeof(data) - 113);
+                Assert::AreEqual(whole, Checksum::Final(alg, state));
+            }
+        }
+
+        // Test that trailers round-trip through Store/Load at each width.
+        TEST_METHOD(StoreLoadTest)
+        {
+            char trailer[Checksum::MAX_SIZE];
+            Checksum::Store(CRC_32C, 0xA1B2C3D4u, trailer);
+            Assert::AreEqual(0xA1B2C3D4u, Checksum::Load(CRC_32C, trailer));
+            Assert::AreEqual(static_cast<int>(static_cast<unsigned char>(0xD4)), static_cast<int>(static_cast<unsigned char>(trailer[0])), L"Trailer must be little-endian");
+
+            Checksum::Store(CRC_16, 0xBEEFu, trailer);
+            Assert::AreEqual(0xBEEFu, Checksum::Load(CRC_16, trailer));
+            Assert::AreEqual(2, Checksum::Size(CRC_16));
+            Assert::AreEqual(1, Checksum::Size(CRC_XOR));
+        }
+
+        // Test that batched checksums match one-at-a-time results, including
+        // the interleaved CRC-32C path with unequal lengths.
+        TEST_METHOD(ComputeBatchTest)
+        {
+            char data[200];
+            for (int i = 0; i < static_cast<int>(sizeof(data)); ++i)
+                data[i] = static_cast<char>(i * 7 + 3);
+            const char* ptrs[9];
+            int sizes[9];
+            unsigned int out[9];
+            for (int i = 0; i < 9; ++i) {
+                ptrs[i] = data + i * 5;
+                sizes[i] = 3 + i * 17;
+            }
+
+            const CrcAlgorithm algs[] = { CRC_XOR, CRC_8, CRC_16, CRC_32C };
+            for (CrcAlgorithm alg : algs) {
+                Checksum::ComputeBatch(alg, ptrs, sizes, out, 9);
+                for (int i = 0; i < 9; ++i)
+                    Assert::AreEqual(Checksum::Compute(alg, ptrs[i], sizes[i]), out[i]);
+            }
+        }
+    };
+}
@@ -0,0 +1,184 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "CommandDispatcher.cpp"
+#include "CommandDispatcher.h"
+#include "PktDef.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    TEST_CLASS(UnitTestCommandDispatcher)
+    {
+    public:
+        // Test that every session sees its packets in PktCount order, never on two workers at once.
+        TEST_METHOD(PerSessionOrderTest)
+        {
+            const int sessions = 64;
+            const int perSession = 400;
+            vector<atomic<int>> busy(sessions);
+            vector<int> last(sessions, -1);
+            vector<int> seen(sessions, 0);
+            atomic<int> violations(0);
+            for (atomic<int>& b : busy)
+                b.store(0);
+
+            CommandDispatcher dispatcher(8, [&](unsigned long long session, PktDef& pkt) {
+                if (busy[session].fetch_add(1) != 0)
+                    violations.fetch_add(1);
+                // Counts start near the 16-bit wrap, so compare the unwrapped value.
+                int count = (pkt.GetPktCount() - 65400 + 65536) % 65536;
+                if (count <= last[session])
+                    violations.fetch_add(1);
+                last[session] = count;
+                ++seen[session];
+                busy[session].fetch_sub(1);
+            });
+            dispatcher.Start();
+
+            // Four I/O threads, each feeding its own quarter of the robots.
+            vector<thread> producers;
+            for (int p = 0; p < 4; ++p) {
+                producers.push_back(thread([&dispatcher, p, sessions, perSession]() {
+                    PktDef pkt;
+                    pkt.SetCmd(PktDef::DRIVE);
+                    for (int i = 0; i < perSession; ++i) {
+                        for (int s = p; s < sessions; s += 4) {
+                            pkt.SetPktCount(65400 + i);
+                            pkt.CalcCRC();
+                            dispatcher.Submit(static_cast<unsigned long long>(s), pkt.GenPacket(), pkt.GetLength());
+                        }
+                    }
+                }));
+            }
+            for (thread& t : producers)
+                t.join();
+            Assert::IsTrue(dispatcher.WaitIdle(10000), L"Dispatcher did not drain");
+            dispatcher.Stop();
+
+            Assert::AreEqual(0, violations.load());
+            Assert::AreEqual(static_cast<long long>(sessions * perSession), dispatcher.GetHandled());
+            for (int s = 0; s < sessions; ++s)
+                Assert::AreEqual(perSession, seen[s]);
+        }
+
+        // Test that a handler stuck on one robot does not hold up robots queued behind it.
+        TEST_METHOD(SlowHandlerStealTest)
+        {
+            const int fastSessions = 16;
+            atomic<bool> release(false);
+            atomic<int> fastDone(0);
+            CommandDispatcher dispatcher(2, [&](unsigned long long session, PktDef&) {
+                if (session == 0) {
+                    while (!release.load())
+                        this_thread::sleep_for(chrono::milliseconds(1));
+                }
+                else {
+                    fastDone.fetch_add(1);
+                }
+            });
+            dispatcher.Start();
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            dispatcher.Submit(0, pkt);
+            this_thread::sleep_for(chrono::milliseconds(20));
+            for (int s = 1; s <= fastSessions; ++s) {
+                for (int i = 1; i <= 10; ++i) {
+                    pkt.SetPktCount(i);
+                    dispatcher.Submit(static_cast<unsigned long long>(s), pkt);
+                }
+            }
+            for (int i = 0; i < 2000 && fastDone.load() < fastSessions * 10; ++i)
+                this_thread::sleep_for(chrono::milliseconds(1));
+            Assert::AreEqual(fastSessions * 10, fastDone.load());
+            Assert::IsTrue(dispatcher.GetSteals() > 0);
+            release.store(true);
+            Assert::IsTrue(dispatcher.WaitIdle(2000));
+        }
+
+        // Test decode-time rejection, reordering of a burst and dropping of late packets.
+        TEST_METHOD(ReorderAndRejectTest)
+        {
+            vector<int> counts;
+            CommandDispatcher dispatcher(1, [&](unsigned long long, PktDef& pkt) {
+                counts.push_back(pkt.GetPktCount());
+            });
+
+            PktDef pkt;
+            pkt.SetCmd(PktDef::SLEEP);
+            const int burst[] = { 7, 5, 6 };
+            for (int count : burst) {
+                pkt.SetPktCount(count);
+                pkt.CalcCRC();
+                Assert::IsTrue(dispatcher.Submit(42, pkt.GenPacket(), pkt.GetLength()));
+            }
+            char* raw = pkt.GenPacket();
+            raw[pkt.GetLength() - 1] ^= 0x5A;
+            Assert::IsFalse(dispatcher.Submit(42, raw, pkt.GetLength()));
+            Assert::AreEqual(1LL, dispatcher.GetRejected());
+
+            // Queued before Start(), so the worker sees the whole burst at once and sorts it.
+            dispatcher.Start();
+            Assert::IsTrue(dispatcher.WaitIdle(2000));
+            Assert::AreEqual(3, static_cast<int>(counts.size()));
+            Assert::AreEqual(5, counts[0]);
+            Assert::AreEqual(6, counts[1]);
+            Assert::AreEqual(7, counts[2]);
+
+            pkt.SetPktCount(6);
+            dispatcher.Submit(42, pkt);
+            Assert::IsTrue(dispatcher.WaitIdle(2000));
+            Assert::AreEqual(1LL, dispatcher.GetStale());
+            Assert::AreEqual(3, static_cast<int>(counts.size()));
+        }
+
+        // Test that a robot restarting its counts after EndSession() is heard
+        // again, and that ended sessions are freed.
+        TEST_METHOD(SessionRestartTest)
+        {
+            vector<int> delivered;
+            CommandDispatcher dispatcher(2, [&](unsigned long long, PktDef& pkt) {
+                delivered.push_back(pkt.GetPktCount());
+            });
+            dispatcher.Start();
+            PktDef pkt;
+            pkt.SetCmd(PktDef::DRIVE);
+            auto submit = [&](int count) {
+                pkt.SetPktCount(count);
+                dispatcher.Submit(7, pkt);
+            };
+
+            for (int count = 5000; count < 5010; ++count)
+                submit(count);
+            Assert::IsTrue(dispatcher.WaitIdle(5000));
+            // Without EndSession() a rebooted robot's counts are stale.
+            submit(0);
+            Assert::IsTrue(dispatcher.WaitIdle(5000));
+            Assert::AreEqual(1LL, dispatcher.GetStale());
+
+            // Packets submitted before the end are handled first; the
+            // reconnected robot's restarted counts follow.
+            submit(5010);
+            dispatcher.EndSession(7);
+            for (int count = 0; count < 5; ++count)
+                submit(count);
+            Assert::IsTrue(dispatcher.WaitIdle(5000));
+            Assert::AreEqual(1LL, dispatcher.GetStale());
+            Assert::AreEqual(16, static_cast<int>(delivered.size()));
+            Assert::AreEqual(5010, delivered[10]);
+            for (int count = 0; count < 5; ++count)
+                Assert::AreEqual(count, delivered[11 + count]);
+
+            dispatcher.EndSession(7);
+            dispatcher.EndSession(8);   // Unknown sessions are ignored.
+            Assert::IsTrue(dispatcher.WaitIdle(5000));
+            for (int i = 0; i < 200 && dispatcher.GetSessions() > 0; ++i)
+                this_thread::sleep_for(chrono::milliseconds(5));
+            Assert::AreEqual(0, dispatcher.GetSessions());
+            dispatcher.Stop();
+        }
+    };
+}
@@ -0,0 +1,81 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "NetMetrics.cpp"
+#include "NetMetrics.h"
+#include "PktDef.h"
+#include <cstdio>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    TEST_CLASS(UnitTestNetMetrics)
+    {
+    public:
+        // Test that bucket bounds stay within 1/SUB_BUCKETS of the recorded value.
+        TEST_METHOD(HistogramPrecisionTest)
+        {
+            const long long values[] = { 0, 1, 15, 16, 17, 100, 1000, 123456, 987654321, 1LL << 40 };
+            for (long long v : values) {
+                int index = LatencyHistogram::BucketIndex(static_cast<unsigned long long>(v));
+                Assert::IsTrue(index >= 0 && index < LatencyHistogram::BUCKET_COUNT);
+                unsigned long long upper = LatencyHistogram::BucketUpperBound(index);
+                Assert::IsTrue(upper >= static_cast<unsigned long long>(v));
+                Assert::IsTrue(upper - v <= static_cast<unsigned long long>(v) / LatencyHistogram::SUB_BUCKETS);
+            }
+        }
+
+        // Test percentiles over a known distribution.
+        TEST_METHOD(HistogramPercentileTest)
+        {
+            LatencyHistogram h;
+            for (int i = 1; i <= 1000; ++i)
+                h.Record(i * 1000);
+            Assert::AreEqual(1000ULL, h.GetCount());
+            Assert::AreEqual(1000000LL, h.GetMax());
+            long long p50 = h.Percentile(50.0);
+            long long p99 = h.Percentile(99.0);
+            Assert::IsTrue(p50 >= 500000 && p50 <= 500000 + 500000 / LatencyHistogram::SUB_BUCKETS);
+            Assert::IsTrue(p99 >= 990000 && p99 <= 1000000);
+            Assert::AreEqual(1000000LL, h.Percentile(100.0));
+        }
+
+        // Test that packet trace stamps are taken only while tracing is enabled,
+        // and that serializing leaves SendNs to the socket that sends the packet.
+        TEST_METHOD(PacketTraceTest)
+        {
+            PktDef tx;
+            tx.SetCmd(PktDef::DRIVE);
+            tx.CalcCRC();
+            char wire[64];
+            int n = tx.GenPacket(wire, sizeof(wire));
+            PktDef untraced(wire, n);
+            Assert::AreEqual(0LL, untraced.GetTrace().DecodeNs);
+
+            SetPacketTracing(true);
+            long long before = MetricsNowNs();
+            n = tx.GenPacket(wire, sizeof(wire));
+            PktDef rx(wire, n);
+            SetPacketTracing(false);
+            Assert::AreEqual(0LL, tx.GetTrace().SendNs);
+#ifdef ROBOTNET_METRICS
+            Assert::IsTrue(rx.GetTrace().DecodeNs >= before);
+#else
+            Assert::AreEqual(0LL, rx.GetTrace().DecodeNs);
+#endif
+        }
+
+        // Test the Prometheus dump of a registered histogram and its file export.
+        TEST_METHOD(PrometheusExportTest)
+        {
+            LatencyHistogram h;
+            h.Record(2000);
+            MetricsRegistry::Instance().Add("unit", &h);
+            string text = MetricsRegistry::Instance().RenderPrometheus();
+            Assert::IsTrue(text.find("robotnet_latency_ns_count{name=\"unit\"} 1") != string::npos);
+            Assert::IsTrue(MetricsRegistry::Instance().WritePrometheus("robotnet_metrics_test.prom"));
+            MetricsRegistry::Instance().Remove(&h);
+            Assert::IsTrue(MetricsRegistry::Instance().RenderPrometheus().find("name=\"unit\"") == string::npos);
+            remove("robotnet_metrics_test.prom");
+        }
+    };
+}
@@ -17,9 +17,23 @@ namespace Microsoft {
                 case PktDef::DRIVE:    return L"DRIVE";
                 case PktDef::SLEEP:    return L"SLEEP";
                 case PktDef::RESPONSE: return L"RESPONSE";
+                case PktDef::EXTENDED: return L"EXTENDED";
                 default:               return L"Unknown CmdType";
                 }
             }
+
+            template<>
+            wstring ToString<CrcAlgorithm>(const CrcAlgorithm& a)
+            {
+                switch (a)
+                {
+                case CRC_XOR:  return L"CRC_XOR";
+                case CRC_8:    return L"CRC_8";
+                case CRC_16:   return L"CRC_16";
+                case CRC_32C:  return L"CRC_32C";
+                default:       return L"Unknown CrcAlgorithm";
+                }
+            }
         }
     }
 }
@@ -118,5 +132,141 @@ namespace UnitTestPktDef
             char* generatedPacket = pkt.GenPacket();
             Assert::AreEqual(170, static_cast<int>(static_cast<unsigned char>(generatedPacket[3])), L"CRC value from overloaded constructor is incorrect");
         }
+
+        // Test the sized constructor that parses header, body and CRC from a complete packet.
+        TEST_METHOD(SizedConstructorTest)
+        {
+            PktDef tx;
+            tx.SetPktCount(77);
+            tx.SetCmd(PktDef::SLEEP);
+            const char testData[] = "xyz";
+            tx.SetBodyData(const_cast<char*>(testData), sizeof(testData));
+            tx.CalcCRC();
+            char* raw = tx.GenPacket();
+
+            PktDef rx(raw, tx.GetLength());
+            Assert::AreEqual(77, rx.GetPktCount());
+            Assert::AreEqual(PktDef::SLEEP, rx.GetCmd());
+            Assert::AreEqual(tx.GetLength(), rx.GetLength());
+            Assert::AreEqual(0, memcmp(rx.GetBodyData(), testData, sizeof(testData)));
+        }
+
+        // Test serializing into a caller-supplied buffer.
+        TEST_METHOD(GenPacketIntoBufferTest)
+        {
+            PktDef pkt;
+            pkt.SetPktCount(5);
+            pkt.SetCmd(PktDef::DRIVE);
+            PktDef::DriveBody body = { PktDef::LEFT, 2, 85 };
+            pkt.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+            pkt.CalcCRC();
+
+            char small[4];
+            Assert::AreEqual(0, pkt.GenPacket(small, sizeof(small)), L"Undersized buffer should not be written");
+
+            char wire[64];
+            int written = pkt.GenPacket(wire, sizeof(wire));
+            Assert::AreEqual(pkt.GetLength(), written);
+            Assert::AreEqual(0, memcmp(wire, pkt.GenPacket(), written), L"Both GenPacket forms should match");
+            Assert::IsTrue(pkt.CheckCRC(wire, written));
+        }
+
+        // Test that bodies larger than the inline buffer use the caller's arena.
+        TEST_METHOD(BodyArenaTest)
+        {
+            char arena[128];
+            char big[PktDef::INLINE_BODY_SIZE + 10];
+            memset(big, 0x42, sizeof(big));
+
+            PktDef pkt;
+            pkt.SetBodyArena(arena, sizeof(arena));
+            pkt.SetBodyData(big, sizeof(big));
+            Assert::IsTrue(pkt.GetBodyData() == arena, L"Large body should be stored in the arena");
+            Assert::AreEqual(0, memcmp(arena, big, sizeof(big)));
+
+            // A DRIVE-sized body stays inline and leaves the arena alone.
+            PktDef::DriveBody body = { PktDef::RIGHT, 1, 80 };
+            pkt.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+            Assert::IsFalse(pkt.GetBodyData() == arena);
+        }
+
+        // Test that copies own their body and do not alias the source object.
+        TEST_METHOD(CopyConstructorTest)
+        {
+            PktDef a;
+            a.SetPktCount(31);
+            const char testData[] = "copy";
+            a.SetBodyData(const_cast<char*>(testData), sizeof(testData));
+
+            PktDef b(a);
+            Assert::AreEqual(31, b.GetPktCount());
+            Assert::IsFalse(a.GetBodyData() == b.GetBodyData());
+            Assert::AreEqual(0, memcmp(b.GetBodyData(), testData, sizeof(testData)));
+        }
+
+        // Test that a CRC-32C packet round-trips and catches an error XOR would miss.
+        TEST_METHOD(Crc32cPacketTest)
+        {
+            PktDef pkt;
+            pkt.SetCrcType(CRC_32C);
+            pkt.SetCmd(PktDef::RESPONSE);
+            const char testData[] = "map tile";
+            pkt.SetBodyData(const_cast<char*>(testData), sizeof(testData));
+            pkt.CalcCRC();
+            Assert::AreEqual(PktDef::HEADERSIZE + static_cast<int>(sizeof(testData)) + 4, pkt.GetLength());
+
+            char wire[64];
+            int len = pkt.GenPacket(wire, sizeof(wire));
+            Assert::IsTrue(pkt.CheckCRC(wire, len));
+            PktDef rx(wire, len);
+            Assert::AreEqual(CRC_32C, rx.GetCrcType());
+            Assert::AreEqual(0, memcmp(rx.GetBodyData(), testData, sizeof(testData)));
+
+            // Flip the same bit in two body bytes: invisible to XOR, caught by CRC-32C.
+            wire[PktDef::HEADERSIZE] ^= 0x01;
+            wire[PktDef::HEADERSIZE + 1] ^= 0x01;
+            Assert::IsFalse(pkt.CheckCRC(wire, len));
+        }
+
+        // Test that packets without a CRC type still use the legacy XOR trailer.
+        TEST_METHOD(LegacyXorDefaultTest)
+        {
+            PktDef pkt;
+            Assert::AreEqual(CRC_XOR, pkt.GetCrcType());
+            const char testData[] = { 0x01, 0x02 };
+            pkt.SetBodyData(const_cast<char*>(testData), sizeof(testData));
+            pkt.CalcCRC();
+            char* raw = pkt.GenPacket();
+            unsigned char expected = 0;
+            for (int i = 0; i < pkt.GetLength() - 1; ++i)
+                expected ^= static_cast<unsigned char>(raw[i]);
+            Assert::AreEqual(static_cast<int>(expected), static_cast<int>(static_cast<unsigned char>(raw[pkt.GetLength() - 1])));
+        }
+
+        // Test that the header-only forms match the header GenPacket writes
+        // and that ParseHeader drops any previous body.
+        TEST_METHOD(HeaderOnlyTest)
+        {
+            PktDef pkt;
+            pkt.SetCmd(PktDef::SLEEP);
+            pkt.SetAck(true);
+            pkt.SetCrcType(CRC_16);
+            pkt.SetPktCount(513);
+            char body[] = { 9, 8, 7 };
+            pkt.SetBodyData(body, sizeof(body));
+            pkt.CalcCRC();
+            char header[PktDef::HEADERSIZE];
+            pkt.GenHeader(header);
+            Assert::AreEqual(0, memcmp(header, pkt.GenPacket(), PktDef::HEADERSIZE));
+
+            PktDef rx;
+            rx.SetBodyData(body, sizeof(body));
+            rx.ParseHeader(header);
+            Assert::IsTrue(rx.GetCmd() == PktDef::SLEEP);
+            Assert::IsTrue(rx.GetAck());
+            Assert::AreEqual(CRC_16, rx.GetCrcType());
+            Assert::AreEqual(513, rx.GetPktCount());
+            Assert::AreEqual(PktDef::HEADERSIZE + 2, rx.GetLength());
+        }
 	};
 }
@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "PktFramer.cpp"
+#include "PktFramer.h"
+#include "PktDef.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    TEST_CLASS(UnitTestPktFramer)
+    {
+    public:
+        // Test that a framed packet fed in one chunk comes back out unchanged.
+        TEST_METHOD(SingleFrameTest)
+        {
+            PktFramer framer(256, 0);
+            const char pkt[] = { 1, 0, 1, 'a', 'b', 'c', 0x5A };
+            char wire[32];
+            int wireLen = PktFramer::Frame(pkt, sizeof(pkt), wire, sizeof(wire));
+            Assert::AreEqual(static_cast<int>(sizeof(pkt)) + PktFramer::PREFIXSIZE, wireLen);
+
+            Assert::AreEqual(wireLen, framer.Feed(wire, wireLen));
+            char out[32];
+            Assert::AreEqual(static_cast<int>(sizeof(pkt)), framer.NextFrame(out, sizeof(out)));
+            Assert::AreEqual(0, memcmp(out, pkt, sizeof(pkt)));
+            Assert::AreEqual(0, framer.NextFrame(out, sizeof(out)), L"No second frame expected");
+        }
+
+        // Test that a packet split across chunks, even inside the prefix, is reassembled.
+        TEST_METHOD(PartialFrameTest)
+        {
+            PktFramer framer(256, 0);
+            const char pkt[] = { 7, 0, 4, 0x10 };
+            char wire[16];
+            int wireLen = PktFramer::Frame(pkt, sizeof(pkt), wire, sizeof(wire));
+
+            char out[16];
+            for (int i = 0; i < wireLen - 1; ++i) {
+                framer.Feed(wire + i, 1);
+                Assert::AreEqual(0, framer.NextFrame(out, sizeof(out)), L"Frame delivered before it was complete");
+            }
+            framer.Feed(wire + wireLen - 1, 1);
+            Assert::AreEqual(static_cast<int>(sizeof(pkt)), framer.NextFrame(out, sizeof(out)));
+        }
+
+        // Test that several packets coalesced into one chunk are split apart in order,
+        // including when the ring wraps around.
+        TEST_METHOD(CoalescedFramesTest)
+        {
+            PktFramer framer(16, 0);
+            char out[16];
+            for (int round = 0; round < 10; ++round) {
+                char wire[16];
+                int len = 0;
+                for (char id = 0; id < 2; ++id) {
+                    const char pkt[] = { id, 0, 1, static_cast<char>(round) };
+                    len += PktFramer::Frame(pkt, sizeof(pkt), wire + len, sizeof(wire) - len);
+                }
+                Assert::AreEqual(len, framer.Feed(wire, len));
+                for (char id = 0; id < 2; ++id) {
+                    Assert::AreEqual(4, framer.NextFrame(out, sizeof(out)));
+                    Assert::AreEqual(static_cast<int>(id), static_cast<int>(out[0]));
+                    Assert::AreEqual(round, static_cast<int>(out[3]));
+                }
+            }
+        }
+
+        // Test that an oversized packet is skipped and the stream stays in sync.
+        TEST_METHOD(OversizedFrameTest)
+        {
+            PktFramer framer(64, 8);
+            char big[20] = { 0 };
+            const char small[] = { 2, 0, 4, 0x33 };
+            char wire[64];
+            int len = PktFramer::Frame(big, sizeof(big), wire, sizeof(wire));
+            len += PktFramer::Frame(small, sizeof(small), wire + len, sizeof(wire) - len);
+
+            // Deliver the oversized packet in two pieces to exercise the discard path.
+            framer.Feed(wire, 10);
+            char out[16];
+            Assert::AreEqual(0, framer.NextFrame(out, sizeof(out)));
+            framer.Feed(wire + 10, len - 10);
+            Assert::AreEqual(static_cast<int>(sizeof(small)), framer.NextFrame(out, sizeof(out)));
+            Assert::AreEqual(0, memcmp(out, small, sizeof(small)));
+            Assert::AreEqual(1, framer.GetOversizedFrames());
+        }
+
+        // Test that a reassembled frame parses into a PktDef with its body intact.
+        TEST_METHOD(FrameToPktDefTest)
+        {
+            PktDef tx;
+            tx.SetPktCount(9);
+            tx.SetCmd(PktDef::DRIVE);
+            PktDef::DriveBody body = { PktDef::FORWARD, 5, 90 };
+            tx.SetBodyData(reinterpret_cast<char*>(&body), sizeof(body));
+            tx.CalcCRC();
+
+            char wire[64];
+            int len = PktFramer::Frame(tx.GenPacket(), tx.GetLength(), wire, sizeof(wire));
+            PktFramer framer(128, 0);
+            framer.Feed(wire, len);
+
+            char out[64];
+            int pktLen = framer.NextFrame(out, sizeof(out));
+            PktDef rx(out, pktLen);
+            Assert::AreEqual(9, rx.GetPktCount());
+            Assert::AreEqual(tx.GetLength(), rx.GetLength());
+            Assert::IsTrue(rx.CheckCRC(out, pktLen));
+            Assert::AreEqual(0, memcmp(rx.GetBodyData(), &body, sizeof(body)));
+        }
+    };
+}
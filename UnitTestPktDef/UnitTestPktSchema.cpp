@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Commands.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    TEST_CLASS(UnitTestPktSchema)
+    {
+    public:
+        // Test that fields land at fixed offsets in little-endian order.
+        TEST_METHOD(ExplicitLayoutTest)
+        {
+            TelemetryReport report = {};
+            report.TimestampMs = 0x11223344;
+            report.BatteryMv = 0x5566;
+            report.LeftRpm = -2;
+            report.TemperatureC = 1.0f;
+            char wire[TelemetryReport::Schema::Size];
+            TelemetryReport::Schema::Encode(report, wire);
+
+            const unsigned char expected[] = { 0x44, 0x33, 0x22, 0x11, 0x66, 0x55, 0xFE, 0xFF };
+            Assert::AreEqual(0, memcmp(expected, wire, sizeof(expected)));
+            // 1.0f is 0x3F800000.
+            Assert::AreEqual(0, memcmp("\x00\x00\x80\x3F", wire + 12, 4));
+        }
+
+        // Test a full EXTENDED packet round trip and rejection of mismatches.
+        TEST_METHOD(CommandRoundTripTest)
+        {
+            ArmCommand arm = { 3, -4500, 75 };
+            char wire[32];
+            int n = CommandCodec<ArmCommand>::Encode(arm, 0x0102, wire, sizeof(wire), CRC_16);
+            Assert::AreEqual(CommandCodec<ArmCommand>::PacketSize(CRC_16), n);
+            Assert::AreEqual(static_cast<int>(CMD_ARM), ExtendedCommandCode(wire, n));
+
+            ArmCommand decoded = {};
+            Assert::IsTrue(CommandCodec<ArmCommand>::Decode(wire, n, decoded));
+            Assert::AreEqual(3, static_cast<int>(decoded.Joint));
+            Assert::AreEqual(-4500, static_cast<int>(decoded.AngleCentiDeg));
+            Assert::AreEqual(75, static_cast<int>(decoded.Speed));
+
+            CameraCommand camera = {};
+            Assert::IsFalse(CommandCodec<CameraCommand>::Decode(wire, n, camera), L"Wrong command code accepted");
+            wire[4] ^= 0x01;
+            Assert::IsFalse(CommandCodec<ArmCommand>::Decode(wire, n, decoded), L"Corrupt packet accepted");
+            Assert::AreEqual(0, CommandCodec<ArmCommand>::Encode(arm, 0, wire, 4));
+        }
+
+        // Test that PktDef carries typed commands and parses packets built by the codec.
+        TEST_METHOD(PktDefInteropTest)
+        {
+            CameraCommand camera = { -900, 450, 4, 1 };
+            PktDef tx;
+            tx.SetPktCount(42);
+            CommandCodec<CameraCommand>::ToPacket(camera, tx);
+            tx.CalcCRC();
+            Assert::IsTrue(tx.GetCmd() == PktDef::EXTENDED);
+
+            char wire[32];
+            char direct[32];
+            int n = tx.GenPacket(wire, sizeof(wire));
+            Assert::AreEqual(n, CommandCodec<CameraCommand>::Encode(camera, 42, direct, sizeof(direct)));
+            Assert::AreEqual(0, memcmp(wire, direct, n), L"PktDef and codec disagree on the wire format");
+
+            PktDef rx(wire, n);
+            Assert::IsTrue(rx.CheckCRC(wire, n));
+            CameraCommand decoded = {};
+            Assert::IsTrue(CommandCodec<CameraCommand>::FromPacket(rx, decoded));
+            Assert::AreEqual(-900, static_cast<int>(decoded.PanCentiDeg));
+            Assert::AreEqual(450, static_cast<int>(decoded.TiltCentiDeg));
+            Assert::AreEqual(1, static_cast<int>(decoded.Capture));
+        }
+
+        // Test the explicit header layout and the DRIVE body schema.
+        TEST_METHOD(HeaderAndDriveLayoutTest)
+        {
+            PktDef pkt;
+            pkt.SetPktCount(0x1234);
+            pkt.SetCmd(PktDef::SLEEP);
+            pkt.SetAck(true);
+            pkt.SetCrcType(CRC_32C);
+            PktDef::DriveBody drive = { PktDef::LEFT, 5, 90 };
+            char body[DriveBodySchema::Size];
+            DriveBodySchema::Encode(drive, body);
+            pkt.SetBodyData(body, sizeof(body));
+            pkt.CalcCRC();
+
+            char wire[64];
+            pkt.GenPacket(wire, sizeof(wire));
+            Assert::AreEqual(0x34, static_cast<int>(static_cast<unsigned char>(wire[0])));
+            Assert::AreEqual(0x12, static_cast<int>(static_cast<unsigned char>(wire[1])));
+            // SLEEP (bit 2) | ACK (bit 3) | CRC_32C (3) << 4
+            Assert::AreEqual(0x3C, static_cast<int>(static_cast<unsigned char>(wire[2])));
+            Assert::AreEqual(static_cast<int>(PktDef::LEFT), static_cast<int>(wire[3]));
+            Assert::AreEqual(90, static_cast<int>(static_cast<unsigned char>(wire[11])));
+
+            PktDef::DriveBody decoded = {};
+            DriveBodySchema::Decode(wire + PktDef::HEADERSIZE, decoded);
+            Assert::AreEqual(5, decoded.Duration);
+            Assert::AreEqual(90, decoded.Speed);
+        }
+    };
+}
@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "TelemetryCodec.cpp"
+#include "TelemetryCodec.h"
+#include "Commands.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTestPktDef
+{
+    // Body of a TelemetryReport packet, as CommandCodec lays it out.
+    static const int REPORT_BODY = 1 + TelemetryReport::Schema::Size;
+
+    static void MakeReport(int i, char* body)
+    {
+        TelemetryReport report = { static_cast<unsigned int>(100000 + 50 * i), 12400, 300, -300,
+            static_cast<unsigned short>(9000 + (i % 4)), 36.5f };
+        if (i % 10 == 0)
+            report.BatteryMv -= 1;
+        body[0] = static_cast<char>(TelemetryReport::Code);
+        TelemetryReport::Schema::Encode(report, body + 1);
+    }
+
+    // Encode one sample into a RESPONSE packet and carry it across the wire.
+    static void SendSample(TelemetryEncoder& encoder, PktDef& received, int count, const char* sample, int size)
+    {
+        PktDef pkt;
+        pkt.SetCmd(PktDef::RESPONSE);
+        pkt.SetPktCount(count);
+        encoder.Encode(pkt, sample, size);
+        pkt.CalcCRC();
+        char* wire = pkt.GenPacket();
+        received.Parse(wire, pkt.GetLength());
+        Assert::IsTrue(received.CheckCRC(wire, pkt.GetLength()), L"CRC failed after encoding");
+    }
+
+    TEST_CLASS(UnitTestTelemetryCodec)
+    {
+    public:
+        // Test that the codec bits survive the wire and that a legacy header reads as raw.
+        TEST_METHOD(HeaderBitsTest)
+        {
+            PktDef pkt;
+            pkt.SetCmd(PktDef::RESPONSE);
+            pkt.SetPktCount(7);
+            char body[4] = { 1, 2, 3, 4 };
+            pkt.SetBodyData(body, sizeof(body));
+            Assert::IsTrue(pkt.GetBodyCodec() == BODY_RAW);
+            pkt.SetBodyCodec(BODY_DELTA);
+            pkt.SetCrcType(CRC_16);
+            pkt.CalcCRC();
+            char* wire = pkt.GenPacket();
+            Assert::AreEqual(static_cast<int>(BODY_DELTA), (static_cast<unsigned char>(wire[2]) & WireFormat::BODY_CODEC_MASK) >> WireFormat::BODY_CODEC_SHIFT);
+
+            PktDef parsed(wire, pkt.GetLength());
+            Assert::IsTrue(parsed.GetBodyCodec() == BODY_DELTA);
+            Assert::IsTrue(parsed.GetCrcType() == CRC_16);
+            Assert::IsTrue(parsed.CheckCRC(wire, pkt.GetLength()));
+
+            // A legacy RESPONSE header with bits 6-7 clear.
+            char legacy[] = { 1, 0, 0x02, 'o', 'k', 0 };
+            PktDef old(legacy, sizeof(legacy));
+            Assert::IsTrue(old.GetBodyCodec() == BODY_RAW);
+        }
+
+        // Test that acknowledged samples turn later packets into small deltas that
+        // decode back to the original samples.
+        TEST_METHOD(DeltaRoundTripTest)
+        {
+            TelemetryEncoder encoder(64);
+            TelemetryDecoder decoder(64);
+            char sample[REPORT_BODY];
+            char decoded[64];
+            PktDef received;
+            for (int i = 0; i < 100; ++i) {
+                MakeReport(i, sample);
+                SendSample(encoder, received, i + 1, sample, REPORT_BODY);
+                if (i == 0)
+                    Assert::IsTrue(received.GetBodyCodec() == BODY_KEYFRAME, L"First sample must be a keyframe");
+                int size = decoder.Decode(received, decoded, sizeof(decoded));
+                Assert::AreEqual(REPORT_BODY, size);
+                Assert::AreEqual(0, memcmp(sample, decoded, REPORT_BODY));
+                encoder.OnAck(received.GetPktCount());
+            }
+            Assert::IsTrue(encoder.GetDeltas() > 90, L"Expected nearly every sample to be a delta");
+            Assert::IsTrue(encoder.GetEncodedBytes() * 3 < encoder.GetRawBytes() * 2, L"Deltas should be well under the raw body size");
+            Assert::AreEqual(0LL, decoder.GetMissingReferences());
+        }
+
+        // Test that lost or delayed acks still decode, since the decoder keeps a
+        // history and the encoder only refers to acknowledged samples.
+        TEST_METHOD(LaggingAckTest)
+        {
+            TelemetryEncoder encoder(64);
+            TelemetryDecoder decoder(64);
+            char sample[REPORT_BODY];
+            char decoded[64];
+            PktDef received;
+            for (int i = 0; i < 200; ++i) {
+                MakeReport(i, sample);
+                SendSample(encoder, received, 65530 + i, sample, REPORT_BODY);   // Wraps past 65535.
+                Assert::AreEqual(REPORT_BODY, decoder.Decode(received, decoded, sizeof(decoded)));
+                Assert::AreEqual(0, memcmp(sample, decoded, REPORT_BODY));
+                // Only every fifth ack arrives, five packets late.
+                if (i >= 5 && i % 5 == 0)
+                    encoder.OnAck(65530 + i - 5);
+            }
+            Assert::IsTrue(encoder.GetDeltas() > 150);
+            Assert::AreEqual(0LL, decoder.GetMissingReferences());
+        }
+
+        // Test the fallbacks: keyframes without an ack, on a size change and on
+        // the keyframe interval; and -1 for a delta whose reference was missed.
+        TEST_METHOD(FallbackTest)
+        {
+            TelemetryEncoder encoder(64, 4);
+            char sample[REPORT_BODY];
+            PktDef received;
+
+            MakeReport(0, sample);
+            SendSample(encoder, received, 1, sample, REPORT_BODY);
+            SendSample(encoder, received, 2, sample, REPORT_BODY);
+            Assert::IsTrue(received.GetBodyCodec() == BODY_KEYFRAME, L"Nothing acked yet");
+
+            encoder.OnAck(2);
+            encoder.OnAck(1);       // Stale; must not move the reference back.
+            MakeReport(1, sample);
+            SendSample(encoder, received, 3, sample, REPORT_BODY);
+            Assert::IsTrue(received.GetBodyCodec() == BODY_DELTA);
+
+            // A decoder that never saw packet 2 cannot apply the delta.
+            TelemetryDecoder late(64);
+            char decoded[64];
+            Assert::AreEqual(-1, late.Decode(received, decoded, sizeof(decoded)));
+            Assert::AreEqual(1LL, late.GetMissingReferences());
+
+            SendSample(encoder, received, 4, sample, REPORT_BODY - 1);
+            Assert::IsTrue(received.GetBodyCodec() == BODY_KEYFRAME, L"Size changed");
+
+            // Interval of 4: after four deltas the next packet is a keyframe.
+            encoder.OnAck(4);
+            for (int i = 0; i < 4; ++i) {
+                SendSample(encoder, received, 5 + i, sample, REPORT_BODY - 1);
+                Assert::IsTrue(received.GetBodyCodec() == BODY_DELTA);
+            }
+            SendSample(encoder, received, 9, sample, REPORT_BODY - 1);
+            Assert::IsTrue(received.GetBodyCodec() == BODY_KEYFRAME, L"Keyframe interval");
+
+            encoder.ForceKeyframe();
+            SendSample(encoder, received, 10, sample, REPORT_BODY - 1);
+            Assert::IsTrue(received.GetBodyCodec() == BODY_KEYFRAME, L"Forced keyframe");
+
+            PktDef drive;
+            drive.SetCmd(PktDef::DRIVE);
+            Assert::ExpectException<runtime_error>([&]() { encoder.Encode(drive, sample, REPORT_BODY); });
+        }
+    };
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+// Minimal stand-in for Visual Studio's CppUnitTest.h so the MSTest suites can
+// be built and run as plain executables on Linux. Only the subset of the
+// framework used by this repository is provided.
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <typeinfo>
+
+namespace Microsoft {
+    namespace VisualStudio {
+        namespace CppUnitTestFramework {
+
+            // Thrown by a failed assertion; caught and reported by the runner.
+            struct AssertFailedException {
+                std::wstring Message;
+            };
+
+            // Converts a value to text for assertion messages. Tests specialize this
+            // for their own enums, exactly as with the real framework.
+            template <typename Q>
+            std::wstring ToString(const Q& q)
+            {
+                if constexpr (std::is_same<Q, bool>::value)
+                    return q ? L"true" : L"false";
+                else if constexpr (std::is_arithmetic<Q>::value)
+                    return std::to_wstring(q);
+                else if constexpr (std::is_same<Q, std::string>::value)
+                    return std::wstring(q.begin(), q.end());
+                else if constexpr (std::is_same<Q, std::wstring>::value)
+                    return q;
+                else if constexpr (std::is_pointer<Q>::value)
+                    return std::to_wstring(reinterpret_cast<unsigned long long>(q));
+                else
+                    static_assert(sizeof(Q) == 0, "Test writer must define specialization of ToString<Q> for your class");
+            }
+
+            class Assert {
+            public:
+                template <typename T>
+                static void AreEqual(const T& expected, const T& actual, const wchar_t* message = nullptr)
+                {
+                    if (!(expected == actual))
+                        Fail(L"AreEqual failed. Expected:<" + ToString(expected) + L"> Actual:<" +
+                            ToString(actual) + L"> " + (message ? message : L""));
+                }
+
+                template <typename T>
+                static void AreNotEqual(const T& notExpected, const T& actual, const wchar_t* message = nullptr)
+                {
+                    if (notExpected == actual)
+                        Fail(L"AreNotEqual failed. Value:<" + ToString(actual) + L"> " + (message ? message : L""));
+                }
+
+                static void IsTrue(bool condition, const wchar_t* message = nullptr)
+                {
+                    if (!condition)
+                        Fail(std::wstring(L"IsTrue failed. ") + (message ? message : L""));
+                }
+
+                static void IsFalse(bool condition, const wchar_t* message = nullptr)
+                {
+                    if (condition)
+                        Fail(std::wstring(L"IsFalse failed. ") + (message ? message : L""));
+                }
+
+                template <typename T>
+                static void IsNull(const T* p, const wchar_t* message = nullptr)
+                {
+                    if (p != nullptr)
+                        Fail(std::wstring(L"IsNull failed. ") + (message ? message : L""));
+                }
+
+                template <typename T>
+                static void IsNotNull(const T* p, const wchar_t* message = nullptr)
+                {
+                    if (p == nullptr)
+                        Fail(std::wstring(L"IsNotNull failed. ") + (message ? message : L""));
+                }
+
+                template <typename E, typename F>
+                static void ExpectException(F func, const wchar_t* message = nullptr)
+                {
+                    try {
+                        func();
+                    }
+                    catch (const E&) {
+                        return;
+                    }
+                    catch (...) {
+                        Fail(std::wstring(L"ExpectException caught an unexpected exception type. ") + (message ? message : L""));
+                    }
+                    Fail(std::wstring(L"ExpectException: no exception thrown. ") + (message ? message : L""));
+                }
+
+                static void Fail(const std::wstring& message)
+                {
+                    AssertFailedException e;
+                    e.Message = message;
+                    throw e;
+                }
+            };
+
+            // A registered test method.
+            struct TestEntry {
+                const char* ClassName;
+                const char* MethodName;
+                std::function<void()> Run;
+            };
+
+            inline std::vector<TestEntry>& TestRegistry()
+            {
+                static std::vector<TestEntry> entries;
+                return entries;
+            }
+
+            inline int RegisterTest(const char* className, const char* methodName, std::function<void()> run)
+            {
+                TestEntry entry = { className, methodName, run };
+                TestRegistry().push_back(entry);
+                return 0;
+            }
+
+            // Base for TEST_CLASS; gives TEST_METHOD access to the concrete class type.
+            template <typename T>
+            class TestClass {
+            public:
+                typedef T ThisClass;
+            };
+        }
+    }
+}
+
+#define TEST_CLASS(className) \
+    class className : public ::Microsoft::VisualStudio::CppUnitTestFramework::TestClass<className>
+
+#define TEST_METHOD(methodName) \
+    struct methodName##_Registrar { \
+        methodName##_Registrar() { \
+            ::Microsoft::VisualStudio::CppUnitTestFramework::RegisterTest(typeid(ThisClass).name(), #methodName, \
+                [] { ThisClass instance; instance.methodName(); }); \
+        } \
+    }; \
+    inline static methodName##_Registrar methodName##_registrar; \
+    void methodName()
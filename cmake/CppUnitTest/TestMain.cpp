@@ -0,0 +1,54 @@
+#include "CppUnitTest.h"
+#include <cstdio>
+#include <cxxabi.h>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+static std::string Demangle(const char* name)
+{
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    std::string result = (status == 0 && demangled) ? demangled : name;
+    free(demangled);
+    return result;
+}
+
+static std::string Narrow(const std::wstring& text)
+{
+    std::string result;
+    for (wchar_t c : text)
+        result += (c < 128) ? static_cast<char>(c) : '?';
+    return result;
+}
+
+// Runs every registered test, or only those whose name contains argv[1].
+int main(int argc, char* argv[])
+{
+    const char* filter = (argc > 1) ? argv[1] : nullptr;
+    int passed = 0;
+    int failed = 0;
+    for (const TestEntry& test : TestRegistry()) {
+        std::string name = Demangle(test.ClassName) + "::" + test.MethodName;
+        if (filter && strstr(name.c_str(), filter) == nullptr)
+            continue;
+        try {
+            test.Run();
+            printf("[ PASS ] %s\n", name.c_str());
+            ++passed;
+        }
+        catch (const AssertFailedException& e) {
+            printf("[ FAIL ] %s: %s\n", name.c_str(), Narrow(e.Message).c_str());
+            ++failed;
+        }
+        catch (const std::exception& e) {
+            printf("[ FAIL ] %s: unhandled exception: %s\n", name.c_str(), e.what());
+            ++failed;
+        }
+    }
+    printf("%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}